@@ -0,0 +1,363 @@
+/*******************************************************************************
+ * bench_containers.c - Microbenchmarks for the container types.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file bench_containers.c
+ *
+ * @brief Times the basic operations of each list type at a range of sizes.
+ *
+ * Every container is measured on push, random indexed access, random
+ * removal, clear and a full iteration, at sizes from 10 to 10^6. Each
+ * measurement prints one line of key=value pairs with the time per
+ * operation and the number of heap allocations made while timing, so that
+ * runs can be diffed against a saved baseline.
+ *
+ * Heap allocations are counted by wrapping malloc() and friends at link
+ * time (-Wl,--wrap), which catches every allocation made by the container
+ * code itself but not those made inside libc.
+ *
+ * Some combinations are left out:
+ *  - Indexed operations on the linked lists cost O(n) each, so only
+ *    @ref MAX_RANDOM_OPS of them are timed per size, and a full iteration
+ *    of @ref linkedlist, which can only be done by index, is skipped past
+ *    @ref MAX_QUADRATIC_SIZE.
+ *  - @ref songlist has no indexed access or removal, so its "at" walks
+ *    from the head and its removal isn't measured.
+ *  - @ref songlist owns libmpdclient song objects, so it stops at
+ *    @ref MAX_SONGLIST_SIZE to keep memory use reasonable.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "pantomime/linkedlist.h"
+#include "pantomime/mpd/song.h"
+#include "pantomime/mpd/songlist.h"
+#include "pantomime/vector.h"
+
+#define MIN_SIZE 10
+#define MAX_SIZE 1000000
+
+/**
+ * @brief Operations are repeated until at least this many elements have been processed.
+ */
+#define MIN_WORK 1000000
+
+/**
+ * @brief The number of random accesses or removals timed per size.
+ */
+#define MAX_RANDOM_OPS 1000
+
+#define MAX_QUADRATIC_SIZE 10000
+#define MAX_SONGLIST_SIZE 100000
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static unsigned long allocations;
+
+/**
+ * @brief Values read in timed loops are added here so the compiler can't drop the reads.
+ */
+static volatile unsigned long sink;
+
+void *__wrap_malloc(size_t size)
+{
+    ++allocations;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    ++allocations;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    ++allocations;
+    return __real_realloc(ptr, size);
+}
+
+/**
+ * @brief The running totals of one measurement.
+ */
+struct measurement {
+    double ns;             /** Time spent in the timed sections. */
+    unsigned long ops;     /** Operations performed in the timed sections. */
+    unsigned long allocs;  /** Allocations made in the timed sections. */
+    double start;          /** When the current timed section began. */
+    unsigned long allocs_start;
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void begin(struct measurement *m)
+{
+    m->allocs_start = allocations;
+    m->start = now_ns();
+}
+
+static void end(struct measurement *m, unsigned long ops)
+{
+    m->ns += now_ns() - m->start;
+    m->allocs += allocations - m->allocs_start;
+    m->ops += ops;
+}
+
+static void report(const char *container, const char *op, unsigned size,
+                   const struct measurement *m)
+{
+    printf("bench=containers container=%s op=%s n=%u ops=%lu ns_per_op=%.2f allocs=%lu "
+           "allocs_per_op=%.4f\n",
+           container, op, size, m->ops, m->ops ? m->ns / m->ops : 0.0, m->allocs,
+           m->ops ? (double)m->allocs / m->ops : 0.0);
+}
+
+/**
+ * @brief A small deterministic random number generator (xorshift32).
+ */
+static unsigned next_random(unsigned *state)
+{
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+/**
+ * @brief Gets how many times to repeat a pass over @p size elements.
+ */
+static unsigned repetitions(unsigned size)
+{
+    return size >= MIN_WORK ? 1 : MIN_WORK / size;
+}
+
+static struct song make_song(unsigned i)
+{
+    struct song song = {i, 180, i, i, i};
+    return song;
+}
+
+static void bench_vector(unsigned size)
+{
+    struct measurement push = {0}, at = {0}, removal = {0}, clear = {0}, iterate = {0};
+    unsigned reps = repetitions(size);
+    unsigned seed = 2463534242U;
+    unsigned long sum = 0;
+
+    for (unsigned r = 0; r < reps; ++r) {
+        struct vector *vec = vector_new(sizeof(struct song));
+
+        begin(&push);
+        for (unsigned i = 0; i < size; ++i) {
+            struct song song = make_song(i);
+            vector_push(vec, &song);
+        }
+        end(&push, size);
+
+        begin(&iterate);
+        for (unsigned i = 0; i < size; ++i) {
+            sum += ((struct song *)vector_at(vec, i))->id;
+        }
+        end(&iterate, size);
+
+        if (r == 0) {
+            unsigned ops = size < MAX_RANDOM_OPS ? size : MAX_RANDOM_OPS;
+
+            begin(&at);
+            for (unsigned i = 0; i < ops; ++i) {
+                sum += ((struct song *)vector_at(vec, next_random(&seed) % size))->id;
+            }
+            end(&at, ops);
+
+            begin(&removal);
+            for (unsigned i = 0; i < ops; ++i) {
+                unsigned index = next_random(&seed) % vector_get_length(vec);
+                vector_remove_range(vec, index, index + 1, NULL);
+            }
+            end(&removal, ops);
+        }
+
+        unsigned length = vector_get_length(vec);
+        begin(&clear);
+        vector_clear(vec, NULL);
+        end(&clear, length);
+
+        vector_free(vec, NULL);
+    }
+
+    report("vector", "push", size, &push);
+    report("vector", "at", size, &at);
+    report("vector", "remove", size, &removal);
+    report("vector", "clear", size, &clear);
+    report("vector", "iterate", size, &iterate);
+
+    sink += sum;
+}
+
+static void bench_linkedlist(unsigned size)
+{
+    struct measurement push = {0}, at = {0}, removal = {0}, clear = {0}, iterate = {0};
+    unsigned reps = repetitions(size);
+    unsigned seed = 2463534242U;
+    unsigned long sum = 0;
+
+    for (unsigned r = 0; r < reps; ++r) {
+        struct linkedlist *list = linkedlist_new(sizeof(struct song));
+
+        begin(&push);
+        for (unsigned i = 0; i < size; ++i) {
+            struct song song = make_song(i);
+            linkedlist_push(list, &song);
+        }
+        end(&push, size);
+
+        if (r == 0) {
+            unsigned ops = size < MAX_RANDOM_OPS ? size : MAX_RANDOM_OPS;
+
+            if (size <= MAX_QUADRATIC_SIZE) {
+                begin(&iterate);
+                for (unsigned i = 0; i < size; ++i) {
+                    sum += ((struct song *)linkedlist_at(list, i))->id;
+                }
+                end(&iterate, size);
+            }
+
+            begin(&at);
+            for (unsigned i = 0; i < ops; ++i) {
+                sum += ((struct song *)linkedlist_at(list, next_random(&seed) % size))->id;
+            }
+            end(&at, ops);
+
+            begin(&removal);
+            for (unsigned i = 0; i < ops; ++i) {
+                linkedlist_remove(list, next_random(&seed) % linkedlist_get_length(list), free);
+            }
+            end(&removal, ops);
+        }
+
+        unsigned length = linkedlist_get_length(list);
+        begin(&clear);
+        linkedlist_clear(list, free);
+        end(&clear, length);
+
+        linkedlist_free(list, free);
+    }
+
+    report("linkedlist", "push", size, &push);
+    report("linkedlist", "at", size, &at);
+    report("linkedlist", "remove", size, &removal);
+    report("linkedlist", "clear", size, &clear);
+    if (size <= MAX_QUADRATIC_SIZE) {
+        report("linkedlist", "iterate", size, &iterate);
+    }
+
+    sink += sum;
+}
+
+static void bench_songlist(unsigned size)
+{
+    struct measurement push = {0}, at = {0}, clear = {0}, iterate = {0};
+    unsigned reps = repetitions(size);
+    unsigned seed = 2463534242U;
+    unsigned long sum = 0;
+
+    struct mpd_song **songs = malloc(sizeof(*songs) * size);
+    struct mpd_pair pair = {"file", "song.flac"};
+
+    for (unsigned r = 0; r < reps; ++r) {
+        /* The list takes ownership of its songs, so new ones are made for every pass. */
+        for (unsigned i = 0; i < size; ++i) {
+            songs[i] = mpd_song_begin(&pair);
+        }
+
+        struct songlist *list = songlist_new();
+
+        begin(&push);
+        for (unsigned i = 0; i < size; ++i) {
+            songlist_append(list, songs[i]);
+        }
+        end(&push, size);
+
+        begin(&iterate);
+        for (struct songlist_node *node = list->head; node; node = node->next) {
+            sum += (uintptr_t)node->song;
+        }
+        end(&iterate, size);
+
+        if (r == 0) {
+            unsigned ops = size < MAX_RANDOM_OPS ? size : MAX_RANDOM_OPS;
+
+            begin(&at);
+            for (unsigned i = 0; i < ops; ++i) {
+                unsigned index = next_random(&seed) % size;
+                struct songlist_node *node = list->head;
+                while (index--) {
+                    node = node->next;
+                }
+                sum += (uintptr_t)node->song;
+            }
+            end(&at, ops);
+        }
+
+        begin(&clear);
+        songlist_clear(list);
+        end(&clear, size);
+
+        songlist_free(list);
+    }
+
+    free(songs);
+
+    report("songlist", "push", size, &push);
+    report("songlist", "at", size, &at);
+    report("songlist", "clear", size, &clear);
+    report("songlist", "iterate", size, &iterate);
+
+    sink += sum;
+}
+
+int main(void)
+{
+    for (unsigned size = MIN_SIZE; size <= MAX_SIZE; size *= 10) {
+        bench_vector(size);
+        bench_linkedlist(size);
+        if (size <= MAX_SONGLIST_SIZE) {
+            bench_songlist(size);
+        }
+        fflush(stdout);
+    }
+
+    return EXIT_SUCCESS;
+}
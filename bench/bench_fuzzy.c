@@ -0,0 +1,287 @@
+/*******************************************************************************
+ * bench_fuzzy.c - Microbenchmarks for fuzzy matching and top-k ranking.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file bench_fuzzy.c
+ *
+ * @brief Times fuzzy searches over @ref NUM_CANDIDATES synthetic songs.
+ *
+ * Each candidate is an "artist - album - title" made with fuzzy_join(), as
+ * the queue and library screens make them. For each pattern, three steps
+ * are timed separately: narrowing the candidates down with fuzzy_match(),
+ * on one thread and then on a thread pool, scoring the matches and keeping
+ * the best @ref TOP_K in a heap, and, for comparison, scoring the matches
+ * and sorting all of them. Every measurement prints one line of key=value
+ * pairs, and the run fails if the heap and the sort disagree on the best
+ * matches, or the pool finds different matches than one thread.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pantomime/fuzzy.h"
+#include "pantomime/pool.h"
+#include "pantomime/strmatch.h"
+#include "pantomime/vector.h"
+
+#define NUM_CANDIDATES 1000000
+
+/**
+ * @brief The number of best matches kept, about one screenful.
+ */
+#define TOP_K 50
+
+static const char *const artists[] = {
+    "The Beatles", "Beyoncé",     "Motörhead",   "Sigur Rós",    "Herbie Hancock",
+    "Miles Davis", "Björk",       "Daft Punk",   "Led Zeppelin", "Wolfgang Amadeus Mozart",
+    "Radiohead",   "Aphex Twin",  "Nina Simone", "Boards of Canada", "Fleetwood Mac",
+    "Kraftwerk",
+};
+
+static const char *const words[] = {
+    "Love",   "Night",      "Symphony", "No.",  "Live",     "Remastered", "Blue",  "Dream",
+    "Part",   "II",         "Original", "Mix",  "Radio",    "Edit",       "Major", "minor",
+    "Allegro", "Concerto",  "Wembley",  "Dub",  "Sessions", "Demo",       "Help!", "Road",
+};
+
+static const char *const patterns[] = {"b", "beatles", "mtrhd", "lve wmbly", "allegro concerto",
+                                       "zzq"};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief A small deterministic random number generator (xorshift32).
+ */
+static unsigned next_random(unsigned *state)
+{
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+/**
+ * @brief Writes a few random words and a number, such as "Blue Dream 42".
+ */
+static void make_words(char *buffer, size_t size, unsigned *seed, unsigned number)
+{
+    unsigned num_words = sizeof(words) / sizeof(*words);
+    unsigned count = 1 + next_random(seed) % 4;
+    size_t used = 0;
+
+    for (unsigned w = 0; w < count; ++w) {
+        used += snprintf(buffer + used, size - used, "%s ", words[next_random(seed) % num_words]);
+    }
+    snprintf(buffer + used, size - used, "%u", number);
+}
+
+/**
+ * @brief Builds the candidates.
+ *
+ * @param candidates Filled with a pointer to each candidate.
+ *
+ * @return The buffer holding the candidates, or NULL if memory ran out.
+ */
+static char *make_candidates(const char **candidates)
+{
+    char *buffer = malloc((size_t)NUM_CANDIDATES * 128);
+    if (!buffer) {
+        return NULL;
+    }
+
+    unsigned seed = 2463534242U;
+    unsigned num_artists = sizeof(artists) / sizeof(*artists);
+    size_t used = 0;
+    char album[48];
+    char title[48];
+    char text[FUZZY_TEXT_SIZE];
+
+    for (unsigned i = 0; i < NUM_CANDIDATES; ++i) {
+        /* Ten tracks to an album, as they would be in a real queue. */
+        make_words(album, sizeof(album), &seed, i / 10);
+        make_words(title, sizeof(title), &seed, i);
+
+        const char *fields[] = {artists[(i / 10) % num_artists], album, title};
+        size_t length = fuzzy_join(text, fields, sizeof(fields) / sizeof(*fields));
+
+        candidates[i] = buffer + used;
+        memcpy(buffer + used, text, length + 1);  // NOLINT
+        used += length + 1;
+    }
+
+    return buffer;
+}
+
+/**
+ * @brief Orders results best first, with ties broken the same way as struct fuzzy_top.
+ */
+static int compare_results(const void *a, const void *b)
+{
+    const struct fuzzy_result *x = a;
+    const struct fuzzy_result *y = b;
+
+    if (x->score != y->score) {
+        return x->score > y->score ? -1 : 1;
+    }
+    return x->id < y->id ? -1 : x->id > y->id;
+}
+
+/**
+ * @brief A pattern being matched against the candidates on a thread pool.
+ */
+struct bench_scan {
+    const char **candidates;
+    const char *pattern;
+    size_t length;
+};
+
+/**
+ * @brief Checks whether one candidate matches. Called from the thread pool.
+ */
+static int bench_scan_candidate(void *data, unsigned index)
+{
+    const struct bench_scan *scan = data;
+    return fuzzy_match(scan->candidates[index], scan->pattern, scan->length);
+}
+
+/**
+ * @brief Times one pattern.
+ *
+ * @param candidates The candidates.
+ * @param matches Room for the index of every candidate.
+ * @param sorted Room for a result for every candidate.
+ * @param top The ranking to use.
+ * @param pool The threads to filter on as well.
+ * @param pooled The vector to filter into on @p pool.
+ * @param pattern The folded pattern.
+ *
+ * @return 0 if the heap and the sort agree on the best matches, and the pool
+ * found the same matches as one thread, or -1 otherwise.
+ */
+static int bench_pattern(const char **candidates, unsigned *matches, struct fuzzy_result *sorted,
+                         struct fuzzy_top *top, struct pool *pool, struct vector *pooled,
+                         const char *pattern)
+{
+    size_t length = strlen(pattern);
+    unsigned num_matches = 0;
+
+    double start = now_ns();
+    for (unsigned i = 0; i < NUM_CANDIDATES; ++i) {
+        if (fuzzy_match(candidates[i], pattern, length)) {
+            matches[num_matches++] = i;
+        }
+    }
+    double filter_ns = now_ns() - start;
+
+    struct bench_scan scan = {candidates, pattern, length};
+    vector_clear(pooled, NULL);
+    start = now_ns();
+    int pool_status = pool_filter(pool, 0, NUM_CANDIDATES, bench_scan_candidate, &scan, pooled);
+    double pool_ns = now_ns() - start;
+
+    start = now_ns();
+    fuzzy_top_reset(top, TOP_K);
+    for (unsigned i = 0; i < num_matches; ++i) {
+        fuzzy_top_add(top, fuzzy_score(candidates[matches[i]], pattern, length), matches[i]);
+    }
+    fuzzy_top_finish(top);
+    double top_ns = now_ns() - start;
+
+    start = now_ns();
+    for (unsigned i = 0; i < num_matches; ++i) {
+        sorted[i].score = fuzzy_score(candidates[matches[i]], pattern, length);
+        sorted[i].id = matches[i];
+    }
+    qsort(sorted, num_matches, sizeof(*sorted), compare_results);
+    double sort_ns = now_ns() - start;
+
+    printf("bench=fuzzy pattern=\"%s\" candidates=%u matches=%u k=%u filter_ms=%.2f "
+           "filter_threads=%u filter_threads_ms=%.2f top_k_ms=%.2f sort_ms=%.2f best=\"%s\"\n",
+           pattern, NUM_CANDIDATES, num_matches, TOP_K, filter_ns / 1e6, pool_get_threads(pool),
+           pool_ns / 1e6, top_ns / 1e6, sort_ns / 1e6,
+           top->length ? candidates[top->results[0].id] : "");
+
+    if (pool_status != 0 || vector_get_length(pooled) != num_matches ||
+        (num_matches &&
+         memcmp(vector_at(pooled, 0), matches, sizeof(*matches) * num_matches) != 0)) {
+        fprintf(stderr, "bench_fuzzy: the pool and one thread disagree on \"%s\"\n", pattern);
+        return -1;
+    }
+
+    for (unsigned i = 0; i < top->length; ++i) {
+        if (top->results[i].id != sorted[i].id || top->results[i].score != sorted[i].score) {
+            fprintf(stderr, "bench_fuzzy: heap and sort disagree at rank %u for \"%s\"\n", i,
+                    pattern);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    const char **candidates = malloc(sizeof(*candidates) * NUM_CANDIDATES);
+    unsigned *matches = malloc(sizeof(*matches) * NUM_CANDIDATES);
+    struct fuzzy_result *sorted = malloc(sizeof(*sorted) * NUM_CANDIDATES);
+    struct fuzzy_top *top = fuzzy_top_new();
+    struct pool *pool = pool_new(0);
+    struct vector *pooled = vector_new(sizeof(unsigned));
+    char *buffer = candidates ? make_candidates(candidates) : NULL;
+    int status = EXIT_SUCCESS;
+
+    if (!buffer || !matches || !sorted || !top || !pool || !pooled) {
+        fprintf(stderr, "bench_fuzzy: out of memory\n");
+        status = EXIT_FAILURE;
+    }
+
+    for (unsigned n = 0; status == EXIT_SUCCESS && n < sizeof(patterns) / sizeof(*patterns); ++n) {
+        char pattern[64];
+        snprintf(pattern, sizeof(pattern), "%s", patterns[n]);
+        strmatch_fold(pattern, strlen(pattern));
+
+        if (bench_pattern(candidates, matches, sorted, top, pool, pooled, pattern) != 0) {
+            status = EXIT_FAILURE;
+        }
+        fflush(stdout);
+    }
+
+    fuzzy_top_free(top);
+    pool_free(pool);
+    vector_free(pooled, NULL);
+    free(buffer);
+    free(sorted);
+    free(matches);
+    free(candidates);
+
+    return status;
+}
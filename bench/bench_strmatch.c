@@ -0,0 +1,330 @@
+/*******************************************************************************
+ * bench_strmatch.c - Microbenchmarks for tag substring matching.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file bench_strmatch.c
+ *
+ * @brief Times strmatch_contains() against strcasestr() over synthetic tags.
+ *
+ * The corpus is @ref NUM_STRINGS tag-like strings of mixed case, a few of
+ * them with multibyte UTF-8 characters, packed back to back in one buffer
+ * the way the intern table stores them. Each needle is searched for in
+ * every string with each search this CPU can run and with strcasestr().
+ * Every measurement prints one line of key=value pairs, and the run fails
+ * if any two searches disagree on the number of matches.
+ *
+ * The same corpus is then loaded into a library as artist names, and each
+ * needle is searched for with library_index_search(), first with a trigram
+ * index and then without one, on one thread and then on a thread pool.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pantomime/mpd/library.h"
+#include "pantomime/mpd/library_index.h"
+#include "pantomime/pool.h"
+#include "pantomime/strmatch.h"
+#include "pantomime/vector.h"
+
+#define NUM_STRINGS 200000
+
+/**
+ * @brief Passes over the corpus are repeated until at least this many strings have been searched.
+ */
+#define MIN_WORK 2000000
+
+static const char *const words[] = {
+    "The",   "love",     "NIGHT",    "Symphony", "No.",       "live",  "Remastered", "Beyoncé",
+    "Rós",   "Motörhead", "of",      "in",       "Sessions",  "Blue",  "dream",      "Édition",
+    "part",  "II",       "Original", "Mix",      "feat.",     "Radio", "Edit",       "Concerto",
+    "Major", "minor",    "Allegro",  "Live at",  "Wembley",   "Dub",   "Instrumental", "Demo",
+};
+
+static const char *const needles[] = {"e", "dr", "live", "motörhead", "remastered", "zzz",
+                                      "allegro concerto"};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * @brief A small deterministic random number generator (xorshift32).
+ */
+static unsigned next_random(unsigned *state)
+{
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+/**
+ * @brief Builds the corpus.
+ *
+ * @param strings Filled with a pointer to each string.
+ *
+ * @return The buffer holding the strings, or NULL if memory ran out.
+ */
+static char *make_corpus(const char **strings)
+{
+    /* No string is longer than 8 of the longest word, a space and a number. */
+    char *buffer = malloc((size_t)NUM_STRINGS * 128);
+    if (!buffer) {
+        return NULL;
+    }
+
+    unsigned seed = 2463534242U;
+    size_t used = 0;
+    unsigned num_words = sizeof(words) / sizeof(*words);
+
+    for (unsigned i = 0; i < NUM_STRINGS; ++i) {
+        strings[i] = buffer + used;
+
+        unsigned count = 1 + next_random(&seed) % 8;
+        for (unsigned w = 0; w < count; ++w) {
+            used += sprintf(buffer + used, "%s ", words[next_random(&seed) % num_words]);
+        }
+        used += sprintf(buffer + used, "%u", i) + 1;
+    }
+
+    return buffer;
+}
+
+/**
+ * @brief Prints one measurement. @p matches counts a single pass over the corpus.
+ */
+static void report(const char *impl, const char *needle, unsigned long searches,
+                   unsigned long matches, double ns)
+{
+    printf("bench=strmatch impl=%s needle=\"%s\" searches=%lu matches=%lu ns_per_search=%.2f\n",
+           impl, needle, searches, matches, ns / searches);
+}
+
+/**
+ * @brief Times one needle with strmatch_contains() or strcasestr().
+ *
+ * @param strings The corpus.
+ * @param needle The folded needle.
+ * @param use_libc Whether to time strcasestr() rather than strmatch_contains().
+ *
+ * @return The number of strings in the corpus that contain @p needle.
+ */
+static unsigned long bench_needle(const char **strings, const char *needle, int use_libc)
+{
+    size_t length = strlen(needle);
+    unsigned reps = MIN_WORK / NUM_STRINGS;
+    unsigned long matches = 0;
+
+    double start = now_ns();
+    for (unsigned r = 0; r < reps; ++r) {
+        for (unsigned i = 0; i < NUM_STRINGS; ++i) {
+            if (use_libc) {
+                matches += strcasestr(strings[i], needle) != NULL;
+            }
+            else {
+                matches += strmatch_contains(strings[i], needle, length);
+            }
+        }
+    }
+    double ns = now_ns() - start;
+
+    matches /= reps;
+    report(use_libc ? "strcasestr" : strmatch_get_impl_name(strmatch_get_impl()), needle,
+           (unsigned long)reps * NUM_STRINGS, matches, ns);
+
+    return matches;
+}
+
+/**
+ * @brief Times one library search.
+ *
+ * @return The number of matches, or -1 if memory ran out.
+ */
+static long bench_library_search(struct library *library, const char *needle,
+                                 struct vector *matches, struct pool *pool, double *ns)
+{
+    double start = now_ns();
+    int status = library_index_search(library, needle, strlen(needle), matches, pool);
+    *ns = now_ns() - start;
+
+    return status == 0 ? (long)vector_get_length(matches) : -1;
+}
+
+/**
+ * @brief Times building an index over a library.
+ *
+ * @return The index, or NULL if memory ran out.
+ */
+static struct library_index *bench_build(struct library *library, struct pool *pool)
+{
+    double start = now_ns();
+    struct library_index_source *source = library_index_snapshot(library);
+    struct library_index *index = source ? library_index_build(source, (size_t)-1, pool) : NULL;
+    library_index_source_free(source);
+    double ns = now_ns() - start;
+
+    if (index) {
+        printf("bench=library_index op=build nodes=%u threads=%u bytes=%zu ms=%.2f\n",
+               index->num_nodes, pool_get_threads(pool), index->size, ns / 1e6);
+    }
+
+    return index;
+}
+
+/**
+ * @brief Checks whether two indices have the same posting lists.
+ */
+static int same_index(const struct library_index *a, const struct library_index *b)
+{
+    return a->size == b->size && memcmp(a->offsets, b->offsets, a->size) == 0;
+}
+
+/**
+ * @brief Checks whether two searches found the same matches in the same order.
+ */
+static int same_matches(struct vector *a, struct vector *b)
+{
+    unsigned length = vector_get_length(a);
+    return length == vector_get_length(b) &&
+           (!length || memcmp(vector_at(a, 0), vector_at(b, 0), sizeof(unsigned) * length) == 0);
+}
+
+/**
+ * @brief Times building an index over the corpus, and searching the library with and without it.
+ *
+ * Both are done on one thread and on a pool of one thread per CPU, and the
+ * run fails unless both give the same index and the same matches.
+ *
+ * @param strings The corpus.
+ * @param expected The number of strings that contain each needle.
+ *
+ * @return 0 if every search found the expected number of matches, or -1 otherwise.
+ */
+static int bench_index(const char **strings, const unsigned long *expected)
+{
+    struct library *library = library_new();
+    struct vector *names = vector_new(sizeof(char *));
+    struct vector *matches = vector_new(sizeof(unsigned));
+    struct vector *pooled = vector_new(sizeof(unsigned));
+    struct pool *pool = pool_new(0);
+    struct library_index *serial = NULL;
+    int status = -1;
+
+    for (unsigned i = 0; names && i < NUM_STRINGS; ++i) {
+        vector_push(names, &strings[i]);
+    }
+
+    if (library && names && matches && pooled && pool && vector_get_length(names) == NUM_STRINGS &&
+        library_set_artists(library, names) == 0) {
+        serial = bench_build(library, NULL);
+        library->index = bench_build(library, pool);
+
+        status = serial && library->index ? 0 : -1;
+        if (status == 0 && !same_index(serial, library->index)) {
+            fprintf(stderr, "bench_strmatch: indices built on 1 and %u threads differ\n",
+                    pool_get_threads(pool));
+            status = -1;
+        }
+    }
+
+    for (unsigned n = 0; status == 0 && n < sizeof(needles) / sizeof(*needles); ++n) {
+        double indexed_ns;
+        double scan_ns;
+        double pooled_ns;
+        long indexed = bench_library_search(library, needles[n], matches, NULL, &indexed_ns);
+
+        struct library_index *index = library->index;
+        library->index = NULL;
+        long scanned = bench_library_search(library, needles[n], matches, NULL, &scan_ns);
+        long pooled_scanned = bench_library_search(library, needles[n], pooled, pool, &pooled_ns);
+        library->index = index;
+
+        printf("bench=library_index op=search needle=\"%s\" matches=%ld indexed_ms=%.3f "
+               "scan_ms=%.3f scan_threads=%u scan_threads_ms=%.3f\n",
+               needles[n], indexed, indexed_ns / 1e6, scan_ns / 1e6, pool_get_threads(pool),
+               pooled_ns / 1e6);
+        if (indexed != (long)expected[n] || scanned != (long)expected[n] ||
+            pooled_scanned != (long)expected[n] || !same_matches(matches, pooled)) {
+            fprintf(stderr, "bench_strmatch: library search disagrees with strcasestr on \"%s\"\n",
+                    needles[n]);
+            status = -1;
+        }
+    }
+
+    /* The library interned its own copies of the names. */
+    library_index_free(serial);
+    pool_free(pool);
+    vector_free(names, NULL);
+    vector_free(matches, NULL);
+    vector_free(pooled, NULL);
+    library_free(library);
+
+    return status;
+}
+
+int main(void)
+{
+    const char **strings = malloc(sizeof(*strings) * NUM_STRINGS);
+    char *buffer = strings ? make_corpus(strings) : NULL;
+    if (!buffer) {
+        fprintf(stderr, "bench_strmatch: out of memory\n");
+        free(strings);
+        return EXIT_FAILURE;
+    }
+
+    enum strmatch_impl best = strmatch_get_impl();
+    int status = EXIT_SUCCESS;
+    unsigned long expected[sizeof(needles) / sizeof(*needles)];
+
+    for (unsigned n = 0; n < sizeof(needles) / sizeof(*needles); ++n) {
+        expected[n] = bench_needle(strings, needles[n], 1);
+
+        for (int impl = STRMATCH_SCALAR; impl <= (int)best; ++impl) {
+            strmatch_set_impl(impl);
+            if (bench_needle(strings, needles[n], 0) != expected[n]) {
+                fprintf(stderr, "bench_strmatch: %s disagrees with strcasestr on \"%s\"\n",
+                        strmatch_get_impl_name(impl), needles[n]);
+                status = EXIT_FAILURE;
+            }
+        }
+        fflush(stdout);
+    }
+
+    strmatch_set_impl(best);
+    if (bench_index(strings, expected) != 0) {
+        status = EXIT_FAILURE;
+    }
+
+    free(buffer);
+    free(strings);
+
+    return status;
+}
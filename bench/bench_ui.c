@@ -0,0 +1,510 @@
+/*******************************************************************************
+ * bench_ui.c - Headless benchmark of queue loading and drawing.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file bench_ui.c
+ *
+ * @brief Measures how quickly the queue screen comes up and how long frames take.
+ *
+ * A @ref fake_mpd server is started with a synthetic queue, and the client
+ * connects to it as it would to a real server. The queue screen draws into
+ * an off-screen curses terminal whose output goes to /dev/null, so the
+ * measurements include curses' own work but not the terminal's.
+ *
+ * These are reported, as a single line of key=value pairs:
+ *  - time to first frame: from mpdclient_new() until a fully populated
+ *    first screen has been written out. With --warm, a previous run's
+ *    snapshot is restored first, as pantomime does on startup.
+ *  - frame latency percentiles over a scripted scroll through the queue.
+ *  - round trips for a volume key held down for @ref HOLD_MS, with the
+ *    repeats sent together once they pause for @ref CONTROL_DELAY or the
+ *    first has waited for @ref CONTROL_MAX_WAIT, as pantomime does, and for
+ *    comparison with each repeat sent on its own. Holding the key must cost
+ *    no more than @ref HOLD_MAX_COMMANDS commands, or the run fails.
+ *  - heap allocations made on the drawing thread during the scripted scroll,
+ *    and during @ref STEADY_FRAMES frames over rows that are already loaded.
+ *    Steady-state frames must not allocate at all, or the run fails.
+ *    Allocations are counted by wrapping malloc() and friends at link time
+ *    (-Wl,--wrap), per thread, so the worker and the fake server don't count.
+ *  - peak resident set size of the whole process, fake server included.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <argp.h>
+#include <curses.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fake_mpd.h"
+#include "pantomime/mpd/client.h"
+#include "pantomime/snapshot.h"
+#include "pantomime/ui/queue_screen.h"
+
+/**
+ * @brief Every this many frames, the scripted scroll moves a whole page instead of one row.
+ */
+#define PAGE_EVERY 50
+
+/**
+ * @brief How long to wait for the client before giving up, in milliseconds.
+ */
+#define RESULT_TIMEOUT 60000
+
+/**
+ * @brief How long the volume key is held down, in simulated milliseconds.
+ */
+#define HOLD_MS 2000
+
+/**
+ * @brief The time between a held-down key's repeats, in milliseconds, at a typical 30 per second.
+ */
+#define REPEAT_MS 33
+
+/**
+ * @brief How long volume changes must pause before being sent, pantomime's default.
+ */
+#define CONTROL_DELAY 150
+
+/**
+ * @brief The longest a volume change is held back, pantomime's default.
+ */
+#define CONTROL_MAX_WAIT 1000
+
+/**
+ * @brief The most commands a held-down volume key may cost: a handful, however long the hold.
+ */
+#define HOLD_MAX_COMMANDS 10
+
+/**
+ * @brief The number of frames drawn over already-loaded rows, none of which may allocate.
+ */
+#define STEADY_FRAMES 100
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+/**
+ * @brief Heap allocations made by the calling thread.
+ */
+static _Thread_local unsigned long allocations;
+
+void *__wrap_malloc(size_t size)
+{
+    ++allocations;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+    ++allocations;
+    return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    ++allocations;
+    return __real_realloc(ptr, size);
+}
+
+/**
+ * @brief The benchmark's settings.
+ */
+struct bench_options {
+    unsigned songs;      /** The number of songs in the queue. */
+    unsigned latency_ms; /** Simulated server latency per command. */
+    unsigned frames;     /** The number of frames to time. */
+    unsigned lazy_mb;    /** The lazy queue budget in megabytes, or 0 to load eagerly. */
+    int rows;            /** The height of the off-screen terminal. */
+    int cols;            /** The width of the off-screen terminal. */
+    int warm;            /** Whether to start from a snapshot of the queue. */
+};
+
+static struct argp_option options[] = {
+    {"songs", 's', "N", 0, "Number of songs in the synthetic queue (default 10000)."},
+    {"latency", 'l', "MS", 0, "Simulated server latency per command (default 0)."},
+    {"frames", 'f', "N", 0, "Number of frames to time (default 1000)."},
+    {"lazy", 'z', "MB", 0, "Load the queue lazily with the given budget."},
+    {"rows", 'r', "N", 0, "Height of the off-screen terminal (default 50)."},
+    {"cols", 'c', "N", 0, "Width of the off-screen terminal (default 160)."},
+    {"warm", 'w', 0, 0, "Start from a snapshot of the queue saved by an earlier client."},
+    {0}};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state)
+{
+    struct bench_options *opts = state->input;
+    switch (key) {
+        case 's':
+            opts->songs = strtoul(arg, NULL, 10);
+            break;
+        case 'l':
+            opts->latency_ms = strtoul(arg, NULL, 10);
+            break;
+        case 'f':
+            opts->frames = strtoul(arg, NULL, 10);
+            break;
+        case 'z':
+            opts->lazy_mb = strtoul(arg, NULL, 10);
+            break;
+        case 'r':
+            opts->rows = atoi(arg);
+            break;
+        case 'c':
+            opts->cols = atoi(arg);
+            break;
+        case 'w':
+            opts->warm = 1;
+            break;
+        default:
+            return ARGP_ERR_UNKNOWN;
+    }
+    return 0;
+}
+
+/**
+ * @brief Gets the current monotonic time in microseconds.
+ */
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Gets a percentile of a sorted array.
+ */
+static double percentile(const double *sorted, unsigned count, double p)
+{
+    if (!count) {
+        return 0;
+    }
+
+    unsigned index = (unsigned)(p / 100 * (count - 1) + 0.5);
+    return sorted[index];
+}
+
+/**
+ * @brief Waits for the worker thread to finish something and applies it.
+ *
+ * @return The number of results applied, or 0 on timeout.
+ */
+static unsigned wait_for_results(struct mpdclient *mpd, int timeout)
+{
+    struct pollfd pfd = {mpdclient_get_fd(mpd), POLLIN, 0};
+
+    if (poll(&pfd, 1, timeout) <= 0) {
+        return 0;
+    }
+    return mpdclient_handle_results(mpd);
+}
+
+/**
+ * @brief Draws one frame of the queue screen and writes it out.
+ */
+static void draw_frame(struct queue_screen *screen, struct mpdclient *mpd)
+{
+    queue_screen_sync(screen, mpd);
+    queue_screen_draw(screen, mpd);
+    doupdate();
+}
+
+/**
+ * @brief Checks whether every visible row of the queue screen has a song to show.
+ */
+static int screen_is_complete(struct queue_screen *screen, struct mpdclient *mpd, unsigned songs)
+{
+    unsigned length = mpdclient_get_queue_length(mpd);
+    if (length != songs) {
+        return 0;
+    }
+
+    unsigned end = screen->offset + getmaxy(screen->win);
+    for (unsigned pos = screen->offset; pos < end && pos < length; ++pos) {
+        if (!mpdclient_get_queue_song(mpd, pos)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @brief Holds down a volume key, sending the changes as pantomime's main loop does.
+ *
+ * Time is simulated, so the hold takes as long as its round trips do.
+ *
+ * @param server The server, which counts the commands.
+ * @param mpd The client.
+ * @param delta The volume change of each repeat.
+ * @param delay How long changes must pause before being sent, or 0 to send each one at once.
+ * @param max_wait The longest the first unsent change is held back.
+ *
+ * @return The number of commands the server answered, or 0 if the volume ended up wrong.
+ */
+static unsigned long hold_volume_key(struct fake_mpd *server, struct mpdclient *mpd, int delta,
+                                     unsigned delay, unsigned max_wait)
+{
+    unsigned long before = fake_mpd_get_commands(server);
+    int expected = mpd->volume;
+    unsigned quiet = 0;
+    unsigned deadline = 0;
+    int waiting = 0;
+
+    for (unsigned t = 0; t < HOLD_MS; t += REPEAT_MS) {
+        if (waiting && (t >= quiet || t >= deadline)) {
+            mpdclient_send_controls(mpd);
+            waiting = 0;
+        }
+
+        mpdclient_change_volume(mpd, delta);
+        expected += delta;
+        expected = expected < 0 ? 0 : expected > 100 ? 100 : expected;
+
+        if (!delay) {
+            mpdclient_send_controls(mpd);
+            continue;
+        }
+        if (!waiting) {
+            deadline = t + max_wait;
+            waiting = 1;
+        }
+        quiet = t + delay;
+    }
+
+    /* The key is let go, so the changes pause and are sent. */
+    mpdclient_send_controls(mpd);
+
+    while (mpd->controls_pending && wait_for_results(mpd, RESULT_TIMEOUT)) {
+    }
+
+    return mpd->volume == expected ? fake_mpd_get_commands(server) - before : 0;
+}
+
+/**
+ * @brief Loads the whole queue with a separate client and saves a snapshot of it.
+ *
+ * @return 0 on success, or -1 on error.
+ */
+static int save_snapshot(struct fake_mpd *server, const struct bench_options *opts,
+                         const char *path)
+{
+    struct mpdclient *mpd = mpdclient_new(fake_mpd_get_path(server), 0, 0,
+                                          (size_t)opts->lazy_mb << 20, 0);
+    if (!mpd) {
+        return -1;
+    }
+    mpdclient_update_queue(mpd);
+
+    while (!mpd->queue_version && !mpdclient_has_error(mpd)) {
+        if (!wait_for_results(mpd, RESULT_TIMEOUT)) {
+            break;
+        }
+    }
+
+    struct snapshot_view view = {0, 0, 0};
+    int result = mpd->queue_version && !mpdclient_has_error(mpd) ?
+                     snapshot_save(mpd, path, &view) :
+                     -1;
+
+    mpdclient_free(mpd);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_options opts = {10000, 0, 1000, 0, 50, 160, 0};
+    struct argp argp = {options, parse_opt, "", "Headless benchmark of the queue screen."};
+    argp_parse(&argp, argc, argv, 0, 0, &opts);
+
+    struct fake_mpd_config config = {opts.songs, opts.latency_ms};
+    struct fake_mpd *server = fake_mpd_start(&config);
+    if (!server) {
+        fprintf(stderr, "Error starting the fake MPD server.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Draw into a terminal nobody looks at. */
+    FILE *out = fopen("/dev/null", "w");
+    FILE *in = fopen("/dev/null", "r");
+    const char *term = getenv("TERM");
+    SCREEN *curses = newterm(term && *term ? term : "xterm", out, in);
+    if (!curses) {
+        fprintf(stderr, "Error creating the off-screen terminal.\n");
+        fake_mpd_stop(server);
+        return EXIT_FAILURE;
+    }
+    resizeterm(opts.rows, opts.cols);
+
+    WINDOW *win = newwin(opts.rows, opts.cols, 0, 0);
+    struct queue_screen *screen = queue_screen_new(win);
+
+    double *frames = malloc(sizeof(*frames) * (opts.frames ? opts.frames : 1));
+    if (!frames || !screen) {
+        fprintf(stderr, "Out of memory.\n");
+        return EXIT_FAILURE;
+    }
+
+    char snapshot_path[64];
+    snprintf(snapshot_path, sizeof(snapshot_path), "/tmp/pantomime-bench-%d.snapshot",
+             (int)getpid());
+    if (opts.warm && save_snapshot(server, &opts, snapshot_path) != 0) {
+        fprintf(stderr, "Error saving a snapshot of the queue.\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Time to first frame. */
+    double start = now_us();
+    struct mpdclient *mpd = mpdclient_new(fake_mpd_get_path(server), 0, 0,
+                                          (size_t)opts.lazy_mb << 20, 0);
+    if (!mpd) {
+        fprintf(stderr, "Error connecting to the fake MPD server.\n");
+        return EXIT_FAILURE;
+    }
+    if (opts.warm) {
+        struct snapshot_view view;
+        snapshot_load(mpd, snapshot_path, &view);
+        unlink(snapshot_path);
+    }
+    mpdclient_update_queue(mpd);
+
+    draw_frame(screen, mpd);
+    while (!screen_is_complete(screen, mpd, opts.songs)) {
+        if (!wait_for_results(mpd, RESULT_TIMEOUT) || mpdclient_has_error(mpd)) {
+            fprintf(stderr, "Error loading the queue: %s\n",
+                    mpdclient_has_error(mpd) ? mpdclient_get_last_error_message(mpd) : "timeout");
+            return EXIT_FAILURE;
+        }
+        draw_frame(screen, mpd);
+    }
+    double first_frame = now_us() - start;
+
+    /* Scroll through the queue, one row at a time with an occasional page jump. */
+    int page = getmaxy(win);
+    unsigned long rows_drawn = 0;
+    unsigned long frame_allocs = allocations;
+    for (unsigned i = 0; i < opts.frames; ++i) {
+        int delta = (i % PAGE_EVERY == PAGE_EVERY - 1) ? page : 1;
+        queue_screen_move_cursor(screen, delta, mpdclient_get_queue_length(mpd));
+
+        double frame_start = now_us();
+        draw_frame(screen, mpd);
+        frames[i] = now_us() - frame_start;
+        rows_drawn += screen->rows_drawn;
+
+        /* Apply whatever the worker finished meanwhile, as the main loop would. */
+        wait_for_results(mpd, 0);
+    }
+    frame_allocs = allocations - frame_allocs;
+
+    /* Let the rows around the cursor finish loading, then step back and forth over them. */
+    draw_frame(screen, mpd);
+    while (mpd->fetch_pending && wait_for_results(mpd, RESULT_TIMEOUT)) {
+        draw_frame(screen, mpd);
+    }
+    unsigned long steady_allocs = allocations;
+    for (unsigned i = 0; i < STEADY_FRAMES; ++i) {
+        queue_screen_move_cursor(screen, i % 2 ? -1 : 1, mpdclient_get_queue_length(mpd));
+        draw_frame(screen, mpd);
+    }
+    steady_allocs = allocations - steady_allocs;
+
+    /* The same over fuzzy matches, once they have been found and ranked. */
+    queue_screen_filter_begin(screen, 1);
+    queue_screen_filter_append(screen, mpd, "t1");
+    screen->filter_input = 0;
+    draw_frame(screen, mpd);
+    unsigned long filtered_allocs = allocations;
+    for (unsigned i = 0; i < STEADY_FRAMES; ++i) {
+        queue_screen_move_cursor(screen, i % 2 ? -1 : 1, queue_screen_get_length(screen, mpd));
+        draw_frame(screen, mpd);
+    }
+    steady_allocs += allocations - filtered_allocs;
+    queue_screen_filter_clear(screen);
+    if (steady_allocs) {
+        fprintf(stderr, "Error: %lu allocations in %u steady-state frames.\n", steady_allocs,
+                STEADY_FRAMES);
+        return EXIT_FAILURE;
+    }
+
+    /* Round trip of a queue update that finds nothing new. */
+    double update_start = now_us();
+    mpdclient_update_queue(mpd);
+    wait_for_results(mpd, RESULT_TIMEOUT);
+    double update = now_us() - update_start;
+
+    /* The fake server starts at full volume, which the first hold reads. */
+    mpd->volume = 100;
+    unsigned hold_presses = (HOLD_MS + REPEAT_MS - 1) / REPEAT_MS;
+    unsigned long hold_commands = hold_volume_key(server, mpd, -1, CONTROL_DELAY,
+                                                  CONTROL_MAX_WAIT);
+    unsigned long hold_unbatched = hold_volume_key(server, mpd, 1, 0, 0);
+    if (!hold_commands || !hold_unbatched) {
+        fprintf(stderr, "Error holding the volume key: the volume ended up wrong.\n");
+        return EXIT_FAILURE;
+    }
+    if (hold_commands > HOLD_MAX_COMMANDS) {
+        fprintf(stderr, "Error holding the volume key: it cost %lu commands, more than %d.\n",
+                hold_commands, HOLD_MAX_COMMANDS);
+        return EXIT_FAILURE;
+    }
+
+    qsort(frames, opts.frames, sizeof(*frames), compare_doubles);
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    printf("bench=ui songs=%u mode=%s start=%s latency_ms=%u frames=%u "
+           "ttff_ms=%.3f frame_p50_us=%.1f frame_p90_us=%.1f frame_p99_us=%.1f "
+           "frame_max_us=%.1f rows_per_frame=%.2f update_ms=%.3f hold_presses=%u "
+           "hold_commands=%lu hold_commands_unbatched=%lu frame_allocs=%lu steady_allocs=%lu "
+           "commands=%lu peak_rss_kb=%ld\n",
+           opts.songs, opts.lazy_mb ? "lazy" : "eager", opts.warm ? "warm" : "cold",
+           opts.latency_ms, opts.frames,
+           first_frame / 1e3, percentile(frames, opts.frames, 50),
+           percentile(frames, opts.frames, 90), percentile(frames, opts.frames, 99),
+           percentile(frames, opts.frames, 100),
+           opts.frames ? (double)rows_drawn / opts.frames : 0.0, update / 1e3, hold_presses,
+           hold_commands, hold_unbatched, frame_allocs, steady_allocs,
+           fake_mpd_get_commands(server), usage.ru_maxrss);
+
+    mpdclient_free(mpd);
+    queue_screen_free(screen);
+    endwin();
+    delscreen(curses);
+    fclose(out);
+    fclose(in);
+    fake_mpd_stop(server);
+    free(frames);
+
+    return EXIT_SUCCESS;
+}
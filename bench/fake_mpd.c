@@ -0,0 +1,495 @@
+/*******************************************************************************
+ * fake_mpd.c - Scripted stand-in MPD server for benchmarks.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file fake_mpd.h
+ *
+ * @brief Speaks just enough of the MPD text protocol to benchmark the client.
+ *
+ * The server listens on a UNIX socket and runs on its own thread, serving
+ * one connection at a time. Its queue is synthetic: every song is generated
+ * from its position when requested, so even a million-song queue costs no
+ * memory on the server side. The queue never changes, so its version is
+ * always @ref FAKE_MPD_VERSION. Nothing is ever playing, but the volume can
+ * be set.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "fake_mpd.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief The playlist version reported by the server.
+ */
+#define FAKE_MPD_VERSION 2
+
+/**
+ * @brief The longest command line the server accepts.
+ */
+#define MAX_LINE 4096
+
+struct fake_mpd {
+    struct fake_mpd_config config;
+    struct sockaddr_un addr; /** The socket's address. */
+    int listen_fd;           /** The listening socket. */
+    int stop_pipe[2];        /** Written to when the server should shut down. */
+    pthread_t thread;        /** The thread serving clients. */
+    atomic_ulong commands;   /** The number of commands answered, a command list counting as one. */
+    time_t started;          /** When the server started, for the uptime in stats. */
+    unsigned volume;         /** The volume, as set by setvol. */
+};
+
+/**
+ * @brief What the server remembers about the client it's serving.
+ */
+struct fake_mpd_client {
+    int idle;          /** Whether the client is idling. */
+    int list;          /** Whether the client is sending a command list. */
+    int list_failed;   /** Whether a command in the list failed, so the rest are skipped. */
+    int mixer_changed; /** Whether the volume was set since the client last idled. */
+};
+
+/**
+ * @brief Simulates network and server delay before a response.
+ */
+static void fake_mpd_delay(struct fake_mpd *server)
+{
+    if (!server->config.latency_ms) {
+        return;
+    }
+
+    struct timespec delay;
+    delay.tv_sec = server->config.latency_ms / 1000;
+    delay.tv_nsec = (long)(server->config.latency_ms % 1000) * 1000000;
+    nanosleep(&delay, NULL);
+}
+
+/**
+ * @brief Writes the synthetic song at a queue position.
+ *
+ * Ten songs share an album and ten albums share an artist, which gives
+ * roughly the tag repetition of a real library.
+ */
+static void fake_mpd_write_song(FILE *out, unsigned pos)
+{
+    unsigned album = pos / 10;
+    unsigned artist = album / 10;
+    unsigned duration = 120 + pos % 300;
+
+    fprintf(out,
+            "file: artist%u/album%u/track%u.flac\n"
+            "Title: Track %u\n"
+            "Artist: Artist %u\n"
+            "Album: Album %u\n"
+            "Time: %u\n"
+            "duration: %u.000\n"
+            "Pos: %u\n"
+            "Id: %u\n",
+            artist, album, pos, pos, artist, album, duration, duration, pos, pos + 1);
+}
+
+/**
+ * @brief Parses a range argument such as "10:20" or "10".
+ *
+ * @return 0 on success, or -1 if the argument is malformed.
+ */
+static int fake_mpd_parse_range(const char *arg, unsigned songs, unsigned *start, unsigned *end)
+{
+    char *rest;
+    *start = strtoul(arg, &rest, 10);
+
+    if (*rest == ':') {
+        *end = rest[1] ? strtoul(rest + 1, NULL, 10) : songs;
+    }
+    else if (*rest == '\0') {
+        *end = *start + 1;
+    }
+    else {
+        return -1;
+    }
+
+    if (*start > *end || *end > songs) {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Runs a single command and writes its response, except for the final "OK".
+ *
+ * @param server The server.
+ * @param out The client's output stream.
+ * @param command The command's name.
+ * @param arg The command's argument, without quotes, or NULL.
+ * @param client The client's state.
+ *
+ * @return 1 on success, 0 if an error was written instead, or -1 to close the connection.
+ */
+static int fake_mpd_run_command(struct fake_mpd *server, FILE *out, const char *command,
+                                const char *arg, struct fake_mpd_client *client)
+{
+    unsigned songs = server->config.songs;
+    unsigned start = 0;
+    unsigned end = songs;
+
+    if (strcmp(command, "noidle") == 0) {
+        client->idle = 0;
+    }
+    else if (strcmp(command, "close") == 0) {
+        return -1;
+    }
+    else if (strcmp(command, "ping") == 0) {
+    }
+    else if (strcmp(command, "status") == 0) {
+        fprintf(out,
+                "volume: %u\n"
+                "repeat: 0\n"
+                "random: 0\n"
+                "single: 0\n"
+                "consume: 0\n"
+                "playlist: %u\n"
+                "playlistlength: %u\n"
+                "state: stop\n",
+                server->volume, FAKE_MPD_VERSION, songs);
+    }
+    else if (strcmp(command, "stats") == 0) {
+        fprintf(out,
+                "uptime: %lu\n"
+                "playtime: 0\n"
+                "songs: %u\n"
+                "db_playtime: 0\n"
+                "db_update: %lu\n",
+                (unsigned long)(time(NULL) - server->started), songs,
+                (unsigned long)server->started);
+    }
+    else if (strcmp(command, "setvol") == 0) {
+        unsigned volume = arg ? strtoul(arg, NULL, 10) : 101;
+        if (volume > 100) {
+            fprintf(out, "ACK [2@0] {setvol} Invalid volume value\n");
+            return 0;
+        }
+        server->volume = volume;
+        client->mixer_changed = 1;
+    }
+    else if (strcmp(command, "seekcur") == 0) {
+        fprintf(out, "ACK [55@0] {seekcur} Not playing\n");
+        return 0;
+    }
+    else if (strcmp(command, "playlistinfo") == 0) {
+        if (arg && fake_mpd_parse_range(arg, songs, &start, &end) != 0) {
+            fprintf(out, "ACK [2@0] {playlistinfo} Bad song index\n");
+            return 0;
+        }
+        for (unsigned pos = start; pos < end; ++pos) {
+            fake_mpd_write_song(out, pos);
+        }
+    }
+    else if (strcmp(command, "plchanges") == 0 || strcmp(command, "plchangesposid") == 0) {
+        /* The queue was filled in one go at version 1 and hasn't changed since. */
+        unsigned version = arg ? strtoul(arg, NULL, 10) : 0;
+        int brief = strcmp(command, "plchangesposid") == 0;
+        if (version >= 1) {
+            end = 0;
+        }
+        for (unsigned pos = start; pos < end; ++pos) {
+            if (brief) {
+                fprintf(out, "cpos: %u\nId: %u\n", pos, pos + 1);
+            }
+            else {
+                fake_mpd_write_song(out, pos);
+            }
+        }
+    }
+    else {
+        fprintf(out, "ACK [5@0] {%s} unknown command \"%s\"\n", command, command);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Answers a single line from the client.
+ *
+ * The commands of a command list are run as they arrive, but answered
+ * together when the list ends, so the list costs one round trip and
+ * counts as one command. After a command in the list fails, the rest are
+ * skipped, as MPD does.
+ *
+ * @param server The server.
+ * @param out The client's output stream.
+ * @param line The line, without its newline.
+ * @param client The client's state, updated by idle, noidle and command lists.
+ *
+ * @return 0 to keep serving the client, or -1 to close the connection.
+ */
+static int fake_mpd_handle(struct fake_mpd *server, FILE *out, char *line,
+                           struct fake_mpd_client *client)
+{
+    char *command = line;
+    char *arg = strchr(line, ' ');
+    if (arg) {
+        *arg++ = '\0';
+        /* libmpdclient quotes every argument. */
+        if (*arg == '"') {
+            ++arg;
+            char *quote = strchr(arg, '"');
+            if (quote) {
+                *quote = '\0';
+            }
+        }
+    }
+
+    if (strcmp(command, "idle") == 0) {
+        if (client->mixer_changed) {
+            client->mixer_changed = 0;
+            fputs("changed: mixer\nOK\n", out);
+            return 0;
+        }
+        /* Nothing else ever changes, so the answer only comes when the client gives up. */
+        client->idle = 1;
+        return 0;
+    }
+
+    /* MPD ignores noidle from a client that isn't idling, rather than answering it. */
+    if (strcmp(command, "noidle") == 0 && !client->idle) {
+        return 0;
+    }
+
+    if (strcmp(command, "command_list_begin") == 0) {
+        client->list = 1;
+        client->list_failed = 0;
+        return 0;
+    }
+    if (client->list && strcmp(command, "command_list_end") != 0) {
+        if (!client->list_failed) {
+            int result = fake_mpd_run_command(server, out, command, arg, client);
+            if (result < 0) {
+                return -1;
+            }
+            client->list_failed = !result;
+        }
+        return 0;
+    }
+
+    fake_mpd_delay(server);
+    atomic_fetch_add(&server->commands, 1);
+
+    int result = 1;
+    if (client->list) {
+        client->list = 0;
+        result = !client->list_failed;
+    }
+    else {
+        result = fake_mpd_run_command(server, out, command, arg, client);
+    }
+
+    if (result < 0) {
+        return -1;
+    }
+    if (result) {
+        fputs("OK\n", out);
+    }
+    return 0;
+}
+
+/**
+ * @brief Serves one client until it disconnects or the server is stopped.
+ */
+static void fake_mpd_serve(struct fake_mpd *server, int fd)
+{
+    FILE *out = fdopen(dup(fd), "w");
+    if (!out) {
+        return;
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 16);
+
+    fputs("OK MPD 0.23.5\n", out);
+    fflush(out);
+
+    char buffer[MAX_LINE];
+    size_t used = 0;
+    struct fake_mpd_client client = {0, 0, 0, 0};
+
+    struct pollfd fds[2];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = server->stop_pipe[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0 || fds[1].revents) {
+            break;
+        }
+
+        ssize_t bytes = read(fd, buffer + used, sizeof(buffer) - used);
+        if (bytes <= 0) {
+            break;
+        }
+        used += bytes;
+
+        char *line = buffer;
+        char *newline;
+        while ((newline = memchr(line, '\n', buffer + used - line))) {
+            *newline = '\0';
+            if (fake_mpd_handle(server, out, line, &client) != 0) {
+                fclose(out);
+                return;
+            }
+            line = newline + 1;
+        }
+        fflush(out);
+
+        used = buffer + used - line;
+        memmove(buffer, line, used);
+        if (used == sizeof(buffer)) {
+            /* A line this long isn't something libmpdclient would send. */
+            break;
+        }
+    }
+
+    fclose(out);
+}
+
+/**
+ * @brief The server thread's main loop.
+ */
+static void *fake_mpd_run(void *data)
+{
+    struct fake_mpd *server = data;
+
+    struct pollfd fds[2];
+    fds[0].fd = server->listen_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = server->stop_pipe[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0 || fds[1].revents) {
+            return NULL;
+        }
+
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+
+        fake_mpd_serve(server, fd);
+        close(fd);
+    }
+}
+
+/**
+ * @brief Starts a fake server on a fresh UNIX socket.
+ *
+ * @param config What the server should pretend to have.
+ *
+ * @return A running server, or NULL on error.
+ */
+struct fake_mpd *fake_mpd_start(const struct fake_mpd_config *config)
+{
+    struct fake_mpd *server = malloc(sizeof(*server));
+    if (!server) {
+        return NULL;
+    }
+
+    server->config = *config;
+    server->started = time(NULL);
+    atomic_init(&server->commands, 0);
+    server->volume = 100;
+    memset(&server->addr, 0, sizeof(server->addr));  // NOLINT
+    server->addr.sun_family = AF_UNIX;
+    snprintf(server->addr.sun_path, sizeof(server->addr.sun_path), "/tmp/pantomime-bench-%d.sock",
+             (int)getpid());
+    unlink(server->addr.sun_path);
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server->listen_fd < 0) {
+        free(server);
+        return NULL;
+    }
+
+    if (bind(server->listen_fd, (struct sockaddr *)&server->addr, sizeof(server->addr)) != 0 ||
+        listen(server->listen_fd, 1) != 0 || pipe(server->stop_pipe) != 0) {
+        close(server->listen_fd);
+        unlink(server->addr.sun_path);
+        free(server);
+        return NULL;
+    }
+
+    if (pthread_create(&server->thread, NULL, fake_mpd_run, server) != 0) {
+        close(server->listen_fd);
+        close(server->stop_pipe[0]);
+        close(server->stop_pipe[1]);
+        unlink(server->addr.sun_path);
+        free(server);
+        return NULL;
+    }
+
+    return server;
+}
+
+/**
+ * @brief Stops a fake server and removes its socket.
+ *
+ * @param server The server to stop.
+ */
+void fake_mpd_stop(struct fake_mpd *server)
+{
+    if (!server) {
+        return;
+    }
+
+    ssize_t written = write(server->stop_pipe[1], "", 1);
+    (void)written;
+    pthread_join(server->thread, NULL);
+
+    close(server->listen_fd);
+    close(server->stop_pipe[0]);
+    close(server->stop_pipe[1]);
+    unlink(server->addr.sun_path);
+    free(server);
+}
+
+/**
+ * @brief Gets the path of the server's socket, to be passed to mpdclient_new().
+ */
+const char *fake_mpd_get_path(struct fake_mpd *server)
+{
+    return server->addr.sun_path;
+}
+
+/**
+ * @brief Gets the number of commands the server has answered.
+ */
+unsigned long fake_mpd_get_commands(struct fake_mpd *server)
+{
+    return atomic_load(&server->commands);
+}
@@ -0,0 +1,43 @@
+/*******************************************************************************
+ * fake_mpd.h - Scripted stand-in MPD server for benchmarks.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file fake_mpd.h
+ */
+
+#ifndef FAKE_MPD_H
+#define FAKE_MPD_H
+
+/**
+ * @brief Describes what the fake server should pretend to have.
+ */
+struct fake_mpd_config {
+    unsigned songs;      /** The number of songs in the synthetic queue. */
+    unsigned latency_ms; /** How long to wait before answering each command. */
+};
+
+struct fake_mpd;
+
+struct fake_mpd *fake_mpd_start(const struct fake_mpd_config *config);
+void fake_mpd_stop(struct fake_mpd *server);
+
+const char *fake_mpd_get_path(struct fake_mpd *server);
+unsigned long fake_mpd_get_commands(struct fake_mpd *server);
+
+#endif /* FAKE_MPD_H */
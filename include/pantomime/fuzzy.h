@@ -0,0 +1,77 @@
+/*******************************************************************************
+ * fuzzy.h - Fuzzy matching and ranking for searches.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file fuzzy.h
+ */
+
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <limits.h>
+#include <stddef.h>
+
+/**
+ * @brief The score of a text that doesn't contain the pattern at all.
+ */
+#define FUZZY_NO_MATCH INT_MIN
+
+/**
+ * @brief Room for a joined "artist - album - title", including the terminator.
+ *
+ * Longer texts are cut short, and only their start can match.
+ */
+#define FUZZY_TEXT_SIZE 1024
+
+/**
+ * @brief A scored candidate.
+ */
+struct fuzzy_result {
+    int score;   /** How well the candidate matched. Higher is better. */
+    unsigned id; /** The caller's name for the candidate, such as a queue position. */
+};
+
+/**
+ * @brief Keeps the best few candidates seen, without sorting the rest.
+ *
+ * While candidates are being added, @ref results is a min-heap whose root
+ * is the worst candidate kept, so each new one costs O(log capacity) at
+ * most, and nothing at all if it's worse than the root of a full heap.
+ * Ties go to the candidate with the lower id.
+ */
+struct fuzzy_top {
+    struct fuzzy_result *results; /** The candidates kept. */
+    unsigned length;              /** The number of candidates kept. */
+    unsigned capacity;            /** The most candidates kept. */
+    unsigned size;                /** The number of entries @ref results has room for. */
+    unsigned long matches;        /** The number of candidates added since the last reset. */
+};
+
+size_t fuzzy_join(char *buffer, const char *const *fields, unsigned count);
+int fuzzy_match(const char *text, const char *pattern, size_t length);
+int fuzzy_score(const char *text, const char *pattern, size_t length);
+
+struct fuzzy_top *fuzzy_top_new(void);
+void fuzzy_top_free(struct fuzzy_top *top);
+int fuzzy_top_reset(struct fuzzy_top *top, unsigned capacity);
+void fuzzy_top_add(struct fuzzy_top *top, int score, unsigned id);
+void fuzzy_top_merge(struct fuzzy_top *top, const struct fuzzy_top *other);
+void fuzzy_top_finish(struct fuzzy_top *top);
+
+#endif /* FUZZY_H */
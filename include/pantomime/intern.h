@@ -0,0 +1,50 @@
+/*******************************************************************************
+ * intern.h - Deduplicating string storage.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file intern.h
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+/**
+ * @brief The id of the empty string, which is present in every table.
+ */
+#define INTERN_EMPTY 0
+
+struct intern_table;
+
+struct intern_table *intern_table_new(void);
+void intern_table_free(struct intern_table *table);
+
+unsigned intern_table_add(struct intern_table *table, const char *str);
+const char *intern_table_get(struct intern_table *table, unsigned id);
+
+const char *intern_table_get_data(struct intern_table *table, size_t *size);
+int intern_table_load(struct intern_table *table, const char *data, size_t size);
+
+unsigned intern_table_get_count(struct intern_table *table);
+size_t intern_table_get_size(struct intern_table *table);
+
+void intern_table_clear(struct intern_table *table);
+
+#endif /* INTERN_H */
@@ -26,7 +26,13 @@
 
 #include <mpd/client.h>
 
-#include "pantomime/linkedlist.h"
+#include "pantomime/intern.h"
+#include "pantomime/mpd/library.h"
+#include "pantomime/mpd/pagecache.h"
+#include "pantomime/mpd/song.h"
+#include "pantomime/mpd/worker.h"
+#include "pantomime/pool.h"
+#include "pantomime/vector.h"
 
 /**
  * @brief Holds information about the current MPD server connection.
@@ -36,24 +42,80 @@
  * without having to make continual (often unnecessary) server requests.
  */
 struct mpdclient {
-    struct mpd_connection *connection;
-    struct linkedlist *queue;
+    struct mpd_connection *connection; /** Owned by @ref worker while it runs. */
+    struct mpd_worker *worker;         /** The thread that talks to the server. */
+    struct vector *queue;         /** The songs in the queue, as @ref song records. */
+    struct pagecache *pages;      /** The loaded parts of the queue, when loading lazily. */
+    size_t queue_budget;          /** Memory budget for lazily-loaded queues, or 0 to load eagerly. */
+    unsigned prefetch_margin;     /** Songs to load on either side of the visible ones. */
+    int fetch_pending;            /** Whether a range of the queue is being fetched. */
+    struct intern_table *strings; /** Tag strings shared by the songs in the queue. */
+    size_t strings_live;          /** Bytes of @ref strings in use when it was last compacted. */
+    unsigned queue_version;       /** The playlist version the local queue reflects. */
+    int queue_seeded;             /** Whether the queue was restored and the worker must be told. */
+    time_t server_start;          /** When the server was started, as of the last queue update. */
+    struct vector *changed_ids;   /** Ids of queue songs updated since the changes were consumed. */
+    int queue_reloaded;           /** Whether the whole queue was refetched since then. */
+    int reload_pending;           /** Whether the queue is being refetched after a failed update. */
+    struct library *library;      /** The parts of the database browsed so far. */
+    char *library_cache;          /** Where the library is saved between runs, or NULL. */
+    int library_cache_checked;    /** Whether the saved library has been looked for yet. */
+    unsigned library_saved_at; /** The library version that was loaded or saved. */
+    size_t index_budget;       /** Memory budget for the library's search index, or 0 for none. */
+    int index_pending;         /** Whether a search index is being built. */
+    unsigned index_generation; /** The library generation of the last index build. */
+    unsigned index_attempted;  /** The number of nodes the last index build covered. */
+    int index_unsaved;         /** Whether an index was built since the library was loaded. */
+    struct pool *pool;         /** Threads for indexing and searching the library, or NULL. */
+    int volume_delta;          /** Volume changes waiting to be sent, added up. */
+    int seek_delta;            /** Seeks waiting to be sent, added up, in seconds. */
+    unsigned controls_pending; /** The number of volume and seek changes sent but not yet made. */
+    int volume;                /** The volume after the last change made, or -1 if unknown. */
+    struct vector *edits;      /** Queue edits waiting to be sent, as @ref queue_edit records. */
+    unsigned edits_made;       /** The number of edits made to the local queue so far. */
+    unsigned edits_pending;    /** The number of batches of edits sent but not yet made. */
+    unsigned edits_synced;     /** @ref edits_made when an update last followed every edit sent. */
+    unsigned placeholder_id;   /** The id to show the next locally-added song under. */
 
     enum mpd_error last_error;
+    char *error_message; /** A description of @ref last_error. */
 };
 
-struct mpdclient *mpdclient_new(const char *host, unsigned int port, unsigned int timeout);
+struct mpdclient *mpdclient_new(const char *host, unsigned int port, unsigned int timeout,
+                                size_t queue_budget, unsigned threads);
 void mpdclient_free(struct mpdclient *mpdclient);
-void mpdclient_song_free(void *);
 
 int mpdclient_has_error(struct mpdclient *mpd);
 const char *mpdclient_get_last_error_message(struct mpdclient *mpd);
 
 void mpdclient_update_queue(struct mpdclient *mpd);
+void mpdclient_clear_queue_changes(struct mpdclient *mpd);
+void mpdclient_prefetch_queue(struct mpdclient *mpd, unsigned start, unsigned end);
 
-char *mpdclient_get_song_title(struct mpd_song *song);
-char *mpdclient_get_song_artist(struct mpd_song *song);
-char *mpdclient_get_song_album(struct mpd_song *song);
-unsigned mpdclient_get_song_length(struct mpd_song *song);
+void mpdclient_load_library(struct mpdclient *mpd, unsigned node);
+
+void mpdclient_change_volume(struct mpdclient *mpd, int delta);
+void mpdclient_seek(struct mpdclient *mpd, int seconds);
+int mpdclient_has_unsent_controls(struct mpdclient *mpd);
+void mpdclient_send_controls(struct mpdclient *mpd);
+
+int mpdclient_delete(struct mpdclient *mpd, unsigned start, unsigned end);
+int mpdclient_move(struct mpdclient *mpd, unsigned start, unsigned end, unsigned to);
+int mpdclient_add(struct mpdclient *mpd, const char *uri, unsigned to);
+int mpdclient_has_unsent_edits(struct mpdclient *mpd);
+void mpdclient_send_edits(struct mpdclient *mpd);
+int mpdclient_flush(struct mpdclient *mpd, int timeout);
+
+unsigned mpdclient_get_queue_length(struct mpdclient *mpd);
+const struct song *mpdclient_get_queue_song(struct mpdclient *mpd, unsigned pos);
+const struct song *mpdclient_peek_queue_song(const struct mpdclient *mpd, unsigned pos);
+
+int mpdclient_get_fd(struct mpdclient *mpd);
+unsigned mpdclient_handle_results(struct mpdclient *mpd);
+
+const char *mpdclient_get_song_title(struct mpdclient *mpd, const struct song *song);
+const char *mpdclient_get_song_artist(struct mpdclient *mpd, const struct song *song);
+const char *mpdclient_get_song_album(struct mpdclient *mpd, const struct song *song);
+unsigned mpdclient_get_song_length(const struct song *song);
 
 #endif /* MPDCLIENT_H */
@@ -0,0 +1,105 @@
+/*******************************************************************************
+ * library.h - Lazily loaded tree of the MPD database.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file library.h
+ */
+
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include <mpd/client.h>
+
+#include "pantomime/intern.h"
+#include "pantomime/vector.h"
+
+/**
+ * @brief Marks the absence of a node, such as the parent of an artist.
+ */
+#define LIBRARY_NO_NODE ((unsigned)-1)
+
+struct library_index;
+
+/**
+ * @brief The depth of a node in the library tree.
+ */
+enum library_level {
+    LIBRARY_ARTIST, /** A top-level artist. */
+    LIBRARY_ALBUM,  /** An album by its parent artist. */
+    LIBRARY_TRACK   /** A song on its parent album. */
+};
+
+/**
+ * @brief Whether a node's children have been fetched.
+ */
+enum library_node_state {
+    NODE_UNLOADED, /** Nothing has been requested yet. */
+    NODE_LOADING,  /** A request is on its way to the server. */
+    NODE_LOADED    /** The children are available. */
+};
+
+/**
+ * @brief An artist, album or track.
+ *
+ * The children of a node are fetched in one go and stored next to each
+ * other, so a node only needs to know where they start and how many there
+ * are.
+ */
+struct library_node {
+    unsigned name;          /** The interned artist name, album name or track title. */
+    unsigned parent;        /** The index of the parent node, or @ref LIBRARY_NO_NODE. */
+    unsigned first_child;   /** The index of the first child, once loaded. */
+    unsigned num_children;  /** The number of children, once loaded. */
+    unsigned uri;           /** The interned file path, for tracks. */
+    unsigned duration;      /** The length in seconds, for tracks. */
+    unsigned char level;    /** The node's @ref library_level. */
+    unsigned char state;    /** The @ref library_node_state of the node's children. */
+    unsigned char expanded; /** Whether the node's children are shown. */
+};
+
+/**
+ * @brief The part of the MPD database that has been browsed so far.
+ *
+ * Only the artist list is fetched up front. Albums and tracks are fetched
+ * when their parent is first expanded and kept from then on, until the
+ * database changes.
+ */
+struct library {
+    struct vector *nodes;          /** Every loaded @ref library_node. Artists come first. */
+    struct intern_table *strings;  /** Names and paths used by the nodes. */
+    unsigned num_artists;          /** The number of artists, at the start of @ref nodes. */
+    enum library_node_state state; /** Whether the artist list has been fetched. */
+    unsigned generation;           /** Bumped when the library is cleared, to spot stale results. */
+    unsigned version;              /** Bumped whenever the tree changes. */
+    unsigned long db_update;       /** The database update time the tree reflects, or 0 if unknown. */
+    struct library_index *index;   /** Speeds up searches over the first nodes, or NULL. */
+};
+
+struct library *library_new(void);
+void library_free(struct library *library);
+void library_clear(struct library *library);
+
+struct library_node *library_get_node(struct library *library, unsigned index);
+const char *library_get_name(struct library *library, const struct library_node *node);
+
+int library_set_artists(struct library *library, struct vector *names);
+int library_set_albums(struct library *library, unsigned artist, struct vector *names);
+int library_set_tracks(struct library *library, unsigned album, struct vector *songs);
+
+#endif /* LIBRARY_H */
@@ -0,0 +1,32 @@
+/*******************************************************************************
+ * library_cache.h - On-disk copy of the browsed parts of the library.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file library_cache.h
+ */
+
+#ifndef LIBRARY_CACHE_H
+#define LIBRARY_CACHE_H
+
+#include "pantomime/mpd/library.h"
+
+int library_cache_load(struct library *library, const char *path);
+int library_cache_save(struct library *library, const char *path);
+
+#endif /* LIBRARY_CACHE_H */
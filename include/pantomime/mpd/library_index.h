@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * library_index.h - Trigram index for searching the library.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file library_index.h
+ */
+
+#ifndef LIBRARY_INDEX_H
+#define LIBRARY_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pantomime/mpd/library.h"
+#include "pantomime/pool.h"
+#include "pantomime/vector.h"
+
+/**
+ * @brief The number of posting lists. Trigrams are hashed into this many buckets.
+ */
+#define LIBRARY_INDEX_BUCKETS 65536
+
+/**
+ * @brief The default memory budget for an index, in bytes.
+ */
+#define LIBRARY_INDEX_BUDGET (128 * 1024 * 1024)
+
+/**
+ * @brief The names of a library's nodes, copied so that an index can be built on another thread.
+ */
+struct library_index_source {
+    char *strings;       /** A copy of the library's string table. */
+    unsigned *names;     /** The name of each node, as an offset into @ref strings. */
+    unsigned num_nodes;  /** The number of nodes in @ref names. */
+    unsigned generation; /** The library generation the copy was taken in. */
+};
+
+/**
+ * @brief Maps each trigram of the nodes' folded names to the nodes that contain it.
+ *
+ * Only the first @ref num_nodes nodes are covered. Nodes added to the
+ * library later are searched one by one until the index is rebuilt. The
+ * posting lists are stored back to back in one array, so the index can be
+ * used straight from a mapped file.
+ */
+struct library_index {
+    unsigned generation;      /** The library generation the index was built for. */
+    unsigned num_nodes;       /** The number of nodes covered. */
+    const uint32_t *offsets;  /** Where each bucket's postings start, plus the end of the last. */
+    const uint32_t *postings; /** Node indices, ascending within each bucket. */
+    size_t size;              /** The number of bytes taken by @ref offsets and @ref postings. */
+    void *memory;             /** The allocation or mapping holding the lists. */
+    size_t mapped;            /** The length of the mapping, or 0 if @ref memory was allocated. */
+};
+
+struct library_index_source *library_index_snapshot(struct library *library);
+void library_index_source_free(struct library_index_source *source);
+
+struct library_index *library_index_build(const struct library_index_source *source,
+                                          size_t budget, struct pool *pool);
+struct library_index *library_index_wrap(const uint32_t *lists, uint64_t num_postings,
+                                         unsigned num_nodes, void *map, size_t map_size);
+void library_index_free(struct library_index *index);
+
+int library_index_search(struct library *library, const char *needle, size_t length,
+                         struct vector *matches, struct pool *pool);
+
+#endif /* LIBRARY_INDEX_H */
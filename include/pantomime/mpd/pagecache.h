@@ -0,0 +1,81 @@
+/*******************************************************************************
+ * pagecache.h - Bounded cache of queue pages for lazily-loaded queues.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file pagecache.h
+ */
+
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stddef.h>
+
+#include "pantomime/mpd/song.h"
+
+/**
+ * @brief The number of consecutive queue positions held by one page.
+ */
+#define QUEUE_PAGE_SIZE 256
+
+/**
+ * @brief A block of consecutive queue entries.
+ */
+struct queue_page {
+    struct song songs[QUEUE_PAGE_SIZE];
+};
+
+/**
+ * @brief Holds the loaded parts of a queue, evicting the least recently used pages.
+ *
+ * The cache knows the length of the whole queue, but only keeps as many
+ * pages as fit in its memory budget.
+ */
+struct pagecache {
+    struct queue_page **pages; /** One slot per page of the queue, NULL if not loaded. */
+    unsigned *lru_prev;        /** The next more recently used page, per page. */
+    unsigned *lru_next;        /** The next less recently used page, per page. */
+    unsigned num_pages;        /** The number of pages the queue spans. */
+    unsigned capacity;         /** The number of allocated page slots. */
+    unsigned length;           /** The length of the queue. */
+
+    unsigned lru_head; /** The most recently used page. */
+    unsigned lru_tail; /** The least recently used page. */
+
+    size_t budget; /** The maximum number of bytes to spend on pages. */
+    size_t used;   /** The number of bytes currently spent on pages. */
+
+    unsigned long hits;      /** Lookups that found their page loaded. */
+    unsigned long misses;    /** Lookups whose page wasn't loaded. */
+    unsigned long evictions; /** Pages dropped to stay within the budget. */
+    unsigned long changes;   /** Pages loaded or dropped, to tell when the loaded songs change. */
+};
+
+struct pagecache *pagecache_new(size_t budget);
+void pagecache_free(struct pagecache *cache);
+
+int pagecache_set_length(struct pagecache *cache, unsigned length);
+void pagecache_clear(struct pagecache *cache);
+
+const struct song *pagecache_get(struct pagecache *cache, unsigned pos);
+const struct song *pagecache_peek(const struct pagecache *cache, unsigned pos);
+int pagecache_has_page(struct pagecache *cache, unsigned page);
+struct song *pagecache_load_page(struct pagecache *cache, unsigned page);
+void pagecache_drop_page(struct pagecache *cache, unsigned page);
+
+#endif /* PAGECACHE_H */
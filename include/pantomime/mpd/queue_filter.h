@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * queue_filter.h - Incremental search over the queue.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file queue_filter.h
+ */
+
+#ifndef QUEUE_FILTER_H
+#define QUEUE_FILTER_H
+
+#include <stddef.h>
+
+#include "pantomime/fuzzy.h"
+#include "pantomime/mpd/client.h"
+#include "pantomime/vector.h"
+
+/**
+ * @brief The longest query the filter accepts, in bytes.
+ */
+#define QUEUE_FILTER_MAX_QUERY 255
+
+/**
+ * @brief Narrows the queue down to the songs whose title, artist or album contain a query.
+ *
+ * The matches for every prefix of the query are kept, one set per byte.
+ * Typing another character only tests the songs that matched so far, and
+ * deleting one goes back to the set that was already there.
+ *
+ * In fuzzy mode, a song matches if "artist - album - title" contains the
+ * query's characters in order, and the matches are listed best first.
+ * Only as many as are asked for with queue_filter_rank() are put in order.
+ */
+struct queue_filter {
+    char query[QUEUE_FILTER_MAX_QUERY + 1]; /** The query, NUL-terminated. */
+    unsigned length;                        /** The length of the query in bytes. */
+    int fuzzy;                              /** Whether the query is matched fuzzily. */
+
+    /** The matching queue positions for each length of the query, or NULL if not known. */
+    struct vector *levels[QUEUE_FILTER_MAX_QUERY + 1];
+    unsigned queue_version;     /** The queue version the matches were found in. */
+    unsigned edits_made;        /** The number of local queue edits made when they were found. */
+    unsigned long page_changes; /** The queue's @ref pagecache::changes when they were found. */
+    unsigned long scanned;      /** The number of songs tested by the last update. */
+    unsigned char *loaded;      /** Whether each page was loaded when they were found. */
+    unsigned num_pages;         /** The number of pages in @ref loaded. */
+
+    struct fuzzy_top *ranked; /** The best fuzzy matches, best first. */
+    int ranked_valid;         /** Whether @ref ranked is up to date with the matches. */
+};
+
+struct queue_filter *queue_filter_new(void);
+void queue_filter_free(struct queue_filter *filter);
+
+int queue_filter_is_active(struct queue_filter *filter);
+const char *queue_filter_get_query(struct queue_filter *filter);
+void queue_filter_set_fuzzy(struct queue_filter *filter, int fuzzy);
+
+int queue_filter_append(struct queue_filter *filter, struct mpdclient *mpd, const char *text);
+void queue_filter_backspace(struct queue_filter *filter, struct mpdclient *mpd);
+void queue_filter_clear(struct queue_filter *filter);
+void queue_filter_sync(struct queue_filter *filter, struct mpdclient *mpd);
+int queue_filter_rank(struct queue_filter *filter, struct mpdclient *mpd, unsigned count);
+
+unsigned queue_filter_get_length(struct queue_filter *filter);
+unsigned queue_filter_get_position(struct queue_filter *filter, unsigned index);
+unsigned queue_filter_find(struct queue_filter *filter, unsigned position);
+
+#endif /* QUEUE_FILTER_H */
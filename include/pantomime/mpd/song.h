@@ -0,0 +1,49 @@
+/*******************************************************************************
+ * song.h - Compact song records.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file song.h
+ */
+
+#ifndef SONG_H
+#define SONG_H
+
+#include <mpd/client.h>
+
+#include "pantomime/intern.h"
+
+/**
+ * @brief The parts of an MPD song that the UI needs.
+ *
+ * Tags are stored as ids into a shared @ref intern_table, so songs from the
+ * same artist or album share a single copy of those strings. A song's
+ * position is its index in whatever list holds it.
+ */
+struct song {
+    unsigned id;       /** The song's id in the MPD queue. */
+    unsigned duration; /** The song's length in seconds. */
+    unsigned title;    /** The interned title, or the file name if the song has no title. */
+    unsigned artist;   /** The interned artist name. */
+    unsigned album;    /** The interned album name. */
+};
+
+void song_from_mpd(struct song *song, const struct mpd_song *mpd_song,
+                   struct intern_table *strings);
+
+#endif /* SONG_H */
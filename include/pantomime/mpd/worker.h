@@ -0,0 +1,178 @@
+/*******************************************************************************
+ * worker.h - Background thread that owns the MPD connection.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file worker.h
+ */
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <mpd/client.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "pantomime/mpd/library_index.h"
+#include "pantomime/ring.h"
+#include "pantomime/vector.h"
+
+/**
+ * @brief The kinds of work the network thread can do.
+ */
+enum mpd_job_type {
+    JOB_IDLE,          /** Created by the worker when the server reports events. */
+    JOB_UPDATE_QUEUE,  /** Fetch what changed in the queue since the last update. */
+    JOB_FETCH_RANGE,   /** Fetch the songs in a range of the queue. */
+    JOB_LIST_TAGS,     /** List the distinct values of a tag in the database. */
+    JOB_FIND_SONGS,    /** Find the songs in the database with the given artist and album. */
+    JOB_DB_STATS,      /** Find out when the database was last updated. */
+    JOB_INDEX_LIBRARY, /** Build a search index over a copy of the library, on its own thread. */
+    JOB_CONTROL,       /** Change the volume and seek, in one command list. */
+    JOB_EDIT_QUEUE     /** Delete, move and add queue songs, in one command list. */
+};
+
+/**
+ * @brief A queue entry that changed, as reported by plchangesposid.
+ */
+struct queue_change {
+    unsigned pos; /** The entry's position in the queue. */
+    unsigned id;  /** The entry's song id. */
+};
+
+/**
+ * @brief The kinds of change that can be made to the queue.
+ */
+enum queue_edit_type {
+    EDIT_DELETE, /** Delete the songs from @ref queue_edit::start up to @ref queue_edit::end. */
+    EDIT_MOVE,   /** Move the songs in that range so that the first is at @ref queue_edit::to. */
+    EDIT_ADD     /** Add the song at @ref queue_edit::uri at position @ref queue_edit::to. */
+};
+
+/**
+ * @brief A change to the queue, sent to the server as one command.
+ */
+struct queue_edit {
+    enum queue_edit_type type;
+    unsigned start; /** The first position of the range, for deletes and moves. */
+    unsigned end;   /** The position after the last one of the range, for deletes and moves. */
+    unsigned to;    /** Where moved songs go or the added song goes. */
+    char *uri;      /** The song to add. Owned by the edit. */
+};
+
+/**
+ * @brief A request sent to the network thread, which comes back filled in with the results.
+ *
+ * Jobs are allocated by the thread that submits them. The network thread
+ * takes ownership until the job is published back to the UI thread, which
+ * applies the results and frees it.
+ */
+struct mpd_job {
+    enum mpd_job_type type;
+    unsigned start; /** The first position to fetch, for @ref JOB_FETCH_RANGE. */
+    unsigned end;   /** The position after the last one to fetch, for @ref JOB_FETCH_RANGE. */
+
+    enum mpd_tag_type tag;   /** The tag to list, for @ref JOB_LIST_TAGS. */
+    char *artist;            /** Only consider songs by this artist, if not NULL. Owned by the job. */
+    char *album;             /** Only consider songs on this album, if not NULL. Owned by the job. */
+    unsigned node;           /** The library node the results belong to. */
+    unsigned generation;     /** The library generation the request was made in. */
+    unsigned long db_update; /** When the database was last updated, for @ref JOB_DB_STATS. */
+
+    struct library_index_source *source; /** What to index. Owned by the job. */
+    size_t index_budget;                 /** The most memory the index may take. */
+    struct pool *pool;                   /** The threads to build the index on, or NULL. */
+    struct library_index *index;         /** The index, unless it didn't fit. Owned by the job. */
+
+    int volume_delta; /** How much to change the volume by, for @ref JOB_CONTROL. */
+    int seek_delta;   /** How many seconds to seek by, for @ref JOB_CONTROL. */
+    int volume;       /** The volume after a @ref JOB_CONTROL, or -1 if it isn't known. */
+
+    struct vector *edits; /** The @ref queue_edit records to make, for @ref JOB_EDIT_QUEUE. */
+    unsigned edits_made;  /** The local queue edits made before a @ref JOB_FETCH_RANGE was sent. */
+
+    enum mpd_idle events;   /** The events the server reported, for @ref JOB_IDLE. */
+    int seeded;             /** Whether the queue was restored at @ref queue_version. */
+    time_t server_start;    /** When the server was started. */
+    int has_queue;          /** Whether the job carries a queue update. */
+    int reload;             /** Whether the update replaces the whole queue. May be asked for. */
+    unsigned queue_version; /** The playlist version the update brings the queue to. */
+    unsigned queue_length;  /** The length of the queue after the update. */
+    struct vector *songs;   /** Received songs, as pointers to struct mpd_song. */
+    struct vector *changes; /** Changed entries, as @ref queue_change records, when loading lazily. */
+    struct vector *names;   /** Received tag values, as strings owned by the job. */
+
+    enum mpd_error error; /** The error that stopped the job, if any. */
+    char *error_message;  /** A description of @ref error. Owned by the job. */
+};
+
+/**
+ * @brief A thread that performs every request on an MPD connection.
+ *
+ * Requests travel to the thread and results travel back through two
+ * single-producer, single-consumer rings, so neither side ever blocks on the
+ * other. Each ring is paired with an eventfd that wakes up its consumer.
+ *
+ * Between requests, the thread keeps the connection in idle mode and turns
+ * the server's notifications into @ref JOB_IDLE results.
+ *
+ * Building a search index takes a while and needs no connection, so
+ * @ref JOB_INDEX_LIBRARY jobs go to a second thread with its own pair of
+ * rings instead, and the connection is never kept waiting by one.
+ */
+struct mpd_worker {
+    pthread_t thread;
+    pthread_t index_thread;
+    struct mpd_connection *connection; /** The connection. Only touched by the worker thread. */
+    int lazy;                          /** Whether queue updates report positions instead of songs. */
+
+    struct ring *requests; /** Jobs waiting to run, pushed by the UI thread. */
+    struct ring *results;  /** Finished jobs, pushed by the worker thread. */
+    int request_fd;        /** An eventfd signalled when a job is submitted. */
+    int result_fd;         /** An eventfd signalled when a job is finished. */
+    atomic_int quitting;   /** Set when the threads should stop. */
+
+    struct ring *index_requests; /** Index builds waiting to run, pushed by the UI thread. */
+    struct ring *index_results;  /** Finished index builds, pushed by the index thread. */
+    int index_fd;                /** An eventfd signalled when an index build is submitted. */
+
+    /* The rest is private to the worker thread. */
+    int idle;               /** Whether the connection is in idle mode. */
+    int have_queue;         /** Whether the queue has been fetched at least once. */
+    unsigned queue_version; /** The playlist version of the last queue update. */
+    unsigned queue_length;  /** The queue length as of the last queue update. */
+    time_t server_start;    /** When the server was started, to notice restarts. */
+    int volume;             /** The volume as last read or set, or -1 if it may have changed. */
+    int volume_echo;        /** Whether the server has yet to report our last volume change. */
+    enum mpd_error error;   /** The first unrecoverable error, after which the connection is unused. */
+};
+
+void queue_edit_clear(void *edit);
+
+struct mpd_job *mpd_job_new(enum mpd_job_type type);
+void mpd_job_free(struct mpd_job *job);
+
+struct mpd_worker *mpd_worker_new(struct mpd_connection *connection, int lazy);
+void mpd_worker_free(struct mpd_worker *worker);
+
+int mpd_worker_submit(struct mpd_worker *worker, struct mpd_job *job);
+struct mpd_job *mpd_worker_receive(struct mpd_worker *worker);
+int mpd_worker_get_fd(struct mpd_worker *worker);
+
+#endif /* WORKER_H */
@@ -0,0 +1,50 @@
+/*******************************************************************************
+ * pool.h - A small work-stealing thread pool for splitting scans across cores.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file pool.h
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include "pantomime/vector.h"
+
+/**
+ * @brief A fixed set of threads that run the tasks of one job at a time.
+ *
+ * The thread that starts a job works on it too, and gets its results as
+ * soon as every task has finished. Any function that takes a pool accepts
+ * NULL, and then runs every task on the calling thread.
+ */
+struct pool;
+
+struct pool *pool_new(unsigned threads);
+void pool_free(struct pool *pool);
+
+unsigned pool_get_threads(struct pool *pool);
+unsigned pool_get_shards(struct pool *pool, unsigned length, unsigned grain);
+unsigned pool_get_shard_start(unsigned length, unsigned shards, unsigned shard);
+
+void pool_run(struct pool *pool, unsigned count, void (*task)(void *data, unsigned index),
+              void *data);
+int pool_filter(struct pool *pool, unsigned start, unsigned end,
+                int (*keep)(void *data, unsigned index), void *data, struct vector *matches);
+
+#endif /* POOL_H */
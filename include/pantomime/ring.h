@@ -0,0 +1,43 @@
+/*******************************************************************************
+ * ring.h - Lock-free single-producer, single-consumer queue.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file ring.h
+ */
+
+#ifndef RING_H
+#define RING_H
+
+/**
+ * @brief A fixed-size queue of pointers shared between exactly two threads.
+ *
+ * One thread pushes and the other pops, without any locking. The structure
+ * is opaque so that the head and tail indices can be kept on separate
+ * cache lines.
+ */
+struct ring;
+
+struct ring *ring_new(unsigned capacity);
+void ring_free(struct ring *ring);
+
+int ring_push(struct ring *ring, void *item);
+void *ring_pop(struct ring *ring);
+int ring_is_empty(struct ring *ring);
+
+#endif /* RING_H */
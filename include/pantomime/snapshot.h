@@ -0,0 +1,41 @@
+/*******************************************************************************
+ * snapshot.h - Saved queue and view state for instant startup.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file snapshot.h
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "pantomime/mpd/client.h"
+
+/**
+ * @brief The parts of the UI's state that are restored on startup.
+ */
+struct snapshot_view {
+    unsigned panel;  /** The visible panel, as an @ref ui_panel. */
+    unsigned cursor; /** Queue position of the selected song. */
+    unsigned offset; /** Queue position of the song on the first visible row. */
+};
+
+int snapshot_load(struct mpdclient *mpd, const char *path, struct snapshot_view *view);
+int snapshot_save(struct mpdclient *mpd, const char *path, const struct snapshot_view *view);
+
+#endif /* SNAPSHOT_H */
@@ -0,0 +1,49 @@
+/*******************************************************************************
+ * strmatch.h - Case-insensitive substring matching for tag searches.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file strmatch.h
+ */
+
+#ifndef STRMATCH_H
+#define STRMATCH_H
+
+#include <stddef.h>
+
+/**
+ * @brief The ways a substring search can be carried out.
+ *
+ * They all give the same answers; they only differ in speed and in which
+ * CPUs can run them.
+ */
+enum strmatch_impl {
+    STRMATCH_SCALAR, /** One byte at a time. Runs everywhere. */
+    STRMATCH_SSE2,   /** 16 candidate positions at a time. */
+    STRMATCH_AVX2,   /** 32 candidate positions at a time. */
+};
+
+unsigned char strmatch_fold_char(unsigned char c);
+void strmatch_fold(char *text, size_t length);
+int strmatch_contains(const char *haystack, const char *needle, size_t length);
+
+enum strmatch_impl strmatch_get_impl(void);
+int strmatch_set_impl(enum strmatch_impl impl);
+const char *strmatch_get_impl_name(enum strmatch_impl impl);
+
+#endif /* STRMATCH_H */
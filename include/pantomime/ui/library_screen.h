@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * library_screen.h - Screen for browsing the MPD database.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file library_screen.h
+ */
+
+#ifndef LIBRARY_SCREEN_H
+#define LIBRARY_SCREEN_H
+
+#include <curses.h>
+
+#include "pantomime/fuzzy.h"
+#include "pantomime/mpd/client.h"
+#include "pantomime/vector.h"
+
+/**
+ * @brief The longest search, in bytes.
+ */
+#define LIBRARY_SCREEN_MAX_QUERY 255
+
+/**
+ * @brief Shows the library as a tree of artists, albums and tracks.
+ *
+ * While a search is active, the loaded nodes whose names match it are
+ * listed instead of the tree. A fuzzy search matches each node's
+ * "artist - album - title" instead, and lists the best matches first.
+ */
+struct library_screen {
+    WINDOW *win;     /** The window to draw in. It belongs to the caller. */
+    unsigned cursor; /** Row of the selected node. */
+    unsigned offset; /** Row shown at the top of the window. */
+
+    struct vector *rows;      /** Indices of the visible nodes, in display order. */
+    unsigned rows_version;    /** The library version @ref rows was built from. */
+    unsigned rows_generation; /** The library generation @ref rows was built from. */
+    int rows_valid;           /** Whether @ref rows is up to date with the expanded nodes. */
+
+    char query[LIBRARY_SCREEN_MAX_QUERY + 1]; /** The folded search, empty when not searching. */
+    unsigned query_length;                    /** The length of @ref query. */
+    int search_input;                         /** Whether typed keys go to the search. */
+    int fuzzy;                                /** Whether the search is matched fuzzily. */
+
+    /** In a fuzzy search, every matching node, in library order. @ref rows holds the best. */
+    struct vector *matches;
+    struct fuzzy_top *ranked; /** Puts the best of @ref matches in order. */
+};
+
+struct library_screen *library_screen_new(WINDOW *win);
+void library_screen_free(struct library_screen *screen);
+
+unsigned library_screen_get_length(struct library_screen *screen, struct mpdclient *mpd);
+void library_screen_move_cursor(struct library_screen *screen, struct mpdclient *mpd, int delta);
+void library_screen_set_cursor(struct library_screen *screen, struct mpdclient *mpd,
+                               unsigned row);
+
+void library_screen_expand(struct library_screen *screen, struct mpdclient *mpd);
+void library_screen_collapse(struct library_screen *screen, struct mpdclient *mpd);
+
+void library_screen_search_begin(struct library_screen *screen, int fuzzy);
+int library_screen_search_append(struct library_screen *screen, struct mpdclient *mpd,
+                                 const char *text);
+void library_screen_search_backspace(struct library_screen *screen);
+void library_screen_search_clear(struct library_screen *screen);
+
+void library_screen_draw(struct library_screen *screen, struct mpdclient *mpd);
+
+#endif /* LIBRARY_SCREEN_H */
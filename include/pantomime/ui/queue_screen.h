@@ -21,29 +21,126 @@
  * @file queue_screen.h
  */
 
+#ifndef QUEUE_SCREEN_H
+#define QUEUE_SCREEN_H
+
 #include <curses.h>
 
-#include "pantomime/linkedlist.h"
 #include "pantomime/mpd/client.h"
+#include "pantomime/mpd/queue_filter.h"
+
+/**
+ * @brief The song information a column of the queue can show.
+ */
+enum queue_column_field {
+    COLUMN_ARTIST,
+    COLUMN_TITLE,
+    COLUMN_ALBUM,
+    NUM_COLUMN_FIELDS
+};
+
+/**
+ * @brief The most columns of song information, besides the song's length.
+ */
+#define QUEUE_MAX_COLUMNS NUM_COLUMN_FIELDS
+
+/**
+ * @brief A column of song information.
+ */
+struct queue_column {
+    enum queue_column_field field; /** What the column shows. */
+    unsigned weight;               /** The column's share of the width, relative to the others. */
+};
 
+/**
+ * @brief What is currently shown on a row of the queue screen's window.
+ */
+enum queue_screen_row_state {
+    ROW_DAMAGED, /** The row's contents are unknown and must be redrawn. */
+    ROW_SONG,    /** The row shows a song. */
+    ROW_BLANK    /** The row is empty. */
+};
+
+/**
+ * @brief Records what was drawn on a row, so unchanged rows can be skipped.
+ */
 struct queue_screen_row {
-    
-    char *song_title;
-    char *song_artist;
-    char *song_album;
-    unsigned song_length;
-    unsigned selected;
+    enum queue_screen_row_state state;
+    unsigned song_id; /** The id of the song shown, if @ref state is ROW_SONG. */
+    int selected;     /** Whether the row was highlighted. */
 };
 
+/**
+ * @brief Describes a fully laid-out row kept in the queue screen's row cache.
+ */
+struct queue_screen_cached_row {
+    unsigned song_id; /** The id of the song the row shows. */
+    int width;        /** The width the row was laid out for, or 0 if the slot is empty. */
+    size_t length;    /** The length of the row's text in bytes. */
+};
+
+/**
+ * @brief Holds the state of the queue screen.
+ *
+ * Only the rows between @ref offset and the bottom of the window are drawn,
+ * so the cost of a redraw depends on the window's height rather than the
+ * length of the queue.
+ */
 struct queue_screen {
     WINDOW *win;
+    unsigned cursor; /** Row of the selected song, counting from the top of the list. */
+    unsigned offset; /** Row shown at the top of the window. */
+
+    struct queue_filter *filter; /** Narrows the list to matching songs when it has a query. */
+    int filter_input;            /** Whether typed keys go to the filter's query. */
+
+    struct queue_column columns[QUEUE_MAX_COLUMNS]; /** The columns, left to right. */
+    unsigned num_columns;                           /** The number of @ref columns. */
+
+    char *line;       /** Reusable buffer that each row is formatted into. */
+    size_t line_size; /** The size of @ref line in bytes. */
+
+    struct queue_screen_cached_row *cache; /** Laid-out rows, direct-mapped by song id. */
+    char *cache_text;                      /** Row text, one row of @ref cache_width cells per slot. */
+    unsigned cache_slots;                  /** The number of cache slots, a power of two. */
+    int cache_width;                       /** The window width the cache was sized for. */
+    unsigned long cache_hits;              /** Rows drawn straight from the cache. */
+    unsigned long cache_misses;            /** Rows that had to be laid out. */
+
+    struct queue_screen_row *rows; /** What is shown on each row of the window. */
+    unsigned num_rows;             /** The number of entries in @ref rows. */
+    int rows_width;                /** The window width when @ref rows was last valid. */
+    unsigned rows_drawn;           /** The number of rows redrawn in the last frame. */
 };
 
 struct queue_screen *queue_screen_new(WINDOW *win);
 void queue_screen_free(struct queue_screen *screen);
 
+void queue_screen_set_columns(struct queue_screen *screen, const struct queue_column *columns,
+                              unsigned count);
+
+void queue_screen_move_cursor(struct queue_screen *screen, int delta, unsigned length);
+void queue_screen_set_cursor(struct queue_screen *screen, unsigned position, unsigned length);
+
+unsigned queue_screen_get_length(struct queue_screen *screen, struct mpdclient *mpd);
+unsigned queue_screen_get_position(struct queue_screen *screen, unsigned row);
+
+void queue_screen_filter_begin(struct queue_screen *screen, int fuzzy);
+void queue_screen_filter_append(struct queue_screen *screen, struct mpdclient *mpd,
+                                const char *text);
+void queue_screen_filter_backspace(struct queue_screen *screen, struct mpdclient *mpd);
+void queue_screen_filter_clear(struct queue_screen *screen);
+
 void queue_screen_create_label_time(char *buffer, unsigned int length);
 
-void queue_screen_write_song_info(WINDOW *win, const char *title, const char *artist, const char *album, unsigned length);
+const char *queue_screen_format_row(struct queue_screen *screen, int width, const char *title,
+                                    const char *artist, const char *album, unsigned length);
+
+void queue_screen_invalidate_song(struct queue_screen *screen, unsigned song_id);
+void queue_screen_invalidate_all(struct queue_screen *screen);
+void queue_screen_damage_all(struct queue_screen *screen);
+void queue_screen_sync(struct queue_screen *screen, struct mpdclient *mpd);
+
+void queue_screen_draw(struct queue_screen *screen, struct mpdclient *mpd);
 
-void queue_screen_draw(struct queue_screen *screen, struct linkedlist *queue);
+#endif /* QUEUE_SCREEN_H */
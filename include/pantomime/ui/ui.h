@@ -24,12 +24,18 @@
 #ifndef UI_H
 #define UI_H
 
+#include "pantomime/ui/library_screen.h"
 #include "pantomime/ui/queue_screen.h"
 
 #include <panel.h>
 
 #define STATUSBAR_HEIGHT 2
 
+/**
+ * @brief Room for a message in the status bar, including the terminator.
+ */
+#define UI_MESSAGE_SIZE 160
+
 enum ui_panel { HELP, QUEUE, LIBRARY, NUM_PANELS };
 
 struct ui {
@@ -37,6 +43,18 @@ struct ui {
     enum ui_panel visible_panel;
 
     struct queue_screen *queue_screen;
+    struct library_screen *library_screen;
+
+    WINDOW *statusbar;             /** The status bar below the panels. */
+    int statusbar_dirty;           /** Whether the status bar must be redrawn. */
+    enum ui_panel statusbar_panel; /** The visible panel when the status bar was last drawn. */
+    unsigned statusbar_length;     /** The queue length when the status bar was last drawn. */
+    unsigned statusbar_matches;    /** The number of filter matches when it was last drawn. */
+    char message[UI_MESSAGE_SIZE]; /** Shown in the status bar until cleared, or empty. */
+
+    int io_fd;              /** This thread's /proc I/O accounting file, or -1. */
+    long long frame_bytes;  /** Bytes written to the terminal by the last frame. */
+    long long total_bytes;  /** Bytes written to the terminal by all frames. */
 
     int maxx;
     int maxy;
@@ -52,6 +70,8 @@ PANEL **create_panels(int num_panels, int width, int height);
 void destroy_panels(PANEL **panels, int num_panels);
 
 void ui_set_visible_panel(struct ui *ui, enum ui_panel panel);
+void ui_resize(struct ui *ui);
+void ui_set_message(struct ui *ui, const char *format, ...);
 
 void ui_draw(struct ui *ui, struct mpdclient *mpd);
 
@@ -0,0 +1,58 @@
+/*******************************************************************************
+ * vector.h
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file vector.h
+ */
+
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include <stddef.h>
+
+enum vec_error {
+    VEC_ERROR_SUCCESS,   /** No error. */
+    VEC_ERROR_PARAM,     /** Invalid parameter passed to vector-handling function. */
+    VEC_ERROR_FULL,      /** Vector is full. */
+    VEC_ERROR_NO_MEMORY, /** No memory available to perform operation. */
+    VEC_ERROR_UNKNOWN    /** Unknown error. */
+};
+
+struct vector;
+
+struct vector *vector_new(size_t data_size);
+void vector_free(struct vector *vec, void (*free_fn)(void *));
+
+unsigned vector_get_length(struct vector *vec);
+
+void *vector_at(struct vector *vec, unsigned index);
+
+enum vec_error vector_reserve(struct vector *vec, unsigned capacity);
+enum vec_error vector_push(struct vector *vec, const void *data);
+enum vec_error vector_insert(struct vector *vec, unsigned index, const void *data, unsigned count);
+enum vec_error vector_set(struct vector *vec, unsigned index, const void *data,
+                          void (*free_fn)(void *));
+
+enum vec_error vector_move_range(struct vector *vec, unsigned start, unsigned end, unsigned to);
+enum vec_error vector_remove_range(struct vector *vec, unsigned start, unsigned end,
+                                   void (*free_fn)(void *));
+enum vec_error vector_truncate(struct vector *vec, unsigned length, void (*free_fn)(void *));
+enum vec_error vector_clear(struct vector *vec, void (*free_fn)(void *));
+
+#endif /* VECTOR_H */
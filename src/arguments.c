@@ -24,12 +24,23 @@
 const char *argp_program_version = "Pantomime 0.0.1";
 const char *argp_program_bug_address = "<julianne@julianneadams.info>";
 
+/**
+ * @brief The queue budget in megabytes used when --lazy-queue is given without one.
+ */
+#define DEFAULT_QUEUE_BUDGET 16
+
 char doc[] = "An MPD client built on NCURSES.";
 char args_doc[] = "";
 
 struct argp_option options[] = {
     {"host", 'h', "HOST", 0, "The IP address or UNIX socket path of the MPD host."},
     {"port", 'p', "PORT", 0, "The port of the MPD host. Only used when connecting via IP address."},
+    {"lazy-queue", 'l', "MB", OPTION_ARG_OPTIONAL,
+     "Load queue metadata on demand, keeping at most MB megabytes of it in memory (default 16)."},
+    {"threads", 't', "N", 0,
+     "Index and search the library on N threads (default: one per CPU)."},
+    {"config", 'c', "FILE", 0,
+     "Read settings from FILE instead of $XDG_CONFIG_HOME/pantomime/config."},
     {0}};
 
 error_t parse_opt(int key, char *arg, struct argp_state *state)
@@ -42,6 +53,21 @@ error_t parse_opt(int key, char *arg, struct argp_state *state)
         case 'p':
             arguments->port = atoi(arg);
             break;
+        case 'l':
+            arguments->queue_budget = (size_t)(arg ? atoi(arg) : DEFAULT_QUEUE_BUDGET) << 20;
+            if (arguments->queue_budget == 0) {
+                argp_error(state, "invalid queue budget: %s", arg);
+            }
+            break;
+        case 't':
+            arguments->threads = atoi(arg);
+            if (arguments->threads <= 0) {
+                argp_error(state, "invalid number of threads: %s", arg);
+            }
+            break;
+        case 'c':
+            arguments->config = arg;
+            break;
         case ARGP_KEY_ARG:
             /* Too many arguments. */
             if (state->arg_num > 2) {
@@ -60,9 +86,12 @@ struct arguments parse_arguments(int argc, char *argv[])
     struct argp argp = {options, parse_opt, args_doc, doc};
     struct arguments arguments;
 
-    /* Default arguments */
-    arguments.host = "localhost";
-    arguments.port = 6600;
+    /* Default arguments. Anything left unset here falls back to the config file. */
+    arguments.host = NULL;
+    arguments.port = 0;
+    arguments.queue_budget = 0;
+    arguments.threads = 0;
+    arguments.config = NULL;
 
     argp_parse(&argp, argc, argv, 0, 0, &arguments);
 
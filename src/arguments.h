@@ -25,14 +25,18 @@
 #define ARGUMENTS_H
 
 #include <argp.h>
+#include <stddef.h>
 
 /**
  * @brief Holds command-line arguments passed to the program.
  */
 struct arguments {
     char *args[0];
-    char *host;
-    int port;
+    char *host;          /** The MPD host, or NULL to use the config file's. */
+    int port;            /** The MPD port, or 0 to use the config file's. */
+    size_t queue_budget; /** Memory budget in bytes for lazily loading the queue, or 0. */
+    int threads;         /** Threads to index and search the library on, or 0 for one per CPU. */
+    char *config;        /** The config file to read, or NULL for the default one. */
 };
 
 error_t parse_opt(int key, char *arg, struct argp_state *state);
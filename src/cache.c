@@ -0,0 +1,96 @@
+/*******************************************************************************
+ * cache.c - Locations of files kept between runs.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file cache.h
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pantomime/cache.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/**
+ * @brief Builds the path of a cache file for a server.
+ *
+ * Each server gets its own files in $XDG_CACHE_HOME/pantomime, or
+ * ~/.cache/pantomime if that isn't set. The directories are created if
+ * needed.
+ *
+ * @param name What the file holds, such as "library".
+ * @param host The server's hostname or socket path, or NULL for the default.
+ * @param port The server's port, or 0 for the default.
+ *
+ * @return A newly-allocated path, or NULL if there is nowhere to put the cache.
+ */
+char *cache_get_path(const char *name, const char *host, unsigned port)
+{
+    char dir[4096];
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int length;
+
+    if (cache_home && *cache_home) {
+        length = snprintf(dir, sizeof(dir), "%s", cache_home);
+    }
+    else if (home && *home) {
+        length = snprintf(dir, sizeof(dir), "%s/.cache", home);
+    }
+    else {
+        return NULL;
+    }
+    if (length < 0 || (size_t)length >= sizeof(dir)) {
+        return NULL;
+    }
+    mkdir(dir, 0700);
+
+    length = snprintf(dir + length, sizeof(dir) - length, "/pantomime") + length;
+    if (length < 0 || (size_t)length >= sizeof(dir)) {
+        return NULL;
+    }
+    mkdir(dir, 0700);
+
+    if (!host) {
+        host = getenv("MPD_HOST");
+    }
+    if (!host || !*host) {
+        host = "default";
+    }
+
+    /* Socket paths contain slashes, so only keep characters that are safe in a file name. */
+    size_t size = strlen(dir) + strlen(name) + strlen(host) + 32;
+    char *path = malloc(size);
+    if (!path) {
+        return NULL;
+    }
+
+    int prefix = snprintf(path, size, "%s/%s-", dir, name);
+    char *p = path + prefix;
+    for (const char *c = host; *c; ++c) {
+        *p++ = isalnum((unsigned char)*c) || *c == '.' || *c == '-' ? *c : '_';
+    }
+    snprintf(p, size - (p - path), "-%u.db", port);
+
+    return path;
+}
@@ -22,181 +22,210 @@
  * @file command.h
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "command.h"
 
+#include <ctype.h>
 #include <curses.h>
-#include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <strings.h>
 
 #define KEY_CTRL(x) ((x)&0x1f)
 #define KEY_RETURN 10
+#define KEY_TAB 9
+#define KEY_ESCAPE 27
 
 static struct command commands[] = {
-    {CMD_NULL, {0, 0, 0}, "Null", "Null command. Does nothing."},
+    {CMD_NULL, "Null", "Null command. Does nothing."},
+    {CMD_QUIT, "Quit", "Quit Pantomime."},
+    {CMD_HELP, "Help", "Display the help screen."},
+    {CMD_QUEUE, "Queue", "Display the queue screen."},
+    {CMD_LIBRARY, "Library", "Display the library screen."},
+    {CMD_SCROLL_UP, "Up", "Move the cursor up one line."},
+    {CMD_SCROLL_DOWN, "Down", "Move the cursor down one line."},
+    {CMD_PAGE_UP, "Page up", "Move the cursor up one page."},
+    {CMD_PAGE_DOWN, "Page down", "Move the cursor down one page."},
+    {CMD_SCROLL_TOP, "Top", "Move the cursor to the first line."},
+    {CMD_SCROLL_BOTTOM, "Bottom", "Move the cursor to the last line."},
+    {CMD_EXPAND, "Expand", "Expand the selected artist or album."},
+    {CMD_COLLAPSE, "Collapse", "Collapse the selected artist or album."},
+    {CMD_FILTER, "Filter", "Show only the songs matching what you type."},
+    {CMD_FUZZY, "Fuzzy find", "Show the songs that best fuzzily match what you type, best first."},
+    {CMD_VOLUME_UP, "Volume up", "Turn the volume up."},
+    {CMD_VOLUME_DOWN, "Volume down", "Turn the volume down."},
+    {CMD_SEEK_FORWARD, "Seek forward", "Skip ahead in the current song."},
+    {CMD_SEEK_BACKWARD, "Seek backward", "Go back in the current song."},
+    {CMD_DELETE, "Delete", "Remove the selected song from the queue."}};
 
-    {CMD_QUIT, {'q', 'Q', KEY_CTRL('c')}, "Quit", "Quit Pantomime."},
+/**
+ * @brief The keys each command is bound to until the user binds others.
+ */
+static const struct key_binding default_bindings[] = {
+    {CMD_QUIT, {'q'}},
+    {CMD_QUIT, {'Q'}},
+    {CMD_QUIT, {KEY_CTRL('c')}},
+
+    {CMD_HELP, {'1'}},
+    {CMD_QUEUE, {'2'}},
+    {CMD_LIBRARY, {'3'}},
+
+    {CMD_SCROLL_UP, {'k'}},
+    {CMD_SCROLL_UP, {KEY_UP}},
+    {CMD_SCROLL_DOWN, {'j'}},
+    {CMD_SCROLL_DOWN, {KEY_DOWN}},
+    {CMD_PAGE_UP, {KEY_PPAGE}},
+    {CMD_PAGE_UP, {KEY_CTRL('b')}},
+    {CMD_PAGE_DOWN, {KEY_NPAGE}},
+    {CMD_PAGE_DOWN, {KEY_CTRL('f')}},
+    {CMD_SCROLL_TOP, {'g', 'g'}},
+    {CMD_SCROLL_TOP, {KEY_HOME}},
+    {CMD_SCROLL_BOTTOM, {'G'}},
+    {CMD_SCROLL_BOTTOM, {KEY_END}},
+
+    {CMD_EXPAND, {'l'}},
+    {CMD_EXPAND, {KEY_RIGHT}},
+    {CMD_EXPAND, {KEY_RETURN}},
+    {CMD_COLLAPSE, {'h'}},
+    {CMD_COLLAPSE, {KEY_LEFT}},
+    {CMD_COLLAPSE, {KEY_BACKSPACE}},
+
+    {CMD_FILTER, {'/'}},
+    {CMD_FUZZY, {'f'}},
+
+    {CMD_VOLUME_UP, {'+'}},
+    {CMD_VOLUME_UP, {'='}},
+    {CMD_VOLUME_DOWN, {'-'}},
+    {CMD_SEEK_FORWARD, {']'}},
+    {CMD_SEEK_BACKWARD, {'['}},
+
+    {CMD_DELETE, {'d'}},
+};
 
-    {CMD_HELP, {'1', 0, 0}, "Help", "Display the help screen."},
+/**
+ * @brief The names of keys that aren't shown as the character they type.
+ */
+static const struct {
+    int key;
+    const char *name;
+} key_names[] = {
+    {KEY_RETURN, "Enter"},  {KEY_BACKSPACE, "Backspace"}, {KEY_RIGHT, "Right"},
+    {KEY_LEFT, "Left"},     {KEY_UP, "Up"},               {KEY_DOWN, "Down"},
+    {KEY_PPAGE, "PageUp"},  {KEY_NPAGE, "PageDown"},      {KEY_HOME, "Home"},
+    {KEY_END, "End"},       {KEY_TAB, "Tab"},             {KEY_ESCAPE, "Esc"},
+    {' ', "Space"},         {'<', "lt"},                  {KEY_F(1), "F1"},
+    {KEY_F(2), "F2"},       {KEY_F(3), "F3"},             {KEY_F(4), "F4"},
+    {KEY_F(5), "F5"},       {KEY_F(6), "F6"},             {KEY_F(7), "F7"},
+    {KEY_F(8), "F8"},       {KEY_F(9), "F9"},             {KEY_F(10), "F10"},
+    {KEY_F(11), "F11"},     {KEY_F(12), "F12"},
+};
 
-    {CMD_QUEUE, {'2', 0, 0}, "Queue", "Display the queue screen."},
+/**
+ * @brief Gets the built-in key bindings.
+ *
+ * @param count Set to the number of bindings.
+ *
+ * @return The bindings.
+ */
+const struct key_binding *get_default_bindings(unsigned *count)
+{
+    *count = sizeof(default_bindings) / sizeof(*default_bindings);
+    return default_bindings;
+}
 
-    {CMD_LIBRARY, {'3', 0, 0}, "Library", "Display the library screen."}};
+/**
+ * @brief Gets a command's name.
+ */
+char *get_command_name(enum command_type cmd_type)
+{
+    return commands[cmd_type].name;
+}
+
+/**
+ * @brief Gets a command's description.
+ */
+char *get_command_desc(enum command_type cmd_type)
+{
+    return commands[cmd_type].description;
+}
 
 /**
- * @brief Finds the command mapped to a given key.
+ * @brief Looks up a command by name, ignoring case and treating '_' and '-' as spaces.
  *
- * @param key The key that was pressed by the user.
+ * @param name The name, such as "page_down".
+ * @param length The length of @p name.
  *
- * @return The command mapped to the key.
+ * @return The command, or NUM_CMDS if there is none by that name.
  */
-enum command_type find_key_command(int key)
+enum command_type find_command(const char *name, size_t length)
 {
-    if (key == 0) {
-        return CMD_NULL;
-    }
-
-    for (int i = 0; i < NUM_CMDS; ++i) {     /* Search each command. */
-        for (int j = 0; j < MAX_KEYS; ++j) { /* Search each key mapped to the command. */
-            if (key == commands[i].keys[j]) {
-                return commands[i].cmd_type;
+    for (int i = 0; i < NUM_CMDS; ++i) {
+        const char *candidate = commands[i].name;
+        size_t j = 0;
+
+        for (; j < length && candidate[j]; ++j) {
+            char c = name[j] == '_' || name[j] == '-' ? ' ' : name[j];
+            if (tolower((unsigned char)c) != tolower((unsigned char)candidate[j])) {
+                break;
             }
         }
+        if (j == length && !candidate[j]) {
+            return commands[i].cmd_type;
+        }
     }
 
-    return CMD_NULL;
+    return NUM_CMDS;
 }
 
 /**
- * @brief Gets a string representation of the keys mapped to a command.
+ * @brief Finds the key code of a key's name, as written by key_to_str().
+ *
+ * @param name The name, such as "PageDown", "Ctrl-d" or "x".
+ * @param length The length of @p name.
+ *
+ * @return The key code, or 0 if the name isn't known.
  */
-void get_command_keys(enum command_type cmd_type, char *buffer)
+int key_from_str(const char *name, size_t length)
 {
-    int *keys = commands[cmd_type].keys;
-    char *key_str = malloc(sizeof(char) * 16);
-
-    if (!key_str) {
-        return;
+    for (size_t i = 0; i < sizeof(key_names) / sizeof(*key_names); ++i) {
+        if (strlen(key_names[i].name) == length &&
+            strncasecmp(key_names[i].name, name, length) == 0) {
+            return key_names[i].key;
+        }
     }
 
-    key_to_str(keys[0], key_str);
-    strcpy(buffer, key_str);  // NOLINT
-
-    if (keys[1] != 0) {
-        key_to_str(keys[1], key_str);
-        strcat(buffer, " ");      // NOLINT
-        strcat(buffer, key_str);  // NOLINT
+    if (length == strlen("Ctrl-a") && strncasecmp(name, "Ctrl-", strlen("Ctrl-")) == 0 &&
+        isalpha((unsigned char)name[length - 1])) {
+        return KEY_CTRL(name[length - 1]);
     }
-    if (keys[2] != 0) {
-        key_to_str(keys[2], key_str);
-        strcat(buffer, " ");      // NOLINT
-        strcat(buffer, key_str);  // NOLINT
+    if (length == 1) {
+        return (unsigned char)name[0];
     }
 
-    free(key_str);
-}
-
-/**
- * @brief Gets a command's description.
- */
-char *get_command_desc(enum command_type cmd_type)
-{
-    return commands[cmd_type].description;
+    return 0;
 }
 
 /**
  * @brief Creates a string representation of a keypress.
+ *
+ * @param key The key.
+ * @param buffer Filled with the name of the key.
+ * @param size The size of @p buffer.
  */
-void key_to_str(int key, char *buffer)
+void key_to_str(int key, char *buffer, size_t size)
 {
-    char *str;
-    switch (key) {
-        case 0:
-            str = NULL;
-            break;
-        case KEY_RETURN:
-            str = "Enter";
-            break;
-        case KEY_BACKSPACE:
-            str = "Backspace";
-            break;
-        case KEY_RIGHT:
-            str = "Right";
-            break;
-        case KEY_LEFT:
-            str = "Left";
-            break;
-        case KEY_UP:
-            str = "Up";
-            break;
-        case KEY_DOWN:
-            str = "Down";
-            break;
-        case KEY_PPAGE:
-            str = "PageUp";
-            break;
-        case KEY_NPAGE:
-            str = "PageDown";
-            break;
-        case KEY_HOME:
-            str = "Home";
-            break;
-        case KEY_END:
-            str = "End";
-            break;
-        case KEY_F(1):
-            str = "F1";
-            break;
-        case KEY_F(2):
-            str = "F2";
-            break;
-        case KEY_F(3):
-            str = "F3";
-            break;
-        case KEY_F(4):
-            str = "F4";
-            break;
-        case KEY_F(5):
-            str = "F5";
-            break;
-        case KEY_F(6):
-            str = "F6";
-            break;
-        case KEY_F(7):
-            str = "F7";
-            break;
-        case KEY_F(8):
-            str = "F8";
-            break;
-        case KEY_F(9):
-            str = "F9";
-            break;
-        case KEY_F(10):
-            str = "F10";
-            break;
-        case KEY_F(11):
-            str = "F11";
-            break;
-        case KEY_F(12):
-            str = "F12";
-            break;
-        default:
-            str = NULL;
-            break;
+    for (size_t i = 0; i < sizeof(key_names) / sizeof(*key_names); ++i) {
+        if (key_names[i].key == key) {
+            snprintf(buffer, size, "%s", key_names[i].name);
+            return;
+        }
     }
 
-    int length;
-    if (str) {
-        length = strlen(str);
-        buffer = realloc(buffer, sizeof(char) * length);
-        strcpy(buffer, str);  // NOLINT
-    }
-    else if (!str && !(key & ~0x1f)) { /* A CTRL combo was pressed */
-        length = strlen("Ctrl-a");
-        buffer = realloc(buffer, sizeof(char) * length + 1);
-        sprintf(buffer, "Ctrl-%c", 'a' + (key & 0x1f) - 1);  // NOLINT
+    if (!(key & ~0x1f)) { /* A CTRL combo was pressed */
+        snprintf(buffer, size, "Ctrl-%c", 'a' + (key & 0x1f) - 1);
     }
     else { /* The key is just one character */
-        buffer = realloc(buffer, sizeof(char) + 1);
-        sprintf(buffer, "%c", key);  // NOLINT
+        snprintf(buffer, size, "%c", key);
     }
 }
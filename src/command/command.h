@@ -24,7 +24,12 @@
 #ifndef COMMAND_H
 #define COMMAND_H
 
-#define MAX_KEYS 3 /* Maximum number of keys a command can be mapped to. */
+#include <stddef.h>
+
+/**
+ * @brief The most keys in one binding, such as 2 for "gg".
+ */
+#define MAX_SEQUENCE 4
 
 enum command_type {
     CMD_NULL,
@@ -32,19 +37,43 @@ enum command_type {
     CMD_HELP,
     CMD_QUEUE,
     CMD_LIBRARY,
+    CMD_SCROLL_UP,
+    CMD_SCROLL_DOWN,
+    CMD_PAGE_UP,
+    CMD_PAGE_DOWN,
+    CMD_SCROLL_TOP,
+    CMD_SCROLL_BOTTOM,
+    CMD_EXPAND,
+    CMD_COLLAPSE,
+    CMD_FILTER,
+    CMD_FUZZY,
+    CMD_VOLUME_UP,
+    CMD_VOLUME_DOWN,
+    CMD_SEEK_FORWARD,
+    CMD_SEEK_BACKWARD,
+    CMD_DELETE,
     NUM_CMDS
 };
 
 struct command {
     enum command_type cmd_type; /** The type of command to execute. */
-    int keys[MAX_KEYS];         /** The keys bound to the command. */
     char *name;                 /** The name of the command. */
     char *description;          /** Brief description of what the command does. */
 };
 
-enum command_type find_key_command(int key);
-void get_command_keys(enum command_type cmd_type, char *buffer);
+/**
+ * @brief A sequence of keys that runs a command.
+ */
+struct key_binding {
+    enum command_type cmd_type; /** The command the keys run. */
+    int keys[MAX_SEQUENCE];     /** The keys, in the order they are typed, ended early by a 0. */
+};
+
+const struct key_binding *get_default_bindings(unsigned *count);
+char *get_command_name(enum command_type cmd_type);
 char *get_command_desc(enum command_type cmd_type);
-void key_to_str(int key, char *buffer);
+enum command_type find_command(const char *name, size_t length);
+int key_from_str(const char *name, size_t length);
+void key_to_str(int key, char *buffer, size_t size);
 
 #endif /* COMMAND_H */
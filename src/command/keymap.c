@@ -0,0 +1,313 @@
+/*******************************************************************************
+ * keymap.c - Maps typed keys and key sequences to commands.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file keymap.h
+ *
+ * @brief Finds the command bound to each key, or each sequence of keys, as it is typed.
+ *
+ * A key that begins a longer binding is held until the rest of it arrives.
+ * If the next key doesn't continue any binding, the held keys are dropped
+ * and the new key is looked up on its own. If nothing arrives, the caller
+ * calls keymap_timeout(), which runs the command bound to the held keys,
+ * if any. That is how a key can be bound both on its own and as the start
+ * of a sequence.
+ */
+
+#include "keymap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Gets a node of the trie.
+ */
+static struct keymap_node *keymap_get_node(struct keymap *keymap, unsigned node)
+{
+    return vector_at(keymap->nodes, node);
+}
+
+/**
+ * @brief Finds the run one key longer than another.
+ *
+ * @param keymap The keymap.
+ * @param parent The shorter run, or 0 to look up a first key.
+ * @param key The next key.
+ *
+ * @return The longer run's node, or 0 if no binding starts with it.
+ */
+static unsigned keymap_find_child(struct keymap *keymap, unsigned parent, int key)
+{
+    if (!parent) {
+        return key > 0 && key < KEYMAP_KEYS ? keymap->roots[key] : 0;
+    }
+
+    unsigned child = keymap_get_node(keymap, parent)->first_child;
+    while (child && keymap_get_node(keymap, child)->key != key) {
+        child = keymap_get_node(keymap, child)->next_sibling;
+    }
+
+    return child;
+}
+
+/**
+ * @brief Adds a run one key longer than another.
+ *
+ * @return The new run's node, or 0 if memory ran out.
+ */
+static unsigned keymap_add_child(struct keymap *keymap, unsigned parent, int key)
+{
+    struct keymap_node node = {key, parent, 0, 0, CMD_NULL};
+    unsigned index = vector_get_length(keymap->nodes);
+
+    if (parent) {
+        node.next_sibling = keymap_get_node(keymap, parent)->first_child;
+    }
+    if (vector_push(keymap->nodes, &node) != VEC_ERROR_SUCCESS) {
+        return 0;
+    }
+
+    if (parent) {
+        keymap_get_node(keymap, parent)->first_child = index;
+    }
+    else {
+        keymap->roots[key] = index;
+    }
+
+    return index;
+}
+
+/**
+ * @brief Creates a keymap holding the default bindings.
+ *
+ * @return A newly-allocated keymap, or NULL on error.
+ */
+struct keymap *keymap_new(void)
+{
+    struct keymap *keymap = calloc(1, sizeof(*keymap));
+    if (!keymap) {
+        return NULL;
+    }
+
+    /* Node 0 stands for "no node", so the trie starts with a placeholder. */
+    struct keymap_node placeholder = {0, 0, 0, 0, CMD_NULL};
+    keymap->nodes = vector_new(sizeof(struct keymap_node));
+    if (!keymap->nodes || vector_push(keymap->nodes, &placeholder) != VEC_ERROR_SUCCESS) {
+        keymap_free(keymap);
+        return NULL;
+    }
+
+    unsigned count;
+    const struct key_binding *bindings = get_default_bindings(&count);
+    if (keymap_bind_all(keymap, bindings, count) != 0) {
+        keymap_free(keymap);
+        return NULL;
+    }
+
+    return keymap;
+}
+
+/**
+ * @brief Frees a keymap.
+ *
+ * @param keymap The keymap to free.
+ */
+void keymap_free(struct keymap *keymap)
+{
+    if (!keymap) {
+        return;
+    }
+
+    vector_free(keymap->nodes, NULL);
+    free(keymap);
+}
+
+/**
+ * @brief Binds a sequence of keys to a command, replacing whatever it was bound to.
+ *
+ * @param keymap The keymap to add the binding to.
+ * @param keys The keys, in the order they are typed.
+ * @param count The number of keys, at most @ref MAX_SEQUENCE.
+ * @param cmd_type The command to run, or CMD_NULL to leave the keys unbound.
+ *
+ * @return 0 on success, or -1 if the sequence is invalid or memory ran out.
+ */
+int keymap_bind(struct keymap *keymap, const int *keys, unsigned count,
+                enum command_type cmd_type)
+{
+    if (count == 0 || count > MAX_SEQUENCE) {
+        return -1;
+    }
+    for (unsigned i = 0; i < count; ++i) {
+        if (keys[i] <= 0 || keys[i] >= KEYMAP_KEYS) {
+            return -1;
+        }
+    }
+
+    unsigned node = 0;
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned child = keymap_find_child(keymap, node, keys[i]);
+        if (!child) {
+            child = keymap_add_child(keymap, node, keys[i]);
+        }
+        if (!child) {
+            return -1;
+        }
+        node = child;
+    }
+
+    keymap_get_node(keymap, node)->cmd_type = cmd_type;
+    keymap->pending = 0;
+
+    return 0;
+}
+
+/**
+ * @brief Binds each of a list of key sequences, later ones replacing earlier ones.
+ *
+ * @param keymap The keymap to add the bindings to.
+ * @param bindings The bindings.
+ * @param count The number of bindings.
+ *
+ * @return 0 on success, or -1 if a sequence is invalid or memory ran out.
+ */
+int keymap_bind_all(struct keymap *keymap, const struct key_binding *bindings, unsigned count)
+{
+    for (unsigned i = 0; i < count; ++i) {
+        unsigned length = 0;
+        while (length < MAX_SEQUENCE && bindings[i].keys[length]) {
+            ++length;
+        }
+
+        if (keymap_bind(keymap, bindings[i].keys, length, bindings[i].cmd_type) != 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Looks up a typed key, along with any keys typed just before it.
+ *
+ * @param keymap The keymap.
+ * @param key The key that was pressed.
+ *
+ * @return The command the keys typed so far are bound to, or CMD_NULL if
+ * there is none, or if they begin a longer binding. In the latter case,
+ * keymap_is_pending() is true until another key is pressed or the caller
+ * gives up waiting with keymap_timeout().
+ */
+enum command_type keymap_press(struct keymap *keymap, int key)
+{
+    unsigned node = keymap_find_child(keymap, keymap->pending, key);
+    if (!node && keymap->pending) {
+        node = keymap_find_child(keymap, 0, key);
+    }
+    keymap->pending = 0;
+
+    if (!node) {
+        return CMD_NULL;
+    }
+
+    struct keymap_node *found = keymap_get_node(keymap, node);
+    if (found->first_child) {
+        keymap->pending = node;
+        return CMD_NULL;
+    }
+
+    return found->cmd_type;
+}
+
+/**
+ * @brief Stops waiting for the rest of a key sequence.
+ *
+ * @param keymap The keymap.
+ *
+ * @return The command bound to the keys typed so far on their own, or CMD_NULL if there is none.
+ */
+enum command_type keymap_timeout(struct keymap *keymap)
+{
+    unsigned node = keymap->pending;
+    keymap->pending = 0;
+
+    return node ? keymap_get_node(keymap, node)->cmd_type : CMD_NULL;
+}
+
+/**
+ * @brief Checks whether the keys typed so far begin a longer binding.
+ */
+int keymap_is_pending(struct keymap *keymap)
+{
+    return keymap->pending != 0;
+}
+
+/**
+ * @brief Gets a string representation of the key sequences bound to a command.
+ *
+ * Sequences are separated by spaces, and the keys within one are run
+ * together, with named keys in angle brackets, as in "gg <Home>". That is
+ * how bindings are written in the config file.
+ *
+ * @param keymap The keymap.
+ * @param cmd_type The command.
+ * @param buffer Filled with the sequences. Any that don't fit are left out.
+ * @param size The size of @p buffer.
+ */
+void keymap_get_keys(struct keymap *keymap, enum command_type cmd_type, char *buffer, size_t size)
+{
+    unsigned num_nodes = vector_get_length(keymap->nodes);
+    size_t used = 0;
+
+    if (!size) {
+        return;
+    }
+    buffer[0] = '\0';
+
+    for (unsigned node = 1; node < num_nodes; ++node) {
+        if (keymap_get_node(keymap, node)->cmd_type != cmd_type) {
+            continue;
+        }
+
+        /* The keys are found from last to first, by walking up the trie. */
+        int keys[MAX_SEQUENCE];
+        unsigned count = 0;
+        for (unsigned up = node; up && count < MAX_SEQUENCE; ++count) {
+            keys[count] = keymap_get_node(keymap, up)->key;
+            up = keymap_get_node(keymap, up)->parent;
+        }
+
+        char sequence[64] = "";
+        size_t length = 0;
+        while (count-- && length < sizeof(sequence)) {
+            char name[16];
+            key_to_str(keys[count], name, sizeof(name));
+            length += snprintf(sequence + length, sizeof(sequence) - length,
+                               strlen(name) > 1 ? "<%s>" : "%s", name);
+        }
+
+        int written = snprintf(buffer + used, size - used, used ? " %s" : "%s", sequence);
+        if (written < 0 || (size_t)written >= size - used) {
+            buffer[used] = '\0';
+            return;
+        }
+        used += written;
+    }
+}
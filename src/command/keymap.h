@@ -0,0 +1,75 @@
+/*******************************************************************************
+ * keymap.h - Maps typed keys and key sequences to commands.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file keymap.h
+ */
+
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <curses.h>
+#include <stddef.h>
+
+#include "command.h"
+#include "pantomime/vector.h"
+
+/**
+ * @brief The keys the first key of a binding is looked up among directly: every curses key code.
+ */
+#define KEYMAP_KEYS (KEY_MAX + 1)
+
+/**
+ * @brief A run of keys that is bound to a command, or begins a longer binding, or both.
+ */
+struct keymap_node {
+    int key;                    /** The last key of the run. */
+    unsigned parent;            /** The run one key shorter, or 0 for the first key. */
+    unsigned first_child;       /** The first run one key longer, or 0 if there is none. */
+    unsigned next_sibling;      /** The next run with the same parent, or 0 if there is none. */
+    enum command_type cmd_type; /** The command the run is bound to, or CMD_NULL. */
+};
+
+/**
+ * @brief Turns keys into commands as they are typed.
+ *
+ * Bindings form a trie. Its first level is a table indexed by key code, so
+ * a single key costs one lookup however many bindings there are. Later keys
+ * of a sequence are found among the few children of the run typed so far.
+ */
+struct keymap {
+    unsigned roots[KEYMAP_KEYS]; /** The node of each first key, or 0 if it isn't bound. */
+    struct vector *nodes;        /** The nodes of the trie, as @ref keymap_node. Node 0 is unused. */
+    unsigned pending;            /** The node of the keys typed so far, or 0 if there are none. */
+};
+
+struct keymap *keymap_new(void);
+void keymap_free(struct keymap *keymap);
+
+int keymap_bind(struct keymap *keymap, const int *keys, unsigned count,
+                enum command_type cmd_type);
+int keymap_bind_all(struct keymap *keymap, const struct key_binding *bindings, unsigned count);
+
+enum command_type keymap_press(struct keymap *keymap, int key);
+enum command_type keymap_timeout(struct keymap *keymap);
+int keymap_is_pending(struct keymap *keymap);
+
+void keymap_get_keys(struct keymap *keymap, enum command_type cmd_type, char *buffer, size_t size);
+
+#endif /* KEYMAP_H */
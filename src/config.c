@@ -0,0 +1,558 @@
+/*******************************************************************************
+ * config.c - Settings and key bindings read from the config file
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file config.h
+ *
+ * @brief Reads the config file.
+ *
+ * The file is read once, at startup. Each line is empty, a comment starting
+ * with '#', or one of:
+ *
+ *     name = value
+ *     bind KEYS COMMAND
+ *     unbind KEYS
+ *
+ * KEYS are typed in order, such as "gg". Keys that don't type a character
+ * are named between angle brackets, such as "<PageDown>" or "<Ctrl-d>", and
+ * "<lt>" stands for '<'. COMMAND is a command's name as shown on the help
+ * screen, such as "page down" or "page_down". A line that can't be used is
+ * skipped, so a mistake costs one setting rather than the whole file.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "config.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "command/keymap.h"
+#include "pantomime/mpd/library_index.h"
+#include "pantomime/mpd/pagecache.h"
+
+/**
+ * @brief The default host, used unless the file or the command line names another.
+ */
+#define DEFAULT_HOST "localhost"
+
+/**
+ * @brief The default port.
+ */
+#define DEFAULT_PORT 6600
+
+/**
+ * @brief The default time to wait for the rest of a key sequence, in milliseconds.
+ */
+#define DEFAULT_KEY_TIMEOUT 1000
+
+/**
+ * @brief The default pause after volume and seek keys before sending them, in milliseconds.
+ *
+ * A held-down key repeats about 30 times a second, well within this, so a
+ * hold is sent once it ends, while a single press is still answered quickly.
+ */
+#define DEFAULT_CONTROL_DELAY 150
+
+/**
+ * @brief The default longest time volume and seek keys are held back, in milliseconds.
+ *
+ * This keeps a long hold audible once a second, at a handful of round trips in all.
+ */
+#define DEFAULT_CONTROL_MAX_WAIT 1000
+
+/**
+ * @brief The largest memory budget accepted, in megabytes.
+ */
+#define MAX_BUDGET_MB (1 << 20)
+
+/**
+ * @brief The names of the fields a queue column can show, indexed by field.
+ */
+static const char *const column_names[NUM_COLUMN_FIELDS] = {"artist", "title", "album"};
+
+/**
+ * @brief Parses a whole string as a number no larger than @p max.
+ *
+ * @return 0 on success, or -1 if @p value isn't such a number.
+ */
+static int parse_number(const char *value, unsigned long max, unsigned long *result)
+{
+    char *end;
+
+    if (!isdigit((unsigned char)*value)) {
+        return -1;
+    }
+    errno = 0;
+    *result = strtoul(value, &end, 10);
+    if (errno || *end || *result > max) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static int parse_host(struct config *config, const char *value)
+{
+    char *host = strdup(value);
+    if (!host) {
+        return -1;
+    }
+
+    free(config->host);
+    config->host = host;
+
+    return 0;
+}
+
+static int parse_port(struct config *config, const char *value)
+{
+    unsigned long port;
+    if (parse_number(value, 65535, &port) != 0 || port == 0) {
+        return -1;
+    }
+
+    config->port = (int)port;
+    return 0;
+}
+
+static int parse_threads(struct config *config, const char *value)
+{
+    unsigned long threads;
+    if (parse_number(value, 1024, &threads) != 0) {
+        return -1;
+    }
+
+    config->threads = threads;
+    return 0;
+}
+
+static int parse_queue_budget(struct config *config, const char *value)
+{
+    unsigned long mb;
+    if (parse_number(value, MAX_BUDGET_MB, &mb) != 0) {
+        return -1;
+    }
+
+    config->queue_budget = (size_t)mb << 20;
+    return 0;
+}
+
+static int parse_index_budget(struct config *config, const char *value)
+{
+    unsigned long mb;
+    if (parse_number(value, MAX_BUDGET_MB, &mb) != 0) {
+        return -1;
+    }
+
+    config->index_budget = (size_t)mb << 20;
+    return 0;
+}
+
+static int parse_prefetch_margin(struct config *config, const char *value)
+{
+    unsigned long margin;
+    if (parse_number(value, 1 << 20, &margin) != 0) {
+        return -1;
+    }
+
+    config->prefetch_margin = margin;
+    return 0;
+}
+
+static int parse_page_lines(struct config *config, const char *value)
+{
+    unsigned long lines;
+    if (parse_number(value, 1 << 20, &lines) != 0) {
+        return -1;
+    }
+
+    config->page_lines = lines;
+    return 0;
+}
+
+static int parse_key_timeout(struct config *config, const char *value)
+{
+    unsigned long timeout;
+    if (parse_number(value, 60000, &timeout) != 0 || timeout == 0) {
+        return -1;
+    }
+
+    config->key_timeout = timeout;
+    return 0;
+}
+
+static int parse_control_delay(struct config *config, const char *value)
+{
+    unsigned long delay;
+    if (parse_number(value, 10000, &delay) != 0) {
+        return -1;
+    }
+
+    config->control_delay = delay;
+    return 0;
+}
+
+static int parse_control_max_wait(struct config *config, const char *value)
+{
+    unsigned long wait;
+    if (parse_number(value, 60000, &wait) != 0) {
+        return -1;
+    }
+
+    config->control_max_wait = wait;
+    return 0;
+}
+
+/**
+ * @brief Parses the queue's columns, such as "artist:3 title:4 album:3".
+ *
+ * Each column is a field's name, optionally followed by a colon and its
+ * weight, which defaults to 1.
+ */
+static int parse_columns(struct config *config, const char *value)
+{
+    struct queue_column columns[QUEUE_MAX_COLUMNS];
+    unsigned count = 0;
+
+    while (*value) {
+        size_t length = strcspn(value, ": \t");
+        unsigned field = 0;
+        while (field < NUM_COLUMN_FIELDS &&
+               (strlen(column_names[field]) != length ||
+                strncmp(column_names[field], value, length) != 0)) {
+            ++field;
+        }
+        if (field == NUM_COLUMN_FIELDS || count == QUEUE_MAX_COLUMNS) {
+            return -1;
+        }
+        value += length;
+
+        unsigned long weight = 1;
+        if (*value == ':') {
+            char *end;
+            if (!isdigit((unsigned char)value[1])) {
+                return -1;
+            }
+            weight = strtoul(value + 1, &end, 10);
+            if (weight == 0 || weight > 100) {
+                return -1;
+            }
+            value = end;
+        }
+
+        columns[count].field = field;
+        columns[count].weight = weight;
+        ++count;
+
+        value += strspn(value, " \t");
+    }
+
+    if (count == 0) {
+        return -1;
+    }
+
+    memcpy(config->columns, columns, sizeof(*columns) * count);  // NOLINT
+    config->num_columns = count;
+
+    return 0;
+}
+
+/**
+ * @brief The settings that can be given as "name = value".
+ */
+static const struct {
+    const char *name;
+    int (*parse)(struct config *config, const char *value);
+} settings[] = {
+    {"host", parse_host},
+    {"port", parse_port},
+    {"threads", parse_threads},
+    {"queue_budget", parse_queue_budget},
+    {"index_budget", parse_index_budget},
+    {"prefetch_margin", parse_prefetch_margin},
+    {"page_lines", parse_page_lines},
+    {"key_timeout", parse_key_timeout},
+    {"control_delay", parse_control_delay},
+    {"control_max_wait", parse_control_max_wait},
+    {"columns", parse_columns},
+};
+
+/**
+ * @brief Creates a config holding the default settings and no extra key bindings.
+ *
+ * @return A newly-allocated config, or NULL on error.
+ */
+struct config *config_new(void)
+{
+    struct config *config = calloc(1, sizeof(*config));
+    if (!config) {
+        return NULL;
+    }
+
+    config->host = strdup(DEFAULT_HOST);
+    config->bindings = vector_new(sizeof(struct key_binding));
+    if (!config->host || !config->bindings) {
+        config_free(config);
+        return NULL;
+    }
+
+    config->port = DEFAULT_PORT;
+    config->threads = 0;
+    config->queue_budget = 0;
+    config->index_budget = LIBRARY_INDEX_BUDGET;
+    config->prefetch_margin = QUEUE_PAGE_SIZE;
+    config->page_lines = 0;
+    config->key_timeout = DEFAULT_KEY_TIMEOUT;
+    config->control_delay = DEFAULT_CONTROL_DELAY;
+    config->control_max_wait = DEFAULT_CONTROL_MAX_WAIT;
+
+    for (unsigned i = 0; i < NUM_COLUMN_FIELDS; ++i) {
+        config->columns[i].field = i;
+        config->columns[i].weight = i == COLUMN_TITLE ? 4 : 3;
+    }
+    config->num_columns = NUM_COLUMN_FIELDS;
+
+    return config;
+}
+
+/**
+ * @brief Frees a config.
+ *
+ * @param config The config to free.
+ */
+void config_free(struct config *config)
+{
+    if (!config) {
+        return;
+    }
+
+    free(config->host);
+    vector_free(config->bindings, NULL);
+    free(config);
+}
+
+/**
+ * @brief Gets the path of the config file: "pantomime/config" in the XDG config directory.
+ *
+ * @return A newly-allocated path, or NULL if there is no home directory or memory ran out.
+ */
+char *config_get_path(void)
+{
+    const char *base = getenv("XDG_CONFIG_HOME");
+    const char *suffix = "";
+    if (!base || !*base) {
+        base = getenv("HOME");
+        suffix = "/.config";
+    }
+    if (!base || !*base) {
+        return NULL;
+    }
+
+    size_t size = strlen(base) + strlen(suffix) + strlen("/pantomime/config") + 1;
+    char *path = malloc(size);
+    if (path) {
+        snprintf(path, size, "%s%s/pantomime/config", base, suffix);  // NOLINT
+    }
+
+    return path;
+}
+
+/**
+ * @brief Notes that a line couldn't be used. Only the first such line is described.
+ */
+static void config_error(struct config *config, unsigned line, const char *format, ...)
+{
+    if (config->num_errors++) {
+        return;
+    }
+
+    va_list args;
+    int length = snprintf(config->error, sizeof(config->error), "line %u: ", line);  // NOLINT
+    va_start(args, format);
+    vsnprintf(config->error + length, sizeof(config->error) - length, format, args);  // NOLINT
+    va_end(args);
+}
+
+/**
+ * @brief Parses the keys of a binding, such as "gg" or "<Ctrl-d>".
+ *
+ * @param text The keys.
+ * @param length The length of @p text.
+ * @param binding Its keys are set, and ended with a 0 if there are fewer than @ref MAX_SEQUENCE.
+ *
+ * @return 0 on success, or -1 if a key is unknown or there are too many.
+ */
+static int config_parse_keys(const char *text, size_t length, struct key_binding *binding)
+{
+    unsigned count = 0;
+    size_t i = 0;
+
+    memset(binding->keys, 0, sizeof(binding->keys));  // NOLINT
+    while (i < length) {
+        int key;
+        if (text[i] == '<' && i + 1 < length) {
+            const char *close = memchr(text + i + 1, '>', length - i - 1);
+            if (!close) {
+                return -1;
+            }
+            key = key_from_str(text + i + 1, close - text - i - 1);
+            i = close - text + 1;
+        }
+        else {
+            key = (unsigned char)text[i++];
+        }
+
+        if (key <= 0 || key >= KEYMAP_KEYS || count == MAX_SEQUENCE) {
+            return -1;
+        }
+        binding->keys[count++] = key;
+    }
+
+    return count ? 0 : -1;
+}
+
+/**
+ * @brief Parses a "bind KEYS COMMAND" or "unbind KEYS" line.
+ *
+ * @param config The config to add the binding to.
+ * @param line The line's number, for errors.
+ * @param args The rest of the line, after "bind" or "unbind" and any blanks.
+ * @param bind Whether the line binds the keys, rather than unbinding them.
+ */
+static void config_parse_binding(struct config *config, unsigned line, const char *args, int bind)
+{
+    struct key_binding binding;
+    size_t length = strcspn(args, " \t");
+    const char *name = args + length + strspn(args + length, " \t");
+
+    if (config_parse_keys(args, length, &binding) != 0) {
+        config_error(config, line, "bad keys \"%.*s\"", (int)length, args);
+        return;
+    }
+
+    binding.cmd_type = CMD_NULL;
+    if (bind) {
+        binding.cmd_type = find_command(name, strlen(name));
+        if (binding.cmd_type == NUM_CMDS) {
+            config_error(config, line, "unknown command \"%s\"", name);
+            return;
+        }
+    }
+    else if (*name) {
+        config_error(config, line, "unexpected \"%s\"", name);
+        return;
+    }
+
+    if (vector_push(config->bindings, &binding) != VEC_ERROR_SUCCESS) {
+        config_error(config, line, "out of memory");
+    }
+}
+
+/**
+ * @brief Parses one line of the file, with surrounding blanks already removed.
+ */
+static void config_parse_line(struct config *config, unsigned line, char *text)
+{
+    size_t word = strcspn(text, " \t=");
+    const char *args = text + word + strspn(text + word, " \t");
+
+    if (word == strlen("bind") && strncmp(text, "bind", word) == 0 && *args != '=') {
+        config_parse_binding(config, line, args, 1);
+        return;
+    }
+    if (word == strlen("unbind") && strncmp(text, "unbind", word) == 0 && *args != '=') {
+        config_parse_binding(config, line, args, 0);
+        return;
+    }
+
+    if (*args != '=') {
+        config_error(config, line, "expected \"name = value\"");
+        return;
+    }
+    text[word] = '\0';
+    args += 1 + strspn(args + 1, " \t");
+
+    for (size_t i = 0; i < sizeof(settings) / sizeof(*settings); ++i) {
+        if (strcmp(settings[i].name, text) == 0) {
+            if (settings[i].parse(config, args) != 0) {
+                config_error(config, line, "bad value for %s: \"%s\"", text, args);
+            }
+            return;
+        }
+    }
+
+    config_error(config, line, "unknown setting \"%s\"", text);
+}
+
+/**
+ * @brief Reads a config file, replacing the settings it mentions.
+ *
+ * The time taken is stored in @ref config::parse_ms, and lines that
+ * couldn't be used are counted in @ref config::num_errors.
+ *
+ * @param config The config to update.
+ * @param path The file's path.
+ * @param required Whether a missing file is an error, rather than leaving the defaults alone.
+ *
+ * @return 0 on success, or -1 if the file couldn't be read.
+ */
+int config_load(struct config *config, const char *path, int required)
+{
+    struct timespec start;
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return errno == ENOENT && !required ? 0 : -1;
+    }
+
+    char *text = NULL;
+    size_t size = 0;
+    ssize_t length;
+    unsigned line = 0;
+
+    while ((length = getline(&text, &size, file)) >= 0) {
+        ++line;
+        while (length > 0 && isspace((unsigned char)text[length - 1])) {
+            text[--length] = '\0';
+        }
+        char *start_of_text = text + strspn(text, " \t");
+        if (*start_of_text && *start_of_text != '#') {
+            config_parse_line(config, line, start_of_text);
+        }
+    }
+
+    int status = ferror(file) ? -1 : 0;
+    free(text);
+    fclose(file);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    config->parse_ms =
+        (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    config->loaded = status == 0;
+
+    return status;
+}
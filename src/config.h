@@ -0,0 +1,74 @@
+/*******************************************************************************
+ * config.h - Settings and key bindings read from the config file
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file config.h
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+
+#include "command/command.h"
+#include "pantomime/ui/queue_screen.h"
+#include "pantomime/vector.h"
+
+/**
+ * @brief Room for the description of a config file error.
+ */
+#define CONFIG_ERROR_SIZE 128
+
+/**
+ * @brief Holds the settings and key bindings read from a config file.
+ *
+ * Settings the file doesn't mention keep their defaults. Everything is
+ * parsed once at startup into these fields, so nothing is looked up by
+ * name afterwards.
+ */
+struct config {
+    char *host;               /** The MPD host. */
+    int port;                 /** The MPD port. */
+    unsigned threads;         /** Threads for the library, or 0 for one per CPU. */
+    size_t queue_budget;      /** Memory budget in bytes for lazily loading the queue, or 0. */
+    size_t index_budget;      /** Memory budget in bytes for the library's search index, or 0. */
+    unsigned prefetch_margin; /** Songs to load on either side of the visible ones. */
+    unsigned page_lines;      /** Lines moved by a page up or down, or 0 for a windowful. */
+    unsigned key_timeout;     /** How long to wait for the rest of a key sequence, in ms. */
+    unsigned control_delay;   /** The pause in control and edit keys that sends them, in ms. */
+    unsigned control_max_wait; /** The longest control and edit keys are held back, in ms. */
+
+    struct queue_column columns[QUEUE_MAX_COLUMNS]; /** The queue's columns, left to right. */
+    unsigned num_columns;                           /** The number of @ref columns. */
+
+    struct vector *bindings; /** Key bindings added to the defaults, as @ref key_binding. */
+
+    int loaded;                    /** Whether a config file was read. */
+    double parse_ms;               /** How long reading and parsing the file took. */
+    unsigned num_errors;           /** The number of lines that couldn't be used. */
+    char error[CONFIG_ERROR_SIZE]; /** A description of the first of them. */
+};
+
+struct config *config_new(void);
+void config_free(struct config *config);
+
+char *config_get_path(void);
+int config_load(struct config *config, const char *path, int required);
+
+#endif /* CONFIG_H */
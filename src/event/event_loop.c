@@ -0,0 +1,249 @@
+/*******************************************************************************
+ * event_loop.c - Multiplexes terminal input, MPD events, timers and signals.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file event_loop.h
+ *
+ * @brief A small epoll-based loop that lets the program sleep until something happens.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "event_loop.h"
+
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_EVENTS 8
+
+/**
+ * @brief Gets the current monotonic time in milliseconds.
+ */
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Registers a file descriptor with the loop's epoll instance.
+ *
+ * The event source is stored in the epoll data so that event_loop_wait()
+ * can map ready descriptors back to @ref event_source values.
+ */
+static int event_loop_watch(struct event_loop *loop, int fd, unsigned source)
+{
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.u32 = source;
+
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/**
+ * @brief Arms the timerfd for the earliest pending deadline, or disarms it if there is none.
+ */
+static void event_loop_arm(struct event_loop *loop)
+{
+    long long earliest = 0;
+    for (int i = 0; i < NUM_TIMERS; ++i) {
+        if (loop->deadlines[i] && (!earliest || loop->deadlines[i] < earliest)) {
+            earliest = loop->deadlines[i];
+        }
+    }
+
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = earliest / 1000;
+    spec.it_value.tv_nsec = (earliest % 1000) * 1000000;
+
+    timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+/**
+ * @brief Creates a new event loop.
+ *
+ * SIGWINCH is blocked for the calling thread so that it is only ever
+ * delivered through the loop's signalfd. Call this before starting any
+ * threads so that they inherit the signal mask.
+ *
+ * @param input_fd The terminal's input file descriptor.
+ * @param mpd_fd The MPD connection's socket, or -1 to not watch one.
+ *
+ * @return A newly-allocated event loop, or NULL on error.
+ */
+struct event_loop *event_loop_new(int input_fd, int mpd_fd)
+{
+    struct event_loop *loop = malloc(sizeof(*loop));
+    if (!loop) {
+        return NULL;
+    }
+
+    loop->expired = 0;
+    for (int i = 0; i < NUM_TIMERS; ++i) {
+        loop->deadlines[i] = 0;
+    }
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    sigprocmask(SIG_BLOCK, &mask, NULL);
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    loop->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    if (loop->epoll_fd < 0 || loop->timer_fd < 0 || loop->signal_fd < 0) {
+        event_loop_free(loop);
+        return NULL;
+    }
+
+    int err = event_loop_watch(loop, input_fd, EVENT_INPUT);
+    err |= event_loop_watch(loop, loop->timer_fd, EVENT_TIMER);
+    err |= event_loop_watch(loop, loop->signal_fd, EVENT_RESIZE);
+    if (mpd_fd >= 0) {
+        err |= event_loop_watch(loop, mpd_fd, EVENT_MPD);
+    }
+
+    if (err) {
+        event_loop_free(loop);
+        return NULL;
+    }
+
+    return loop;
+}
+
+/**
+ * @brief Closes all descriptors owned by an event loop and frees its memory.
+ *
+ * @param loop The event loop to free.
+ */
+void event_loop_free(struct event_loop *loop)
+{
+    if (!loop) {
+        return;
+    }
+
+    if (loop->epoll_fd >= 0) {
+        close(loop->epoll_fd);
+    }
+    if (loop->timer_fd >= 0) {
+        close(loop->timer_fd);
+    }
+    if (loop->signal_fd >= 0) {
+        close(loop->signal_fd);
+    }
+
+    free(loop);
+}
+
+/**
+ * @brief Sleeps until at least one event source is ready.
+ *
+ * Timer and signal notifications are consumed here. Terminal input and MPD
+ * data are left for the caller to read. Expired timers are recorded in
+ * @ref event_loop::expired and can be checked with event_loop_timer_expired().
+ *
+ * @param loop The event loop to wait on.
+ *
+ * @return A bitmask of @ref event_source values, or 0 if the wait was interrupted.
+ */
+unsigned event_loop_wait(struct event_loop *loop)
+{
+    struct epoll_event events[MAX_EVENTS];
+    unsigned ready = 0;
+
+    loop->expired = 0;
+
+    int count = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, -1);
+    for (int i = 0; i < count; ++i) {
+        ready |= events[i].data.u32;
+    }
+
+    if (ready & EVENT_RESIZE) {
+        struct signalfd_siginfo info;
+        while (read(loop->signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        }
+    }
+
+    if (ready & EVENT_TIMER) {
+        uint64_t expirations;
+        while (read(loop->timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+        }
+
+        long long now = now_ms();
+        for (int i = 0; i < NUM_TIMERS; ++i) {
+            if (loop->deadlines[i] && loop->deadlines[i] <= now) {
+                loop->deadlines[i] = 0;
+                loop->expired |= 1U << i;
+            }
+        }
+        event_loop_arm(loop);
+
+        if (!loop->expired) {
+            ready &= ~EVENT_TIMER;
+        }
+    }
+
+    return ready;
+}
+
+/**
+ * @brief Schedules a timer to fire after the given delay.
+ *
+ * Setting a timer that is already pending moves its deadline.
+ *
+ * @param loop The event loop that owns the timer.
+ * @param timer The timer to set.
+ * @param ms The delay in milliseconds.
+ */
+void event_loop_set_timer(struct event_loop *loop, enum event_timer timer, unsigned ms)
+{
+    loop->deadlines[timer] = now_ms() + ms + 1;
+    event_loop_arm(loop);
+}
+
+/**
+ * @brief Cancels a pending timer.
+ *
+ * @param loop The event loop that owns the timer.
+ * @param timer The timer to cancel.
+ */
+void event_loop_cancel_timer(struct event_loop *loop, enum event_timer timer)
+{
+    loop->deadlines[timer] = 0;
+    event_loop_arm(loop);
+}
+
+/**
+ * @brief Checks whether a timer fired during the last call to event_loop_wait().
+ *
+ * @return 1 if the timer expired, or 0 otherwise.
+ */
+int event_loop_timer_expired(struct event_loop *loop, enum event_timer timer)
+{
+    return (loop->expired >> timer) & 1;
+}
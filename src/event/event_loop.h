@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * event_loop.h - Multiplexes terminal input, MPD events, timers and signals.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file event_loop.h
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+/**
+ * @brief The sources that can wake up the event loop.
+ *
+ * event_loop_wait() returns a bitmask of these values.
+ */
+enum event_source {
+    EVENT_INPUT = 0x1,  /** The terminal has input waiting. */
+    EVENT_MPD = 0x2,    /** The MPD connection has data waiting. */
+    EVENT_TIMER = 0x4,  /** One or more timers expired. */
+    EVENT_RESIZE = 0x8, /** The terminal was resized. */
+};
+
+/**
+ * @brief One-shot timers multiplexed onto the loop's timerfd.
+ */
+enum event_timer {
+    TIMER_RESIZE,  /** Coalesces bursts of SIGWINCH while the terminal is being resized. */
+    TIMER_KEYS,    /** Gives up waiting for the rest of a key sequence. */
+    TIMER_FRAME,   /** Ends the shortest time between two frames. */
+    TIMER_CONTROL,     /** Sends the volume and seek keys once they pause. */
+    TIMER_CONTROL_MAX, /** Sends them anyway once the first has waited long enough. */
+    NUM_TIMERS
+};
+
+struct event_loop {
+    int epoll_fd;  /** The epoll instance watching every other descriptor. */
+    int timer_fd;  /** Armed for the earliest pending timer deadline. */
+    int signal_fd; /** Receives SIGWINCH. */
+
+    long long deadlines[NUM_TIMERS]; /** Monotonic deadlines in milliseconds, 0 if disarmed. */
+    unsigned expired;                /** Bitmask of timers that fired during the last wait. */
+};
+
+struct event_loop *event_loop_new(int input_fd, int mpd_fd);
+void event_loop_free(struct event_loop *loop);
+
+unsigned event_loop_wait(struct event_loop *loop);
+
+void event_loop_set_timer(struct event_loop *loop, enum event_timer timer, unsigned ms);
+void event_loop_cancel_timer(struct event_loop *loop, enum event_timer timer);
+int event_loop_timer_expired(struct event_loop *loop, enum event_timer timer);
+
+#endif /* EVENT_LOOP_H */
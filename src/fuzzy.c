@@ -0,0 +1,581 @@
+/*******************************************************************************
+ * fuzzy.c - Fuzzy matching and ranking for searches.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file fuzzy.h
+ *
+ * @brief Matches a pattern against text the way fzf does, and keeps the best matches.
+ *
+ * A text matches if it contains the characters of the pattern in order,
+ * with anything in between, ignoring ASCII case. Matching compares whole
+ * UTF-8 characters, so a multibyte character of the pattern never matches
+ * bytes of two different characters.
+ *
+ * Matches are scored like fzf's first algorithm: the first occurrence of
+ * the pattern is found scanning forward, then shortened by scanning back
+ * from its end, and the window between is scored. Each matched character
+ * earns points, more at the start of a word or a run of matches, and each
+ * character skipped costs some. This finds a good window in linear time,
+ * though not always the best one.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pantomime/fuzzy.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pantomime/strmatch.h"
+
+#define SCORE_MATCH 16
+#define SCORE_GAP_START -3
+#define SCORE_GAP_EXTENSION -1
+
+/**
+ * @brief Bonus for matching the first character of a word.
+ */
+#define BONUS_BOUNDARY (SCORE_MATCH / 2)
+
+/**
+ * @brief Bonus for matching the first character after a space, which starts a word for sure.
+ */
+#define BONUS_BOUNDARY_WHITE (BONUS_BOUNDARY + 2)
+
+/**
+ * @brief Bonus for matching punctuation, which is rarely typed by accident.
+ */
+#define BONUS_NON_WORD (SCORE_MATCH / 2)
+
+/**
+ * @brief Bonus for matching the start of a camelCase hump or a number.
+ */
+#define BONUS_CAMEL (BONUS_BOUNDARY + SCORE_GAP_EXTENSION)
+
+/**
+ * @brief The least bonus a match right after another earns. It cancels out a gap.
+ */
+#define BONUS_CONSECUTIVE (-(SCORE_GAP_START + SCORE_GAP_EXTENSION))
+
+/**
+ * @brief How much more the bonus for the pattern's first character counts.
+ */
+#define BONUS_FIRST_CHAR_MULTIPLIER 2
+
+/**
+ * @brief What fuzzy_join() puts between fields.
+ */
+#define FIELD_SEPARATOR " - "
+
+/**
+ * @brief The kinds of character that decide where words start.
+ */
+enum fuzzy_class {
+    CLASS_WHITE,    /** A space or tab. */
+    CLASS_NON_WORD, /** Any other ASCII punctuation or control character. */
+    CLASS_LOWER,    /** A lowercase letter, or any character outside ASCII. */
+    CLASS_UPPER,    /** An uppercase letter. */
+    CLASS_NUMBER    /** A digit. */
+};
+
+/**
+ * @brief Appends as much of a string as fits in a buffer of @ref FUZZY_TEXT_SIZE bytes.
+ *
+ * @return The new length of the buffer's contents.
+ */
+static size_t fuzzy_append(char *buffer, size_t used, const char *text)
+{
+    size_t length = strnlen(text, FUZZY_TEXT_SIZE - 1 - used);
+    memcpy(buffer + used, text, length);  // NOLINT
+
+    return used + length;
+}
+
+/**
+ * @brief Joins fields into one text to match against, such as "artist - album - title".
+ *
+ * Empty fields are left out, and the text is cut short if it doesn't fit.
+ *
+ * @param buffer Filled with the text. It must hold @ref FUZZY_TEXT_SIZE bytes.
+ * @param fields The fields to join. NULL fields count as empty.
+ * @param count The number of fields.
+ *
+ * @return The length of the text.
+ */
+size_t fuzzy_join(char *buffer, const char *const *fields, unsigned count)
+{
+    size_t used = 0;
+
+    for (unsigned i = 0; i < count; ++i) {
+        if (!fields[i] || !*fields[i]) {
+            continue;
+        }
+
+        if (used) {
+            used = fuzzy_append(buffer, used, FIELD_SEPARATOR);
+        }
+        used = fuzzy_append(buffer, used, fields[i]);
+    }
+    buffer[used] = '\0';
+
+    return used;
+}
+
+/**
+ * @brief Gets the number of bytes in the UTF-8 character at @p s.
+ *
+ * A stray continuation byte counts as a character of its own.
+ *
+ * @param s The character.
+ * @param available The most bytes the character can have. Text that is
+ *                  NUL-terminated can pass SIZE_MAX, since the terminator
+ *                  is never a continuation byte.
+ */
+static size_t fuzzy_char_size(const unsigned char *s, size_t available)
+{
+    size_t size = 1;
+    while (size < available && (s[size] & 0xC0) == 0x80) {
+        ++size;
+    }
+
+    return size;
+}
+
+/**
+ * @brief Finds where the character that ends just before @p pos starts.
+ *
+ * @p pos must be greater than 0.
+ */
+static size_t fuzzy_char_start(const unsigned char *s, size_t pos)
+{
+    do {
+        --pos;
+    } while (pos > 0 && (s[pos] & 0xC0) == 0x80);
+
+    return pos;
+}
+
+/**
+ * @brief Checks whether a character of the text matches one of the folded pattern.
+ *
+ * A pattern character that is cut short, as the last one is while its
+ * bytes are still being typed, matches any character it is the start of.
+ * That way a query matches everything that a longer query matches.
+ */
+static int fuzzy_char_equal(const unsigned char *text, size_t text_size,
+                            const unsigned char *pattern, size_t pattern_size)
+{
+    if (pattern_size == 1) {
+        return strmatch_fold_char(*text) == *pattern;
+    }
+
+    return pattern_size <= text_size && memcmp(text, pattern, pattern_size) == 0;
+}
+
+/**
+ * @brief Classifies a character by its first byte.
+ */
+static enum fuzzy_class fuzzy_get_class(unsigned char c)
+{
+    if (c >= 'a' && c <= 'z') {
+        return CLASS_LOWER;
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return CLASS_UPPER;
+    }
+    if (c >= '0' && c <= '9') {
+        return CLASS_NUMBER;
+    }
+    if (c == ' ' || c == '\t') {
+        return CLASS_WHITE;
+    }
+
+    /* Letters of other scripts can't be told apart from punctuation without decoding them. */
+    return c >= 0x80 ? CLASS_LOWER : CLASS_NON_WORD;
+}
+
+/**
+ * @brief Gets the bonus for matching a character of class @p class after one of class @p prev.
+ */
+static int fuzzy_get_bonus(enum fuzzy_class prev, enum fuzzy_class class)
+{
+    if (class > CLASS_NON_WORD) {
+        if (prev == CLASS_WHITE) {
+            return BONUS_BOUNDARY_WHITE;
+        }
+        if (prev == CLASS_NON_WORD) {
+            return BONUS_BOUNDARY;
+        }
+        if ((prev == CLASS_LOWER && class == CLASS_UPPER) ||
+            (prev != CLASS_NUMBER && class == CLASS_NUMBER)) {
+            return BONUS_CAMEL;
+        }
+        return 0;
+    }
+
+    return class == CLASS_WHITE ? BONUS_BOUNDARY_WHITE : BONUS_NON_WORD;
+}
+
+/**
+ * @brief Finds where the first occurrence of the pattern ends, scanning forward.
+ *
+ * This is where most candidates are ruled out, so it avoids decoding the
+ * text: a pattern byte on its own can only match a character that starts
+ * with it, and a multibyte character only where its first byte is.
+ *
+ * @return One past the last byte of the occurrence, or 0 if there is none.
+ */
+static size_t fuzzy_find_end(const unsigned char *text, const unsigned char *pattern,
+                             size_t length)
+{
+    size_t i = 0;
+
+    for (size_t p = 0; p < length;) {
+        size_t size = fuzzy_char_size(pattern + p, length - p);
+        unsigned char first = pattern[p];
+
+        if (size == 1 && first >= 'a' && first <= 'z') {
+            /* Setting bit 5 lowercases a letter, and nothing else turns into one. */
+            while (text[i] && (text[i] | 0x20) != first) {
+                ++i;
+            }
+        }
+        else if (size == 1) {
+            while (text[i] && text[i] != first) {
+                ++i;
+            }
+        }
+        else {
+            while (text[i] && (text[i] != first || memcmp(text + i, pattern + p, size) != 0)) {
+                ++i;
+            }
+        }
+
+        if (!text[i]) {
+            return 0;
+        }
+        i += size;
+        p += size;
+    }
+
+    return i;
+}
+
+/**
+ * @brief Finds the latest start of an occurrence ending at @p end, scanning backward.
+ *
+ * The forward scan takes the first character that matches each one of the
+ * pattern. Going back from the end takes the last instead, which drops any
+ * detour the forward scan made.
+ */
+static size_t fuzzy_find_start(const unsigned char *text, size_t end, const unsigned char *pattern,
+                               size_t length)
+{
+    size_t p = length;
+    size_t i = end;
+
+    while (p > 0 && i > 0) {
+        size_t pattern_start = fuzzy_char_start(pattern, p);
+
+        while (i > 0) {
+            size_t text_start = fuzzy_char_start(text, i);
+            int matched = fuzzy_char_equal(text + text_start, i - text_start,
+                                           pattern + pattern_start, p - pattern_start);
+            i = text_start;
+            if (matched) {
+                break;
+            }
+        }
+        p = pattern_start;
+    }
+
+    return i;
+}
+
+/**
+ * @brief Scores the occurrence of the pattern between @p start and @p end.
+ */
+static int fuzzy_calculate(const unsigned char *text, size_t start, size_t end,
+                           const unsigned char *pattern, size_t length)
+{
+    int score = 0;
+    int in_gap = 0;
+    int consecutive = 0;
+    int first_bonus = 0;
+    size_t p = 0;
+
+    /* The start of the text counts as coming after a space. */
+    enum fuzzy_class prev = CLASS_WHITE;
+    if (start > 0) {
+        prev = fuzzy_get_class(text[fuzzy_char_start(text, start)]);
+    }
+
+    for (size_t i = start; i < end;) {
+        size_t text_size = fuzzy_char_size(text + i, end - i);
+        enum fuzzy_class class = fuzzy_get_class(text[i]);
+        size_t pattern_size = p < length ? fuzzy_char_size(pattern + p, length - p) : 0;
+
+        if (p < length && fuzzy_char_equal(text + i, text_size, pattern + p, pattern_size)) {
+            int bonus = fuzzy_get_bonus(prev, class);
+
+            if (!consecutive) {
+                first_bonus = bonus;
+            }
+            else {
+                /* A run keeps the bonus of the word boundary it started on. */
+                if (bonus >= BONUS_BOUNDARY && bonus > first_bonus) {
+                    first_bonus = bonus;
+                }
+                if (bonus < first_bonus) {
+                    bonus = first_bonus;
+                }
+                if (bonus < BONUS_CONSECUTIVE) {
+                    bonus = BONUS_CONSECUTIVE;
+                }
+            }
+
+            score += SCORE_MATCH + (p == 0 ? bonus * BONUS_FIRST_CHAR_MULTIPLIER : bonus);
+            in_gap = 0;
+            ++consecutive;
+            p += pattern_size;
+        }
+        else {
+            score += in_gap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+            in_gap = 1;
+            consecutive = 0;
+            first_bonus = 0;
+        }
+
+        prev = class;
+        i += text_size;
+    }
+
+    return score;
+}
+
+/**
+ * @brief Checks whether a text contains the characters of a pattern in order.
+ *
+ * This is much cheaper than fuzzy_score(), so it suits narrowing a list down.
+ *
+ * @param text The text to search.
+ * @param pattern The pattern, folded with strmatch_fold().
+ * @param length The length of @p pattern. An empty pattern matches everything.
+ *
+ * @return 1 if @p text matches, or 0 if it doesn't.
+ */
+int fuzzy_match(const char *text, const char *pattern, size_t length)
+{
+    return !length ||
+           fuzzy_find_end((const unsigned char *)text, (const unsigned char *)pattern, length);
+}
+
+/**
+ * @brief Scores how well a text matches a pattern.
+ *
+ * @param text The text to search.
+ * @param pattern The pattern, folded with strmatch_fold().
+ * @param length The length of @p pattern. An empty pattern matches everything with a score of 0.
+ *
+ * @return The score, or @ref FUZZY_NO_MATCH if @p text doesn't match.
+ */
+int fuzzy_score(const char *text, const char *pattern, size_t length)
+{
+    const unsigned char *t = (const unsigned char *)text;
+    const unsigned char *p = (const unsigned char *)pattern;
+
+    if (!length) {
+        return 0;
+    }
+
+    size_t end = fuzzy_find_end(t, p, length);
+    if (!end) {
+        return FUZZY_NO_MATCH;
+    }
+
+    return fuzzy_calculate(t, fuzzy_find_start(t, end, p, length), end, p, length);
+}
+
+/**
+ * @brief Checks whether candidate @p a ranks below candidate @p b.
+ */
+static int fuzzy_worse(const struct fuzzy_result *a, const struct fuzzy_result *b)
+{
+    return a->score < b->score || (a->score == b->score && a->id > b->id);
+}
+
+static void fuzzy_swap(struct fuzzy_result *results, unsigned i, unsigned j)
+{
+    struct fuzzy_result result = results[i];
+    results[i] = results[j];
+    results[j] = result;
+}
+
+/**
+ * @brief Moves a candidate up the heap until its parent is worse.
+ */
+static void fuzzy_sift_up(struct fuzzy_result *results, unsigned i)
+{
+    while (i > 0) {
+        unsigned parent = (i - 1) / 2;
+        if (!fuzzy_worse(&results[i], &results[parent])) {
+            break;
+        }
+
+        fuzzy_swap(results, i, parent);
+        i = parent;
+    }
+}
+
+/**
+ * @brief Moves a candidate down the first @p length entries of the heap below its children.
+ */
+static void fuzzy_sift_down(struct fuzzy_result *results, unsigned length, unsigned i)
+{
+    for (;;) {
+        unsigned worst = i;
+        unsigned left = 2 * i + 1;
+        unsigned right = left + 1;
+
+        if (left < length && fuzzy_worse(&results[left], &results[worst])) {
+            worst = left;
+        }
+        if (right < length && fuzzy_worse(&results[right], &results[worst])) {
+            worst = right;
+        }
+        if (worst == i) {
+            return;
+        }
+
+        fuzzy_swap(results, i, worst);
+        i = worst;
+    }
+}
+
+/**
+ * @brief Creates an empty ranking that keeps nothing until it is reset.
+ *
+ * @return A newly-allocated ranking, or NULL on error.
+ */
+struct fuzzy_top *fuzzy_top_new(void)
+{
+    return calloc(1, sizeof(struct fuzzy_top));
+}
+
+/**
+ * @brief Frees a ranking.
+ *
+ * @param top The ranking to free.
+ */
+void fuzzy_top_free(struct fuzzy_top *top)
+{
+    if (!top) {
+        return;
+    }
+
+    free(top->results);
+    free(top);
+}
+
+/**
+ * @brief Empties a ranking, ready to keep the best @p capacity candidates.
+ *
+ * @param top The ranking to reset.
+ * @param capacity The number of candidates to keep.
+ *
+ * @return 0 on success, or -1 if memory ran out, in which case nothing will be kept.
+ */
+int fuzzy_top_reset(struct fuzzy_top *top, unsigned capacity)
+{
+    top->length = 0;
+    top->matches = 0;
+
+    if (capacity > top->size) {
+        struct fuzzy_result *results = realloc(top->results, sizeof(*results) * capacity);
+        if (!results) {
+            top->capacity = 0;
+            return -1;
+        }
+
+        top->results = results;
+        top->size = capacity;
+    }
+
+    top->capacity = capacity;
+    return 0;
+}
+
+/**
+ * @brief Offers a candidate, which is kept if it is among the best seen since the reset.
+ *
+ * @param top The ranking.
+ * @param score The candidate's score from fuzzy_score().
+ * @param id The candidate's id.
+ */
+void fuzzy_top_add(struct fuzzy_top *top, int score, unsigned id)
+{
+    struct fuzzy_result result = {score, id};
+    ++top->matches;
+
+    if (top->length < top->capacity) {
+        top->results[top->length] = result;
+        fuzzy_sift_up(top->results, top->length++);
+    }
+    else if (top->length && fuzzy_worse(&top->results[0], &result)) {
+        top->results[0] = result;
+        fuzzy_sift_down(top->results, top->length, 0);
+    }
+}
+
+/**
+ * @brief Adds the candidates another ranking kept, as if they had been added to this one.
+ *
+ * Since the best candidates are the same whatever order they come in,
+ * rankings of separate runs of candidates can be made in parallel and
+ * merged in any order. Neither may be finished yet.
+ *
+ * @param top The ranking to add to.
+ * @param other The ranking to add.
+ */
+void fuzzy_top_merge(struct fuzzy_top *top, const struct fuzzy_top *other)
+{
+    unsigned long matches = top->matches + other->matches;
+
+    for (unsigned i = 0; i < other->length; ++i) {
+        fuzzy_top_add(top, other->results[i].score, other->results[i].id);
+    }
+    top->matches = matches;
+}
+
+/**
+ * @brief Puts the kept candidates in order, best first.
+ *
+ * This sorts the heap in place, so no more candidates can be added until
+ * the ranking is reset.
+ *
+ * @param top The ranking.
+ */
+void fuzzy_top_finish(struct fuzzy_top *top)
+{
+    /* Moving the worst remaining candidate to the back each time leaves the best at the front. */
+    for (unsigned length = top->length; length > 1; --length) {
+        fuzzy_swap(top->results, 0, length - 1);
+        fuzzy_sift_down(top->results, length - 1, 0);
+    }
+}
@@ -0,0 +1,379 @@
+/*******************************************************************************
+ * intern.c - Deduplicating string storage.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file intern.h
+ *
+ * @brief Stores each distinct string once and refers to it by a small integer id.
+ *
+ * Strings are packed back to back in a single buffer and a string's id is its
+ * offset into that buffer, so looking one up is a single addition. An open
+ * addressing hash table maps string contents to ids when adding.
+ */
+
+#include "pantomime/intern.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_MIN_SLOTS 1024
+#define INTERN_MIN_CAPACITY 4096
+
+/**
+ * @brief A hash table slot. An offset of 0 marks the slot as empty.
+ */
+struct intern_slot {
+    unsigned offset; /** The string's id. */
+    unsigned hash;   /** The string's hash, kept to avoid needless comparisons. */
+};
+
+struct intern_table {
+    char *strings;   /** Every interned string, NUL-terminated and packed together. */
+    size_t used;     /** The number of bytes used in @ref strings. */
+    size_t capacity; /** The number of bytes allocated for @ref strings. */
+
+    struct intern_slot *slots; /** The hash table. Its size is a power of two. */
+    unsigned num_slots;        /** The number of slots in the hash table. */
+    unsigned count;            /** The number of strings in the table. */
+    int indexed;               /** Whether @ref slots reflects @ref strings. */
+};
+
+/**
+ * @brief Hashes a string with FNV-1a and reports its length.
+ */
+static unsigned intern_hash(const char *str, size_t *length)
+{
+    unsigned hash = 2166136261U;
+    const unsigned char *p = (const unsigned char *)str;
+
+    while (*p) {
+        hash ^= *p++;
+        hash *= 16777619U;
+    }
+
+    *length = (const char *)p - str;
+    return hash;
+}
+
+/**
+ * @brief Doubles the size of the hash table and reinserts every string.
+ */
+static int intern_table_rehash(struct intern_table *table)
+{
+    unsigned num_slots = table->num_slots * 2;
+    struct intern_slot *slots = calloc(num_slots, sizeof(*slots));
+    if (!slots) {
+        return -1;
+    }
+
+    unsigned mask = num_slots - 1;
+    for (unsigned i = 0; i < table->num_slots; ++i) {
+        struct intern_slot slot = table->slots[i];
+        if (!slot.offset) {
+            continue;
+        }
+
+        unsigned index = slot.hash & mask;
+        while (slots[index].offset) {
+            index = (index + 1) & mask;
+        }
+        slots[index] = slot;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->num_slots = num_slots;
+
+    return 0;
+}
+
+/**
+ * @brief Builds the hash table for strings that were loaded without one.
+ *
+ * Loading leaves the hash table empty, since a table that is only read from
+ * never needs it. It is built the first time a string is added.
+ */
+static int intern_table_index(struct intern_table *table)
+{
+    unsigned count = 0;
+    for (size_t offset = 1; offset < table->used; offset += strlen(table->strings + offset) + 1) {
+        ++count;
+    }
+
+    unsigned num_slots = INTERN_MIN_SLOTS;
+    while ((size_t)count * 10 > (size_t)num_slots * 7) {
+        num_slots *= 2;
+    }
+
+    struct intern_slot *slots = calloc(num_slots, sizeof(*slots));
+    if (!slots) {
+        return -1;
+    }
+
+    unsigned mask = num_slots - 1;
+    size_t length;
+    for (size_t offset = 1; offset < table->used; offset += length + 1) {
+        unsigned hash = intern_hash(table->strings + offset, &length);
+        unsigned index = hash & mask;
+        while (slots[index].offset) {
+            index = (index + 1) & mask;
+        }
+        slots[index].offset = offset;
+        slots[index].hash = hash;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->num_slots = num_slots;
+    table->count = count;
+    table->indexed = 1;
+
+    return 0;
+}
+
+/**
+ * @brief Makes room for @p size more bytes in the string buffer.
+ */
+static int intern_table_reserve(struct intern_table *table, size_t size)
+{
+    if (size > UINT_MAX - table->used) {
+        /* Ids are unsigned offsets, so the buffer can't grow past UINT_MAX. */
+        return -1;
+    }
+    if (table->used + size <= table->capacity) {
+        return 0;
+    }
+
+    size_t capacity = table->capacity;
+    while (capacity < table->used + size) {
+        capacity *= 2;
+    }
+
+    char *strings = realloc(table->strings, capacity);
+    if (!strings) {
+        return -1;
+    }
+
+    table->strings = strings;
+    table->capacity = capacity;
+
+    return 0;
+}
+
+/**
+ * @brief Creates a new, empty intern table.
+ *
+ * @return A newly-allocated intern table, or NULL on error.
+ */
+struct intern_table *intern_table_new(void)
+{
+    struct intern_table *table = malloc(sizeof(*table));
+    if (!table) {
+        return NULL;
+    }
+
+    table->strings = malloc(INTERN_MIN_CAPACITY);
+    table->slots = calloc(INTERN_MIN_SLOTS, sizeof(*table->slots));
+    if (!table->strings || !table->slots) {
+        free(table->strings);
+        free(table->slots);
+        free(table);
+        return NULL;
+    }
+
+    /* Offset 0 holds the empty string, which doubles as the "empty slot" marker. */
+    table->strings[0] = '\0';
+    table->used = 1;
+    table->capacity = INTERN_MIN_CAPACITY;
+    table->num_slots = INTERN_MIN_SLOTS;
+    table->count = 0;
+    table->indexed = 1;
+
+    return table;
+}
+
+/**
+ * @brief Frees all memory used by an intern table.
+ *
+ * Any strings obtained from the table become invalid.
+ *
+ * @param table The table to free.
+ */
+void intern_table_free(struct intern_table *table)
+{
+    if (!table) {
+        return;
+    }
+
+    free(table->strings);
+    free(table->slots);
+    free(table);
+}
+
+/**
+ * @brief Adds a string to the table if it isn't already there.
+ *
+ * @param table The table to add to.
+ * @param str The string to add. NULL is treated as the empty string.
+ *
+ * @return The string's id, or @ref INTERN_EMPTY if @p str is empty or memory ran out.
+ */
+unsigned intern_table_add(struct intern_table *table, const char *str)
+{
+    if (!str || !*str) {
+        return INTERN_EMPTY;
+    }
+    if (!table->indexed && intern_table_index(table) != 0) {
+        return INTERN_EMPTY;
+    }
+
+    size_t length;
+    unsigned hash = intern_hash(str, &length);
+    unsigned mask = table->num_slots - 1;
+    unsigned index = hash & mask;
+
+    while (table->slots[index].offset) {
+        struct intern_slot slot = table->slots[index];
+        if (slot.hash == hash && strcmp(table->strings + slot.offset, str) == 0) {
+            return slot.offset;
+        }
+        index = (index + 1) & mask;
+    }
+
+    if (intern_table_reserve(table, length + 1) != 0) {
+        return INTERN_EMPTY;
+    }
+
+    unsigned offset = table->used;
+    memcpy(table->strings + offset, str, length + 1);  // NOLINT
+    table->used += length + 1;
+
+    table->slots[index].offset = offset;
+    table->slots[index].hash = hash;
+    ++table->count;
+
+    /* Keep the load factor under 70% so that probe sequences stay short. */
+    if ((size_t)table->count * 10 > (size_t)table->num_slots * 7) {
+        intern_table_rehash(table);
+    }
+
+    return offset;
+}
+
+/**
+ * @brief Looks up an interned string by id.
+ *
+ * The returned pointer is borrowed from the table. It stays valid until the
+ * next call to intern_table_add() or intern_table_clear().
+ *
+ * @param table The table to search.
+ * @param id An id returned by intern_table_add().
+ *
+ * @return The string with the given id, or the empty string if the id is invalid.
+ */
+const char *intern_table_get(struct intern_table *table, unsigned id)
+{
+    if (id >= table->used) {
+        return table->strings;
+    }
+
+    return table->strings + id;
+}
+
+/**
+ * @brief Gets the buffer every string is stored in, so that it can be saved.
+ *
+ * A string's id is its offset into the buffer, so loading the buffer back
+ * with intern_table_load() keeps every id valid.
+ *
+ * @param table The table to read.
+ * @param size Set to the number of bytes in the buffer.
+ *
+ * @return The buffer, which belongs to the table.
+ */
+const char *intern_table_get_data(struct intern_table *table, size_t *size)
+{
+    *size = table->used;
+    return table->strings;
+}
+
+/**
+ * @brief Replaces the contents of a table with a buffer from intern_table_get_data().
+ *
+ * @param table The table to fill.
+ * @param data The strings, starting with the empty string, each NUL-terminated.
+ * @param size The number of bytes in @p data.
+ *
+ * @return 0 on success, or -1 if the data is malformed or memory ran out.
+ */
+int intern_table_load(struct intern_table *table, const char *data, size_t size)
+{
+    if (size == 0 || size > UINT_MAX || data[0] != '\0' || data[size - 1] != '\0') {
+        return -1;
+    }
+
+    intern_table_clear(table);
+    table->used = 0;
+    if (intern_table_reserve(table, size) != 0) {
+        intern_table_clear(table);
+        return -1;
+    }
+
+    memcpy(table->strings, data, size);  // NOLINT
+    table->used = size;
+    table->indexed = size == 1;
+
+    return 0;
+}
+
+/**
+ * @brief Gets the number of distinct strings in the table.
+ */
+unsigned intern_table_get_count(struct intern_table *table)
+{
+    if (!table->indexed) {
+        intern_table_index(table);
+    }
+    return table->count;
+}
+
+/**
+ * @brief Gets the number of bytes of memory allocated by the table.
+ */
+size_t intern_table_get_size(struct intern_table *table)
+{
+    return sizeof(*table) + table->capacity + (size_t)table->num_slots * sizeof(*table->slots);
+}
+
+/**
+ * @brief Removes every string from the table, keeping its memory for reuse.
+ *
+ * All previously returned ids become invalid.
+ *
+ * @param table The table to clear.
+ */
+void intern_table_clear(struct intern_table *table)
+{
+    memset(table->slots, 0, (size_t)table->num_slots * sizeof(*table->slots));  // NOLINT
+    table->strings[0] = '\0';
+    table->used = 1;
+    table->count = 0;
+    table->indexed = 1;
+}
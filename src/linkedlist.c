@@ -155,9 +155,20 @@ void *linkedlist_at(struct linkedlist *list, unsigned index)
         return NULL;
     }
 
-    struct node *current = list->head;
-    for (int i = 0; i < index; ++i) {
-        current = current->next;
+    struct node *current;
+
+    /* Walk from whichever end of the list is closer. */
+    if (index < list->length / 2) {
+        current = list->head;
+        for (unsigned i = 0; i < index; ++i) {
+            current = current->next;
+        }
+    }
+    else {
+        current = list->tail;
+        for (unsigned i = list->length - 1; i > index; --i) {
+            current = current->prev;
+        }
     }
     return current->data;
 }
@@ -187,13 +198,8 @@ enum ll_error linkedlist_push(struct linkedlist *list, void *data)
         list->tail = node;
     }
     else {
-        struct node *current = list->head;
-        while (current->next) {
-            current = current->next;
-        }
-
-        node->prev = current;
-        current->next = node;
+        node->prev = list->tail;
+        list->tail->next = node;
         node->next = NULL;
         list->tail = node;
     }
@@ -223,9 +229,10 @@ enum ll_error linkedlist_remove(struct linkedlist *list, unsigned index, void (*
             struct node *current = list->head;
             struct node *new_head = list->head->next;
 
-            current->prev = NULL;
+            new_head->prev = NULL;
             list->head = new_head;
             node_free(current, free_fn);
+            list->length--;
         }
     }
     else {
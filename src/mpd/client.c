@@ -21,24 +21,62 @@
  * @file mpdclient.h
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "pantomime/mpd/client.h"
 
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include "pantomime/cache.h"
+#include "pantomime/mpd/library_cache.h"
+#include "pantomime/mpd/library_index.h"
+#include "pantomime/mpd/worker.h"
+#include "pantomime/vector.h"
+
+/**
+ * @brief The number of library nodes that may go unindexed before the search index is rebuilt.
+ */
+#define INDEX_MIN_TAIL 1024
 
-#include "pantomime/linkedlist.h"
+/**
+ * @brief The id of the first song added locally. Later ones count down from it.
+ *
+ * MPD counts song ids up from 0, so a song that was added locally but not
+ * yet fetched never shares a cached row with a real one.
+ */
+#define PLACEHOLDER_ID_START UINT_MAX
+
+/**
+ * @brief The fewest bytes of queue strings worth compacting.
+ */
+#define STRINGS_MIN_COMPACT (64 * 1024)
 
 /**
  * @brief Creates a new connection to an MPD server.
  *
+ * Once connected, the connection is handed to a worker thread. The queue
+ * starts out empty. Call mpdclient_update_queue() to fetch it, possibly
+ * after restoring a saved copy, and it fills in once
+ * mpdclient_handle_results() applies the update.
+ *
  * @param host The server's hostname, IP address, or Unix socket path.
  * @param port The TCP port to connect to (0 for default). If "host" is a Unix socket path, this
  * parameter is ignored.
+ * @param timeout The connection timeout in milliseconds (0 for default).
+ * @param queue_budget If nonzero, only the queue's length is fetched up front, and song metadata
+ * is loaded on demand in pages, keeping at most this many bytes of pages in memory.
+ * @param threads The number of threads to index and search the library on, or 0 for one per CPU.
  *
- * @return An @ref mpdclient object (which may have failed to connect), or NULL on out-of-memory.
+ * @return An @ref mpdclient object, or NULL on error.
  */
-struct mpdclient *mpdclient_new(const char *host, unsigned int port, unsigned int timeout)
+struct mpdclient *mpdclient_new(const char *host, unsigned int port, unsigned int timeout,
+                                size_t queue_budget, unsigned threads)
 {
     struct mpdclient *mpd = malloc(sizeof(*mpd));
     if (!mpd) {
@@ -46,11 +84,64 @@ struct mpdclient *mpdclient_new(const char *host, unsigned int port, unsigned in
     }
 
     mpd->connection = NULL;
+    mpd->worker = NULL;
     mpd->queue = NULL;
+    mpd->pages = NULL;
+    mpd->queue_budget = queue_budget;
+    mpd->prefetch_margin = QUEUE_PAGE_SIZE;
+    mpd->fetch_pending = 0;
+    mpd->queue_version = 0;
+    mpd->queue_seeded = 0;
+    mpd->server_start = 0;
+    mpd->queue_reloaded = 0;
+    mpd->reload_pending = 0;
+    mpd->strings_live = 0;
+    mpd->library = NULL;
+    mpd->library_cache = cache_get_path("library", host, port);
+    mpd->library_cache_checked = 0;
+    mpd->library_saved_at = 0;
+    mpd->index_budget = LIBRARY_INDEX_BUDGET;
+    mpd->index_pending = 0;
+    mpd->index_generation = 0;
+    mpd->index_attempted = 0;
+    mpd->index_unsaved = 0;
+    mpd->pool = NULL;
+    mpd->volume_delta = 0;
+    mpd->seek_delta = 0;
+    mpd->controls_pending = 0;
+    mpd->volume = -1;
+    mpd->edits = NULL;
+    mpd->edits_made = 0;
+    mpd->edits_pending = 0;
+    mpd->edits_synced = 0;
+    mpd->placeholder_id = PLACEHOLDER_ID_START;
+    mpd->last_error = MPD_ERROR_SUCCESS;
+    mpd->error_message = NULL;
+
+    if (queue_budget) {
+        mpd->pages = pagecache_new(queue_budget);
+    }
+    else {
+        mpd->queue = vector_new(sizeof(struct song));
+    }
+    mpd->strings = intern_table_new();
+    mpd->changed_ids = vector_new(sizeof(unsigned));
+    mpd->edits = vector_new(sizeof(struct queue_edit));
+    mpd->library = library_new();
+    mpd->pool = pool_new(threads);
+    if ((!mpd->queue && !mpd->pages) || !mpd->strings || !mpd->changed_ids || !mpd->edits ||
+        !mpd->library || !mpd->pool) {
+        mpdclient_free(mpd);
+        return NULL;
+    }
 
     mpd->connection = mpd_connection_new(host, port, timeout);
+    if (!mpd->connection) {
+        mpdclient_free(mpd);
+        return NULL;
+    }
 
-    if (mpdclient_has_error(mpd)) {
+    if (mpd_connection_get_error(mpd->connection) != MPD_ERROR_SUCCESS) {
         const char *error_message = mpd_connection_get_error_message(mpd->connection);
         fprintf(stderr, "MPD error: %s\n", error_message);
 
@@ -58,17 +149,12 @@ struct mpdclient *mpdclient_new(const char *host, unsigned int port, unsigned in
         return NULL;
     }
 
-    mpdclient_update_queue(mpd);
-    if (mpdclient_has_error(mpd)) {
-        // TODO: create function for printing MPD error messages
-        const char *error_message = mpd_connection_get_error_message(mpd->connection);
-        fprintf(stderr, "MPD error: %s\n", error_message);
-
+    mpd->worker = mpd_worker_new(mpd->connection, queue_budget != 0);
+    if (!mpd->worker) {
         mpdclient_free(mpd);
         return NULL;
     }
 
-    mpd->last_error = mpd_connection_get_error(mpd->connection);
     return mpd;
 }
 
@@ -83,19 +169,30 @@ void mpdclient_free(struct mpdclient *mpd)
         return;
     }
 
+    /* Stop the worker first, since it owns the connection while running. */
+    mpd_worker_free(mpd->worker);
+    pool_free(mpd->pool);
+
     if (mpd->connection) {
         mpd_connection_free(mpd->connection);
     }
     if (mpd->queue) {
-        linkedlist_free(mpd->queue, mpdclient_song_free);
+        vector_free(mpd->queue, NULL);
     }
+    pagecache_free(mpd->pages);
+    intern_table_free(mpd->strings);
+    vector_free(mpd->changed_ids, NULL);
+    vector_free(mpd->edits, queue_edit_clear);
 
-    free(mpd);
-}
+    if (mpd->library && mpd->library_cache && mpd->library->db_update &&
+        (mpd->library->version != mpd->library_saved_at || mpd->index_unsaved)) {
+        library_cache_save(mpd->library, mpd->library_cache);
+    }
+    library_free(mpd->library);
+    free(mpd->library_cache);
+    free(mpd->error_message);
 
-void mpdclient_song_free(void *song)
-{
-    mpd_song_free(song);
+    free(mpd);
 }
 
 /**
@@ -107,7 +204,7 @@ void mpdclient_song_free(void *song)
  */
 int mpdclient_has_error(struct mpdclient *mpd)
 {
-    return mpd_connection_get_error(mpd->connection) != MPD_ERROR_SUCCESS;
+    return mpd->last_error != MPD_ERROR_SUCCESS;
 }
 
 /**
@@ -121,101 +218,1076 @@ const char *mpdclient_get_last_error_message(struct mpdclient *mpd)
         return NULL;
     }
 
-    return mpd_connection_get_error_message(mpd->connection);
+    return mpd->error_message ? mpd->error_message : "Unknown error";
 }
 
-/*
- * @brief Fetches the current MPD queue.
+/**
+ * @brief Sends a job to the worker thread.
+ *
+ * @return 0 on success, or -1 if the job couldn't be queued.
+ */
+static int mpdclient_submit(struct mpdclient *mpd, struct mpd_job *job)
+{
+    if (!job) {
+        return -1;
+    }
+    if (mpd_worker_submit(mpd->worker, job) != 0) {
+        mpd_job_free(job);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Asks the worker thread to bring the local copy of the MPD queue up to date.
+ *
+ * If the queue was restored from a snapshot, the first update only fetches
+ * what changed since the snapshot's version.
  *
  * @param mpd The connection to MPD.
  */
 void mpdclient_update_queue(struct mpdclient *mpd)
 {
-    if (!mpd->connection) {
+    struct mpd_job *job = mpd_job_new(JOB_UPDATE_QUEUE);
+
+    if (job && mpd->queue_seeded) {
+        job->seeded = 1;
+        job->queue_version = mpd->queue_version;
+        job->queue_length = mpdclient_get_queue_length(mpd);
+        job->server_start = mpd->server_start;
+    }
+
+    if (mpdclient_submit(mpd, job) == 0) {
+        mpd->queue_seeded = 0;
+    }
+}
+
+/**
+ * @brief Forgets every loaded page of a lazily-loaded queue, along with their strings.
+ */
+static void mpdclient_reset_pages(struct mpdclient *mpd)
+{
+    pagecache_clear(mpd->pages);
+    intern_table_clear(mpd->strings);
+
+    vector_clear(mpd->changed_ids, NULL);
+    mpd->queue_reloaded = 1;
+}
+
+/**
+ * @brief Records that a queue song changed, so that cached views of it are dropped.
+ *
+ * If there's no memory to record it, every cached view is dropped instead.
+ */
+static void mpdclient_record_change(struct mpdclient *mpd, unsigned id)
+{
+    if (!mpd->queue_reloaded && vector_push(mpd->changed_ids, &id) != VEC_ERROR_SUCCESS) {
+        vector_clear(mpd->changed_ids, NULL);
+        mpd->queue_reloaded = 1;
+    }
+}
+
+/**
+ * @brief Downloads the whole queue again, after an update couldn't be applied in full.
+ *
+ * Later updates only carry what changed since, so nothing else would ever
+ * repair the local queue. Until the reload arrives, the queue's version is
+ * 0, so that it isn't taken for a complete copy of any version.
+ */
+static void mpdclient_reload_queue(struct mpdclient *mpd)
+{
+    if (mpd->reload_pending) {
         return;
     }
-    if (!mpd->queue) {
-        mpd->queue = linkedlist_new(sizeof(struct mpd_song *) + 512);
+
+    struct mpd_job *job = mpd_job_new(JOB_UPDATE_QUEUE);
+    if (job) {
+        job->reload = 1;
     }
-    linkedlist_clear(mpd->queue, mpdclient_song_free);
 
-    struct mpd_song *song;
-    mpd_send_list_queue_meta(mpd->connection);
+    if (mpdclient_submit(mpd, job) != 0) {
+        if (mpd->last_error == MPD_ERROR_SUCCESS) {
+            mpd->last_error = MPD_ERROR_OOM;
+            mpd->error_message = strdup("Out of memory");
+        }
+        return;
+    }
+    mpd->reload_pending = 1;
+}
 
-    while ((song = mpd_recv_song(mpd->connection))) {
-        linkedlist_push(mpd->queue, song);
+/**
+ * @brief Rebuilds the string table of an eagerly-loaded queue from the songs still in it.
+ *
+ * Every update interns the tags of the songs it brings, and the strings of
+ * the songs they replace stay behind. Once the table has doubled since it
+ * last held only live strings, so that at least half of it may be dead, the
+ * live strings are copied to a new table. The cost is amortized over the
+ * updates that grew the table.
+ */
+static void mpdclient_compact_strings(struct mpdclient *mpd)
+{
+    size_t used;
+    intern_table_get_data(mpd->strings, &used);
+    if (used < STRINGS_MIN_COMPACT || used < 2 * mpd->strings_live) {
+        return;
+    }
+
+    unsigned count = vector_get_length(mpd->queue);
+    struct intern_table *strings = intern_table_new();
+    unsigned *ids = malloc(sizeof(*ids) * 3 * ((size_t)count + 1));
+    int ok = strings && ids;
+
+    for (unsigned i = 0; i < count && ok; ++i) {
+        const struct song *song = vector_at(mpd->queue, i);
+        unsigned old_ids[3] = {song->title, song->artist, song->album};
+
+        for (unsigned field = 0; field < 3 && ok; ++field) {
+            const char *str = intern_table_get(mpd->strings, old_ids[field]);
+            ids[i * 3 + field] = intern_table_add(strings, str);
+            ok = ids[i * 3 + field] != INTERN_EMPTY || !*str;
+        }
+    }
+
+    /* Without the memory to compact, try again once the table has doubled again. */
+    if (!ok) {
+        intern_table_free(strings);
+        free(ids);
+        mpd->strings_live = used;
+        return;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        struct song *song = vector_at(mpd->queue, i);
+        song->title = ids[i * 3];
+        song->artist = ids[i * 3 + 1];
+        song->album = ids[i * 3 + 2];
     }
-    mpd_response_finish(mpd->connection);
+    free(ids);
 
-    mpd->last_error = mpd_connection_get_error(mpd->connection);
+    intern_table_free(mpd->strings);
+    mpd->strings = strings;
+    intern_table_get_data(mpd->strings, &mpd->strings_live);
 }
 
 /**
- * @brief Get a song's title.
+ * @brief Applies a queue update fetched by the worker thread.
  *
- * @param song The song to query.
+ * When loading eagerly, every received song replaces the entry at its
+ * position, or is appended if it lies past the end of the local queue.
+ * When loading lazily, the pages holding changed entries are dropped and
+ * reloaded the next time they are needed. Removals are handled afterwards
+ * by truncating to the new queue length.
  *
- * @return A dynamically-allocated string containing the song's title.
+ * @param mpd The connection to MPD.
+ * @param job The finished job.
+ */
+static void mpdclient_apply_queue(struct mpdclient *mpd, struct mpd_job *job)
+{
+    if (job->reload) {
+        mpd->reload_pending = 0;
+
+        /* Nothing else refers to the strings, so start over to drop stale ones. */
+        if (mpd->pages) {
+            mpdclient_reset_pages(mpd);
+        }
+        else {
+            vector_clear(mpd->queue, NULL);
+            intern_table_clear(mpd->strings);
+
+            vector_clear(mpd->changed_ids, NULL);
+            mpd->queue_reloaded = 1;
+        }
+    }
+
+    unsigned count = job->changes ? vector_get_length(job->changes) : 0;
+    for (unsigned i = 0; i < count; ++i) {
+        const struct queue_change *change = vector_at(job->changes, i);
+        pagecache_drop_page(mpd->pages, change->pos / QUEUE_PAGE_SIZE);
+        mpdclient_record_change(mpd, change->id);
+    }
+
+    int complete = 1;
+    struct song song;
+    count = job->songs ? vector_get_length(job->songs) : 0;
+    for (unsigned i = 0; i < count && mpd->queue && complete; ++i) {
+        const struct mpd_song *mpd_song = *(struct mpd_song **)vector_at(job->songs, i);
+        unsigned pos = mpd_song_get_pos(mpd_song);
+        song_from_mpd(&song, mpd_song, mpd->strings);
+        mpdclient_record_change(mpd, song.id);
+
+        if (pos < vector_get_length(mpd->queue)) {
+            vector_set(mpd->queue, pos, &song, NULL);
+        }
+        else {
+            /* Songs after a missing one would land in the wrong place, so stop here. */
+            complete = vector_push(mpd->queue, &song) == VEC_ERROR_SUCCESS;
+        }
+    }
+
+    /* A cache that can't grow to the new length no longer matches the server's queue. */
+    if (mpd->pages && pagecache_set_length(mpd->pages, job->queue_length) != 0) {
+        complete = 0;
+    }
+    else if (!mpd->pages) {
+        vector_truncate(mpd->queue, job->queue_length, NULL);
+    }
+    mpd->server_start = job->server_start;
+
+    if (!complete) {
+        mpdclient_reload_queue(mpd);
+    }
+    mpd->queue_version = mpd->reload_pending ? 0 : job->queue_version;
+
+    if (mpd->queue && job->reload) {
+        intern_table_get_data(mpd->strings, &mpd->strings_live);
+    }
+    else if (mpd->queue) {
+        mpdclient_compact_strings(mpd);
+    }
+
+    /* Updates come back in the order they were made, so this one includes every edit sent. */
+    if (!mpd->edits_pending && !mpdclient_has_unsent_edits(mpd)) {
+        mpd->edits_synced = mpd->edits_made;
+    }
+}
+
+/**
+ * @brief Stores the songs of a fetched range in the page cache.
  *
- * This function returns a string that is dynamically-allocated, as if
- * malloc() were called. The caller is responsible for freeing the memory
- * used by this string.
+ * @param mpd The connection to MPD.
+ * @param job The finished job.
  */
-char *mpdclient_get_song_title(struct mpd_song *song)
+static void mpdclient_apply_range(struct mpdclient *mpd, struct mpd_job *job)
 {
-    if (!song) {
-        return NULL;
+    /* Songs fetched before an edit was made locally may no longer be where they were. */
+    if (!mpd->pages || !job->songs || job->edits_made != mpd->edits_made) {
+        return;
+    }
+
+    /* Strings of evicted pages linger in the intern table, so start over once it's too big. */
+    if (intern_table_get_size(mpd->strings) > mpd->queue_budget) {
+        mpdclient_reset_pages(mpd);
     }
 
-    const char *title = mpd_song_get_tag(song, MPD_TAG_TITLE, 0);
-    int len = strlen(title) + 1;
+    struct song *page;
+    unsigned count = vector_get_length(job->songs);
+    for (unsigned i = 0; i < count; ++i) {
+        const struct mpd_song *mpd_song = *(struct mpd_song **)vector_at(job->songs, i);
+        unsigned pos = mpd_song_get_pos(mpd_song);
 
-    char *return_value = malloc(sizeof(char) * len);
-    strncpy(return_value, title, strlen(title) + 1);  // NOLINT
+        page = pagecache_load_page(mpd->pages, pos / QUEUE_PAGE_SIZE);
+        if (page) {
+            song_from_mpd(&page[pos % QUEUE_PAGE_SIZE], mpd_song, mpd->strings);
+        }
+    }
+}
 
-    return return_value;
+/**
+ * @brief Stores fetched artists, albums or tracks in the library.
+ *
+ * Results requested before the library was last cleared are dropped.
+ *
+ * @param mpd The connection to MPD.
+ * @param job The finished job.
+ */
+static void mpdclient_apply_library(struct mpdclient *mpd, struct mpd_job *job)
+{
+    if (job->generation != mpd->library->generation) {
+        return;
+    }
+
+    if (job->node == LIBRARY_NO_NODE) {
+        library_set_artists(mpd->library, job->names);
+    }
+    else if (job->type == JOB_LIST_TAGS) {
+        library_set_albums(mpd->library, job->node, job->names);
+    }
+    else {
+        library_set_tracks(mpd->library, job->node, job->songs);
+    }
 }
 
 /**
- * @brief Get the name of a song's artist.
+ * @brief Asks the worker thread when the database was last updated.
  *
- * @param song The song to query.
+ * The answer is applied by mpdclient_apply_db_stats().
+ */
+static void mpdclient_check_library(struct mpdclient *mpd)
+{
+    struct mpd_job *job = mpd_job_new(JOB_DB_STATS);
+    if (job) {
+        job->node = LIBRARY_NO_NODE;
+        job->generation = mpd->library->generation;
+    }
+
+    mpdclient_submit(mpd, job);
+}
+
+/**
+ * @brief Records when the database was last updated, discarding a saved library that is older.
  *
- * @return A dynamically-allocated string containing the name of the song's artist.
+ * @param mpd The connection to MPD.
+ * @param job The finished job.
+ */
+static void mpdclient_apply_db_stats(struct mpdclient *mpd, struct mpd_job *job)
+{
+    struct library *library = mpd->library;
+    if (job->generation != library->generation) {
+        return;
+    }
+
+    if (library->state == NODE_LOADED && library->db_update != job->db_update) {
+        /* The saved library predates the last database update, so fetch it again. */
+        library_clear(library);
+        mpdclient_load_library(mpd, LIBRARY_NO_NODE);
+        return;
+    }
+
+    library->db_update = job->db_update;
+}
+
+/**
+ * @brief Has the worker thread index the library, if enough of it isn't indexed yet.
  *
- * This function returns a string that is dynamically-allocated, as if
- * malloc() were called. The caller is responsible for freeing the memory
- * used by this string.
+ * The index is built from a copy of the library's names, so the library
+ * can keep changing in the meantime. Nodes added since are searched one by
+ * one, and once @ref INDEX_MIN_TAIL of them pile up, the index is rebuilt.
  */
-char *mpdclient_get_song_artist(struct mpd_song *song)
+static void mpdclient_index_library(struct mpdclient *mpd)
 {
-    const char *artist = mpd_song_get_tag(song, MPD_TAG_ARTIST, 0);
+    struct library *library = mpd->library;
+    if (!mpd->index_budget || mpd->index_pending || library->state != NODE_LOADED) {
+        return;
+    }
 
-    char *return_value = malloc(sizeof(char) * strlen(artist));
-    strcpy(return_value, artist);  // NOLINT
+    unsigned covered = 0;
+    if (library->index && library->index->generation == library->generation) {
+        covered = library->index->num_nodes;
+    }
+    /* An index that didn't fit in the budget isn't tried again until the library grows. */
+    if (mpd->index_generation == library->generation && mpd->index_attempted > covered) {
+        covered = mpd->index_attempted;
+    }
+    if (vector_get_length(library->nodes) < covered + INDEX_MIN_TAIL) {
+        return;
+    }
+
+    struct mpd_job *job = mpd_job_new(JOB_INDEX_LIBRARY);
+    if (!job) {
+        return;
+    }
 
-    return return_value;
+    job->source = library_index_snapshot(library);
+    job->index_budget = mpd->index_budget;
+    job->pool = mpd->pool;
+    job->generation = library->generation;
+    if (!job->source) {
+        mpd_job_free(job);
+        return;
+    }
+
+    unsigned num_nodes = job->source->num_nodes;
+    if (mpdclient_submit(mpd, job) != 0) {
+        return;
+    }
+
+    mpd->index_pending = 1;
+    mpd->index_generation = library->generation;
+    mpd->index_attempted = num_nodes;
 }
 
 /**
- * @brief Get the name of the album a song belongs to.
+ * @brief Starts searching the library with a newly built index.
  *
- * @param song The song to query.
+ * @param mpd The connection to MPD.
+ * @param job The finished job.
+ */
+static void mpdclient_apply_index(struct mpdclient *mpd, struct mpd_job *job)
+{
+    struct library *library = mpd->library;
+    struct library_index *index = job->index;
+
+    if (!index || index->generation != library->generation ||
+        (library->index && library->index->num_nodes >= index->num_nodes)) {
+        return;
+    }
+
+    library_index_free(library->index);
+    library->index = index;
+    job->index = NULL;
+    mpd->index_unsaved = 1;
+}
+
+/**
+ * @brief Requests the children of a library node, unless they are loaded or on their way.
+ *
+ * Artists are listed with a single tag query, albums with a tag query
+ * constrained to the artist, and tracks with an exact search for the artist
+ * and album. The whole database is never downloaded.
+ *
+ * The first time the artist list is needed, the library saved by the last
+ * run is loaded instead, if there is one. It is shown straight away and
+ * thrown out if the server reports a newer database.
+ *
+ * @param mpd The connection to MPD.
+ * @param node The index of the node to expand, or @ref LIBRARY_NO_NODE for the artist list.
+ */
+void mpdclient_load_library(struct mpdclient *mpd, unsigned node)
+{
+    struct library *library = mpd->library;
+    struct library_node *parent = NULL;
+    struct mpd_job *job;
+
+    if (node == LIBRARY_NO_NODE) {
+        if (library->state != NODE_UNLOADED) {
+            return;
+        }
+
+        if (!mpd->library_cache_checked) {
+            mpd->library_cache_checked = 1;
+
+            if (mpd->library_cache && library_cache_load(library, mpd->library_cache) == 0) {
+                mpd->library_saved_at = library->version;
+                mpdclient_check_library(mpd);
+                mpdclient_index_library(mpd);
+                return;
+            }
+        }
+
+        mpdclient_check_library(mpd);
+        job = mpd_job_new(JOB_LIST_TAGS);
+        if (!job) {
+            return;
+        }
+        job->tag = MPD_TAG_ARTIST;
+    }
+    else {
+        parent = library_get_node(library, node);
+        if (!parent || parent->state != NODE_UNLOADED) {
+            return;
+        }
+
+        if (parent->level == LIBRARY_ARTIST) {
+            job = mpd_job_new(JOB_LIST_TAGS);
+            if (!job) {
+                return;
+            }
+            job->tag = MPD_TAG_ALBUM;
+            job->artist = strdup(library_get_name(library, parent));
+        }
+        else {
+            job = mpd_job_new(JOB_FIND_SONGS);
+            if (!job) {
+                return;
+            }
+            struct library_node *artist = library_get_node(library, parent->parent);
+            job->artist = strdup(library_get_name(library, artist));
+            job->album = strdup(library_get_name(library, parent));
+        }
+
+        if (!job->artist || (job->type == JOB_FIND_SONGS && !job->album)) {
+            mpd_job_free(job);
+            return;
+        }
+    }
+
+    job->node = node;
+    job->generation = library->generation;
+
+    if (mpdclient_submit(mpd, job) != 0) {
+        return;
+    }
+
+    if (parent) {
+        parent->state = NODE_LOADING;
+    }
+    else {
+        library->state = NODE_LOADING;
+    }
+}
+
+/**
+ * @brief Changes the volume, once mpdclient_send_controls() is called.
+ *
+ * Changes made before then are added up and sent as one.
+ *
+ * @param mpd The connection to MPD.
+ * @param delta The percentage points to change the volume by.
+ */
+void mpdclient_change_volume(struct mpdclient *mpd, int delta)
+{
+    mpd->volume_delta += delta;
+    mpd->volume_delta = mpd->volume_delta < -100 ? -100 : mpd->volume_delta;
+    mpd->volume_delta = mpd->volume_delta > 100 ? 100 : mpd->volume_delta;
+}
+
+/**
+ * @brief Seeks within the current song, once mpdclient_send_controls() is called.
+ *
+ * Seeks made before then are added up and sent as one.
+ *
+ * @param mpd The connection to MPD.
+ * @param seconds How far to seek, negative to go back.
+ */
+void mpdclient_seek(struct mpdclient *mpd, int seconds)
+{
+    mpd->seek_delta += seconds;
+}
+
+/**
+ * @brief Checks whether there are volume changes or seeks waiting for mpdclient_send_controls().
+ *
+ * @param mpd The connection to MPD.
+ */
+int mpdclient_has_unsent_controls(struct mpdclient *mpd)
+{
+    return mpd->volume_delta || mpd->seek_delta;
+}
+
+/**
+ * @brief Sends the volume changes and seeks made since the last call.
+ *
+ * However many there were, they cost one round trip to the server, or two
+ * if the volume has to be read first. Callers should wait for the changes to
+ * pause before sending, so that the repeats of a held-down key are sent
+ * together.
+ *
+ * @param mpd The connection to MPD.
+ */
+void mpdclient_send_controls(struct mpdclient *mpd)
+{
+    if (!mpdclient_has_unsent_controls(mpd) || mpd->last_error != MPD_ERROR_SUCCESS) {
+        return;
+    }
+
+    struct mpd_job *job = mpd_job_new(JOB_CONTROL);
+    if (!job) {
+        return;
+    }
+    job->volume_delta = mpd->volume_delta;
+    job->seek_delta = mpd->seek_delta;
+
+    if (mpdclient_submit(mpd, job) == 0) {
+        mpd->volume_delta = 0;
+        mpd->seek_delta = 0;
+        ++mpd->controls_pending;
+    }
+}
+
+/**
+ * @brief Drops the loaded pages of a lazily-loaded queue that overlap a range of positions.
+ */
+static void mpdclient_drop_pages(struct mpdclient *mpd, unsigned start, unsigned end)
+{
+    for (unsigned page = start / QUEUE_PAGE_SIZE; page * QUEUE_PAGE_SIZE < end; ++page) {
+        pagecache_drop_page(mpd->pages, page);
+    }
+}
+
+/**
+ * @brief Adds an edit to the ones waiting for mpdclient_send_edits().
+ *
+ * A delete that ends where the last one started, or starts there, is merged
+ * into it, so deleting song after song sends a single range.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+static int mpdclient_record_edit(struct mpdclient *mpd, const struct queue_edit *edit)
+{
+    unsigned count = vector_get_length(mpd->edits);
+    struct queue_edit *last = count ? vector_at(mpd->edits, count - 1) : NULL;
+
+    if (edit->type == EDIT_DELETE && last && last->type == EDIT_DELETE) {
+        /* The last delete's range is in positions from before it was made. */
+        if (edit->start == last->start) {
+            last->end += edit->end - edit->start;
+            return 0;
+        }
+        if (edit->end == last->start) {
+            last->start = edit->start;
+            return 0;
+        }
+    }
+
+    return vector_push(mpd->edits, edit) == VEC_ERROR_SUCCESS ? 0 : -1;
+}
+
+/**
+ * @brief Deletes a range of songs from the queue.
+ *
+ * The songs leave the local queue straight away, and the server's queue
+ * once mpdclient_send_edits() is called.
+ *
+ * @param mpd The connection to MPD.
+ * @param start The position of the first song to delete.
+ * @param end The position after the last song to delete.
+ *
+ * @return 0 on success, or -1 if the range is out of bounds or memory ran out.
+ */
+int mpdclient_delete(struct mpdclient *mpd, unsigned start, unsigned end)
+{
+    unsigned length = mpdclient_get_queue_length(mpd);
+    if (start >= end || end > length) {
+        return -1;
+    }
+
+    if (mpd->pages && pagecache_set_length(mpd->pages, length - (end - start)) != 0) {
+        return -1;
+    }
+
+    struct queue_edit edit = {EDIT_DELETE, start, end, 0, NULL};
+    if (mpdclient_record_edit(mpd, &edit) != 0) {
+        /* The cache held this length a moment ago, so it can't fail to again. */
+        if (mpd->pages) {
+            pagecache_set_length(mpd->pages, length);
+        }
+        return -1;
+    }
+
+    if (mpd->pages) {
+        mpdclient_drop_pages(mpd, start, length);
+    }
+    else {
+        vector_remove_range(mpd->queue, start, end, NULL);
+    }
+    ++mpd->edits_made;
+
+    return 0;
+}
+
+/**
+ * @brief Moves a range of songs within the queue.
+ *
+ * Like MPD's "move START:END TO", the first song of the range ends up at
+ * @p to. The local queue changes straight away, and the server's once
+ * mpdclient_send_edits() is called.
+ *
+ * @param mpd The connection to MPD.
+ * @param start The position of the first song to move.
+ * @param end The position after the last song to move.
+ * @param to The position the first song moves to.
+ *
+ * @return 0 on success, or -1 if the range or the destination is out of bounds or memory ran out.
+ */
+int mpdclient_move(struct mpdclient *mpd, unsigned start, unsigned end, unsigned to)
+{
+    unsigned length = mpdclient_get_queue_length(mpd);
+    if (start >= end || end > length || to > length - (end - start)) {
+        return -1;
+    }
+    if (to == start) {
+        return 0;
+    }
+
+    struct queue_edit edit = {EDIT_MOVE, start, end, to, NULL};
+    if (mpdclient_record_edit(mpd, &edit) != 0) {
+        return -1;
+    }
+
+    if (mpd->pages) {
+        unsigned to_end = to + (end - start);
+        mpdclient_drop_pages(mpd, to < start ? to : start, to_end > end ? to_end : end);
+    }
+    else {
+        vector_move_range(mpd->queue, start, end, to);
+    }
+    ++mpd->edits_made;
+
+    return 0;
+}
+
+/**
+ * @brief Adds a song from the database to the queue.
+ *
+ * Until the queue is next updated, the local queue shows the song by its
+ * file name, with no other tags.
+ *
+ * @param mpd The connection to MPD.
+ * @param uri The song's path in the database.
+ * @param to The position to add the song at, or the queue's length to add it at the end.
+ *
+ * @return 0 on success, or -1 if @p to is out of bounds or memory ran out.
+ */
+int mpdclient_add(struct mpdclient *mpd, const char *uri, unsigned to)
+{
+    unsigned length = mpdclient_get_queue_length(mpd);
+    if (to > length) {
+        return -1;
+    }
+
+    struct queue_edit edit = {EDIT_ADD, 0, 0, to, strdup(uri)};
+    if (!edit.uri) {
+        return -1;
+    }
+
+    /* Make room locally first, so that an edit is only recorded once it has been applied. */
+    int grown;
+    if (mpd->pages) {
+        grown = pagecache_set_length(mpd->pages, length + 1) == 0;
+    }
+    else {
+        const char *slash = strrchr(uri, '/');
+        struct song song = {mpd->placeholder_id--, 0, 0, INTERN_EMPTY, INTERN_EMPTY};
+        song.title = intern_table_add(mpd->strings, slash ? slash + 1 : uri);
+        grown = vector_insert(mpd->queue, to, &song, 1) == VEC_ERROR_SUCCESS;
+    }
+
+    if (!grown || mpdclient_record_edit(mpd, &edit) != 0) {
+        if (grown && mpd->pages) {
+            pagecache_set_length(mpd->pages, length);
+        }
+        else if (grown) {
+            vector_remove_range(mpd->queue, to, to + 1, NULL);
+        }
+        free(edit.uri);
+        return -1;
+    }
+
+    if (mpd->pages) {
+        mpdclient_drop_pages(mpd, to, length + 1);
+    }
+    ++mpd->edits_made;
+
+    return 0;
+}
+
+/**
+ * @brief Checks whether there are queue edits waiting for mpdclient_send_edits().
+ *
+ * @param mpd The connection to MPD.
+ */
+int mpdclient_has_unsent_edits(struct mpdclient *mpd)
+{
+    return vector_get_length(mpd->edits) != 0;
+}
+
+/**
+ * @brief Sends the queue edits made since the last call.
+ *
+ * However many there were, they go in one command list and cost one round
+ * trip to the server. Lazily-loaded pages aren't fetched while edits are
+ * waiting, so callers should send soon after the first edit, though not
+ * so soon that the repeats of a held-down key go one at a time.
+ *
+ * @param mpd The connection to MPD.
+ */
+void mpdclient_send_edits(struct mpdclient *mpd)
+{
+    if (!mpdclient_has_unsent_edits(mpd) || mpd->last_error != MPD_ERROR_SUCCESS) {
+        return;
+    }
+
+    struct vector *edits = vector_new(sizeof(struct queue_edit));
+    struct mpd_job *job = mpd_job_new(JOB_EDIT_QUEUE);
+    if (!edits || !job) {
+        vector_free(edits, NULL);
+        mpd_job_free(job);
+        return;
+    }
+
+    /* The edits are already made locally, so keep them to try again rather than drop them. */
+    job->edits = mpd->edits;
+    if (mpd_worker_submit(mpd->worker, job) != 0) {
+        job->edits = NULL;
+        mpd_job_free(job);
+        vector_free(edits, NULL);
+        return;
+    }
+    mpd->edits = edits;
+    ++mpd->edits_pending;
+}
+
+/**
+ * @brief Gets the current monotonic time in milliseconds.
+ */
+static long long mpdclient_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Sends the changes waiting to be sent, and waits until the server has made them.
+ *
+ * This should be called before quitting, since jobs the worker thread
+ * hasn't started when it stops are dropped. The wait for edits lasts until
+ * the queue update that follows them has been applied, so that the local
+ * queue matches its version again and can be saved.
+ *
+ * @param mpd The connection to MPD.
+ * @param timeout The longest to wait, in milliseconds.
+ *
+ * @return 0 once the local queue matches the server's, or -1 on error or if time ran out.
+ */
+int mpdclient_flush(struct mpdclient *mpd, int timeout)
+{
+    long long deadline = mpdclient_now_ms() + timeout;
+    struct pollfd fd = {mpdclient_get_fd(mpd), POLLIN, 0};
+
+    while (mpd->last_error == MPD_ERROR_SUCCESS &&
+           (mpdclient_has_unsent_controls(mpd) || mpd->controls_pending ||
+            mpd->edits_synced != mpd->edits_made)) {
+        /* Sending only fails while the worker's ring is full, so try again each time. */
+        mpdclient_send_controls(mpd);
+        mpdclient_send_edits(mpd);
+
+        long long remaining = deadline - mpdclient_now_ms();
+        if (remaining <= 0) {
+            break;
+        }
+
+        int ready = poll(&fd, 1, (int)remaining);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        if (ready > 0) {
+            mpdclient_handle_results(mpd);
+        }
+    }
+
+    return mpd->last_error == MPD_ERROR_SUCCESS && mpd->edits_synced == mpd->edits_made ? 0 : -1;
+}
+
+/**
+ * @brief Applies the results of every job the worker thread has finished.
  *
- * @return A dynamically-allocated string containing the name of the song's album name.
+ * This should be called when the descriptor from mpdclient_get_fd() becomes
+ * readable.
+ *
+ * @param mpd The connection to MPD.
+ *
+ * @return The number of jobs applied. If nonzero, the screen should be redrawn.
+ */
+unsigned mpdclient_handle_results(struct mpdclient *mpd)
+{
+    struct mpd_job *job;
+    unsigned count = 0;
+
+    while ((job = mpd_worker_receive(mpd->worker))) {
+        if (job->type == JOB_FETCH_RANGE) {
+            mpd->fetch_pending = 0;
+        }
+        else if (job->type == JOB_INDEX_LIBRARY) {
+            mpd->index_pending = 0;
+        }
+        else if (job->type == JOB_CONTROL) {
+            --mpd->controls_pending;
+        }
+        else if (job->type == JOB_EDIT_QUEUE) {
+            --mpd->edits_pending;
+        }
+
+        if (job->error != MPD_ERROR_SUCCESS) {
+            if (mpd->last_error == MPD_ERROR_SUCCESS) {
+                mpd->last_error = job->error;
+                mpd->error_message = job->error_message;
+                job->error_message = NULL;
+            }
+        }
+        else if (job->type == JOB_FETCH_RANGE) {
+            mpdclient_apply_range(mpd, job);
+        }
+        else if (job->type == JOB_LIST_TAGS || job->type == JOB_FIND_SONGS) {
+            mpdclient_apply_library(mpd, job);
+        }
+        else if (job->type == JOB_DB_STATS) {
+            mpdclient_apply_db_stats(mpd, job);
+        }
+        else if (job->type == JOB_INDEX_LIBRARY) {
+            mpdclient_apply_index(mpd, job);
+        }
+        else if (job->type == JOB_CONTROL) {
+            mpd->volume = job->volume;
+        }
+        else if (job->has_queue) {
+            mpdclient_apply_queue(mpd, job);
+        }
+
+        if (job->events & MPD_IDLE_DATABASE) {
+            /* Anything browsed so far may be out of date, so fetch it again when needed. */
+            library_clear(mpd->library);
+        }
+
+        mpd_job_free(job);
+        ++count;
+    }
+
+    if (count) {
+        mpdclient_index_library(mpd);
+    }
+
+    return count;
+}
+
+/**
+ * @brief Requests the songs in a range of a lazily-loaded queue that aren't loaded yet.
+ *
+ * Consecutive missing pages are fetched in a single request. Only one
+ * request is outstanding at a time. Once it has been applied, the caller
+ * redraws and asks again for anything still missing. This does nothing if
+ * the whole queue is loaded.
+ *
+ * @param mpd The connection to MPD.
+ * @param start The position of the first song needed.
+ * @param end The position after the last song needed.
+ */
+void mpdclient_prefetch_queue(struct mpdclient *mpd, unsigned start, unsigned end)
+{
+    /* Until edits made locally are sent, the server would return songs they have moved. */
+    if (!mpd->pages || mpd->fetch_pending || mpd->last_error != MPD_ERROR_SUCCESS ||
+        mpdclient_has_unsent_edits(mpd)) {
+        return;
+    }
+    if (end > mpd->pages->length) {
+        end = mpd->pages->length;
+    }
+    if (start >= end) {
+        return;
+    }
+
+    unsigned page = start / QUEUE_PAGE_SIZE;
+    unsigned last = (end - 1) / QUEUE_PAGE_SIZE + 1;
+    while (page < last && pagecache_has_page(mpd->pages, page)) {
+        ++page;
+    }
+    if (page == last) {
+        return;
+    }
+
+    unsigned run_end = page;
+    while (run_end < last && !pagecache_has_page(mpd->pages, run_end)) {
+        ++run_end;
+    }
+
+    struct mpd_job *job = mpd_job_new(JOB_FETCH_RANGE);
+    if (!job) {
+        return;
+    }
+    job->start = page * QUEUE_PAGE_SIZE;
+    job->end = run_end * QUEUE_PAGE_SIZE;
+    job->edits_made = mpd->edits_made;
+
+    if (mpdclient_submit(mpd, job) == 0) {
+        mpd->fetch_pending = 1;
+    }
+}
+
+/**
+ * @brief Gets the number of songs in the queue.
  *
- * This function returns a string that is dynamically-allocated, as if
- * malloc() were called. The caller is responsible for freeing the memory
- * used by this string.
+ * @param mpd The connection to MPD.
  */
-char *mpdclient_get_song_album(struct mpd_song *song)
+unsigned mpdclient_get_queue_length(struct mpdclient *mpd)
 {
-    const char *album = mpd_song_get_tag(song, MPD_TAG_ALBUM, 0);
+    if (mpd->pages) {
+        return mpd->pages->length;
+    }
 
-    char *return_value = malloc(sizeof(char) * strlen(album));
-    strcpy(return_value, album);  // NOLINT
+    return vector_get_length(mpd->queue);
+}
 
-    return return_value;
+/**
+ * @brief Gets the song at a queue position.
+ *
+ * @param mpd The connection to MPD.
+ * @param pos The queue position.
+ *
+ * @return The song, or NULL if it is out of range or hasn't been loaded yet.
+ */
+const struct song *mpdclient_get_queue_song(struct mpdclient *mpd, unsigned pos)
+{
+    if (mpd->pages) {
+        return pagecache_get(mpd->pages, pos);
+    }
+
+    return vector_at(mpd->queue, pos);
+}
+
+/**
+ * @brief Gets the song at a queue position without counting it as a use of its page.
+ *
+ * @param mpd The connection to MPD.
+ * @param pos The queue position.
+ *
+ * @return The song, or NULL if it is out of range or hasn't been loaded yet.
+ */
+const struct song *mpdclient_peek_queue_song(const struct mpdclient *mpd, unsigned pos)
+{
+    if (mpd->pages) {
+        return pagecache_peek(mpd->pages, pos);
+    }
+
+    return pos < vector_get_length(mpd->queue) ? vector_at(mpd->queue, pos) : NULL;
+}
+
+/**
+ * @brief Forgets which queue songs changed, once the changes have been acted upon.
+ *
+ * Every queue update records the ids of the songs it touched in
+ * @ref mpdclient::changed_ids, or sets @ref mpdclient::queue_reloaded if the
+ * whole queue was downloaded again, so that cached views of the queue can
+ * be invalidated selectively.
+ *
+ * @param mpd The connection to MPD.
+ */
+void mpdclient_clear_queue_changes(struct mpdclient *mpd)
+{
+    vector_clear(mpd->changed_ids, NULL);
+    mpd->queue_reloaded = 0;
+}
+
+/**
+ * @brief Gets a file descriptor that becomes readable when the worker thread has results.
+ *
+ * At that point, mpdclient_handle_results() should be called.
+ *
+ * @param mpd The connection to MPD.
+ */
+int mpdclient_get_fd(struct mpdclient *mpd)
+{
+    return mpd_worker_get_fd(mpd->worker);
+}
+
+/**
+ * @brief Get a song's title.
+ *
+ * @param mpd The connection to MPD.
+ * @param song The song to query.
+ *
+ * @return The song's title. The string is owned by the client and must not be freed.
+ */
+const char *mpdclient_get_song_title(struct mpdclient *mpd, const struct song *song)
+{
+    return intern_table_get(mpd->strings, song->title);
+}
+
+/**
+ * @brief Get the name of a song's artist.
+ *
+ * @param mpd The connection to MPD.
+ * @param song The song to query.
+ *
+ * @return The name of the song's artist. The string is owned by the client and must not be freed.
+ */
+const char *mpdclient_get_song_artist(struct mpdclient *mpd, const struct song *song)
+{
+    return intern_table_get(mpd->strings, song->artist);
+}
+
+/**
+ * @brief Get the name of the album a song belongs to.
+ *
+ * @param mpd The connection to MPD.
+ * @param song The song to query.
+ *
+ * @return The name of the song's album. The string is owned by the client and must not be freed.
+ */
+const char *mpdclient_get_song_album(struct mpdclient *mpd, const struct song *song)
+{
+    return intern_table_get(mpd->strings, song->album);
 }
 
 /**
@@ -225,7 +1297,7 @@ char *mpdclient_get_song_album(struct mpd_song *song)
  *
  * @return An unsigned integer representing the song's length in seconds.
  */
-unsigned mpdclient_get_song_length(struct mpd_song *song)
+unsigned mpdclient_get_song_length(const struct song *song)
 {
-    return mpd_song_get_duration(song);
+    return song->duration;
 }
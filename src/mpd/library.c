@@ -0,0 +1,255 @@
+/*******************************************************************************
+ * library.c - Lazily loaded tree of the MPD database.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file library.h
+ */
+
+#include "pantomime/mpd/library.h"
+
+#include <stdlib.h>
+
+#include "pantomime/mpd/library_index.h"
+#include "pantomime/mpd/song.h"
+
+/**
+ * @brief Creates an empty library.
+ *
+ * @return A newly-allocated library, or NULL on error.
+ */
+struct library *library_new(void)
+{
+    struct library *library = malloc(sizeof(*library));
+    if (!library) {
+        return NULL;
+    }
+
+    library->nodes = vector_new(sizeof(struct library_node));
+    library->strings = intern_table_new();
+    if (!library->nodes || !library->strings) {
+        vector_free(library->nodes, NULL);
+        intern_table_free(library->strings);
+        free(library);
+        return NULL;
+    }
+
+    library->num_artists = 0;
+    library->state = NODE_UNLOADED;
+    library->generation = 0;
+    library->version = 0;
+    library->db_update = 0;
+    library->index = NULL;
+
+    return library;
+}
+
+/**
+ * @brief Frees a library and every node in it.
+ *
+ * @param library The library to free.
+ */
+void library_free(struct library *library)
+{
+    if (!library) {
+        return;
+    }
+
+    vector_free(library->nodes, NULL);
+    intern_table_free(library->strings);
+    library_index_free(library->index);
+    free(library);
+}
+
+/**
+ * @brief Forgets everything that was loaded, so that it gets fetched again.
+ *
+ * Results of requests made before this call are ignored when they arrive.
+ *
+ * @param library The library to clear.
+ */
+void library_clear(struct library *library)
+{
+    vector_clear(library->nodes, NULL);
+    intern_table_clear(library->strings);
+
+    library->num_artists = 0;
+    library->state = NODE_UNLOADED;
+    library->db_update = 0;
+    library_index_free(library->index);
+    library->index = NULL;
+    ++library->generation;
+    ++library->version;
+}
+
+/**
+ * @brief Gets a node by index.
+ *
+ * The pointer is only valid until the next node is added.
+ *
+ * @return The node, or NULL if the index is out of range.
+ */
+struct library_node *library_get_node(struct library *library, unsigned index)
+{
+    return vector_at(library->nodes, index);
+}
+
+/**
+ * @brief Gets the name of a node. The string belongs to the library.
+ */
+const char *library_get_name(struct library *library, const struct library_node *node)
+{
+    return intern_table_get(library->strings, node->name);
+}
+
+/**
+ * @brief Appends a node to the library.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+static int library_add_node(struct library *library, unsigned parent, enum library_level level,
+                            const char *name)
+{
+    struct library_node node = {0};
+    node.name = intern_table_add(library->strings, name);
+    node.parent = parent;
+    node.level = level;
+    node.state = level == LIBRARY_TRACK ? NODE_LOADED : NODE_UNLOADED;
+
+    return vector_push(library->nodes, &node) == VEC_ERROR_SUCCESS ? 0 : -1;
+}
+
+/**
+ * @brief Fills in the list of artists.
+ *
+ * @param library The library to fill.
+ * @param names The artist names, as pointers to strings.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+int library_set_artists(struct library *library, struct vector *names)
+{
+    /* The update time arrives first, and still describes the new list. */
+    unsigned long db_update = library->db_update;
+    library_clear(library);
+    library->db_update = db_update;
+
+    unsigned count = names ? vector_get_length(names) : 0;
+    if (vector_reserve(library->nodes, count) != VEC_ERROR_SUCCESS) {
+        return -1;
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        library_add_node(library, LIBRARY_NO_NODE, LIBRARY_ARTIST, *(char **)vector_at(names, i));
+    }
+
+    library->num_artists = count;
+    library->state = NODE_LOADED;
+    ++library->version;
+
+    return 0;
+}
+
+/**
+ * @brief Marks where a node's children start, before they are appended.
+ *
+ * @return The node, or NULL if it doesn't exist or already has children.
+ */
+static struct library_node *library_begin_children(struct library *library, unsigned index)
+{
+    struct library_node *node = library_get_node(library, index);
+    if (!node || node->state == NODE_LOADED) {
+        return NULL;
+    }
+
+    node->first_child = vector_get_length(library->nodes);
+    node->num_children = 0;
+    return node;
+}
+
+/**
+ * @brief Records that a node's children have been appended.
+ */
+static void library_end_children(struct library *library, unsigned index)
+{
+    /* Appending may have moved the nodes, so look the parent up again. */
+    struct library_node *node = library_get_node(library, index);
+    node->num_children = vector_get_length(library->nodes) - node->first_child;
+    node->state = NODE_LOADED;
+    ++library->version;
+}
+
+/**
+ * @brief Fills in an artist's albums.
+ *
+ * @param library The library to fill.
+ * @param artist The index of the artist's node.
+ * @param names The album names, as pointers to strings.
+ *
+ * @return 0 on success, or -1 on error.
+ */
+int library_set_albums(struct library *library, unsigned artist, struct vector *names)
+{
+    if (!library_begin_children(library, artist)) {
+        return -1;
+    }
+
+    unsigned count = names ? vector_get_length(names) : 0;
+    for (unsigned i = 0; i < count; ++i) {
+        library_add_node(library, artist, LIBRARY_ALBUM, *(char **)vector_at(names, i));
+    }
+
+    library_end_children(library, artist);
+    return 0;
+}
+
+/**
+ * @brief Fills in an album's tracks.
+ *
+ * @param library The library to fill.
+ * @param album The index of the album's node.
+ * @param songs The tracks, as pointers to struct mpd_song.
+ *
+ * @return 0 on success, or -1 on error.
+ */
+int library_set_tracks(struct library *library, unsigned album, struct vector *songs)
+{
+    if (!library_begin_children(library, album)) {
+        return -1;
+    }
+
+    struct song song;
+    unsigned count = songs ? vector_get_length(songs) : 0;
+    for (unsigned i = 0; i < count; ++i) {
+        const struct mpd_song *mpd_song = *(struct mpd_song **)vector_at(songs, i);
+        song_from_mpd(&song, mpd_song, library->strings);
+
+        struct library_node node = {0};
+        node.name = song.title;
+        node.parent = album;
+        node.uri = intern_table_add(library->strings, mpd_song_get_uri(mpd_song));
+        node.duration = song.duration;
+        node.level = LIBRARY_TRACK;
+        node.state = NODE_LOADED;
+
+        vector_push(library->nodes, &node);
+    }
+
+    library_end_children(library, album);
+    return 0;
+}
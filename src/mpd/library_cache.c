@@ -0,0 +1,384 @@
+/*******************************************************************************
+ * library_cache.c - On-disk copy of the browsed parts of the library.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file library_cache.h
+ *
+ * @brief Saves the library tree so that the next start doesn't have to fetch it again.
+ *
+ * The file is laid out so that it can be mapped and copied straight into
+ * memory, without parsing:
+ *
+ *     header | node records | string table | padding | search index
+ *
+ * The records have a fixed width and refer to their strings by offset into
+ * the string table, which is the library's intern table saved verbatim. The
+ * header records the database update time the tree was fetched at, so a
+ * file from before the last database update is ignored.
+ *
+ * The search index is optional. It is the library index's posting lists
+ * saved verbatim and padded to their alignment, so when the file is loaded
+ * they are used straight from the mapping instead of being copied.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pantomime/mpd/library_cache.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pantomime/mpd/library_index.h"
+
+/**
+ * @brief Identifies a library cache file.
+ */
+#define LIBRARY_CACHE_MAGIC "PNTMLIB"
+
+/**
+ * @brief The version of the file format. Bump it whenever the layout changes.
+ */
+#define LIBRARY_CACHE_FORMAT 2
+
+/**
+ * @brief Written as a number so that files from a machine with a different byte order are ignored.
+ */
+#define LIBRARY_CACHE_BYTE_ORDER 0x01020304U
+
+/**
+ * @brief The start of a cache file.
+ */
+struct library_cache_header {
+    char magic[8];           /** @ref LIBRARY_CACHE_MAGIC. */
+    uint32_t format;         /** @ref LIBRARY_CACHE_FORMAT. */
+    uint32_t byte_order;     /** @ref LIBRARY_CACHE_BYTE_ORDER. */
+    uint64_t db_update;      /** The database update time the tree was fetched at. */
+    uint32_t num_nodes;      /** The number of records after the header. */
+    uint32_t num_artists;    /** The number of artists, which come first. */
+    uint64_t strings_size;   /** The number of bytes in the string table after the records. */
+    uint32_t index_nodes;    /** The number of nodes the search index covers, or 0 for none. */
+    uint32_t index_buckets;  /** @ref LIBRARY_INDEX_BUCKETS, so other shapes are ignored. */
+    uint64_t index_postings; /** The number of postings in the search index. */
+};
+
+/**
+ * @brief A @ref library_node as stored on disk.
+ */
+struct library_cache_record {
+    uint32_t name;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t num_children;
+    uint32_t uri;
+    uint32_t duration;
+    uint8_t level;
+    uint8_t loaded; /** Whether the node's children are in the file. */
+    uint8_t padding[2];
+};
+
+/**
+ * @brief Checks that the records describe a well-formed tree before anything trusts them.
+ */
+static int library_cache_check(const struct library_cache_header *header,
+                               const struct library_cache_record *records)
+{
+    if (header->num_artists > header->num_nodes) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < header->num_nodes; ++i) {
+        const struct library_cache_record *record = &records[i];
+
+        if (record->level > LIBRARY_TRACK || record->name >= header->strings_size ||
+            record->uri >= header->strings_size) {
+            return -1;
+        }
+        if ((i < header->num_artists) != (record->parent == LIBRARY_NO_NODE)) {
+            return -1;
+        }
+        if (record->parent != LIBRARY_NO_NODE && record->parent >= i) {
+            return -1;
+        }
+
+        /* Children always come after their parent, which rules out cycles. */
+        if (record->num_children &&
+            (!record->loaded || record->first_child <= i ||
+             record->num_children > header->num_nodes ||
+             record->first_child > header->num_nodes - record->num_children)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Gets the offset of the end of the string table.
+ */
+static uint64_t library_cache_strings_end(const struct library_cache_header *header)
+{
+    return sizeof(*header) + (uint64_t)header->num_nodes * sizeof(struct library_cache_record) +
+           header->strings_size;
+}
+
+/**
+ * @brief Gets the offset of the search index, just past the string table, aligned for its lists.
+ */
+static uint64_t library_cache_index_offset(const struct library_cache_header *header)
+{
+    uint64_t end = library_cache_strings_end(header);
+    return (end + sizeof(uint32_t) - 1) / sizeof(uint32_t) * sizeof(uint32_t);
+}
+
+/**
+ * @brief Gets the size of the search index, or 0 if the file has none.
+ */
+static uint64_t library_cache_index_size(const struct library_cache_header *header)
+{
+    if (!header->index_nodes) {
+        return 0;
+    }
+    return sizeof(uint32_t) * ((uint64_t)header->index_buckets + 1 + header->index_postings);
+}
+
+/**
+ * @brief Starts using the search index in a mapped cache file, if it has a usable one.
+ *
+ * @return 1 if the index took over the mapping, or 0 if it didn't.
+ */
+static int library_cache_read_index(struct library *library, void *map, size_t size)
+{
+    const struct library_cache_header *header = map;
+    if (!header->index_nodes || header->index_buckets != LIBRARY_INDEX_BUCKETS ||
+        header->index_nodes > header->num_nodes) {
+        return 0;
+    }
+
+    const uint32_t *lists = (const void *)((const char *)map + library_cache_index_offset(header));
+    library->index =
+        library_index_wrap(lists, header->index_postings, header->index_nodes, map, size);
+    if (!library->index) {
+        return 0;
+    }
+
+    library->index->generation = library->generation;
+    return 1;
+}
+
+/**
+ * @brief Copies the tree out of a mapped cache file into the library.
+ *
+ * @param library The library to fill.
+ * @param map The mapped file.
+ * @param size The size of the file.
+ * @param mapped Set to 1 if the library's search index took over the mapping, or 0 if not.
+ */
+static int library_cache_read(struct library *library, void *map, size_t size, int *mapped)
+{
+    const struct library_cache_header *header = map;
+    const struct library_cache_record *records = (const void *)(header + 1);
+    *mapped = 0;
+
+    if (memcmp(header->magic, LIBRARY_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->format != LIBRARY_CACHE_FORMAT || header->byte_order != LIBRARY_CACHE_BYTE_ORDER ||
+        header->num_nodes > (size - sizeof(*header)) / sizeof(*records) ||
+        header->strings_size > size || header->index_postings > size ||
+        header->index_buckets > size) {
+        return -1;
+    }
+
+    const char *strings = (const char *)(records + header->num_nodes);
+    uint64_t index_size = library_cache_index_size(header);
+    uint64_t end = index_size ? library_cache_index_offset(header) + index_size
+                              : library_cache_strings_end(header);
+    if (end != size || library_cache_check(header, records) != 0) {
+        return -1;
+    }
+
+    library_clear(library);
+    if (intern_table_load(library->strings, strings, header->strings_size) != 0 ||
+        vector_reserve(library->nodes, header->num_nodes) != VEC_ERROR_SUCCESS) {
+        library_clear(library);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < header->num_nodes; ++i) {
+        struct library_node node = {0};
+        node.name = records[i].name;
+        node.parent = records[i].parent;
+        node.first_child = records[i].first_child;
+        node.num_children = records[i].num_children;
+        node.uri = records[i].uri;
+        node.duration = records[i].duration;
+        node.level = records[i].level;
+        node.state = records[i].loaded ? NODE_LOADED : NODE_UNLOADED;
+        vector_push(library->nodes, &node);
+    }
+
+    library->num_artists = header->num_artists;
+    library->state = NODE_LOADED;
+    library->db_update = header->db_update;
+    ++library->version;
+
+    *mapped = library_cache_read_index(library, map, size);
+    return 0;
+}
+
+/**
+ * @brief Replaces the library with the tree saved in a cache file.
+ *
+ * The file is mapped rather than read, so loading costs little more than
+ * copying the records and strings into place. A saved search index isn't
+ * copied at all: the library keeps the file mapped and searches it in place.
+ * On success, the library's
+ * @ref library::db_update holds the update time the file was saved at, which
+ * the caller should compare with the server's.
+ *
+ * @param library The library to fill.
+ * @param path The cache file.
+ *
+ * @return 0 on success, or -1 if the file is missing, malformed, or memory ran out.
+ */
+int library_cache_load(struct library *library, const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct library_cache_header)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    int mapped;
+    int result = library_cache_read(library, map, size, &mapped);
+    if (!mapped) {
+        munmap(map, size);
+    }
+
+    return result;
+}
+
+/**
+ * @brief Writes the loaded parts of the library to a cache file.
+ *
+ * The file is written under a temporary name and renamed into place, so a
+ * crash never leaves a truncated cache behind. Nodes whose children were
+ * still on their way are saved as not loaded. The search index is saved
+ * too, if the library has one.
+ *
+ * @param library The library to save. Its artist list must be loaded.
+ * @param path The cache file.
+ *
+ * @return 0 on success, or -1 on error.
+ */
+int library_cache_save(struct library *library, const char *path)
+{
+    if (library->state != NODE_LOADED) {
+        return -1;
+    }
+
+    size_t strings_size;
+    const char *strings = intern_table_get_data(library->strings, &strings_size);
+
+    struct library_cache_header header;
+    memset(&header, 0, sizeof(header));  // NOLINT
+    memcpy(header.magic, LIBRARY_CACHE_MAGIC, sizeof(header.magic));  // NOLINT
+    header.format = LIBRARY_CACHE_FORMAT;
+    header.byte_order = LIBRARY_CACHE_BYTE_ORDER;
+    header.db_update = library->db_update;
+    header.num_nodes = vector_get_length(library->nodes);
+    header.num_artists = library->num_artists;
+    header.strings_size = strings_size;
+
+    const struct library_index *index = library->index;
+    if (index && index->generation == library->generation && index->num_nodes <= header.num_nodes) {
+        header.index_nodes = index->num_nodes;
+        header.index_buckets = LIBRARY_INDEX_BUCKETS;
+        header.index_postings = index->size / sizeof(uint32_t) - (LIBRARY_INDEX_BUCKETS + 1);
+    }
+
+    size_t length = strlen(path);
+    char *tmp_path = malloc(length + sizeof(".tmp"));
+    if (!tmp_path) {
+        return -1;
+    }
+    memcpy(tmp_path, path, length);  // NOLINT
+    memcpy(tmp_path + length, ".tmp", sizeof(".tmp"));  // NOLINT
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        free(tmp_path);
+        return -1;
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (uint32_t i = 0; ok && i < header.num_nodes; ++i) {
+        const struct library_node *node = library_get_node(library, i);
+        int loaded = node->state == NODE_LOADED;
+
+        struct library_cache_record record;
+        memset(&record, 0, sizeof(record));  // NOLINT
+        record.name = node->name;
+        record.parent = node->parent;
+        record.first_child = loaded ? node->first_child : 0;
+        record.num_children = loaded ? node->num_children : 0;
+        record.uri = node->uri;
+        record.duration = node->duration;
+        record.level = node->level;
+        record.loaded = loaded;
+
+        ok = fwrite(&record, sizeof(record), 1, file) == 1;
+    }
+    ok = ok && fwrite(strings, 1, strings_size, file) == strings_size;
+
+    if (header.index_nodes) {
+        static const char padding[sizeof(uint32_t)];
+        size_t unaligned = library_cache_index_offset(&header) - library_cache_strings_end(&header);
+        ok = ok && fwrite(padding, 1, unaligned, file) == unaligned;
+        ok = ok && fwrite(index->offsets, sizeof(uint32_t), LIBRARY_INDEX_BUCKETS + 1, file) ==
+                       LIBRARY_INDEX_BUCKETS + 1;
+        ok = ok && fwrite(index->postings, sizeof(uint32_t), header.index_postings, file) ==
+                       header.index_postings;
+    }
+
+    if (fclose(file) != 0 || !ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    free(tmp_path);
+    return 0;
+}
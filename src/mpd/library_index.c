@@ -0,0 +1,599 @@
+/*******************************************************************************
+ * library_index.c - Trigram index for searching the library.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file library_index.h
+ *
+ * @brief Narrows a library search down to a few candidates before any string is compared.
+ *
+ * Every run of three bytes in a node's case-folded name is hashed into one
+ * of @ref LIBRARY_INDEX_BUCKETS buckets, and each bucket lists the nodes
+ * that have such a trigram. A node can only contain a needle if it appears
+ * in the list of every trigram of the needle, so intersecting those lists,
+ * shortest first, leaves a small set of candidates. Hash collisions and
+ * trigrams in the wrong order can still let through nodes that don't match,
+ * so each candidate is checked with strmatch_contains().
+ *
+ * Needles shorter than a trigram can't use the index, and neither can
+ * nodes added since the index was built. Both are searched one node at a
+ * time.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pantomime/mpd/library_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "pantomime/intern.h"
+#include "pantomime/pool.h"
+#include "pantomime/strmatch.h"
+
+/**
+ * @brief The number of bytes in a trigram.
+ */
+#define TRIGRAM 3
+
+/**
+ * @brief The most trigrams of a needle that are looked up.
+ *
+ * Longer needles are still checked in full against each candidate.
+ */
+#define MAX_TRIGRAMS 64
+
+/**
+ * @brief The fewest nodes an index build gives a shard of its own.
+ *
+ * Every shard needs two arrays the size of the bucket table, so small
+ * libraries are built on one thread.
+ */
+#define MIN_SHARD_NODES 16384
+
+/**
+ * @brief Hashes a folded trigram into a bucket (Fibonacci hashing).
+ */
+static unsigned library_index_bucket(uint32_t key)
+{
+    return (key * 2654435761U) >> 16;
+}
+
+/**
+ * @brief Packs the trigram at the start of a folded string into a key for library_index_bucket().
+ */
+static uint32_t library_index_key(const unsigned char *trigram)
+{
+    return (uint32_t)trigram[0] << 16 | (uint32_t)trigram[1] << 8 | trigram[2];
+}
+
+/**
+ * @brief Copies the names of the library's nodes for library_index_build().
+ *
+ * @param library The library to copy.
+ *
+ * @return A newly-allocated copy, or NULL on error.
+ */
+struct library_index_source *library_index_snapshot(struct library *library)
+{
+    struct library_index_source *source = malloc(sizeof(*source));
+    if (!source) {
+        return NULL;
+    }
+
+    size_t size;
+    const char *strings = intern_table_get_data(library->strings, &size);
+
+    source->num_nodes = vector_get_length(library->nodes);
+    source->generation = library->generation;
+    source->strings = malloc(size);
+    source->names = malloc(sizeof(*source->names) * (source->num_nodes + 1));
+    if (!source->strings || !source->names) {
+        library_index_source_free(source);
+        return NULL;
+    }
+
+    memcpy(source->strings, strings, size);  // NOLINT
+    for (unsigned i = 0; i < source->num_nodes; ++i) {
+        source->names[i] = library_get_node(library, i)->name;
+    }
+
+    return source;
+}
+
+/**
+ * @brief Frees a copy made by library_index_snapshot().
+ */
+void library_index_source_free(struct library_index_source *source)
+{
+    if (!source) {
+        return;
+    }
+
+    free(source->strings);
+    free(source->names);
+    free(source);
+}
+
+/**
+ * @brief One shard of a snapshot's nodes, visited on one thread while building an index.
+ *
+ * Each shard counts its own postings, then fills them in at its own
+ * cursors, which start where the shards before it leave off in each
+ * bucket. Shards are runs of nodes in order, so every bucket's postings
+ * come out ascending, exactly as if one thread had visited every node.
+ */
+struct library_index_pass {
+    const struct library_index_source *source; /** The snapshot being indexed. */
+    uint32_t first;     /** The shard's first node. */
+    uint32_t end;       /** One past the shard's last node. */
+    uint32_t *last;     /** The last node added to each bucket, to skip repeated trigrams. */
+    uint32_t *lists;    /** The counts or cursors @ref visit updates. */
+    uint32_t *postings; /** Where @ref visit fills postings in. */
+    void (*visit)(const struct library_index_pass *pass, unsigned bucket,
+                  uint32_t node); /** Adds one posting. */
+};
+
+/**
+ * @brief Calls the pass's visitor with each distinct trigram bucket in a node's name.
+ *
+ * A trigram that occurs twice in one name would otherwise list the node
+ * twice. The pass remembers the last node added to each bucket, and since
+ * nodes are visited in order, that is enough to catch repeats.
+ */
+static void library_index_visit(const struct library_index_pass *pass, const char *name,
+                                uint32_t node)
+{
+    uint32_t key = 0;
+
+    for (size_t i = 0; name[i]; ++i) {
+        key = (key << 8 | strmatch_fold_char((unsigned char)name[i])) & 0xffffff;
+        if (i + 1 < TRIGRAM) {
+            continue;
+        }
+
+        unsigned bucket = library_index_bucket(key);
+        if (pass->last[bucket] != node) {
+            pass->last[bucket] = node;
+            pass->visit(pass, bucket, node);
+        }
+    }
+}
+
+/**
+ * @brief Visits every node in one shard. Called from the thread pool.
+ */
+static void library_index_run(void *data, unsigned shard)
+{
+    const struct library_index_pass *pass = (const struct library_index_pass *)data + shard;
+    const struct library_index_source *source = pass->source;
+
+    /* All ones is a node index no name has, so nothing counts as a repeat yet. */
+    memset(pass->last, 0xff, sizeof(*pass->last) * LIBRARY_INDEX_BUCKETS);  // NOLINT
+    for (uint32_t node = pass->first; node < pass->end; ++node) {
+        library_index_visit(pass, source->strings + source->names[node], node);
+    }
+}
+
+/**
+ * @brief Counts a posting.
+ *
+ * Counts are stored one bucket up, so that a prefix sum turns them into offsets.
+ */
+static void library_index_count(const struct library_index_pass *pass, unsigned bucket,
+                                uint32_t node)
+{
+    (void)node;
+    ++pass->lists[bucket + 1];
+}
+
+/**
+ * @brief Stores a posting at its bucket's cursor and advances the cursor.
+ */
+static void library_index_fill(const struct library_index_pass *pass, unsigned bucket,
+                               uint32_t node)
+{
+    pass->postings[pass->lists[bucket]++] = node;
+}
+
+/**
+ * @brief Frees the scratch space of the shards of an index build.
+ */
+static void library_index_free_passes(struct library_index_pass *passes, unsigned num_passes)
+{
+    for (unsigned shard = 0; shard < num_passes; ++shard) {
+        free(passes[shard].last);
+        free(passes[shard].lists);
+    }
+    free(passes);
+}
+
+/**
+ * @brief Splits a snapshot into shards, each with its own scratch space.
+ *
+ * @return The shards, or NULL if memory ran out.
+ */
+static struct library_index_pass *library_index_split(const struct library_index_source *source,
+                                                      unsigned num_passes)
+{
+    struct library_index_pass *passes = calloc(num_passes, sizeof(*passes));
+    if (!passes) {
+        return NULL;
+    }
+
+    for (unsigned shard = 0; shard < num_passes; ++shard) {
+        struct library_index_pass *pass = &passes[shard];
+        pass->source = source;
+        pass->first = pool_get_shard_start(source->num_nodes, num_passes, shard);
+        pass->end = pool_get_shard_start(source->num_nodes, num_passes, shard + 1);
+        pass->last = malloc(sizeof(*pass->last) * LIBRARY_INDEX_BUCKETS);
+        pass->lists = calloc(LIBRARY_INDEX_BUCKETS + 1, sizeof(*pass->lists));
+        pass->visit = library_index_count;
+        if (!pass->last || !pass->lists) {
+            library_index_free_passes(passes, num_passes);
+            return NULL;
+        }
+    }
+
+    return passes;
+}
+
+/**
+ * @brief Builds an index over the nodes in a snapshot.
+ *
+ * This takes a while for a large library, and touches nothing but the
+ * snapshot, so it can run on any thread. The nodes are split into shards,
+ * one per thread of the pool, which are counted and then filled in
+ * parallel. The index is the same however many shards there are.
+ *
+ * @param source The names of the nodes to index.
+ * @param budget The most memory the index may take, in bytes.
+ * @param pool The threads to build the index on, or NULL to build it on the calling thread.
+ *
+ * @return A newly-allocated index, or NULL if it wouldn't fit in the budget or memory ran out.
+ */
+struct library_index *library_index_build(const struct library_index_source *source,
+                                          size_t budget, struct pool *pool)
+{
+    unsigned num_passes = source->num_nodes / MIN_SHARD_NODES;
+    if (num_passes > pool_get_threads(pool)) {
+        num_passes = pool_get_threads(pool);
+    }
+    if (num_passes == 0) {
+        num_passes = 1;
+    }
+
+    struct library_index_pass *passes = library_index_split(source, num_passes);
+    struct library_index *index = malloc(sizeof(*index));
+    uint32_t *lists = NULL;
+
+    if (passes && index) {
+        pool_run(pool, num_passes, library_index_run, passes);
+
+        size_t num_postings = 0;
+        for (unsigned shard = 0; shard < num_passes; ++shard) {
+            for (unsigned bucket = 0; bucket < LIBRARY_INDEX_BUCKETS; ++bucket) {
+                num_postings += passes[shard].lists[bucket + 1];
+            }
+        }
+
+        index->size = sizeof(*lists) * (LIBRARY_INDEX_BUCKETS + 1 + num_postings);
+        if (index->size <= budget) {
+            lists = malloc(index->size);
+        }
+    }
+
+    if (!lists) {
+        if (passes) {
+            library_index_free_passes(passes, num_passes);
+        }
+        free(index);
+        return NULL;
+    }
+
+    /*
+     * Each bucket's postings start where the last bucket's end, and within
+     * a bucket, each shard's start where the last shard's end. A shard's
+     * counts are turned into its cursors in place: each count is read one
+     * bucket up before the cursor below it is written.
+     */
+    uint32_t *postings = lists + LIBRARY_INDEX_BUCKETS + 1;
+    uint32_t offset = 0;
+    for (unsigned bucket = 0; bucket < LIBRARY_INDEX_BUCKETS; ++bucket) {
+        lists[bucket] = offset;
+        for (unsigned shard = 0; shard < num_passes; ++shard) {
+            uint32_t count = passes[shard].lists[bucket + 1];
+            passes[shard].lists[bucket] = offset;
+            offset += count;
+        }
+    }
+    lists[LIBRARY_INDEX_BUCKETS] = offset;
+
+    for (unsigned shard = 0; shard < num_passes; ++shard) {
+        passes[shard].postings = postings;
+        passes[shard].visit = library_index_fill;
+    }
+    pool_run(pool, num_passes, library_index_run, passes);
+
+    library_index_free_passes(passes, num_passes);
+
+    index->generation = source->generation;
+    index->num_nodes = source->num_nodes;
+    index->offsets = lists;
+    index->postings = postings;
+    index->memory = lists;
+    index->mapped = 0;
+
+    return index;
+}
+
+/**
+ * @brief Uses posting lists that were saved to a file and mapped back in.
+ *
+ * The offsets are checked, so a damaged file can't send a search out of
+ * bounds. On success, the index takes over the mapping.
+ *
+ * @param lists The offsets, immediately followed by the postings.
+ * @param num_postings The number of postings.
+ * @param num_nodes The number of nodes covered.
+ * @param map The mapping @p lists lies in.
+ * @param map_size The length of the mapping.
+ *
+ * @return A newly-allocated index, or NULL if the lists are malformed or memory ran out.
+ */
+struct library_index *library_index_wrap(const uint32_t *lists, uint64_t num_postings,
+                                         unsigned num_nodes, void *map, size_t map_size)
+{
+    if (lists[0] != 0 || lists[LIBRARY_INDEX_BUCKETS] != num_postings) {
+        return NULL;
+    }
+    for (unsigned bucket = 0; bucket < LIBRARY_INDEX_BUCKETS; ++bucket) {
+        if (lists[bucket] > lists[bucket + 1]) {
+            return NULL;
+        }
+    }
+
+    struct library_index *index = malloc(sizeof(*index));
+    if (!index) {
+        return NULL;
+    }
+
+    index->generation = 0;
+    index->num_nodes = num_nodes;
+    index->offsets = lists;
+    index->postings = lists + LIBRARY_INDEX_BUCKETS + 1;
+    index->size = sizeof(*lists) * (LIBRARY_INDEX_BUCKETS + 1 + num_postings);
+    index->memory = map;
+    index->mapped = map_size;
+
+    return index;
+}
+
+/**
+ * @brief Frees an index, unmapping its lists if they came from a file.
+ *
+ * @param index The index to free.
+ */
+void library_index_free(struct library_index *index)
+{
+    if (!index) {
+        return;
+    }
+
+    if (index->mapped) {
+        munmap(index->memory, index->mapped);
+    }
+    else {
+        free(index->memory);
+    }
+    free(index);
+}
+
+/**
+ * @brief Finds the first posting at or after a position that is at least a node.
+ *
+ * Candidates are looked up in ascending order, so each search starts where
+ * the last one left off, and gallops ahead before bisecting. That keeps a
+ * long list's lookups close together in memory, and costs little more than
+ * a merge when the lists are of similar length.
+ *
+ * @param postings The sorted posting list.
+ * @param count The number of postings in the list.
+ * @param from The position to start from.
+ * @param node The node to look for.
+ *
+ * @return The position found, or @p count if every posting from @p from on is smaller.
+ */
+static uint32_t library_index_seek(const uint32_t *postings, uint32_t count, uint32_t from,
+                                   uint32_t node)
+{
+    uint32_t low = from;
+    uint32_t step = 1;
+
+    while (low + step < count && postings[low + step] < node) {
+        low += step;
+        step *= 2;
+    }
+
+    uint32_t high = low + step < count ? low + step : count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (postings[mid] < node) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+/**
+ * @brief Gets the number of postings in a bucket.
+ */
+static uint32_t library_index_count_postings(const struct library_index *index, unsigned bucket)
+{
+    return index->offsets[bucket + 1] - index->offsets[bucket];
+}
+
+/**
+ * @brief Sorts a needle's buckets by the length of their posting lists.
+ *
+ * There are only a few, so insertion sort does.
+ */
+static void library_index_sort(const struct library_index *index, unsigned *buckets,
+                               unsigned count)
+{
+    for (unsigned i = 1; i < count; ++i) {
+        unsigned bucket = buckets[i];
+        uint32_t length = library_index_count_postings(index, bucket);
+
+        unsigned j = i;
+        while (j > 0 && library_index_count_postings(index, buckets[j - 1]) > length) {
+            buckets[j] = buckets[j - 1];
+            --j;
+        }
+        buckets[j] = bucket;
+    }
+}
+
+/**
+ * @brief Adds the indexed nodes that contain a needle to the matches.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+static int library_index_search_indexed(struct library *library, const char *needle,
+                                        size_t length, struct vector *matches)
+{
+    const struct library_index *index = library->index;
+    unsigned buckets[MAX_TRIGRAMS];
+    unsigned num_buckets = 0;
+
+    for (size_t i = 0; i + TRIGRAM <= length && num_buckets < MAX_TRIGRAMS; ++i) {
+        uint32_t key = library_index_key((const unsigned char *)needle + i);
+        unsigned bucket = library_index_bucket(key);
+
+        int seen = 0;
+        for (unsigned j = 0; j < num_buckets && !seen; ++j) {
+            seen = buckets[j] == bucket;
+        }
+        if (!seen) {
+            buckets[num_buckets++] = bucket;
+        }
+    }
+
+    /* Checking the shortest lists first rules candidates out soonest. */
+    library_index_sort(index, buckets, num_buckets);
+
+    const uint32_t *lists[MAX_TRIGRAMS];
+    uint32_t counts[MAX_TRIGRAMS];
+    uint32_t cursors[MAX_TRIGRAMS] = {0};
+    for (unsigned j = 0; j < num_buckets; ++j) {
+        lists[j] = index->postings + index->offsets[buckets[j]];
+        counts[j] = library_index_count_postings(index, buckets[j]);
+    }
+
+    for (uint32_t i = 0; i < counts[0]; ++i) {
+        uint32_t node = lists[0][i];
+        if (node >= index->num_nodes) {
+            continue;
+        }
+
+        unsigned j = 1;
+        while (j < num_buckets) {
+            cursors[j] = library_index_seek(lists[j], counts[j], cursors[j], node);
+            if (cursors[j] == counts[j]) {
+                /* This list has nothing left, so no later candidate can be in all of them. */
+                return 0;
+            }
+            if (lists[j][cursors[j]] != node) {
+                break;
+            }
+            ++j;
+        }
+        if (j < num_buckets) {
+            continue;
+        }
+
+        const char *name = library_get_name(library, library_get_node(library, node));
+        if (strmatch_contains(name, needle, length) &&
+            vector_push(matches, &node) != VEC_ERROR_SUCCESS) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief A needle being looked for in the nodes the index doesn't cover.
+ */
+struct library_index_scan {
+    struct library *library;
+    const char *needle;
+    size_t length;
+};
+
+/**
+ * @brief Checks whether one node's name contains the needle. Called from the thread pool.
+ */
+static int library_index_scan_node(void *data, unsigned node)
+{
+    const struct library_index_scan *scan = data;
+    const char *name = library_get_name(scan->library, library_get_node(scan->library, node));
+
+    return strmatch_contains(name, scan->needle, scan->length);
+}
+
+/**
+ * @brief Finds every loaded node whose name contains a needle, ignoring ASCII case.
+ *
+ * The library's index is used for the nodes it covers, as long as the
+ * needle is at least a trigram long. The rest are checked one by one,
+ * split across the pool's threads.
+ *
+ * @param library The library to search.
+ * @param needle The needle, folded with strmatch_fold().
+ * @param length The length of @p needle.
+ * @param matches Filled with the indices of the matching nodes, in ascending order.
+ * @param pool The threads to check unindexed nodes on, or NULL.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+int library_index_search(struct library *library, const char *needle, size_t length,
+                         struct vector *matches, struct pool *pool)
+{
+    unsigned num_nodes = vector_get_length(library->nodes);
+    unsigned node = 0;
+
+    vector_clear(matches, NULL);
+
+    const struct library_index *index = library->index;
+    if (index && index->generation == library->generation && index->num_nodes <= num_nodes &&
+        length >= TRIGRAM) {
+        if (library_index_search_indexed(library, needle, length, matches) != 0) {
+            return -1;
+        }
+        node = index->num_nodes;
+    }
+
+    struct library_index_scan scan = {library, needle, length};
+    return pool_filter(pool, node, num_nodes, library_index_scan_node, &scan, matches);
+}
@@ -0,0 +1,317 @@
+/*******************************************************************************
+ * pagecache.c - Bounded cache of queue pages for lazily-loaded queues.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file pagecache.h
+ */
+
+#include "pantomime/mpd/pagecache.h"
+
+#include <stdlib.h>
+
+/**
+ * @brief Marks the end of the LRU list.
+ */
+#define NO_PAGE ((unsigned)-1)
+
+/**
+ * @brief The smallest budget allowed, so that a screenful of songs always fits.
+ */
+#define MIN_PAGES 16
+
+/**
+ * @brief Unlinks a page from the LRU list.
+ */
+static void pagecache_unlink(struct pagecache *cache, unsigned page)
+{
+    unsigned prev = cache->lru_prev[page];
+    unsigned next = cache->lru_next[page];
+
+    if (prev != NO_PAGE) {
+        cache->lru_next[prev] = next;
+    }
+    else {
+        cache->lru_head = next;
+    }
+
+    if (next != NO_PAGE) {
+        cache->lru_prev[next] = prev;
+    }
+    else {
+        cache->lru_tail = prev;
+    }
+}
+
+/**
+ * @brief Links a page at the front of the LRU list.
+ */
+static void pagecache_link_front(struct pagecache *cache, unsigned page)
+{
+    cache->lru_prev[page] = NO_PAGE;
+    cache->lru_next[page] = cache->lru_head;
+
+    if (cache->lru_head != NO_PAGE) {
+        cache->lru_prev[cache->lru_head] = page;
+    }
+    cache->lru_head = page;
+
+    if (cache->lru_tail == NO_PAGE) {
+        cache->lru_tail = page;
+    }
+}
+
+/**
+ * @brief Creates an empty page cache.
+ *
+ * @param budget The maximum number of bytes to spend on loaded pages.
+ *
+ * @return A newly-allocated page cache, or NULL on error.
+ */
+struct pagecache *pagecache_new(size_t budget)
+{
+    struct pagecache *cache = malloc(sizeof(*cache));
+    if (!cache) {
+        return NULL;
+    }
+
+    cache->pages = NULL;
+    cache->lru_prev = NULL;
+    cache->lru_next = NULL;
+    cache->num_pages = 0;
+    cache->capacity = 0;
+    cache->length = 0;
+
+    cache->lru_head = NO_PAGE;
+    cache->lru_tail = NO_PAGE;
+
+    cache->budget = budget;
+    if (cache->budget < MIN_PAGES * sizeof(struct queue_page)) {
+        cache->budget = MIN_PAGES * sizeof(struct queue_page);
+    }
+    cache->used = 0;
+
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+    cache->changes = 0;
+
+    return cache;
+}
+
+/**
+ * @brief Frees a page cache and every page in it.
+ *
+ * @param cache The cache to free.
+ */
+void pagecache_free(struct pagecache *cache)
+{
+    if (!cache) {
+        return;
+    }
+
+    pagecache_clear(cache);
+    free(cache->pages);
+    free(cache->lru_prev);
+    free(cache->lru_next);
+    free(cache);
+}
+
+/**
+ * @brief Sets the length of the queue, dropping any pages past its new end.
+ *
+ * @param cache The cache to modify.
+ * @param length The new length of the queue.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+int pagecache_set_length(struct pagecache *cache, unsigned length)
+{
+    unsigned num_pages = length / QUEUE_PAGE_SIZE + (length % QUEUE_PAGE_SIZE != 0);
+
+    for (unsigned page = num_pages; page < cache->num_pages; ++page) {
+        pagecache_drop_page(cache, page);
+    }
+
+    if (num_pages > cache->capacity) {
+        unsigned capacity = cache->capacity ? cache->capacity : MIN_PAGES;
+        while (capacity < num_pages) {
+            capacity *= 2;
+        }
+
+        struct queue_page **pages = realloc(cache->pages, sizeof(*pages) * capacity);
+        if (pages) {
+            cache->pages = pages;
+        }
+        unsigned *lru_prev = realloc(cache->lru_prev, sizeof(*lru_prev) * capacity);
+        if (lru_prev) {
+            cache->lru_prev = lru_prev;
+        }
+        unsigned *lru_next = realloc(cache->lru_next, sizeof(*lru_next) * capacity);
+        if (lru_next) {
+            cache->lru_next = lru_next;
+        }
+
+        if (!pages || !lru_prev || !lru_next) {
+            return -1;
+        }
+        cache->capacity = capacity;
+    }
+
+    for (unsigned page = cache->num_pages; page < num_pages; ++page) {
+        cache->pages[page] = NULL;
+    }
+
+    cache->num_pages = num_pages;
+    cache->length = length;
+
+    return 0;
+}
+
+/**
+ * @brief Drops every loaded page, keeping the queue's length.
+ *
+ * @param cache The cache to clear.
+ */
+void pagecache_clear(struct pagecache *cache)
+{
+    while (cache->lru_head != NO_PAGE) {
+        pagecache_drop_page(cache, cache->lru_head);
+    }
+}
+
+/**
+ * @brief Looks up the song at a queue position.
+ *
+ * A successful lookup marks the song's page as recently used.
+ *
+ * @param cache The cache to search.
+ * @param pos The queue position.
+ *
+ * @return The song, or NULL if its page isn't loaded.
+ */
+const struct song *pagecache_get(struct pagecache *cache, unsigned pos)
+{
+    if (pos >= cache->length) {
+        return NULL;
+    }
+
+    unsigned page = pos / QUEUE_PAGE_SIZE;
+    if (!cache->pages[page]) {
+        ++cache->misses;
+        return NULL;
+    }
+
+    if (cache->lru_head != page) {
+        pagecache_unlink(cache, page);
+        pagecache_link_front(cache, page);
+    }
+    ++cache->hits;
+
+    return &cache->pages[page]->songs[pos % QUEUE_PAGE_SIZE];
+}
+
+/**
+ * @brief Looks up the song at a queue position without marking it as used.
+ *
+ * For scans over every loaded song, which would otherwise reorder the
+ * eviction list and inflate the hit count.
+ *
+ * @param cache The cache to search.
+ * @param pos The queue position.
+ *
+ * @return The song, or NULL if its page isn't loaded.
+ */
+const struct song *pagecache_peek(const struct pagecache *cache, unsigned pos)
+{
+    if (pos >= cache->length || !cache->pages[pos / QUEUE_PAGE_SIZE]) {
+        return NULL;
+    }
+
+    return &cache->pages[pos / QUEUE_PAGE_SIZE]->songs[pos % QUEUE_PAGE_SIZE];
+}
+
+/**
+ * @brief Checks whether a page is loaded.
+ */
+int pagecache_has_page(struct pagecache *cache, unsigned page)
+{
+    return page < cache->num_pages && cache->pages[page];
+}
+
+/**
+ * @brief Gets a page's storage so it can be filled, allocating it if needed.
+ *
+ * The page becomes the most recently used one. If that puts the cache over
+ * budget, the least recently used pages are evicted.
+ *
+ * @param cache The cache to load into.
+ * @param page The index of the page.
+ *
+ * @return The page's songs, or NULL on error.
+ */
+struct song *pagecache_load_page(struct pagecache *cache, unsigned page)
+{
+    if (page >= cache->num_pages) {
+        return NULL;
+    }
+
+    if (cache->pages[page]) {
+        pagecache_unlink(cache, page);
+        pagecache_link_front(cache, page);
+        return cache->pages[page]->songs;
+    }
+
+    while (cache->used + sizeof(struct queue_page) > cache->budget &&
+           cache->lru_tail != NO_PAGE) {
+        pagecache_drop_page(cache, cache->lru_tail);
+        ++cache->evictions;
+    }
+
+    /* Zeroed so that positions the server didn't send show up as empty songs. */
+    struct queue_page *data = calloc(1, sizeof(*data));
+    if (!data) {
+        return NULL;
+    }
+
+    cache->pages[page] = data;
+    cache->used += sizeof(*data);
+    pagecache_link_front(cache, page);
+    ++cache->changes;
+
+    return data->songs;
+}
+
+/**
+ * @brief Drops a page from the cache, if it is loaded.
+ *
+ * @param cache The cache to modify.
+ * @param page The index of the page.
+ */
+void pagecache_drop_page(struct pagecache *cache, unsigned page)
+{
+    if (!pagecache_has_page(cache, page)) {
+        return;
+    }
+
+    pagecache_unlink(cache, page);
+    free(cache->pages[page]);
+    cache->pages[page] = NULL;
+    cache->used -= sizeof(struct queue_page);
+    ++cache->changes;
+}
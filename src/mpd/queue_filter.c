@@ -0,0 +1,583 @@
+/*******************************************************************************
+ * queue_filter.c - Incremental search over the queue.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file queue_filter.h
+ */
+
+#include "pantomime/mpd/queue_filter.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pantomime/intern.h"
+#include "pantomime/strmatch.h"
+
+/**
+ * @brief Remembers the result for the last artist and album tested.
+ *
+ * Songs on the same album tend to sit next to each other in the queue, so
+ * this skips most artist and album comparisons.
+ */
+struct queue_filter_memo {
+    unsigned artist;   /** The interned artist tested last. */
+    unsigned album;    /** The interned album tested last. */
+    int artist_match;  /** Whether @ref artist contained the query. */
+    int album_match;   /** Whether @ref album contained the query. */
+};
+
+/**
+ * @brief Writes a song's "artist - album - title", which fuzzy queries are matched against.
+ *
+ * @param text Filled with the text. It must hold @ref FUZZY_TEXT_SIZE bytes.
+ */
+static void queue_filter_join(struct mpdclient *mpd, const struct song *song, char *text)
+{
+    const char *fields[] = {mpdclient_get_song_artist(mpd, song),
+                            mpdclient_get_song_album(mpd, song),
+                            mpdclient_get_song_title(mpd, song)};
+    fuzzy_join(text, fields, sizeof(fields) / sizeof(*fields));
+}
+
+/**
+ * @brief Checks whether a song's title, artist or album contain the query.
+ *
+ * In fuzzy mode, the three are matched together, since the query's
+ * characters can be spread across them.
+ */
+static int queue_filter_match(struct queue_filter *filter, struct mpdclient *mpd,
+                              const struct song *song, unsigned length,
+                              struct queue_filter_memo *memo)
+{
+    if (filter->fuzzy) {
+        char text[FUZZY_TEXT_SIZE];
+        queue_filter_join(mpd, song, text);
+        return fuzzy_match(text, filter->query, length);
+    }
+
+    if (song->artist != memo->artist) {
+        memo->artist = song->artist;
+        memo->artist_match =
+            strmatch_contains(mpdclient_get_song_artist(mpd, song), filter->query, length);
+    }
+    if (memo->artist_match) {
+        return 1;
+    }
+
+    if (song->album != memo->album) {
+        memo->album = song->album;
+        memo->album_match =
+            strmatch_contains(mpdclient_get_song_album(mpd, song), filter->query, length);
+    }
+    if (memo->album_match) {
+        return 1;
+    }
+
+    return strmatch_contains(mpdclient_get_song_title(mpd, song), filter->query, length);
+}
+
+/**
+ * @brief Creates a filter with an empty query, which matches everything.
+ *
+ * @return A newly-allocated filter, or NULL on error.
+ */
+struct queue_filter *queue_filter_new(void)
+{
+    struct queue_filter *filter = calloc(1, sizeof(*filter));
+    if (!filter) {
+        return NULL;
+    }
+
+    filter->ranked = fuzzy_top_new();
+    if (!filter->ranked) {
+        free(filter);
+        return NULL;
+    }
+
+    return filter;
+}
+
+/**
+ * @brief Drops the matches for every query length from @p length up.
+ */
+static void queue_filter_drop_levels(struct queue_filter *filter, unsigned length)
+{
+    for (unsigned i = length; i <= QUEUE_FILTER_MAX_QUERY; ++i) {
+        if (filter->levels[i]) {
+            vector_free(filter->levels[i], NULL);
+            filter->levels[i] = NULL;
+        }
+    }
+
+    filter->ranked_valid = 0;
+}
+
+/**
+ * @brief Frees a filter and its matches.
+ *
+ * @param filter The filter to free.
+ */
+void queue_filter_free(struct queue_filter *filter)
+{
+    if (!filter) {
+        return;
+    }
+
+    queue_filter_drop_levels(filter, 0);
+    fuzzy_top_free(filter->ranked);
+    free(filter->loaded);
+    free(filter);
+}
+
+/**
+ * @brief Checks whether the filter hides anything, which it does once a query has been typed.
+ */
+int queue_filter_is_active(struct queue_filter *filter)
+{
+    return filter->length > 0;
+}
+
+/**
+ * @brief Gets the query typed so far.
+ */
+const char *queue_filter_get_query(struct queue_filter *filter)
+{
+    return filter->query;
+}
+
+/**
+ * @brief Switches between substring and fuzzy matching.
+ *
+ * Switching drops the query, since its matches would no longer apply.
+ *
+ * @param filter The filter.
+ * @param fuzzy Whether to match fuzzily.
+ */
+void queue_filter_set_fuzzy(struct queue_filter *filter, int fuzzy)
+{
+    if (filter->fuzzy != fuzzy) {
+        queue_filter_clear(filter);
+        filter->fuzzy = fuzzy;
+    }
+}
+
+/**
+ * @brief Finds the matches for the current query, starting from those of the longest known prefix.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+static int queue_filter_update(struct queue_filter *filter, struct mpdclient *mpd)
+{
+    unsigned length = filter->length;
+    if (!length || filter->levels[length]) {
+        return 0;
+    }
+
+    unsigned base = length;
+    while (base > 0 && !filter->levels[base]) {
+        --base;
+    }
+
+    struct vector *matches = vector_new(sizeof(unsigned));
+    if (!matches) {
+        return -1;
+    }
+
+    /* The empty string never contains a non-empty query, so it's a safe starting point. */
+    struct queue_filter_memo memo = {INTERN_EMPTY, INTERN_EMPTY, 0, 0};
+    const struct song *song;
+    enum vec_error error = VEC_ERROR_SUCCESS;
+    filter->scanned = 0;
+
+    if (base > 0) {
+        /* Anything that contains the longer query also contains its prefix. */
+        struct vector *candidates = filter->levels[base];
+        unsigned count = vector_get_length(candidates);
+
+        for (unsigned i = 0; i < count && error == VEC_ERROR_SUCCESS; ++i) {
+            unsigned pos = *(unsigned *)vector_at(candidates, i);
+            song = mpdclient_peek_queue_song(mpd, pos);
+            if (song && queue_filter_match(filter, mpd, song, length, &memo)) {
+                error = vector_push(matches, &pos);
+            }
+        }
+        filter->scanned = count;
+    }
+    else {
+        unsigned count = mpdclient_get_queue_length(mpd);
+
+        for (unsigned pos = 0; pos < count && error == VEC_ERROR_SUCCESS; ++pos) {
+            song = mpdclient_peek_queue_song(mpd, pos);
+            if (song && queue_filter_match(filter, mpd, song, length, &memo)) {
+                error = vector_push(matches, &pos);
+            }
+        }
+        filter->scanned = count;
+    }
+
+    /* A partial list would be narrowed down from by every later keystroke, so keep none. */
+    if (error != VEC_ERROR_SUCCESS) {
+        vector_free(matches, NULL);
+        return -1;
+    }
+
+    filter->levels[length] = matches;
+    filter->ranked_valid = 0;
+    return 0;
+}
+
+/**
+ * @brief Adds text to the end of the query and narrows the matches.
+ *
+ * Only the songs that matched the shorter query are tested again.
+ *
+ * @param filter The filter to refine.
+ * @param mpd The MPD client whose queue is searched.
+ * @param text The text to add. It may be a fragment of a UTF-8 character.
+ *
+ * @return 0 on success, or -1 if the query is too long or memory ran out.
+ */
+int queue_filter_append(struct queue_filter *filter, struct mpdclient *mpd, const char *text)
+{
+    size_t added = strlen(text);
+    if (added > QUEUE_FILTER_MAX_QUERY - filter->length) {
+        return -1;
+    }
+
+    queue_filter_sync(filter, mpd);
+
+    memcpy(filter->query + filter->length, text, added);
+    strmatch_fold(filter->query + filter->length, added);
+    filter->length += added;
+    filter->query[filter->length] = '\0';
+
+    return queue_filter_update(filter, mpd);
+}
+
+/**
+ * @brief Removes the last character of the query, going back to the matches it had.
+ *
+ * @param filter The filter to widen.
+ * @param mpd The MPD client whose queue is searched.
+ */
+void queue_filter_backspace(struct queue_filter *filter, struct mpdclient *mpd)
+{
+    if (!filter->length) {
+        return;
+    }
+
+    /* Remove a whole UTF-8 character, not just its last byte. */
+    unsigned length = filter->length - 1;
+    while (length > 0 && ((unsigned char)filter->query[length] & 0xC0) == 0x80) {
+        --length;
+    }
+
+    queue_filter_drop_levels(filter, length + 1);
+    filter->length = length;
+    filter->query[length] = '\0';
+
+    queue_filter_sync(filter, mpd);
+    queue_filter_update(filter, mpd);
+}
+
+/**
+ * @brief Empties the query, so that the whole queue is shown again.
+ *
+ * @param filter The filter to clear.
+ */
+void queue_filter_clear(struct queue_filter *filter)
+{
+    queue_filter_drop_levels(filter, 0);
+    filter->length = 0;
+    filter->query[0] = '\0';
+}
+
+/**
+ * @brief Notes which pages of a lazily-loaded queue are loaded, as the matches were found in them.
+ *
+ * @return 0 on success, or -1 if memory ran out, in which case no pages are known.
+ */
+static int queue_filter_note_pages(struct queue_filter *filter, struct mpdclient *mpd)
+{
+    unsigned num_pages = mpd->pages ? mpd->pages->num_pages : 0;
+
+    if (num_pages != filter->num_pages) {
+        unsigned char *loaded = num_pages ? realloc(filter->loaded, num_pages) : NULL;
+        if (!loaded) {
+            free(filter->loaded);
+        }
+        filter->loaded = loaded;
+        if (num_pages && !loaded) {
+            filter->num_pages = 0;
+            return -1;
+        }
+        filter->num_pages = num_pages;
+    }
+
+    for (unsigned page = 0; page < num_pages; ++page) {
+        filter->loaded[page] = pagecache_has_page(mpd->pages, page);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Brings the matches for one query length up to date with the pages loaded now.
+ *
+ * The matches in pages that stayed loaded are kept, those in dropped pages
+ * are removed, and newly loaded pages are searched.
+ *
+ * @return The updated matches, or NULL if memory ran out.
+ */
+static struct vector *queue_filter_patch_level(struct queue_filter *filter, struct mpdclient *mpd,
+                                               struct vector *old, unsigned length)
+{
+    struct vector *matches = vector_new(sizeof(unsigned));
+    if (!matches) {
+        return NULL;
+    }
+
+    struct queue_filter_memo memo = {INTERN_EMPTY, INTERN_EMPTY, 0, 0};
+    unsigned queue_length = mpdclient_get_queue_length(mpd);
+    unsigned count = vector_get_length(old);
+    unsigned i = 0;
+    enum vec_error error = VEC_ERROR_SUCCESS;
+
+    for (unsigned page = 0; page < filter->num_pages && error == VEC_ERROR_SUCCESS; ++page) {
+        int loaded = pagecache_has_page(mpd->pages, page);
+        unsigned start = page * QUEUE_PAGE_SIZE;
+        unsigned end = start + QUEUE_PAGE_SIZE;
+        if (end > queue_length) {
+            end = queue_length;
+        }
+
+        if (loaded && !filter->loaded[page]) {
+            for (unsigned pos = start; pos < end && error == VEC_ERROR_SUCCESS; ++pos) {
+                const struct song *song = mpdclient_peek_queue_song(mpd, pos);
+                if (song && queue_filter_match(filter, mpd, song, length, &memo)) {
+                    error = vector_push(matches, &pos);
+                }
+            }
+            filter->scanned += end - start;
+        }
+
+        for (; i < count && *(unsigned *)vector_at(old, i) < end; ++i) {
+            if (loaded && error == VEC_ERROR_SUCCESS) {
+                error = vector_push(matches, vector_at(old, i));
+            }
+        }
+    }
+
+    if (error != VEC_ERROR_SUCCESS) {
+        vector_free(matches, NULL);
+        return NULL;
+    }
+
+    return matches;
+}
+
+/**
+ * @brief Updates the matches for every query length after pages were loaded or dropped.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+static int queue_filter_patch(struct queue_filter *filter, struct mpdclient *mpd)
+{
+    unsigned page = 0;
+    while (page < filter->num_pages &&
+           filter->loaded[page] == pagecache_has_page(mpd->pages, page)) {
+        ++page;
+    }
+    if (page == filter->num_pages) {
+        return 0;
+    }
+
+    struct vector *patched[QUEUE_FILTER_MAX_QUERY + 1] = {NULL};
+    int ok = 1;
+    filter->scanned = 0;
+
+    for (unsigned length = 1; length <= QUEUE_FILTER_MAX_QUERY && ok; ++length) {
+        if (filter->levels[length]) {
+            patched[length] = queue_filter_patch_level(filter, mpd, filter->levels[length], length);
+            ok = patched[length] != NULL;
+        }
+    }
+
+    for (unsigned length = 1; length <= QUEUE_FILTER_MAX_QUERY; ++length) {
+        struct vector *stale = ok ? filter->levels[length] : patched[length];
+        if (stale) {
+            vector_free(stale, NULL);
+        }
+        if (ok) {
+            filter->levels[length] = patched[length];
+        }
+    }
+
+    if (!ok || queue_filter_note_pages(filter, mpd) != 0) {
+        return -1;
+    }
+
+    filter->ranked_valid = 0;
+    return 0;
+}
+
+/**
+ * @brief Searches again if the queue changed since the matches were found.
+ *
+ * A lazily-loaded queue also counts as changed when a page is loaded or
+ * dropped, since only loaded songs can match. Then only the pages that
+ * came or went are looked at, unless the queue itself changed too.
+ *
+ * @param filter The filter to update.
+ * @param mpd The MPD client whose queue is searched.
+ */
+void queue_filter_sync(struct queue_filter *filter, struct mpdclient *mpd)
+{
+    unsigned long page_changes = mpd->pages ? mpd->pages->changes : 0;
+    if (filter->queue_version == mpd->queue_version && filter->edits_made == mpd->edits_made) {
+        if (filter->page_changes == page_changes) {
+            return;
+        }
+
+        unsigned num_pages = mpd->pages ? mpd->pages->num_pages : 0;
+        if (filter->num_pages == num_pages && queue_filter_patch(filter, mpd) == 0) {
+            filter->page_changes = page_changes;
+            return;
+        }
+    }
+
+    queue_filter_drop_levels(filter, 0);
+    filter->queue_version = mpd->queue_version;
+    filter->edits_made = mpd->edits_made;
+    filter->page_changes = page_changes;
+
+    /* Without a record of the loaded pages, the next page change searches everything again. */
+    queue_filter_note_pages(filter, mpd);
+    queue_filter_update(filter, mpd);
+}
+
+/**
+ * @brief Puts at least the best @p count fuzzy matches in order.
+ *
+ * Every match is scored, but only the best are kept, in a heap, so this
+ * costs O(n log k) rather than the O(n log n) of sorting every match. A
+ * few pages more than asked for are ranked, so that scrolling down
+ * doesn't score the matches again on every step. Does nothing outside
+ * fuzzy mode.
+ *
+ * @param filter The filter.
+ * @param mpd The MPD client whose queue is searched.
+ * @param count The number of matches needed in order, such as the last row on screen plus one.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+int queue_filter_rank(struct queue_filter *filter, struct mpdclient *mpd, unsigned count)
+{
+    struct vector *matches = filter->levels[filter->length];
+    if (!filter->fuzzy || !matches) {
+        return 0;
+    }
+
+    unsigned num_matches = vector_get_length(matches);
+    if (count > num_matches) {
+        count = num_matches;
+    }
+    if (filter->ranked_valid && filter->ranked->length >= count) {
+        return 0;
+    }
+
+    if (fuzzy_top_reset(filter->ranked, count * 2) != 0) {
+        return -1;
+    }
+
+    char text[FUZZY_TEXT_SIZE];
+    for (unsigned i = 0; i < num_matches; ++i) {
+        unsigned pos = *(unsigned *)vector_at(matches, i);
+        const struct song *song = mpdclient_peek_queue_song(mpd, pos);
+        if (!song) {
+            continue;
+        }
+
+        queue_filter_join(mpd, song, text);
+        int score = fuzzy_score(text, filter->query, filter->length);
+        if (score != FUZZY_NO_MATCH) {
+            fuzzy_top_add(filter->ranked, score, pos);
+        }
+    }
+
+    fuzzy_top_finish(filter->ranked);
+    filter->ranked_valid = 1;
+    return 0;
+}
+
+/**
+ * @brief Gets the number of matching songs.
+ */
+unsigned queue_filter_get_length(struct queue_filter *filter)
+{
+    struct vector *matches = filter->levels[filter->length];
+    return matches ? vector_get_length(matches) : 0;
+}
+
+/**
+ * @brief Gets the queue position of a match.
+ *
+ * @param filter The filter.
+ * @param index The index of the match, in queue order, or in order of rank
+ *              in fuzzy mode. Matches past those ranked by
+ *              queue_filter_rank() are in queue order.
+ *
+ * @return The match's queue position.
+ */
+unsigned queue_filter_get_position(struct queue_filter *filter, unsigned index)
+{
+    if (filter->fuzzy && filter->ranked_valid && index < filter->ranked->length) {
+        return filter->ranked->results[index].id;
+    }
+
+    return *(unsigned *)vector_at(filter->levels[filter->length], index);
+}
+
+/**
+ * @brief Finds the first match at or after a queue position.
+ *
+ * Only meaningful outside fuzzy mode, where the matches are in queue order.
+ *
+ * @param filter The filter.
+ * @param position The queue position.
+ *
+ * @return The index of the match, or the number of matches if there is none.
+ */
+unsigned queue_filter_find(struct queue_filter *filter, unsigned position)
+{
+    unsigned low = 0;
+    unsigned high = queue_filter_get_length(filter);
+
+    while (low < high) {
+        unsigned mid = low + (high - low) / 2;
+        if (queue_filter_get_position(filter, mid) < position) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
@@ -0,0 +1,51 @@
+/*******************************************************************************
+ * song.c - Compact song records.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file song.h
+ */
+
+#include "pantomime/mpd/song.h"
+
+#include <string.h>
+
+/**
+ * @brief Fills a song record from a song received from MPD.
+ *
+ * @param song The record to fill.
+ * @param mpd_song The song received from MPD. It is not modified or freed.
+ * @param strings The table to intern the song's tags in.
+ */
+void song_from_mpd(struct song *song, const struct mpd_song *mpd_song,
+                   struct intern_table *strings)
+{
+    const char *title = mpd_song_get_tag(mpd_song, MPD_TAG_TITLE, 0);
+    if (!title) {
+        /* Fall back to the file name, like most clients do. */
+        const char *uri = mpd_song_get_uri(mpd_song);
+        const char *slash = strrchr(uri, '/');
+        title = slash ? slash + 1 : uri;
+    }
+
+    song->id = mpd_song_get_id(mpd_song);
+    song->duration = mpd_song_get_duration(mpd_song);
+    song->title = intern_table_add(strings, title);
+    song->artist = intern_table_add(strings, mpd_song_get_tag(mpd_song, MPD_TAG_ARTIST, 0));
+    song->album = intern_table_add(strings, mpd_song_get_tag(mpd_song, MPD_TAG_ALBUM, 0));
+}
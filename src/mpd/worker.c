@@ -0,0 +1,851 @@
+/*******************************************************************************
+ * worker.c - Background thread that owns the MPD connection.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file worker.h
+ *
+ * @brief Keeps slow server round trips off the UI thread.
+ *
+ * The UI thread submits @ref mpd_job requests and goes back to handling
+ * input. The worker thread runs them one at a time, in order, and hands
+ * each one back with its results for the UI thread to apply. Songs are
+ * passed back as raw libmpdclient objects, so that everything the UI reads
+ * from (the queue and its string table) is only ever touched by one thread.
+ * Search indexes are built on a second thread, so that a long build never
+ * holds up the connection.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pantomime/mpd/worker.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief The number of jobs each ring can hold.
+ */
+#define RING_CAPACITY 64
+
+/**
+ * @brief How long to back off when a ring is full, in nanoseconds.
+ */
+#define RING_RETRY_NS 1000000
+
+/**
+ * @brief How far apart, in seconds, two server start times can be and still mean the same start.
+ */
+#define SERVER_START_SLACK 2
+
+/**
+ * @brief Frees what a queue edit owns, for use with vector_free().
+ *
+ * @param edit The @ref queue_edit to clear.
+ */
+void queue_edit_clear(void *edit)
+{
+    struct queue_edit *queue_edit = edit;
+    free(queue_edit->uri);
+    queue_edit->uri = NULL;
+}
+
+/**
+ * @brief Creates an empty job.
+ *
+ * @param type The kind of work to do.
+ *
+ * @return A newly-allocated job, or NULL on error.
+ */
+struct mpd_job *mpd_job_new(enum mpd_job_type type)
+{
+    struct mpd_job *job = calloc(1, sizeof(*job));
+    if (!job) {
+        return NULL;
+    }
+
+    job->type = type;
+    job->error = MPD_ERROR_SUCCESS;
+
+    return job;
+}
+
+/**
+ * @brief Frees a job and any results it still holds.
+ *
+ * @param job The job to free.
+ */
+void mpd_job_free(struct mpd_job *job)
+{
+    if (!job) {
+        return;
+    }
+
+    if (job->songs) {
+        unsigned count = vector_get_length(job->songs);
+        for (unsigned i = 0; i < count; ++i) {
+            mpd_song_free(*(struct mpd_song **)vector_at(job->songs, i));
+        }
+        vector_free(job->songs, NULL);
+    }
+    vector_free(job->changes, NULL);
+    vector_free(job->edits, queue_edit_clear);
+    if (job->names) {
+        unsigned count = vector_get_length(job->names);
+        for (unsigned i = 0; i < count; ++i) {
+            free(*(char **)vector_at(job->names, i));
+        }
+        vector_free(job->names, NULL);
+    }
+    free(job->artist);
+    free(job->album);
+    library_index_source_free(job->source);
+    library_index_free(job->index);
+    free(job->error_message);
+    free(job);
+}
+
+/**
+ * @brief Wakes up whoever waits on an eventfd.
+ */
+static void mpd_worker_signal(int fd)
+{
+    uint64_t one = 1;
+    ssize_t written = write(fd, &one, sizeof(one));
+    (void)written;
+}
+
+/**
+ * @brief Resets an eventfd after waking up.
+ */
+static void mpd_worker_drain(int fd)
+{
+    uint64_t count;
+    ssize_t bytes = read(fd, &count, sizeof(count));
+    (void)bytes;
+}
+
+/**
+ * @brief Sleeps briefly while the other side of a full ring catches up.
+ */
+static void mpd_worker_back_off(void)
+{
+    struct timespec delay = {0, RING_RETRY_NS};
+    nanosleep(&delay, NULL);
+}
+
+/**
+ * @brief Hands a finished job back to the UI thread.
+ *
+ * If the UI thread has stopped listening, the job is freed instead.
+ *
+ * @param worker The worker.
+ * @param results The results ring of the thread that ran the job.
+ * @param job The finished job.
+ */
+static void mpd_worker_publish(struct mpd_worker *worker, struct ring *results,
+                               struct mpd_job *job)
+{
+    while (ring_push(results, job) != 0) {
+        if (atomic_load(&worker->quitting)) {
+            mpd_job_free(job);
+            return;
+        }
+        mpd_worker_back_off();
+    }
+
+    mpd_worker_signal(worker->result_fd);
+}
+
+/**
+ * @brief Records the connection's error state in a job.
+ *
+ * Errors the connection can recover from, like a rejected command, only
+ * fail the job. Anything else takes the connection out of service.
+ */
+static void mpd_worker_check_error(struct mpd_worker *worker, struct mpd_job *job)
+{
+    enum mpd_error error = mpd_connection_get_error(worker->connection);
+    if (error == MPD_ERROR_SUCCESS) {
+        return;
+    }
+
+    const char *message = mpd_connection_get_error_message(worker->connection);
+    job->error = error;
+    job->error_message = strdup(message ? message : "Unknown error");
+
+    if (!mpd_connection_clear_error(worker->connection)) {
+        worker->error = error;
+    }
+}
+
+/**
+ * @brief Receives every song in the current response into a job.
+ */
+static void mpd_worker_recv_songs(struct mpd_worker *worker, struct mpd_job *job)
+{
+    struct mpd_song *song;
+
+    if (!job->songs) {
+        job->songs = vector_new(sizeof(song));
+    }
+
+    while ((song = mpd_recv_song(worker->connection))) {
+        if (!job->songs || vector_push(job->songs, &song) != VEC_ERROR_SUCCESS) {
+            mpd_song_free(song);
+        }
+    }
+}
+
+/**
+ * @brief Works out when the server was started from its uptime.
+ *
+ * @return The start time, or 0 if the server didn't say.
+ */
+static time_t mpd_worker_get_server_start(struct mpd_worker *worker)
+{
+    struct mpd_stats *stats = mpd_run_stats(worker->connection);
+    if (!stats) {
+        mpd_connection_clear_error(worker->connection);
+        return 0;
+    }
+
+    time_t start = time(NULL) - (time_t)mpd_stats_get_uptime(stats);
+    mpd_stats_free(stats);
+
+    return start;
+}
+
+/**
+ * @brief Fetches what changed in the queue since the last update.
+ *
+ * The first update, or one after the server's playlist version went
+ * backwards, downloads the whole queue. Otherwise only the changed songs are
+ * requested, or just their positions and ids when the queue is loaded lazily.
+ *
+ * A seeded job carries the version of a queue restored from a previous run,
+ * which is treated like the result of an earlier update. Playlist versions
+ * start over when the server restarts, so the queue is downloaded in full
+ * anyway if the server was restarted in the meantime. A job with
+ * @ref mpd_job::reload already set asks for the whole queue outright.
+ */
+static void mpd_worker_update_queue(struct mpd_worker *worker, struct mpd_job *job)
+{
+    if (job->reload) {
+        worker->have_queue = 0;
+    }
+    if (job->seeded) {
+        worker->have_queue = 1;
+        worker->queue_version = job->queue_version;
+        worker->queue_length = job->queue_length;
+        worker->server_start = job->server_start;
+    }
+
+    if (!worker->have_queue || job->seeded) {
+        time_t start = mpd_worker_get_server_start(worker);
+
+        /* Uptime only has a resolution of one second, so allow for rounding. */
+        if (job->seeded && (!start || start < worker->server_start - SERVER_START_SLACK ||
+                            start > worker->server_start + SERVER_START_SLACK)) {
+            worker->have_queue = 0;
+        }
+        worker->server_start = start;
+    }
+    job->server_start = worker->server_start;
+
+    struct mpd_status *status = mpd_run_status(worker->connection);
+    if (!status) {
+        return;
+    }
+
+    unsigned version = mpd_status_get_queue_version(status);
+    unsigned length = mpd_status_get_queue_length(status);
+    mpd_status_free(status);
+
+    job->has_queue = 1;
+    job->queue_version = version;
+    job->queue_length = length;
+
+    if (!worker->have_queue || version < worker->queue_version) {
+        /* The server was restarted, so our version number is meaningless. */
+        job->reload = 1;
+
+        if (!worker->lazy) {
+            mpd_send_list_queue_meta(worker->connection);
+            mpd_worker_recv_songs(worker, job);
+            mpd_response_finish(worker->connection);
+        }
+    }
+    else if (version != worker->queue_version) {
+        if (worker->lazy) {
+            struct queue_change change;
+            job->changes = vector_new(sizeof(change));
+
+            mpd_send_queue_changes_brief(worker->connection, worker->queue_version);
+            while (mpd_recv_queue_change_brief(worker->connection, &change.pos, &change.id)) {
+                if (job->changes) {
+                    vector_push(job->changes, &change);
+                }
+            }
+        }
+        else {
+            mpd_send_queue_changes_meta(worker->connection, worker->queue_version);
+            mpd_worker_recv_songs(worker, job);
+        }
+        mpd_response_finish(worker->connection);
+    }
+
+    if (mpd_connection_get_error(worker->connection) == MPD_ERROR_SUCCESS) {
+        worker->have_queue = 1;
+        worker->queue_version = version;
+        worker->queue_length = length;
+    }
+}
+
+/**
+ * @brief Fetches the songs in a range of the queue.
+ */
+static void mpd_worker_fetch_range(struct mpd_worker *worker, struct mpd_job *job)
+{
+    /* Don't ask for positions that no longer exist. The server would reject the whole range. */
+    if (job->end > worker->queue_length) {
+        job->end = worker->queue_length;
+    }
+    if (job->start >= job->end) {
+        return;
+    }
+
+    mpd_send_list_queue_range_meta(worker->connection, job->start, job->end);
+    mpd_worker_recv_songs(worker, job);
+    mpd_response_finish(worker->connection);
+}
+
+/**
+ * @brief Adds the job's artist and album constraints to the search being built.
+ */
+static void mpd_worker_add_constraints(struct mpd_worker *worker, struct mpd_job *job)
+{
+    if (job->artist) {
+        mpd_search_add_tag_constraint(worker->connection, MPD_OPERATOR_DEFAULT, MPD_TAG_ARTIST,
+                                      job->artist);
+    }
+    if (job->album) {
+        mpd_search_add_tag_constraint(worker->connection, MPD_OPERATOR_DEFAULT, MPD_TAG_ALBUM,
+                                      job->album);
+    }
+}
+
+/**
+ * @brief Lists the distinct values of a tag, such as every artist in the database.
+ */
+static void mpd_worker_list_tags(struct mpd_worker *worker, struct mpd_job *job)
+{
+    struct mpd_pair *pair;
+    char *name;
+
+    job->names = vector_new(sizeof(name));
+
+    mpd_search_db_tags(worker->connection, job->tag);
+    mpd_worker_add_constraints(worker, job);
+    mpd_search_commit(worker->connection);
+
+    while ((pair = mpd_recv_pair_tag(worker->connection, job->tag))) {
+        name = strdup(pair->value);
+        if (!job->names || !name || vector_push(job->names, &name) != VEC_ERROR_SUCCESS) {
+            free(name);
+        }
+        mpd_return_pair(worker->connection, pair);
+    }
+    mpd_response_finish(worker->connection);
+}
+
+/**
+ * @brief Finds the songs matching the job's constraints, without fetching anything else.
+ */
+static void mpd_worker_find_songs(struct mpd_worker *worker, struct mpd_job *job)
+{
+    mpd_search_db_songs(worker->connection, true);
+    mpd_worker_add_constraints(worker, job);
+    mpd_search_commit(worker->connection);
+
+    mpd_worker_recv_songs(worker, job);
+    mpd_response_finish(worker->connection);
+}
+
+/**
+ * @brief Fetches the time of the last database update, which tells whether cached metadata is stale.
+ */
+static void mpd_worker_db_stats(struct mpd_worker *worker, struct mpd_job *job)
+{
+    struct mpd_stats *stats = mpd_run_stats(worker->connection);
+    if (!stats) {
+        return;
+    }
+
+    job->db_update = mpd_stats_get_db_update_time(stats);
+    mpd_stats_free(stats);
+}
+
+/**
+ * @brief Sends the volume change and seek a job carries, merged into at most one of each.
+ *
+ * The volume is set rather than changed, so it's read first unless the last
+ * change made is still known to be current. The seek is relative to where
+ * the song is, so it needs nothing read. Both go in one command list, for a
+ * single round trip. A command the server turns down, such as a seek while
+ * nothing is playing, only costs that command.
+ */
+static void mpd_worker_control(struct mpd_worker *worker, struct mpd_job *job)
+{
+    struct mpd_connection *connection = worker->connection;
+
+    if (job->volume_delta && worker->volume < 0) {
+        struct mpd_status *status = mpd_run_status(connection);
+        if (status) {
+            worker->volume = mpd_status_get_volume(status);
+            mpd_status_free(status);
+        }
+    }
+
+    /* Without a mixer, the volume is reported as -1 and can't be changed. */
+    int volume = -1;
+    if (job->volume_delta && worker->volume >= 0) {
+        volume = worker->volume + job->volume_delta;
+        volume = volume < 0 ? 0 : volume > 100 ? 100 : volume;
+        if (volume == worker->volume) {
+            volume = -1;
+        }
+    }
+
+    if (volume >= 0 || job->seek_delta) {
+        mpd_command_list_begin(connection, false);
+        if (volume >= 0) {
+            mpd_send_set_volume(connection, volume);
+        }
+        if (job->seek_delta) {
+            mpd_send_seek_current(connection, (float)job->seek_delta, true);
+        }
+        mpd_command_list_end(connection);
+
+        if (mpd_response_finish(connection) && volume >= 0) {
+            worker->volume = volume;
+            worker->volume_echo = 1;
+        }
+    }
+
+    if (mpd_connection_get_error(connection) == MPD_ERROR_SERVER) {
+        worker->volume = -1;
+        mpd_connection_clear_error(connection);
+    }
+    job->volume = worker->volume;
+}
+
+/**
+ * @brief Makes the queue edits a job carries, in one command list.
+ *
+ * The UI thread has already made them to its copy of the queue, and the
+ * idle event that follows brings that copy in line with the server's. If
+ * the server turns a command down, the list stops there with the edits
+ * before it made, so the queue is downloaded again to undo the rest.
+ */
+static void mpd_worker_edit_queue(struct mpd_worker *worker, struct mpd_job *job)
+{
+    struct mpd_connection *connection = worker->connection;
+    unsigned count = vector_get_length(job->edits);
+
+    mpd_command_list_begin(connection, false);
+    for (unsigned i = 0; i < count; ++i) {
+        const struct queue_edit *edit = vector_at(job->edits, i);
+
+        switch (edit->type) {
+            case EDIT_DELETE:
+                mpd_send_delete_range(connection, edit->start, edit->end);
+                break;
+            case EDIT_MOVE:
+                mpd_send_move_range(connection, edit->start, edit->end, edit->to);
+                break;
+            case EDIT_ADD:
+                mpd_send_add_id_to(connection, edit->uri, edit->to);
+                break;
+            default:
+                break;
+        }
+    }
+    mpd_command_list_end(connection);
+    mpd_response_finish(connection);
+
+    if (mpd_connection_get_error(connection) == MPD_ERROR_SERVER &&
+        mpd_connection_clear_error(connection)) {
+        worker->have_queue = 0;
+        mpd_worker_update_queue(worker, job);
+    }
+}
+
+/**
+ * @brief Runs a job on the worker thread.
+ */
+static void mpd_worker_execute(struct mpd_worker *worker, struct mpd_job *job)
+{
+    if (worker->error != MPD_ERROR_SUCCESS) {
+        job->error = worker->error;
+        return;
+    }
+
+    switch (job->type) {
+        case JOB_IDLE:
+            if (job->events & MPD_IDLE_QUEUE) {
+                mpd_worker_update_queue(worker, job);
+            }
+            break;
+        case JOB_UPDATE_QUEUE:
+            mpd_worker_update_queue(worker, job);
+            break;
+        case JOB_FETCH_RANGE:
+            mpd_worker_fetch_range(worker, job);
+            break;
+        case JOB_LIST_TAGS:
+            mpd_worker_list_tags(worker, job);
+            break;
+        case JOB_FIND_SONGS:
+            mpd_worker_find_songs(worker, job);
+            break;
+        case JOB_DB_STATS:
+            mpd_worker_db_stats(worker, job);
+            break;
+        case JOB_CONTROL:
+            mpd_worker_control(worker, job);
+            break;
+        case JOB_EDIT_QUEUE:
+            mpd_worker_edit_queue(worker, job);
+            break;
+        default:
+            break;
+    }
+
+    mpd_worker_check_error(worker, job);
+}
+
+/**
+ * @brief Reports events the server sent while the connection was idle.
+ */
+static void mpd_worker_report_events(struct mpd_worker *worker, enum mpd_idle events)
+{
+    /* Our own volume change comes back as one mixer event. Any other means it was changed. */
+    if (events & MPD_IDLE_MIXER) {
+        worker->volume = worker->volume_echo ? worker->volume : -1;
+        worker->volume_echo = 0;
+    }
+
+    if (!events) {
+        return;
+    }
+
+    struct mpd_job *job = mpd_job_new(JOB_IDLE);
+    if (!job) {
+        return;
+    }
+
+    job->events = events;
+    mpd_worker_execute(worker, job);
+    mpd_worker_publish(worker, worker->results, job);
+}
+
+/**
+ * @brief Cancels idle mode so that a command can be sent.
+ */
+static void mpd_worker_leave_idle(struct mpd_worker *worker)
+{
+    if (!worker->idle) {
+        return;
+    }
+
+    enum mpd_idle events = mpd_run_noidle(worker->connection);
+    worker->idle = 0;
+
+    if (mpd_connection_get_error(worker->connection) != MPD_ERROR_SUCCESS) {
+        struct mpd_job *job = mpd_job_new(JOB_IDLE);
+        if (job) {
+            mpd_worker_check_error(worker, job);
+            mpd_worker_publish(worker, worker->results, job);
+        }
+        return;
+    }
+
+    mpd_worker_report_events(worker, events);
+}
+
+/**
+ * @brief The worker thread's main loop.
+ */
+static void *mpd_worker_run(void *data)
+{
+    struct mpd_worker *worker = data;
+    struct pollfd fds[2];
+    struct mpd_job *job;
+
+    fds[0].fd = worker->request_fd;
+    fds[0].events = POLLIN;
+    fds[1].events = POLLIN;
+
+    while (!atomic_load(&worker->quitting)) {
+        while ((job = ring_pop(worker->requests))) {
+            mpd_worker_leave_idle(worker);
+            mpd_worker_execute(worker, job);
+            mpd_worker_publish(worker, worker->results, job);
+        }
+
+        if (!worker->idle && worker->error == MPD_ERROR_SUCCESS) {
+            worker->idle = mpd_send_idle(worker->connection);
+        }
+
+        /* A negative descriptor is ignored by poll(), so a broken connection isn't watched. */
+        fds[1].fd = worker->idle ? mpd_connection_get_fd(worker->connection) : -1;
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NULL;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            mpd_worker_drain(worker->request_fd);
+        }
+
+        if (fds[1].revents) {
+            enum mpd_idle events = mpd_recv_idle(worker->connection, false);
+            worker->idle = 0;
+
+            if (mpd_connection_get_error(worker->connection) != MPD_ERROR_SUCCESS) {
+                job = mpd_job_new(JOB_IDLE);
+                if (job) {
+                    mpd_worker_check_error(worker, job);
+                    mpd_worker_publish(worker, worker->results, job);
+                }
+                continue;
+            }
+
+            mpd_worker_report_events(worker, events);
+        }
+    }
+
+    mpd_worker_leave_idle(worker);
+    return NULL;
+}
+
+/**
+ * @brief The index thread's main loop, which builds search indexes one at a time.
+ */
+static void *mpd_worker_run_index(void *data)
+{
+    struct mpd_worker *worker = data;
+    struct pollfd fd = {worker->index_fd, POLLIN, 0};
+    struct mpd_job *job;
+
+    while (!atomic_load(&worker->quitting)) {
+        while ((job = ring_pop(worker->index_requests))) {
+            job->index = library_index_build(job->source, job->index_budget, job->pool);
+            mpd_worker_publish(worker, worker->index_results, job);
+        }
+
+        if (poll(&fd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return NULL;
+        }
+
+        if (fd.revents & POLLIN) {
+            mpd_worker_drain(worker->index_fd);
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Frees a worker's rings, with any jobs still in them, and closes its eventfds.
+ *
+ * Both threads must have stopped, or never been started.
+ */
+static void mpd_worker_release(struct mpd_worker *worker)
+{
+    struct ring *rings[] = {worker->requests, worker->results, worker->index_requests,
+                            worker->index_results};
+    int fds[] = {worker->request_fd, worker->result_fd, worker->index_fd};
+    struct mpd_job *job;
+
+    for (unsigned i = 0; i < sizeof(rings) / sizeof(*rings); ++i) {
+        while (rings[i] && (job = ring_pop(rings[i]))) {
+            mpd_job_free(job);
+        }
+        ring_free(rings[i]);
+    }
+
+    for (unsigned i = 0; i < sizeof(fds) / sizeof(*fds); ++i) {
+        if (fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+
+    free(worker);
+}
+
+/**
+ * @brief Starts a worker thread on an established connection.
+ *
+ * The worker takes over the connection, which must not be used by any
+ * other thread until mpd_worker_free() returns. Closing it is still up to
+ * the caller.
+ *
+ * @param connection The connection to MPD.
+ * @param lazy Whether the queue is loaded lazily, so that queue updates only
+ * need the positions of changed songs.
+ *
+ * @return A running worker, or NULL on error.
+ */
+struct mpd_worker *mpd_worker_new(struct mpd_connection *connection, int lazy)
+{
+    struct mpd_worker *worker = malloc(sizeof(*worker));
+    if (!worker) {
+        return NULL;
+    }
+
+    worker->connection = connection;
+    worker->lazy = lazy;
+    worker->idle = 0;
+    worker->have_queue = 0;
+    worker->server_start = 0;
+    worker->queue_version = 0;
+    worker->queue_length = 0;
+    worker->volume = -1;
+    worker->volume_echo = 0;
+    worker->error = MPD_ERROR_SUCCESS;
+    atomic_init(&worker->quitting, 0);
+
+    worker->requests = ring_new(RING_CAPACITY);
+    worker->results = ring_new(RING_CAPACITY);
+    worker->index_requests = ring_new(RING_CAPACITY);
+    worker->index_results = ring_new(RING_CAPACITY);
+    worker->request_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    worker->result_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    worker->index_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (!worker->requests || !worker->results || !worker->index_requests ||
+        !worker->index_results || worker->request_fd < 0 || worker->result_fd < 0 ||
+        worker->index_fd < 0 || pthread_create(&worker->thread, NULL, mpd_worker_run, worker)) {
+        mpd_worker_release(worker);
+        return NULL;
+    }
+
+    if (pthread_create(&worker->index_thread, NULL, mpd_worker_run_index, worker)) {
+        atomic_store(&worker->quitting, 1);
+        mpd_worker_signal(worker->request_fd);
+        pthread_join(worker->thread, NULL);
+        mpd_worker_release(worker);
+        return NULL;
+    }
+
+    return worker;
+}
+
+/**
+ * @brief Stops a worker thread and frees every job it hasn't handed back yet.
+ *
+ * Jobs that haven't started yet are dropped without running.
+ *
+ * @param worker The worker to stop.
+ */
+void mpd_worker_free(struct mpd_worker *worker)
+{
+    if (!worker) {
+        return;
+    }
+
+    atomic_store(&worker->quitting, 1);
+    mpd_worker_signal(worker->request_fd);
+    mpd_worker_signal(worker->index_fd);
+    pthread_join(worker->thread, NULL);
+    pthread_join(worker->index_thread, NULL);
+
+    mpd_worker_release(worker);
+}
+
+/**
+ * @brief Queues a job to run on the worker thread. Only the UI thread may call this.
+ *
+ * Index builds are queued for the index thread instead.
+ *
+ * @param worker The worker to run the job.
+ * @param job The job. On success, ownership passes to the worker until the
+ * job comes back from mpd_worker_receive().
+ *
+ * @return 0 on success, or -1 if too many jobs are waiting already.
+ */
+int mpd_worker_submit(struct mpd_worker *worker, struct mpd_job *job)
+{
+    int index = job->type == JOB_INDEX_LIBRARY;
+    if (ring_push(index ? worker->index_requests : worker->requests, job) != 0) {
+        return -1;
+    }
+
+    mpd_worker_signal(index ? worker->index_fd : worker->request_fd);
+    return 0;
+}
+
+/**
+ * @brief Takes the next finished job. Only the UI thread may call this.
+ *
+ * @param worker The worker to take the job from.
+ *
+ * @return The job, which the caller must free, or NULL if none is ready.
+ */
+struct mpd_job *mpd_worker_receive(struct mpd_worker *worker)
+{
+    struct mpd_job *job = ring_pop(worker->results);
+    if (!job) {
+        job = ring_pop(worker->index_results);
+    }
+
+    if (!job) {
+        /* Reset the eventfd, then look again in case a job slipped in before the reset. */
+        mpd_worker_drain(worker->result_fd);
+        job = ring_pop(worker->results);
+    }
+    if (!job) {
+        job = ring_pop(worker->index_results);
+    }
+
+    return job;
+}
+
+/**
+ * @brief Gets a descriptor that becomes readable when finished jobs are waiting.
+ *
+ * @param worker The worker to watch.
+ */
+int mpd_worker_get_fd(struct mpd_worker *worker)
+{
+    return worker->result_fd;
+}
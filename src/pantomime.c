@@ -17,67 +17,588 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  ******************************************************************************/
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "arguments.h"
 #include "command/command.h"
+#include "command/keymap.h"
+#include "config.h"
+#include "event/event_loop.h"
+#include "pantomime/cache.h"
 #include "pantomime/mpd/client.h"
+#include "pantomime/snapshot.h"
 #include "pantomime/ui/ui.h"
 
+/**
+ * @brief How long to wait for a burst of resize signals to settle, in milliseconds.
+ */
+#define RESIZE_DELAY 30
+
+/**
+ * @brief The shortest time between two frames, in milliseconds.
+ *
+ * Changes that come in faster than this, such as the repeats of a held-down
+ * key, are drawn together in the next frame.
+ */
+#define FRAME_INTERVAL 16
+
+/**
+ * @brief The percentage points each volume key changes the volume by.
+ */
+#define VOLUME_STEP 2
+
+/**
+ * @brief The seconds each seek key moves by.
+ */
+#define SEEK_STEP 5
+
+/**
+ * @brief How long to wait on quitting for the last changes to reach the server, in milliseconds.
+ */
+#define QUIT_TIMEOUT 1000
+
+/**
+ * @brief The code of the Escape key, which curses has no name for.
+ */
+#define KEY_ESCAPE 27
+
+/**
+ * @brief The code most terminals send for Backspace, when it doesn't come through as KEY_BACKSPACE.
+ */
+#define KEY_DELETE 127
+
+/**
+ * @brief Handles commands that only apply to the queue screen.
+ *
+ * @param screen The queue screen.
+ * @param mpd The MPD client whose queue is shown.
+ * @param cmd_type The command entered by the user.
+ * @param length The number of songs in the queue.
+ */
+static void handle_queue_command(struct queue_screen *screen, struct mpdclient *mpd,
+                                 enum command_type cmd_type, unsigned length)
+{
+    switch (cmd_type) {
+        case CMD_SCROLL_TOP:
+            queue_screen_set_cursor(screen, 0, length);
+            break;
+        case CMD_SCROLL_BOTTOM:
+            queue_screen_set_cursor(screen, length ? length - 1 : 0, length);
+            break;
+        case CMD_FILTER:
+            queue_screen_filter_begin(screen, 0);
+            break;
+        case CMD_FUZZY:
+            queue_screen_filter_begin(screen, 1);
+            break;
+        case CMD_DELETE:
+            /* The song below moves up under the cursor, so holding the key deletes a run. */
+            if (screen->cursor < length) {
+                unsigned position = queue_screen_get_position(screen, screen->cursor);
+                mpdclient_delete(mpd, position, position + 1);
+                queue_screen_set_cursor(screen, screen->cursor,
+                                        queue_screen_get_length(screen, mpd));
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Handles a key typed while the queue's filter is taking input.
+ *
+ * Enter keeps the filter and returns to normal keys, Escape drops it, and
+ * anything printable is added to the query.
+ *
+ * @param screen The queue screen.
+ * @param mpd The MPD client whose queue is filtered.
+ * @param ch The key that was pressed.
+ */
+static void handle_filter_key(struct queue_screen *screen, struct mpdclient *mpd, int ch)
+{
+    switch (ch) {
+        case '\n':
+        case KEY_ENTER:
+            screen->filter_input = 0;
+            break;
+        case KEY_ESCAPE:
+            queue_screen_filter_clear(screen);
+            break;
+        case KEY_BACKSPACE:
+        case KEY_DELETE:
+        case '\b':
+            if (queue_filter_is_active(screen->filter)) {
+                queue_screen_filter_backspace(screen, mpd);
+            }
+            else {
+                screen->filter_input = 0;
+            }
+            break;
+        default:
+            /* Bytes of UTF-8 characters arrive one at a time, and are matched as they come. */
+            if (ch >= ' ' && ch <= 0xff) {
+                char text[2] = {(char)ch, '\0'};
+                queue_screen_filter_append(screen, mpd, text);
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Handles a key typed while the library search is taking input.
+ *
+ * Works like the queue's filter: Enter keeps the results and returns to
+ * normal keys, so that one can be chosen, Escape ends the search, and
+ * anything printable is added to it.
+ *
+ * @param screen The library screen.
+ * @param mpd The MPD client whose library is searched.
+ * @param ch The key that was pressed.
+ */
+static void handle_search_key(struct library_screen *screen, struct mpdclient *mpd, int ch)
+{
+    switch (ch) {
+        case '\n':
+        case KEY_ENTER:
+            screen->search_input = 0;
+            break;
+        case KEY_ESCAPE:
+            library_screen_search_clear(screen);
+            break;
+        case KEY_BACKSPACE:
+        case KEY_DELETE:
+        case '\b':
+            if (screen->query_length) {
+                library_screen_search_backspace(screen);
+            }
+            else {
+                screen->search_input = 0;
+            }
+            break;
+        default:
+            if (ch >= ' ' && ch <= 0xff) {
+                char text[2] = {(char)ch, '\0'};
+                library_screen_search_append(screen, mpd, text);
+            }
+            break;
+    }
+}
+
+/**
+ * @brief Handles commands that only apply to the library screen.
+ *
+ * @param screen The library screen.
+ * @param cmd_type The command entered by the user.
+ * @param mpd The connection to MPD, which fetches any nodes that get expanded.
+ */
+static void handle_library_command(struct library_screen *screen, enum command_type cmd_type,
+                                   struct mpdclient *mpd)
+{
+    switch (cmd_type) {
+        case CMD_SCROLL_TOP:
+            library_screen_set_cursor(screen, mpd, 0);
+            break;
+        case CMD_SCROLL_BOTTOM:
+            library_screen_set_cursor(screen, mpd, (unsigned)-1);
+            break;
+        case CMD_EXPAND:
+            library_screen_expand(screen, mpd);
+            break;
+        case CMD_COLLAPSE:
+            library_screen_collapse(screen, mpd);
+            break;
+        case CMD_FILTER:
+            library_screen_search_begin(screen, 0);
+            break;
+        case CMD_FUZZY:
+            library_screen_search_begin(screen, 1);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Gets how many rows a command moves the visible screen's cursor by.
+ *
+ * @param ui The user interface.
+ * @param config The settings, which say how far a page up or down moves.
+ * @param cmd_type The command.
+ *
+ * @return The number of rows, negative for up, or 0 if the command doesn't
+ * move the cursor relative to where it is.
+ */
+static int get_cursor_delta(struct ui *ui, const struct config *config,
+                            enum command_type cmd_type)
+{
+    WINDOW *win;
+    switch (ui->visible_panel) {
+        case QUEUE:
+            win = ui->queue_screen->win;
+            break;
+        case LIBRARY:
+            win = ui->library_screen->win;
+            break;
+        default:
+            return 0;
+    }
+
+    int page = config->page_lines ? (int)config->page_lines : getmaxy(win);
+    switch (cmd_type) {
+        case CMD_SCROLL_UP:
+            return -1;
+        case CMD_SCROLL_DOWN:
+            return 1;
+        case CMD_PAGE_UP:
+            return -page;
+        case CMD_PAGE_DOWN:
+            return page;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Moves the visible screen's cursor.
+ *
+ * @param ui The user interface.
+ * @param mpd The connection to MPD.
+ * @param delta The number of rows to move by, negative for up.
+ */
+static void move_cursor(struct ui *ui, struct mpdclient *mpd, int delta)
+{
+    if (!delta) {
+        return;
+    }
+
+    switch (ui->visible_panel) {
+        case QUEUE:
+            queue_screen_move_cursor(ui->queue_screen, delta,
+                                     queue_screen_get_length(ui->queue_screen, mpd));
+            break;
+        case LIBRARY:
+            library_screen_move_cursor(ui->library_screen, mpd, delta);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief Runs a command typed outside of the search and filter prompts.
+ *
+ * @param ui The user interface.
+ * @param mpd The connection to MPD.
+ * @param config The settings, which say how far a page up or down moves.
+ * @param cmd_type The command to run.
+ */
+static void handle_command(struct ui *ui, struct mpdclient *mpd, const struct config *config,
+                           enum command_type cmd_type)
+{
+    switch (cmd_type) {
+        case CMD_HELP:
+            ui_set_visible_panel(ui, HELP);
+            break;
+        case CMD_QUEUE:
+            ui_set_visible_panel(ui, QUEUE);
+            break;
+        case CMD_LIBRARY:
+            ui_set_visible_panel(ui, LIBRARY);
+            break;
+        case CMD_VOLUME_UP:
+            mpdclient_change_volume(mpd, VOLUME_STEP);
+            break;
+        case CMD_VOLUME_DOWN:
+            mpdclient_change_volume(mpd, -VOLUME_STEP);
+            break;
+        case CMD_SEEK_FORWARD:
+            mpdclient_seek(mpd, SEEK_STEP);
+            break;
+        case CMD_SEEK_BACKWARD:
+            mpdclient_seek(mpd, -SEEK_STEP);
+            break;
+        default:
+            break;
+    }
+
+    move_cursor(ui, mpd, get_cursor_delta(ui, config, cmd_type));
+
+    switch (ui->visible_panel) {
+        case HELP:
+            break;
+        case QUEUE:
+            handle_queue_command(ui->queue_screen, mpd, cmd_type,
+                                 queue_screen_get_length(ui->queue_screen, mpd));
+            ui->statusbar_dirty |= ui->queue_screen->filter_input;
+            break;
+        case LIBRARY:
+            handle_library_command(ui->library_screen, cmd_type, mpd);
+            /* Choosing a search result ends the search. */
+            ui->statusbar_dirty |= ui->library_screen->search_input || cmd_type == CMD_EXPAND;
+            break;
+        default:
+            break;
+    }
+}
+
 int main(int argc, char *argv[])
 {
+    /*
+     * Resizes are only ever read from the event loop's signalfd. The worker and pool threads
+     * start before the loop is made, so block SIGWINCH now for them to inherit the mask.
+     */
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
     struct arguments arguments = parse_arguments(argc, argv);
 
-    struct mpdclient *mpd = mpdclient_new(arguments.host, arguments.port, 0);
+    /* Read the config file before anything else, so it can shape everything that follows. */
+    struct config *config = config_new();
+    char *config_path = arguments.config ? strdup(arguments.config) : config_get_path();
+    int config_status = 0;
+    if (config && config_path) {
+        config_status = config_load(config, config_path, arguments.config != NULL);
+    }
+    if (!config || (arguments.config && (!config_path || config_status != 0))) {
+        if (config_path) {
+            fprintf(stderr, "Error reading config file %s.\n", config_path);
+        }
+        else {
+            fprintf(stderr, "Error reading config file.\n");
+        }
+        config_free(config);
+        free(config_path);
+        exit(EXIT_FAILURE);
+    }
+
+    /* The command line overrides the config file. */
+    if (arguments.host) {
+        free(config->host);
+        config->host = strdup(arguments.host);
+    }
+    if (arguments.port) {
+        config->port = arguments.port;
+    }
+    if (arguments.queue_budget) {
+        config->queue_budget = arguments.queue_budget;
+    }
+    if (arguments.threads) {
+        config->threads = arguments.threads;
+    }
+
+    struct mpdclient *mpd = config->host ? mpdclient_new(config->host, config->port, 0,
+                                                         config->queue_budget, config->threads)
+                                         : NULL;
     if (!mpd) {
         fprintf(stderr, "Error connecting to MPD.\n");
+        config_free(config);
+        free(config_path);
+        exit(EXIT_FAILURE);
+    }
+    mpd->index_budget = config->index_budget;
+    mpd->prefetch_margin = config->prefetch_margin;
+
+    /* Show the queue from the last run straight away, then catch up with what changed since. */
+    char *snapshot_path = cache_get_path("queue", config->host, config->port);
+    struct snapshot_view view;
+    int restored = snapshot_path && snapshot_load(mpd, snapshot_path, &view) == 0;
+    mpdclient_update_queue(mpd);
+
+    struct event_loop *loop = event_loop_new(STDIN_FILENO, mpdclient_get_fd(mpd));
+    if (!loop) {
+        fprintf(stderr, "Error creating event loop.\n");
+        mpdclient_free(mpd);
+        config_free(config);
+        free(config_path);
+        free(snapshot_path);
+        exit(EXIT_FAILURE);
+    }
+
+    /* The config file's bindings go on top of the defaults, replacing any they share keys with. */
+    struct keymap *keymap = keymap_new();
+    if (!keymap || keymap_bind_all(keymap, vector_at(config->bindings, 0),
+                                   vector_get_length(config->bindings)) != 0) {
+        fprintf(stderr, "Error creating key bindings.\n");
+        keymap_free(keymap);
+        event_loop_free(loop);
+        mpdclient_free(mpd);
+        config_free(config);
+        free(config_path);
+        free(snapshot_path);
         exit(EXIT_FAILURE);
     }
 
     start_curses();
 
     struct ui *ui = ui_new();
+    queue_screen_set_columns(ui->queue_screen, config->columns, config->num_columns);
+    if (config->num_errors) {
+        ui_set_message(ui, "%s: %s (%u bad lines)", config_path, config->error, config->num_errors);
+    }
+    else if (config_status != 0) {
+        ui_set_message(ui, "Couldn't read %s", config_path);
+    }
+    else if (config->loaded) {
+        ui_set_message(ui, "Read %s in %.2f ms", config_path, config->parse_ms);
+    }
+    if (restored) {
+        ui_set_visible_panel(ui, view.panel < NUM_PANELS ? view.panel : QUEUE);
+        ui->queue_screen->offset = view.offset;
+        queue_screen_set_cursor(ui->queue_screen, view.cursor, mpdclient_get_queue_length(mpd));
+    }
     ui_draw(ui, mpd);
 
     int ch;
+    unsigned events;
+    int redraw;
+    int draw_pending = 0;
+    int frame_waiting = 0;
+    int control_waiting = 0;
+    int cursor_delta = 0;
     enum command_type cmd_type = CMD_NULL;
 
     while (cmd_type != CMD_QUIT) {
-        ch = getch();
-        cmd_type = find_key_command(ch);
+        events = event_loop_wait(loop);
+        redraw = 0;
 
-        switch (cmd_type) {
-            case CMD_HELP:
-                ui_set_visible_panel(ui, HELP);
-                break;
-            case CMD_QUEUE:
-                ui_set_visible_panel(ui, QUEUE);
-                break;
-            case CMD_LIBRARY:
-                ui_set_visible_panel(ui, LIBRARY);
-                break;
-            default:
-                break;
+        if (events & EVENT_INPUT) {
+            while (cmd_type != CMD_QUIT && (ch = getch()) != ERR) {
+                redraw = 1;
+                ui_set_message(ui, NULL);
+
+                if (ui->visible_panel == QUEUE && ui->queue_screen->filter_input) {
+                    handle_filter_key(ui->queue_screen, mpd, ch);
+                    ui->statusbar_dirty = 1;
+                    continue;
+                }
+                if (ui->visible_panel == LIBRARY && ui->library_screen->search_input) {
+                    handle_search_key(ui->library_screen, mpd, ch);
+                    ui->statusbar_dirty = 1;
+                    continue;
+                }
+
+                cmd_type = keymap_press(keymap, ch);
+
+                /*
+                 * A held-down key repeats faster than frames are drawn. Moves in one direction
+                 * are added up and made at once, which lands on the same row as making each.
+                 */
+                int delta = get_cursor_delta(ui, config, cmd_type);
+                if (cursor_delta && (!delta || (delta < 0) != (cursor_delta < 0))) {
+                    move_cursor(ui, mpd, cursor_delta);
+                    cursor_delta = 0;
+                }
+                if (delta) {
+                    cursor_delta += delta;
+                }
+                else {
+                    handle_command(ui, mpd, config, cmd_type);
+                }
+            }
+            move_cursor(ui, mpd, cursor_delta);
+            cursor_delta = 0;
+
+            if (keymap_is_pending(keymap)) {
+                event_loop_set_timer(loop, TIMER_KEYS, config->key_timeout);
+            }
+            else {
+                event_loop_cancel_timer(loop, TIMER_KEYS);
+            }
+        }
+        if (event_loop_timer_expired(loop, TIMER_KEYS)) {
+            cmd_type = keymap_timeout(keymap);
+            handle_command(ui, mpd, config, cmd_type);
+            redraw = 1;
         }
 
-        switch (ui->visible_panel) {
-            case HELP:
-                break;
-            case QUEUE:
-                break;
-            case LIBRARY:
-                break;
-            default:
+        /*
+         * Volume and seek keys, and queue edits, are held back until the keys pause, then sent
+         * together, so a held-down key costs one round trip when it is let go. A long hold is
+         * still sent once its first unsent key has waited for control_max_wait.
+         */
+        if (event_loop_timer_expired(loop, TIMER_CONTROL) ||
+            event_loop_timer_expired(loop, TIMER_CONTROL_MAX)) {
+            mpdclient_send_controls(mpd);
+            mpdclient_send_edits(mpd);
+            event_loop_cancel_timer(loop, TIMER_CONTROL);
+            event_loop_cancel_timer(loop, TIMER_CONTROL_MAX);
+            control_waiting = 0;
+        }
+        if (mpdclient_has_unsent_controls(mpd) || mpdclient_has_unsent_edits(mpd)) {
+            if (!control_waiting) {
+                event_loop_set_timer(loop, TIMER_CONTROL_MAX, config->control_max_wait);
+            }
+            if (!control_waiting || (events & EVENT_INPUT)) {
+                event_loop_set_timer(loop, TIMER_CONTROL, config->control_delay);
+            }
+            control_waiting = 1;
+        }
+
+        if (events & EVENT_MPD) {
+            if (mpdclient_handle_results(mpd)) {
+                redraw = 1;
+            }
+            if (mpdclient_has_error(mpd)) {
                 break;
+            }
+        }
+
+        if (events & EVENT_RESIZE) {
+            event_loop_set_timer(loop, TIMER_RESIZE, RESIZE_DELAY);
+        }
+        if (event_loop_timer_expired(loop, TIMER_RESIZE)) {
+            ui_resize(ui);
+            redraw = 1;
         }
 
-        ui_draw(ui, mpd);
+        /* Draw at most once per frame interval, taking in everything that changed meanwhile. */
+        draw_pending |= redraw;
+        if (event_loop_timer_expired(loop, TIMER_FRAME)) {
+            frame_waiting = 0;
+        }
+        if (draw_pending && !frame_waiting && cmd_type != CMD_QUIT) {
+            ui_draw(ui, mpd);
+            draw_pending = 0;
+            frame_waiting = 1;
+            event_loop_set_timer(loop, TIMER_FRAME, FRAME_INTERVAL);
+        }
     }
 
     stop_curses();
 
+    /*
+     * Edits are sent a moment after they're made, so the last ones may not have been yet. A
+     * queue they changed that the server hasn't confirmed would be saved under a version it
+     * doesn't match, so the last run's snapshot is kept instead.
+     */
+    int synced = !mpdclient_has_error(mpd) && mpdclient_flush(mpd, QUIT_TIMEOUT) == 0;
+
+    if (mpdclient_has_error(mpd)) {
+        fprintf(stderr, "MPD error: %s\n", mpdclient_get_last_error_message(mpd));
+    }
+    else if (snapshot_path && synced) {
+        view.panel = ui->visible_panel;
+        view.cursor = queue_screen_get_position(ui->queue_screen, ui->queue_screen->cursor);
+        view.offset = queue_screen_get_position(ui->queue_screen, ui->queue_screen->offset);
+        snapshot_save(mpd, snapshot_path, &view);
+    }
+    free(snapshot_path);
+
     ui_free(ui);
+    keymap_free(keymap);
+    event_loop_free(loop);
+    config_free(config);
+    free(config_path);
 
     /* free(queue_screen); */
     mpdclient_free(mpd);
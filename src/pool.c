@@ -0,0 +1,490 @@
+/*******************************************************************************
+ * pool.c - A small work-stealing thread pool for splitting scans across cores.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file pool.h
+ *
+ * @brief Runs the tasks of a job on every thread of the pool, balancing them by stealing.
+ *
+ * A job is a run of task indices. It is dealt out in equal ranges, one per
+ * thread. Each thread takes tasks from the front of its own range, and a
+ * thread whose range runs dry steals the back half of another's. A range
+ * is a begin and an end packed into one atomic word, so taking and
+ * stealing are both a single compare-and-swap, and the two can't hand out
+ * the same task.
+ *
+ * Only one job runs at a time. Results don't depend on which thread ran
+ * which task, so callers that give each task its own output and combine
+ * the outputs in task order get the same answer with any number of threads.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pantomime/pool.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+ * @brief The assumed size of a cache line, used to keep the threads' ranges apart.
+ */
+#define CACHE_LINE 64
+
+/**
+ * @brief The most threads a pool runs, however many CPUs there are.
+ */
+#define POOL_MAX_THREADS 64
+
+/**
+ * @brief The number of shards pool_get_shards() aims for per thread.
+ *
+ * A few per thread leaves something to steal when one shard turns out to
+ * be slower than the rest.
+ */
+#define POOL_SHARDS_PER_THREAD 4
+
+/**
+ * @brief The fewest items pool_filter() gives a shard.
+ */
+#define POOL_FILTER_GRAIN 4096
+
+/**
+ * @brief The tasks one thread has yet to start, packed as begin | end << 32.
+ */
+struct pool_range {
+    alignas(CACHE_LINE) _Atomic uint64_t tasks;
+};
+
+/**
+ * @brief One of the threads the pool started.
+ */
+struct pool_thread {
+    struct pool *pool; /** The pool the thread works for. */
+    unsigned slot;     /** The thread's range in @ref pool::ranges. */
+    pthread_t thread;
+};
+
+struct pool {
+    unsigned num_threads;        /** The threads working on a job, counting its caller. */
+    struct pool_range *ranges;   /** The tasks each thread has left. The caller uses the first. */
+    struct pool_thread *threads; /** The threads started, one fewer than @ref num_threads. */
+    unsigned num_started;        /** The number of @ref threads actually running. */
+
+    void (*task)(void *data, unsigned index); /** The current job's task. */
+    void *data;                               /** The current job's data. */
+    atomic_uint remaining;                    /** Tasks of the current job not yet finished. */
+
+    pthread_mutex_t run_lock; /** Held by the thread running a job. */
+    pthread_mutex_t lock;     /** Guards everything below. */
+    pthread_cond_t started;   /** Signalled when a job starts or the pool is freed. */
+    pthread_cond_t finished;  /** Signalled when a job's last task ends or a thread goes idle. */
+    unsigned generation;      /** The number of jobs started. */
+    unsigned active;          /** The number of threads still looking at the last job. */
+    int quitting;             /** Whether the threads should exit. */
+};
+
+static uint64_t pool_pack(uint32_t begin, uint32_t end)
+{
+    return (uint64_t)end << 32 | begin;
+}
+
+/**
+ * @brief Takes the first task from a thread's own range.
+ *
+ * @return 0 with the task in @p index, or -1 if the range is empty.
+ */
+static int pool_take(struct pool_range *range, unsigned *index)
+{
+    uint64_t tasks = atomic_load_explicit(&range->tasks, memory_order_acquire);
+
+    for (;;) {
+        uint32_t begin = (uint32_t)tasks;
+        uint32_t end = (uint32_t)(tasks >> 32);
+        if (begin >= end) {
+            return -1;
+        }
+        if (atomic_compare_exchange_weak_explicit(&range->tasks, &tasks, pool_pack(begin + 1, end),
+                                                  memory_order_acq_rel, memory_order_acquire)) {
+            *index = begin;
+            return 0;
+        }
+    }
+}
+
+/**
+ * @brief Moves the back half of another thread's tasks into an idle thread's range.
+ *
+ * Only the idle thread writes to its own range here, and it only steals
+ * once that range is empty, so the store can't lose any tasks.
+ *
+ * @return 0 if anything was stolen, or -1 if every other range is empty.
+ */
+static int pool_steal(struct pool *pool, unsigned slot)
+{
+    for (unsigned i = 1; i < pool->num_threads; ++i) {
+        struct pool_range *victim = &pool->ranges[(slot + i) % pool->num_threads];
+        uint64_t tasks = atomic_load_explicit(&victim->tasks, memory_order_acquire);
+
+        for (;;) {
+            uint32_t begin = (uint32_t)tasks;
+            uint32_t end = (uint32_t)(tasks >> 32);
+            if (begin >= end) {
+                break;
+            }
+
+            uint32_t middle = begin + (end - begin) / 2;
+            if (atomic_compare_exchange_weak_explicit(&victim->tasks, &tasks,
+                                                      pool_pack(begin, middle),
+                                                      memory_order_acq_rel,
+                                                      memory_order_acquire)) {
+                atomic_store_explicit(&pool->ranges[slot].tasks, pool_pack(middle, end),
+                                      memory_order_release);
+                return 0;
+            }
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Runs tasks of the current job until there are none left to take or steal.
+ */
+static void pool_work(struct pool *pool, unsigned slot)
+{
+    unsigned index;
+
+    do {
+        while (pool_take(&pool->ranges[slot], &index) == 0) {
+            pool->task(pool->data, index);
+
+            if (atomic_fetch_sub_explicit(&pool->remaining, 1, memory_order_acq_rel) == 1) {
+                pthread_mutex_lock(&pool->lock);
+                pthread_cond_broadcast(&pool->finished);
+                pthread_mutex_unlock(&pool->lock);
+            }
+        }
+    } while (pool_steal(pool, slot) == 0);
+}
+
+/**
+ * @brief The body of each thread the pool starts: help with every job until the pool is freed.
+ */
+static void *pool_thread_run(void *arg)
+{
+    struct pool_thread *thread = arg;
+    struct pool *pool = thread->pool;
+    unsigned seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quitting && pool->generation == seen) {
+            pthread_cond_wait(&pool->started, &pool->lock);
+        }
+        if (pool->quitting) {
+            break;
+        }
+        seen = pool->generation;
+        ++pool->active;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool_work(pool, thread->slot);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->active == 0) {
+            pthread_cond_broadcast(&pool->finished);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Creates a pool.
+ *
+ * @param threads The number of threads to run jobs on, counting the one
+ * that starts them, or 0 for one per online CPU.
+ *
+ * @return A newly-allocated pool, or NULL on error.
+ */
+struct pool *pool_new(unsigned threads)
+{
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    if (threads > POOL_MAX_THREADS) {
+        threads = POOL_MAX_THREADS;
+    }
+
+    struct pool *pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->num_threads = threads;
+    pool->ranges = aligned_alloc(CACHE_LINE, sizeof(*pool->ranges) * threads);
+    pool->threads = calloc(threads, sizeof(*pool->threads));
+    if (!pool->ranges || !pool->threads) {
+        free(pool->ranges);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+
+    for (unsigned slot = 0; slot < threads; ++slot) {
+        atomic_init(&pool->ranges[slot].tasks, 0);
+    }
+    atomic_init(&pool->remaining, 0);
+    pthread_mutex_init(&pool->run_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->started, NULL);
+    pthread_cond_init(&pool->finished, NULL);
+
+    for (unsigned slot = 1; slot < threads; ++slot) {
+        struct pool_thread *thread = &pool->threads[pool->num_started];
+        thread->pool = pool;
+        thread->slot = slot;
+        if (pthread_create(&thread->thread, NULL, pool_thread_run, thread) != 0) {
+            break;
+        }
+        ++pool->num_started;
+    }
+    /* Threads that couldn't be started just leave fewer ranges to deal jobs out to. */
+    pool->num_threads = pool->num_started + 1;
+
+    return pool;
+}
+
+/**
+ * @brief Stops a pool's threads and frees it. No job may be running.
+ *
+ * @param pool The pool to free.
+ */
+void pool_free(struct pool *pool)
+{
+    if (!pool) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quitting = 1;
+    pthread_cond_broadcast(&pool->started);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned i = 0; i < pool->num_started; ++i) {
+        pthread_join(pool->threads[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&pool->finished);
+    pthread_cond_destroy(&pool->started);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->run_lock);
+    free(pool->threads);
+    free(pool->ranges);
+    free(pool);
+}
+
+/**
+ * @brief Gets the number of threads a pool runs jobs on, including the caller, or 1 for NULL.
+ */
+unsigned pool_get_threads(struct pool *pool)
+{
+    return pool ? pool->num_threads : 1;
+}
+
+/**
+ * @brief Chooses how many shards to split some items into.
+ *
+ * @param pool The pool the shards will run on, or NULL.
+ * @param length The number of items.
+ * @param grain The fewest items worth giving a shard of their own.
+ *
+ * @return At least 1, and a few per thread if there are enough items.
+ */
+unsigned pool_get_shards(struct pool *pool, unsigned length, unsigned grain)
+{
+    unsigned threads = pool_get_threads(pool);
+    if (threads == 1) {
+        return 1;
+    }
+
+    unsigned shards = threads * POOL_SHARDS_PER_THREAD;
+    unsigned most = grain ? length / grain : length;
+    if (shards > most) {
+        shards = most;
+    }
+
+    return shards ? shards : 1;
+}
+
+/**
+ * @brief Gets the first item of a shard, when items are split into shards as evenly as possible.
+ *
+ * @param length The number of items.
+ * @param shards The number of shards.
+ * @param shard The shard, or @p shards for the end of the last.
+ */
+unsigned pool_get_shard_start(unsigned length, unsigned shards, unsigned shard)
+{
+    return (unsigned)((uint64_t)length * shard / shards);
+}
+
+/**
+ * @brief Runs a task once for each index below a count, and waits for all of them to finish.
+ *
+ * The tasks run concurrently and in no particular order. If the pool is
+ * already running a job for another thread, or is NULL, they all run on
+ * the calling thread instead, in order.
+ *
+ * @param pool The pool to run the tasks on.
+ * @param count The number of tasks.
+ * @param task The task, called with @p data and an index below @p count.
+ * @param data Passed to @p task.
+ */
+void pool_run(struct pool *pool, unsigned count, void (*task)(void *data, unsigned index),
+              void *data)
+{
+    if (!pool || pool->num_threads == 1 || count <= 1 || pthread_mutex_trylock(&pool->run_lock)) {
+        for (unsigned index = 0; index < count; ++index) {
+            task(data, index);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    /* A thread still looking at the last job could otherwise steal into a fresh range. */
+    while (pool->active) {
+        pthread_cond_wait(&pool->finished, &pool->lock);
+    }
+
+    pool->task = task;
+    pool->data = data;
+    atomic_store_explicit(&pool->remaining, count, memory_order_relaxed);
+    for (unsigned slot = 0; slot < pool->num_threads; ++slot) {
+        atomic_store_explicit(&pool->ranges[slot].tasks,
+                              pool_pack(pool_get_shard_start(count, pool->num_threads, slot),
+                                        pool_get_shard_start(count, pool->num_threads, slot + 1)),
+                              memory_order_release);
+    }
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->started);
+    pthread_mutex_unlock(&pool->lock);
+
+    pool_work(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load_explicit(&pool->remaining, memory_order_acquire)) {
+        pthread_cond_wait(&pool->finished, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_mutex_unlock(&pool->run_lock);
+}
+
+/**
+ * @brief The shared state of a pool_filter() call.
+ */
+struct pool_filter_job {
+    unsigned start;                          /** The first item. */
+    unsigned length;                         /** The number of items. */
+    unsigned shards;                         /** The number of shards they are split into. */
+    int (*keep)(void *data, unsigned index); /** Decides whether an item matches. */
+    void *data;                              /** Passed to @ref keep. */
+    struct vector **found;                   /** The matches of each shard. */
+    atomic_int failed;                       /** Whether memory ran out in any shard. */
+};
+
+/**
+ * @brief Checks the items of one shard.
+ */
+static void pool_filter_shard(void *data, unsigned shard)
+{
+    struct pool_filter_job *job = data;
+    unsigned end = job->start + pool_get_shard_start(job->length, job->shards, shard + 1);
+
+    for (unsigned index = job->start + pool_get_shard_start(job->length, job->shards, shard);
+         index < end; ++index) {
+        if (job->keep(job->data, index) &&
+            vector_push(job->found[shard], &index) != VEC_ERROR_SUCCESS) {
+            atomic_store(&job->failed, 1);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Appends the items in a range that match, in ascending order.
+ *
+ * The range is split into shards that are checked in parallel, each into
+ * a list of its own, and the lists are appended in order, so the result
+ * is the same as checking every item in turn.
+ *
+ * @param pool The pool to check the items on, or NULL.
+ * @param start The first item to check.
+ * @param end One past the last item to check.
+ * @param keep Returns nonzero for an item that matches. It must be safe to call from any thread.
+ * @param data Passed to @p keep.
+ * @param matches The vector of unsigned to append the matching items to.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+int pool_filter(struct pool *pool, unsigned start, unsigned end,
+                int (*keep)(void *data, unsigned index), void *data, struct vector *matches)
+{
+    struct pool_filter_job job = {start, end > start ? end - start : 0, 0, keep, data, NULL};
+    job.shards = pool_get_shards(pool, job.length, POOL_FILTER_GRAIN);
+    atomic_init(&job.failed, 0);
+
+    job.found = calloc(job.shards, sizeof(*job.found));
+    if (!job.found) {
+        return -1;
+    }
+
+    /* The first shard's matches go straight to the end of the caller's vector. */
+    job.found[0] = matches;
+    for (unsigned shard = 1; shard < job.shards; ++shard) {
+        job.found[shard] = vector_new(sizeof(unsigned));
+        if (!job.found[shard]) {
+            atomic_store(&job.failed, 1);
+        }
+    }
+
+    if (!atomic_load(&job.failed)) {
+        pool_run(pool, job.shards, pool_filter_shard, &job);
+    }
+
+    for (unsigned shard = 1; shard < job.shards; ++shard) {
+        unsigned length = job.found[shard] ? vector_get_length(job.found[shard]) : 0;
+        if (length && !atomic_load(&job.failed) &&
+            vector_insert(matches, vector_get_length(matches), vector_at(job.found[shard], 0),
+                          length) != VEC_ERROR_SUCCESS) {
+            atomic_store(&job.failed, 1);
+        }
+        vector_free(job.found[shard], NULL);
+    }
+    free(job.found);
+
+    return atomic_load(&job.failed) ? -1 : 0;
+}
@@ -0,0 +1,150 @@
+/*******************************************************************************
+ * ring.c - Lock-free single-producer, single-consumer queue.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file ring.h
+ *
+ * @brief A bounded queue for handing pointers from one thread to another.
+ *
+ * The producer only ever writes @ref ring::tail and the consumer only ever
+ * writes @ref ring::head, so the two sides never contend for a lock. A
+ * release store of an index publishes the slot it covers, and the matching
+ * acquire load on the other side makes the slot's contents visible.
+ */
+
+#include "pantomime/ring.h"
+
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+/**
+ * @brief The assumed size of a cache line, used to keep the two indices apart.
+ */
+#define CACHE_LINE 64
+
+struct ring {
+    alignas(CACHE_LINE) atomic_uint head; /** The next slot to pop. Written by the consumer. */
+    alignas(CACHE_LINE) atomic_uint tail; /** The next slot to push. Written by the producer. */
+    alignas(CACHE_LINE) unsigned mask;    /** The number of slots minus one. */
+    void **slots;                         /** The queued items. */
+};
+
+/**
+ * @brief Creates an empty ring.
+ *
+ * @param capacity The minimum number of items the ring must hold. It is
+ * rounded up to a power of two.
+ *
+ * @return A newly-allocated ring, or NULL on error.
+ */
+struct ring *ring_new(unsigned capacity)
+{
+    unsigned size = 2;
+    while (size < capacity) {
+        size *= 2;
+    }
+
+    struct ring *ring = aligned_alloc(CACHE_LINE, sizeof(*ring));
+    if (!ring) {
+        return NULL;
+    }
+
+    ring->slots = malloc(sizeof(*ring->slots) * size);
+    if (!ring->slots) {
+        free(ring);
+        return NULL;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    ring->mask = size - 1;
+
+    return ring;
+}
+
+/**
+ * @brief Frees a ring. Items still in it are not freed.
+ *
+ * @param ring The ring to free.
+ */
+void ring_free(struct ring *ring)
+{
+    if (!ring) {
+        return;
+    }
+
+    free(ring->slots);
+    free(ring);
+}
+
+/**
+ * @brief Adds an item to the back of the ring. Only the producer thread may call this.
+ *
+ * @param ring The ring to push to.
+ * @param item The item to add.
+ *
+ * @return 0 on success, or -1 if the ring is full.
+ */
+int ring_push(struct ring *ring, void *item)
+{
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    /* The indices run freely and wrap around, so their difference is the fill level. */
+    if (tail - head > ring->mask) {
+        return -1;
+    }
+
+    ring->slots[tail & ring->mask] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return 0;
+}
+
+/**
+ * @brief Removes the item at the front of the ring. Only the consumer thread may call this.
+ *
+ * @param ring The ring to pop from.
+ *
+ * @return The item, or NULL if the ring is empty.
+ */
+void *ring_pop(struct ring *ring)
+{
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head == tail) {
+        return NULL;
+    }
+
+    void *item = ring->slots[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return item;
+}
+
+/**
+ * @brief Checks whether a ring is empty. Only the consumer thread may rely on the answer.
+ */
+int ring_is_empty(struct ring *ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_relaxed) ==
+           atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
@@ -0,0 +1,265 @@
+/*******************************************************************************
+ * snapshot.c - Saved queue and view state for instant startup.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file snapshot.h
+ *
+ * @brief Saves the queue on exit so the next start can show it before the server answers.
+ *
+ * The file uses the same layout as the library cache: a fixed header, an
+ * array of fixed-width song records and the queue's intern table saved
+ * verbatim, so loading is a matter of mapping the file and copying it into
+ * place. The header carries the queue's playlist version and the time the
+ * server was started, which is all the worker thread needs to fetch only
+ * what changed since.
+ *
+ * When the queue is loaded lazily, only its length is saved. The pages are
+ * fetched as usual once the server has confirmed the length.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pantomime/snapshot.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Identifies a snapshot file.
+ */
+#define SNAPSHOT_MAGIC "PNTMQUE"
+
+/**
+ * @brief The version of the file format. Bump it whenever the layout changes.
+ */
+#define SNAPSHOT_FORMAT 1
+
+/**
+ * @brief Written as a number so that files from a machine with a different byte order are ignored.
+ */
+#define SNAPSHOT_BYTE_ORDER 0x01020304U
+
+/**
+ * @brief The start of a snapshot file.
+ */
+struct snapshot_header {
+    char magic[8];         /** @ref SNAPSHOT_MAGIC. */
+    uint32_t format;       /** @ref SNAPSHOT_FORMAT. */
+    uint32_t byte_order;   /** @ref SNAPSHOT_BYTE_ORDER. */
+    int64_t server_start;  /** When the server was started. */
+    uint32_t version;      /** The playlist version of the saved queue. */
+    uint32_t length;       /** The length of the queue. */
+    uint32_t num_songs;    /** The number of records after the header: @ref length or 0. */
+    uint32_t panel;        /** @ref snapshot_view::panel. */
+    uint32_t cursor;       /** @ref snapshot_view::cursor. */
+    uint32_t offset;       /** @ref snapshot_view::offset. */
+    uint64_t strings_size; /** The number of bytes in the string table after the records. */
+};
+
+/**
+ * @brief A @ref song as stored on disk.
+ */
+struct snapshot_record {
+    uint32_t id;
+    uint32_t duration;
+    uint32_t title;
+    uint32_t artist;
+    uint32_t album;
+};
+
+/**
+ * @brief Copies the queue out of a mapped snapshot into the client.
+ */
+static int snapshot_read(struct mpdclient *mpd, const void *map, size_t size,
+                         struct snapshot_view *view)
+{
+    const struct snapshot_header *header = map;
+    const struct snapshot_record *records = (const void *)(header + 1);
+
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 ||
+        header->format != SNAPSHOT_FORMAT || header->byte_order != SNAPSHOT_BYTE_ORDER ||
+        header->num_songs > (size - sizeof(*header)) / sizeof(*records) ||
+        (header->num_songs && header->num_songs != header->length)) {
+        return -1;
+    }
+
+    const char *strings = (const char *)(records + header->num_songs);
+    if (header->strings_size != size - (size_t)(strings - (const char *)map)) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < header->num_songs; ++i) {
+        if (records[i].title >= header->strings_size || records[i].artist >= header->strings_size ||
+            records[i].album >= header->strings_size) {
+            return -1;
+        }
+    }
+
+    view->panel = header->panel;
+    view->cursor = header->cursor;
+    view->offset = header->offset;
+
+    if (mpd->pages) {
+        if (pagecache_set_length(mpd->pages, header->length) != 0) {
+            return -1;
+        }
+    }
+    else if (header->num_songs == header->length) {
+        if (intern_table_load(mpd->strings, strings, header->strings_size) != 0 ||
+            vector_reserve(mpd->queue, header->num_songs) != VEC_ERROR_SUCCESS) {
+            intern_table_clear(mpd->strings);
+            return -1;
+        }
+
+        vector_clear(mpd->queue, NULL);
+        for (uint32_t i = 0; i < header->num_songs; ++i) {
+            struct song song;
+            song.id = records[i].id;
+            song.duration = records[i].duration;
+            song.title = records[i].title;
+            song.artist = records[i].artist;
+            song.album = records[i].album;
+            vector_push(mpd->queue, &song);
+        }
+    }
+    else {
+        /* Saved while loading lazily, so there are no songs to show. Only restore the view. */
+        return 0;
+    }
+
+    mpd->queue_version = header->version;
+    mpd->server_start = (time_t)header->server_start;
+    mpd->queue_seeded = 1;
+    mpd->queue_reloaded = 1;
+
+    return 0;
+}
+
+/**
+ * @brief Restores the queue and view saved by snapshot_save().
+ *
+ * This must be called before the first mpdclient_update_queue(), which then
+ * only fetches what changed since the snapshot was taken.
+ *
+ * @param mpd The connection to MPD, whose queue is still empty.
+ * @param path The snapshot file.
+ * @param view Filled in with the saved view state.
+ *
+ * @return 0 on success, or -1 if the file is missing or malformed.
+ */
+int snapshot_load(struct mpdclient *mpd, const char *path, struct snapshot_view *view)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct snapshot_header)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t size = st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    int result = snapshot_read(mpd, map, size, view);
+    munmap(map, size);
+
+    return result;
+}
+
+/**
+ * @brief Saves the queue and view so that the next start can show them immediately.
+ *
+ * The file is written under a temporary name and renamed into place, so a
+ * crash never leaves a truncated snapshot behind.
+ *
+ * @param mpd The connection to MPD.
+ * @param path The snapshot file.
+ * @param view The view state to save.
+ *
+ * @return 0 on success, or -1 on error.
+ */
+int snapshot_save(struct mpdclient *mpd, const char *path, const struct snapshot_view *view)
+{
+    size_t strings_size;
+    const char *strings = intern_table_get_data(mpd->strings, &strings_size);
+
+    struct snapshot_header header;
+    memset(&header, 0, sizeof(header));  // NOLINT
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));  // NOLINT
+    header.format = SNAPSHOT_FORMAT;
+    header.byte_order = SNAPSHOT_BYTE_ORDER;
+    header.server_start = mpd->server_start;
+    header.version = mpd->queue_version;
+    header.length = mpdclient_get_queue_length(mpd);
+    header.num_songs = mpd->queue ? header.length : 0;
+    header.panel = view->panel;
+    header.cursor = view->cursor;
+    header.offset = view->offset;
+    header.strings_size = mpd->queue ? strings_size : 1;
+
+    size_t length = strlen(path);
+    char *tmp_path = malloc(length + sizeof(".tmp"));
+    if (!tmp_path) {
+        return -1;
+    }
+    memcpy(tmp_path, path, length);  // NOLINT
+    memcpy(tmp_path + length, ".tmp", sizeof(".tmp"));  // NOLINT
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        free(tmp_path);
+        return -1;
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (uint32_t i = 0; ok && i < header.num_songs; ++i) {
+        const struct song *song = vector_at(mpd->queue, i);
+
+        struct snapshot_record record;
+        record.id = song->id;
+        record.duration = song->duration;
+        record.title = song->title;
+        record.artist = song->artist;
+        record.album = song->album;
+
+        ok = fwrite(&record, sizeof(record), 1, file) == 1;
+    }
+    ok = ok && fwrite(strings, 1, header.strings_size, file) == header.strings_size;
+
+    if (fclose(file) != 0 || !ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    free(tmp_path);
+    return 0;
+}
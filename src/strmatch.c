@@ -0,0 +1,357 @@
+/*******************************************************************************
+ * strmatch.c - Case-insensitive substring matching for tag searches.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file strmatch.h
+ *
+ * @brief Finds a needle in tag strings, ignoring ASCII case.
+ *
+ * Only ASCII letters are folded; every other byte, including each byte of a
+ * multibyte UTF-8 character, has to match exactly. Because UTF-8 is
+ * self-synchronizing, a valid needle can only ever match on character
+ * boundaries of a valid haystack.
+ *
+ * The vectorized searches test 16 or 32 candidate positions at once by
+ * comparing the needle's first and last bytes against two shifted loads of
+ * the haystack, and only compare the rest of the needle where both match.
+ * The best search the CPU supports is picked the first time one is needed.
+ *
+ * To keep short strings on the fast path, the vectorized loads may read
+ * past the terminator of the haystack, but never into the next page, so
+ * they can't fault.
+ */
+
+#include "pantomime/strmatch.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STRMATCH_X86
+#include <immintrin.h>
+
+/**
+ * @brief Builds a function for an instruction set, whatever the compiler's flags.
+ *
+ * The loads deliberately overread within a page, which AddressSanitizer
+ * would report.
+ */
+#define STRMATCH_TARGET(isa) __attribute__((target(isa), no_sanitize_address))
+#endif
+
+/**
+ * @brief The size of the smallest memory page an overreading load must stay within.
+ */
+#define STRMATCH_PAGE_SIZE 4096
+
+/**
+ * @brief Marks that the search hasn't been picked yet.
+ */
+#define STRMATCH_UNSET -1
+
+static atomic_int selected = STRMATCH_UNSET;
+
+/**
+ * @brief Lowercases an ASCII letter, leaving every other byte alone.
+ */
+unsigned char strmatch_fold_char(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+/**
+ * @brief Checks whether text equals a lowercase needle, ignoring ASCII case.
+ */
+static int strmatch_equal(const unsigned char *text, const unsigned char *needle, size_t length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        if (strmatch_fold_char(text[i]) != needle[i]) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @brief Searches one byte at a time.
+ *
+ * @param haystack The string to search.
+ * @param size The length of @p haystack, which is at least @p length.
+ * @param needle The lowercase needle.
+ * @param length The length of @p needle, which is at least one.
+ */
+static int strmatch_contains_scalar(const unsigned char *haystack, size_t size,
+                                    const unsigned char *needle, size_t length)
+{
+    for (size_t i = 0; i + length <= size; ++i) {
+        if (strmatch_fold_char(haystack[i]) == needle[0] &&
+            strmatch_equal(haystack + i + 1, needle + 1, length - 1)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+#ifdef STRMATCH_X86
+
+/**
+ * @brief Checks whether a load of @p width bytes stays within the page it starts in.
+ */
+static int strmatch_within_page(const unsigned char *address, size_t width)
+{
+    return ((uintptr_t)address & (STRMATCH_PAGE_SIZE - 1)) <= STRMATCH_PAGE_SIZE - width;
+}
+
+/**
+ * @brief Checks whether the two loads at candidate position @p i can be done safely.
+ *
+ * They can if they end at or before the terminator, or if they don't cross
+ * into another page.
+ */
+static int strmatch_can_load(const unsigned char *haystack, size_t size, size_t length, size_t i,
+                             size_t width)
+{
+    return i + length - 1 + width <= size + 1 ||
+           (strmatch_within_page(haystack + i, width) &&
+            strmatch_within_page(haystack + i + length - 1, width));
+}
+
+/**
+ * @brief Checks the candidates in @p mask, whose first and last bytes are known to match.
+ */
+static int strmatch_check_candidates(const unsigned char *block, unsigned mask,
+                                     const unsigned char *needle, size_t length)
+{
+    while (mask) {
+        unsigned bit = __builtin_ctz(mask);
+        if (length <= 2 || strmatch_equal(block + bit + 1, needle + 1, length - 2)) {
+            return 1;
+        }
+        mask &= mask - 1;
+    }
+
+    return 0;
+}
+
+STRMATCH_TARGET("sse2")
+static __m128i strmatch_fold_sse2(__m128i bytes)
+{
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(bytes, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(bytes, _mm_and_si128(upper, _mm_set1_epi8('a' - 'A')));
+}
+
+/**
+ * @brief Searches 16 candidate positions at a time. Takes the same arguments as the scalar search.
+ */
+STRMATCH_TARGET("sse2")
+static int strmatch_contains_sse2(const unsigned char *haystack, size_t size,
+                                  const unsigned char *needle, size_t length)
+{
+    const __m128i first = _mm_set1_epi8((char)needle[0]);
+    const __m128i last = _mm_set1_epi8((char)needle[length - 1]);
+    size_t starts = size - length + 1;
+
+    for (size_t i = 0; i < starts; i += 16) {
+        if (!strmatch_can_load(haystack, size, length, i, 16)) {
+            return strmatch_contains_scalar(haystack + i, size - i, needle, length);
+        }
+
+        const unsigned char *block = haystack + i;
+        __m128i block_first = strmatch_fold_sse2(_mm_loadu_si128((const __m128i *)block));
+        __m128i block_last =
+            strmatch_fold_sse2(_mm_loadu_si128((const __m128i *)(block + length - 1)));
+
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+        if (starts - i < 16) {
+            mask &= (1U << (starts - i)) - 1;
+        }
+
+        if (strmatch_check_candidates(block, mask, needle, length)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+STRMATCH_TARGET("avx2")
+static __m256i strmatch_fold_avx2(__m256i bytes)
+{
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('A' - 1)),
+                                     _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), bytes));
+    return _mm256_or_si256(bytes, _mm256_and_si256(upper, _mm256_set1_epi8('a' - 'A')));
+}
+
+/**
+ * @brief Searches 32 candidate positions at a time. Takes the same arguments as the scalar search.
+ */
+STRMATCH_TARGET("avx2")
+static int strmatch_contains_avx2(const unsigned char *haystack, size_t size,
+                                  const unsigned char *needle, size_t length)
+{
+    const __m256i first = _mm256_set1_epi8((char)needle[0]);
+    const __m256i last = _mm256_set1_epi8((char)needle[length - 1]);
+    size_t starts = size - length + 1;
+
+    for (size_t i = 0; i < starts; i += 32) {
+        if (!strmatch_can_load(haystack, size, length, i, 32)) {
+            /* Short strings near the end of a page can still be done 16 at a time. */
+            return strmatch_contains_sse2(haystack + i, size - i, needle, length);
+        }
+
+        const unsigned char *block = haystack + i;
+        __m256i block_first = strmatch_fold_avx2(_mm256_loadu_si256((const __m256i *)block));
+        __m256i block_last =
+            strmatch_fold_avx2(_mm256_loadu_si256((const __m256i *)(block + length - 1)));
+
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(block_first, first), _mm256_cmpeq_epi8(block_last, last)));
+        if (starts - i < 32) {
+            mask &= (1U << (starts - i)) - 1;
+        }
+
+        if (strmatch_check_candidates(block, mask, needle, length)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+#endif /* STRMATCH_X86 */
+
+/**
+ * @brief Finds the best search this CPU can run.
+ */
+static enum strmatch_impl strmatch_detect(void)
+{
+#ifdef STRMATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return STRMATCH_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return STRMATCH_SSE2;
+    }
+#endif
+    return STRMATCH_SCALAR;
+}
+
+/**
+ * @brief Lowercases the ASCII letters of a string in place.
+ *
+ * Needles have to be folded like this before being searched for.
+ *
+ * @param text The string to fold.
+ * @param length The number of bytes to fold.
+ */
+void strmatch_fold(char *text, size_t length)
+{
+    for (size_t i = 0; i < length; ++i) {
+        text[i] = (char)strmatch_fold_char((unsigned char)text[i]);
+    }
+}
+
+/**
+ * @brief Checks whether a string contains a needle, ignoring ASCII case.
+ *
+ * @param haystack The string to search.
+ * @param needle The needle, already folded with strmatch_fold().
+ * @param length The length of @p needle. An empty needle is in every string.
+ *
+ * @return 1 if @p haystack contains @p needle, or 0 if it doesn't.
+ */
+int strmatch_contains(const char *haystack, const char *needle, size_t length)
+{
+    if (!length) {
+        return 1;
+    }
+
+    size_t size = strlen(haystack);
+    if (size < length) {
+        return 0;
+    }
+
+    const unsigned char *h = (const unsigned char *)haystack;
+    const unsigned char *n = (const unsigned char *)needle;
+
+    switch (strmatch_get_impl()) {
+#ifdef STRMATCH_X86
+        case STRMATCH_AVX2:
+            return strmatch_contains_avx2(h, size, n, length);
+        case STRMATCH_SSE2:
+            return strmatch_contains_sse2(h, size, n, length);
+#endif
+        default:
+            return strmatch_contains_scalar(h, size, n, length);
+    }
+}
+
+/**
+ * @brief Gets the search strmatch_contains() uses, picking the best one on first use.
+ */
+enum strmatch_impl strmatch_get_impl(void)
+{
+    int impl = atomic_load_explicit(&selected, memory_order_relaxed);
+    if (impl == STRMATCH_UNSET) {
+        /* Every thread that races here detects the same answer. */
+        impl = strmatch_detect();
+        atomic_store_explicit(&selected, impl, memory_order_relaxed);
+    }
+
+    return (enum strmatch_impl)impl;
+}
+
+/**
+ * @brief Forces strmatch_contains() to use a particular search, for benchmarking.
+ *
+ * @param impl The search to use.
+ *
+ * @return 0 on success, or -1 if this CPU can't run it.
+ */
+int strmatch_set_impl(enum strmatch_impl impl)
+{
+    /* Every CPU with AVX2 also has SSE2. */
+    if (impl > strmatch_detect()) {
+        return -1;
+    }
+
+    atomic_store_explicit(&selected, impl, memory_order_relaxed);
+    return 0;
+}
+
+/**
+ * @brief Gets a short name for a search, as printed by the benchmarks.
+ */
+const char *strmatch_get_impl_name(enum strmatch_impl impl)
+{
+    switch (impl) {
+        case STRMATCH_SSE2:
+            return "sse2";
+        case STRMATCH_AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
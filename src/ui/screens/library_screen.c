@@ -0,0 +1,855 @@
+/*******************************************************************************
+ * library_screen.c - Screen for browsing the MPD database.
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file library_screen.h
+ *
+ * @brief Draws the library tree and lets the user expand it.
+ *
+ * The screen keeps a flat list of the nodes that are currently visible,
+ * which is rebuilt whenever a node is expanded or collapsed or new nodes
+ * arrive from the server. Drawing only touches the rows in the window, so
+ * scrolling costs the same whether the tree has a hundred nodes or a
+ * million.
+ *
+ * While searching, the list holds the matching nodes instead, each shown
+ * with the names of its ancestors. Choosing one ends the search and opens
+ * the tree up to it. A fuzzy search keeps every match aside and lists only
+ * as many of the best as have been scrolled to.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include "pantomime/ui/library_screen.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "pantomime/mpd/library_index.h"
+#include "pantomime/pool.h"
+#include "pantomime/strmatch.h"
+#include "pantomime/ui/queue_screen.h"
+
+/**
+ * @brief The number of columns each level of the tree is indented by.
+ */
+#define INDENT 2
+
+/**
+ * @brief Room for a track's length, such as "12:34".
+ */
+#define TIME_WIDTH 8
+
+/**
+ * @brief Room for a search result's artist, album and title.
+ */
+#define PATH_SIZE 1024
+
+/**
+ * @brief The fewest matches worth scoring on a thread of their own.
+ */
+#define RANK_GRAIN 4096
+
+/**
+ * @brief Creates a library screen.
+ *
+ * @param win The window to draw in.
+ *
+ * @return A newly-allocated library screen, or NULL on error.
+ */
+struct library_screen *library_screen_new(WINDOW *win)
+{
+    struct library_screen *screen = calloc(1, sizeof(*screen));
+    if (!screen) {
+        return NULL;
+    }
+
+    screen->rows = vector_new(sizeof(unsigned));
+    screen->matches = vector_new(sizeof(unsigned));
+    screen->ranked = fuzzy_top_new();
+    if (!screen->rows || !screen->matches || !screen->ranked) {
+        library_screen_free(screen);
+        return NULL;
+    }
+
+    screen->win = win;
+    screen->cursor = 0;
+    screen->offset = 0;
+    screen->rows_version = 0;
+    screen->rows_generation = 0;
+    screen->rows_valid = 0;
+
+    screen->query[0] = '\0';
+    screen->query_length = 0;
+    screen->search_input = 0;
+    screen->fuzzy = 0;
+
+    return screen;
+}
+
+/**
+ * @brief Frees a library screen. Its window is left alone.
+ *
+ * @param screen The screen to free.
+ */
+void library_screen_free(struct library_screen *screen)
+{
+    if (!screen) {
+        return;
+    }
+
+    vector_free(screen->rows, NULL);
+    vector_free(screen->matches, NULL);
+    fuzzy_top_free(screen->ranked);
+    free(screen);
+}
+
+/**
+ * @brief Appends a run of sibling nodes, and the visible descendants of each, to the rows.
+ */
+static void library_screen_add_rows(struct library_screen *screen, struct library *library,
+                                    unsigned first, unsigned count)
+{
+    for (unsigned index = first; index < first + count; ++index) {
+        vector_push(screen->rows, &index);
+
+        const struct library_node *node = library_get_node(library, index);
+        if (node->expanded && node->state == NODE_LOADED) {
+            library_screen_add_rows(screen, library, node->first_child, node->num_children);
+        }
+    }
+}
+
+/**
+ * @brief Writes a node's "artist - album - title", which fuzzy searches are matched against.
+ *
+ * Artists and albums leave out the fields below them.
+ *
+ * @param text Filled with the text. It must hold @ref FUZZY_TEXT_SIZE bytes.
+ */
+static void library_screen_join(struct library *library, unsigned index, char *text)
+{
+    const char *fields[LIBRARY_TRACK + 1] = {NULL};
+
+    const struct library_node *node = library_get_node(library, index);
+    for (; node; node = library_get_node(library, node->parent)) {
+        fields[node->level] = library_get_name(library, node);
+    }
+
+    fuzzy_join(text, fields, LIBRARY_TRACK + 1);
+}
+
+/**
+ * @brief A fuzzy search split across the threads of the pool.
+ */
+struct library_screen_scan {
+    struct library *library;
+    const char *query;
+    size_t length;
+    const unsigned *nodes;    /** The nodes to look at, or NULL to look at every node. */
+    unsigned count;           /** The number of nodes to look at. */
+    unsigned shards;          /** The number of shards the nodes are ranked in. */
+    struct fuzzy_top **tops;  /** Each shard's ranking, while ranking. */
+};
+
+/**
+ * @brief Gets the node at a position of a scan.
+ */
+static unsigned library_screen_scan_get(const struct library_screen_scan *scan, unsigned index)
+{
+    return scan->nodes ? scan->nodes[index] : index;
+}
+
+/**
+ * @brief Checks whether one node matches the search. Called from the thread pool.
+ */
+static int library_screen_scan_node(void *data, unsigned index)
+{
+    const struct library_screen_scan *scan = data;
+    char text[FUZZY_TEXT_SIZE];
+
+    library_screen_join(scan->library, library_screen_scan_get(scan, index), text);
+    return fuzzy_match(text, scan->query, scan->length);
+}
+
+/**
+ * @brief Scores one shard of the matches into the shard's own ranking. Called from the thread pool.
+ */
+static void library_screen_rank_shard(void *data, unsigned shard)
+{
+    const struct library_screen_scan *scan = data;
+    unsigned end = pool_get_shard_start(scan->count, scan->shards, shard + 1);
+    char text[FUZZY_TEXT_SIZE];
+
+    for (unsigned i = pool_get_shard_start(scan->count, scan->shards, shard); i < end; ++i) {
+        unsigned index = library_screen_scan_get(scan, i);
+        library_screen_join(scan->library, index, text);
+
+        int score = fuzzy_score(text, scan->query, scan->length);
+        if (score != FUZZY_NO_MATCH) {
+            fuzzy_top_add(scan->tops[shard], score, index);
+        }
+    }
+}
+
+/**
+ * @brief Frees the rankings of every shard but the first, which belongs to the screen.
+ */
+static void library_screen_free_tops(struct fuzzy_top **tops, unsigned shards)
+{
+    for (unsigned shard = 1; shard < shards; ++shard) {
+        fuzzy_top_free(tops[shard]);
+    }
+    free(tops);
+}
+
+/**
+ * @brief Gives each shard of a ranking a heap of its own.
+ *
+ * @return The heaps, the first being the screen's, or NULL if memory ran out.
+ */
+static struct fuzzy_top **library_screen_split_tops(struct library_screen *screen,
+                                                    unsigned shards, unsigned capacity)
+{
+    struct fuzzy_top **tops = calloc(shards, sizeof(*tops));
+    if (!tops) {
+        return NULL;
+    }
+
+    tops[0] = screen->ranked;
+    for (unsigned shard = 1; shard < shards; ++shard) {
+        tops[shard] = fuzzy_top_new();
+        if (!tops[shard] || fuzzy_top_reset(tops[shard], capacity) != 0) {
+            library_screen_free_tops(tops, shard + 1);
+            return NULL;
+        }
+    }
+
+    return tops;
+}
+
+/**
+ * @brief Puts at least the best @p count fuzzy matches in the rows, best first.
+ *
+ * Every match is scored, but only the best are kept, in a heap, so this
+ * costs O(n log k) rather than sorting every match. A few pages more than
+ * asked for are ranked, so that scrolling down doesn't score the matches
+ * again on every step. The matches are scored in shards on the pool's
+ * threads, and the shards' heaps merged, which keeps the same best matches.
+ */
+static void library_screen_rank(struct library_screen *screen, struct mpdclient *mpd,
+                                unsigned count)
+{
+    unsigned num_matches = vector_get_length(screen->matches);
+    if (count > num_matches) {
+        count = num_matches;
+    }
+    if (vector_get_length(screen->rows) >= count ||
+        fuzzy_top_reset(screen->ranked, count * 2) != 0) {
+        return;
+    }
+
+    struct library_screen_scan scan = {mpd->library, screen->query, screen->query_length,
+                                       vector_at(screen->matches, 0), num_matches};
+    scan.shards = pool_get_shards(mpd->pool, num_matches, RANK_GRAIN);
+    scan.tops = library_screen_split_tops(screen, scan.shards, count * 2);
+    if (!scan.tops) {
+        /* Without room for the shards' heaps, the screen's own will do on its own. */
+        scan.shards = 1;
+        scan.tops = &screen->ranked;
+        library_screen_rank_shard(&scan, 0);
+    }
+    else {
+        pool_run(mpd->pool, scan.shards, library_screen_rank_shard, &scan);
+        for (unsigned shard = 1; shard < scan.shards; ++shard) {
+            fuzzy_top_merge(screen->ranked, scan.tops[shard]);
+        }
+        library_screen_free_tops(scan.tops, scan.shards);
+    }
+    fuzzy_top_finish(screen->ranked);
+
+    vector_clear(screen->rows, NULL);
+    for (unsigned rank = 0; rank < screen->ranked->length; ++rank) {
+        vector_push(screen->rows, &screen->ranked->results[rank].id);
+    }
+}
+
+/**
+ * @brief Finds the nodes whose "artist - album - title" fuzzily match the search.
+ *
+ * The best of them are ranked into the rows, as many as the rows held before.
+ */
+static void library_screen_fuzzy_search(struct library_screen *screen, struct mpdclient *mpd)
+{
+    unsigned ranked = vector_get_length(screen->rows);
+    struct library_screen_scan scan = {mpd->library, screen->query, screen->query_length};
+
+    vector_clear(screen->matches, NULL);
+    pool_filter(mpd->pool, 0, vector_get_length(mpd->library->nodes), library_screen_scan_node,
+                &scan, screen->matches);
+
+    vector_clear(screen->rows, NULL);
+    library_screen_rank(screen, mpd, ranked);
+}
+
+/**
+ * @brief Rebuilds the list of visible nodes if the tree changed, keeping the selected node selected.
+ */
+static void library_screen_update_rows(struct library_screen *screen, struct mpdclient *mpd)
+{
+    struct library *library = mpd->library;
+    if (screen->rows_valid && screen->rows_version == library->version) {
+        return;
+    }
+
+    unsigned selected = LIBRARY_NO_NODE;
+    if (screen->rows_generation == library->generation &&
+        screen->cursor < vector_get_length(screen->rows)) {
+        selected = *(unsigned *)vector_at(screen->rows, screen->cursor);
+    }
+
+    if (screen->query_length && screen->fuzzy) {
+        library_screen_fuzzy_search(screen, mpd);
+    }
+    else if (screen->query_length) {
+        library_index_search(library, screen->query, screen->query_length, screen->rows,
+                             mpd->pool);
+    }
+    else {
+        vector_clear(screen->rows, NULL);
+        library_screen_add_rows(screen, library, 0, library->num_artists);
+    }
+
+    unsigned length = vector_get_length(screen->rows);
+    screen->cursor = 0;
+    for (unsigned row = 0; selected != LIBRARY_NO_NODE && row < length; ++row) {
+        if (*(unsigned *)vector_at(screen->rows, row) == selected) {
+            screen->cursor = row;
+            break;
+        }
+    }
+    if (screen->rows_generation != library->generation) {
+        screen->offset = 0;
+    }
+
+    screen->rows_version = library->version;
+    screen->rows_generation = library->generation;
+    screen->rows_valid = 1;
+}
+
+/**
+ * @brief Gets the number of visible rows in the tree, or the number of matches while searching.
+ */
+unsigned library_screen_get_length(struct library_screen *screen, struct mpdclient *mpd)
+{
+    library_screen_update_rows(screen, mpd);
+
+    if (screen->query_length && screen->fuzzy) {
+        return vector_get_length(screen->matches);
+    }
+    return vector_get_length(screen->rows);
+}
+
+/**
+ * @brief Moves the cursor by the given number of rows, stopping at either end.
+ */
+void library_screen_move_cursor(struct library_screen *screen, struct mpdclient *mpd, int delta)
+{
+    unsigned length = library_screen_get_length(screen, mpd);
+    if (!length) {
+        return;
+    }
+
+    if (delta < 0 && (unsigned)-delta > screen->cursor) {
+        screen->cursor = 0;
+    }
+    else if (delta > 0 && screen->cursor + delta >= length) {
+        screen->cursor = length - 1;
+    }
+    else {
+        screen->cursor += delta;
+    }
+}
+
+/**
+ * @brief Moves the cursor to the given row, or the last one if the row is out of range.
+ */
+void library_screen_set_cursor(struct library_screen *screen, struct mpdclient *mpd,
+                               unsigned row)
+{
+    unsigned length = library_screen_get_length(screen, mpd);
+    screen->cursor = row < length ? row : (length ? length - 1 : 0);
+}
+
+/**
+ * @brief Gets the node under the cursor.
+ *
+ * @return The node's index, or @ref LIBRARY_NO_NODE if the tree is empty.
+ */
+static unsigned library_screen_get_selected(struct library_screen *screen, struct mpdclient *mpd)
+{
+    if (screen->cursor >= library_screen_get_length(screen, mpd)) {
+        return LIBRARY_NO_NODE;
+    }
+
+    if (screen->query_length && screen->fuzzy) {
+        library_screen_rank(screen, mpd, screen->cursor + 1);
+    }
+    if (screen->cursor >= vector_get_length(screen->rows)) {
+        return LIBRARY_NO_NODE;
+    }
+
+    return *(unsigned *)vector_at(screen->rows, screen->cursor);
+}
+
+/**
+ * @brief Expands the selected artist or album, fetching its children if needed.
+ *
+ * If a search is active, this ends it and shows the selected result in the
+ * tree instead.
+ *
+ * @param screen The library screen.
+ * @param mpd The connection to MPD.
+ */
+void library_screen_expand(struct library_screen *screen, struct mpdclient *mpd)
+{
+    unsigned index = library_screen_get_selected(screen, mpd);
+    struct library_node *node = library_get_node(mpd->library, index);
+    if (!node) {
+        return;
+    }
+
+    if (screen->query_length) {
+        /* Open the tree up to the chosen result, which stays selected once the search ends. */
+        for (unsigned parent = node->parent; parent != LIBRARY_NO_NODE; parent = node->parent) {
+            node = library_get_node(mpd->library, parent);
+            node->expanded = 1;
+        }
+        library_screen_search_clear(screen);
+        return;
+    }
+
+    if (node->level == LIBRARY_TRACK || node->expanded) {
+        return;
+    }
+
+    node->expanded = 1;
+    screen->rows_valid = 0;
+
+    mpdclient_load_library(mpd, index);
+}
+
+/**
+ * @brief Collapses the selected node, or its parent if it isn't expanded.
+ *
+ * The loaded children are kept, so expanding the node again is instant.
+ * Search results can't be collapsed.
+ *
+ * @param screen The library screen.
+ * @param mpd The connection to MPD.
+ */
+void library_screen_collapse(struct library_screen *screen, struct mpdclient *mpd)
+{
+    unsigned index = library_screen_get_selected(screen, mpd);
+    struct library_node *node = library_get_node(mpd->library, index);
+    if (!node || screen->query_length) {
+        return;
+    }
+
+    if (!node->expanded) {
+        index = node->parent;
+        node = library_get_node(mpd->library, index);
+        if (!node) {
+            return;
+        }
+    }
+
+    node->expanded = 0;
+    screen->rows_valid = 0;
+
+    /* Keep the collapsed node selected, since its children just disappeared. */
+    library_screen_update_rows(screen, mpd);
+    unsigned length = vector_get_length(screen->rows);
+    for (unsigned row = 0; row < length; ++row) {
+        if (*(unsigned *)vector_at(screen->rows, row) == index) {
+            screen->cursor = row;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Narrows the fuzzy matches down to those that match the longer query, and ranks them.
+ *
+ * Like library_screen_refine(), this is only valid when the query was
+ * extended. The best match is selected.
+ */
+static void library_screen_refine_fuzzy(struct library_screen *screen, struct mpdclient *mpd)
+{
+    unsigned length = vector_get_length(screen->matches);
+    unsigned *matches = vector_at(screen->matches, 0);
+    unsigned ranked = vector_get_length(screen->rows);
+    struct library_screen_scan scan = {mpd->library, screen->query, screen->query_length, matches,
+                                       length};
+
+    /*
+     * The positions of the matches that still match come back in order, and
+     * each is at or after the one it moves to, so they can be compacted in
+     * place. If memory runs out, the old matches are kept; scoring drops
+     * any that no longer match.
+     */
+    struct vector *kept = vector_new(sizeof(unsigned));
+    if (kept && pool_filter(mpd->pool, 0, length, library_screen_scan_node, &scan, kept) == 0) {
+        unsigned num_kept = vector_get_length(kept);
+        for (unsigned i = 0; i < num_kept; ++i) {
+            matches[i] = matches[*(unsigned *)vector_at(kept, i)];
+        }
+        vector_truncate(screen->matches, num_kept, NULL);
+    }
+    vector_free(kept, NULL);
+
+    vector_clear(screen->rows, NULL);
+    library_screen_rank(screen, mpd, ranked);
+    screen->cursor = 0;
+    screen->offset = 0;
+}
+
+/**
+ * @brief Narrows the current matches down to those that contain the query.
+ *
+ * This is only valid when the query was extended, since anything that
+ * contains the longer query also contains the shorter one. The selected
+ * node stays selected if it still matches.
+ */
+static void library_screen_refine(struct library_screen *screen, struct library *library)
+{
+    unsigned length = vector_get_length(screen->rows);
+    unsigned *rows = vector_at(screen->rows, 0);
+    unsigned selected = screen->cursor < length ? rows[screen->cursor] : LIBRARY_NO_NODE;
+    unsigned kept = 0;
+
+    screen->cursor = 0;
+    for (unsigned row = 0; row < length; ++row) {
+        const char *name = library_get_name(library, library_get_node(library, rows[row]));
+        if (strmatch_contains(name, screen->query, screen->query_length)) {
+            if (rows[row] == selected) {
+                screen->cursor = kept;
+            }
+            rows[kept++] = rows[row];
+        }
+    }
+
+    vector_truncate(screen->rows, kept, NULL);
+}
+
+/**
+ * @brief Starts sending typed keys to the search.
+ *
+ * Switching between substring and fuzzy matching drops the search typed for the other.
+ *
+ * @param screen The library screen.
+ * @param fuzzy Whether to match fuzzily and list the best matches first.
+ */
+void library_screen_search_begin(struct library_screen *screen, int fuzzy)
+{
+    if (screen->fuzzy != fuzzy) {
+        library_screen_search_clear(screen);
+        screen->fuzzy = fuzzy;
+    }
+
+    screen->search_input = 1;
+}
+
+/**
+ * @brief Searches again from scratch when the rows are next needed.
+ *
+ * A changed fuzzy search reorders every match, so it starts with the best
+ * one selected rather than keeping the selected node.
+ */
+static void library_screen_search_restart(struct library_screen *screen)
+{
+    if (screen->fuzzy && screen->query_length) {
+        vector_clear(screen->rows, NULL);
+        screen->cursor = 0;
+        screen->offset = 0;
+    }
+
+    screen->rows_valid = 0;
+}
+
+/**
+ * @brief Adds text to the end of the search, starting a search if there wasn't one.
+ *
+ * @param screen The library screen.
+ * @param mpd The connection to MPD, whose library is searched.
+ * @param text The text to add. It may be a fragment of a UTF-8 character.
+ *
+ * @return 0 on success, or -1 if the search would be too long.
+ */
+int library_screen_search_append(struct library_screen *screen, struct mpdclient *mpd,
+                                 const char *text)
+{
+    size_t added = strlen(text);
+    if (added > LIBRARY_SCREEN_MAX_QUERY - screen->query_length) {
+        return -1;
+    }
+
+    /* Only the current matches can match a longer search. */
+    int refine = screen->query_length && screen->rows_valid &&
+                 screen->rows_version == mpd->library->version &&
+                 screen->rows_generation == mpd->library->generation;
+
+    memcpy(screen->query + screen->query_length, text, added);  // NOLINT
+    strmatch_fold(screen->query + screen->query_length, added);
+    screen->query_length += added;
+    screen->query[screen->query_length] = '\0';
+
+    if (refine && screen->fuzzy) {
+        library_screen_refine_fuzzy(screen, mpd);
+    }
+    else if (refine) {
+        library_screen_refine(screen, mpd->library);
+    }
+    else {
+        library_screen_search_restart(screen);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Removes the last character of the search.
+ *
+ * Removing the last one leaves search mode and shows the tree again.
+ *
+ * @param screen The library screen.
+ */
+void library_screen_search_backspace(struct library_screen *screen)
+{
+    if (!screen->query_length) {
+        return;
+    }
+
+    /* Remove a whole UTF-8 character, not just its last byte. */
+    unsigned length = screen->query_length - 1;
+    while (length > 0 && ((unsigned char)screen->query[length] & 0xC0) == 0x80) {
+        --length;
+    }
+
+    screen->query_length = length;
+    screen->query[length] = '\0';
+    library_screen_search_restart(screen);
+}
+
+/**
+ * @brief Ends the search and shows the tree again, keeping the selected node selected if visible.
+ *
+ * @param screen The library screen.
+ */
+void library_screen_search_clear(struct library_screen *screen)
+{
+    screen->query_length = 0;
+    screen->query[0] = '\0';
+    screen->search_input = 0;
+    screen->rows_valid = 0;
+}
+
+/**
+ * @brief Gets how many bytes of a UTF-8 string fit in the given number of columns.
+ *
+ * @param str The string to measure.
+ * @param columns The number of columns available.
+ * @param used Set to the number of columns the fitting part takes up.
+ */
+static size_t library_screen_fit(const char *str, int columns, int *used)
+{
+    mbstate_t state;
+    memset(&state, 0, sizeof(state));  // NOLINT
+
+    size_t length = strlen(str);
+    size_t pos = 0;
+    int width = 0;
+
+    while (pos < length) {
+        wchar_t wc;
+        size_t bytes = mbrtowc(&wc, str + pos, length - pos, &state);
+        if (bytes == (size_t)-1 || bytes == (size_t)-2 || bytes == 0) {
+            break;
+        }
+
+        int cells = wcwidth(wc);
+        if (cells < 0 || width + cells > columns) {
+            break;
+        }
+
+        width += cells;
+        pos += bytes;
+    }
+
+    *used = width;
+    return pos;
+}
+
+/**
+ * @brief Gets the name to show for a node, standing in for empty tags.
+ */
+static const char *library_screen_get_label(struct library *library,
+                                            const struct library_node *node)
+{
+    const char *name = library_get_name(library, node);
+    if (!*name) {
+        name = node->level == LIBRARY_ALBUM ? "(no album)" : "(no artist)";
+    }
+
+    return name;
+}
+
+/**
+ * @brief Writes a node's name after those of its ancestors, such as "Artist / Album / Title".
+ */
+static void library_screen_get_path(struct library *library, const struct library_node *node,
+                                    char *path, size_t size)
+{
+    const struct library_node *album = NULL;
+    const struct library_node *artist = node;
+
+    if (node->level == LIBRARY_TRACK) {
+        album = library_get_node(library, node->parent);
+        artist = library_get_node(library, album->parent);
+    }
+    else if (node->level == LIBRARY_ALBUM) {
+        artist = library_get_node(library, node->parent);
+    }
+
+    if (album) {
+        snprintf(path, size, "%s / %s / %s", library_screen_get_label(library, artist),  // NOLINT
+                 library_screen_get_label(library, album), library_screen_get_label(library, node));
+    }
+    else if (artist != node) {
+        snprintf(path, size, "%s / %s", library_screen_get_label(library, artist),  // NOLINT
+                 library_screen_get_label(library, node));
+    }
+    else {
+        snprintf(path, size, "%s", library_screen_get_label(library, node));  // NOLINT
+    }
+}
+
+/**
+ * @brief Draws one node of the tree, or one search result, on the given row of the window.
+ */
+static void library_screen_draw_node(struct library_screen *screen, struct library *library,
+                                     int y, const struct library_node *node, int selected)
+{
+    int width = getmaxx(screen->win);
+    int x = node->level * INDENT;
+    const char *name = library_screen_get_label(library, node);
+    const char *marker = "  ";
+    char path[PATH_SIZE];
+
+    if (screen->query_length) {
+        library_screen_get_path(library, node, path, sizeof(path));
+        name = path;
+        x = 0;
+    }
+    else if (node->level != LIBRARY_TRACK) {
+        marker = node->expanded ? "- " : "+ ";
+    }
+
+    if (selected) {
+        wattron(screen->win, A_REVERSE);
+        mvwhline(screen->win, y, 0, ' ', width);
+    }
+
+    int room = width - x - (int)strlen(marker);
+    if (node->level == LIBRARY_TRACK) {
+        room -= TIME_WIDTH;
+    }
+
+    if (room > 0) {
+        int used;
+        mvwaddstr(screen->win, y, x, marker);
+        waddnstr(screen->win, name, library_screen_fit(name, room, &used));
+
+        if (node->state == NODE_LOADING && used + 4 <= room) {
+            waddstr(screen->win, " ...");
+        }
+    }
+
+    if (node->level == LIBRARY_TRACK && width > TIME_WIDTH) {
+        char label[TIME_WIDTH + 1];
+        queue_screen_create_label_time(label, node->duration);
+        mvwaddstr(screen->win, y, width - (int)strlen(label) - 1, label);
+    }
+
+    wattroff(screen->win, A_REVERSE);
+}
+
+/**
+ * @brief Draws the visible part of the library tree.
+ *
+ * The artist list is requested the first time the screen is drawn.
+ *
+ * @param screen The library screen.
+ * @param mpd The connection to MPD.
+ */
+void library_screen_draw(struct library_screen *screen, struct mpdclient *mpd)
+{
+    struct library *library = mpd->library;
+    mpdclient_load_library(mpd, LIBRARY_NO_NODE);
+
+    werase(screen->win);
+
+    if (library->state != NODE_LOADED) {
+        mvwaddstr(screen->win, 0, 1, "Loading library...");
+        wnoutrefresh(screen->win);
+        return;
+    }
+
+    unsigned length = library_screen_get_length(screen, mpd);
+    unsigned height = getmaxy(screen->win);
+
+    if (screen->query_length && !length) {
+        mvwaddstr(screen->win, 0, 1, "No matches.");
+    }
+
+    if (screen->cursor < screen->offset) {
+        screen->offset = screen->cursor;
+    }
+    else if (height && screen->cursor >= screen->offset + height) {
+        screen->offset = screen->cursor - height + 1;
+    }
+
+    /* Fuzzy matches are only put in order as far down as the window reaches. */
+    if (screen->query_length && screen->fuzzy) {
+        library_screen_rank(screen, mpd, screen->offset + height);
+        length = vector_get_length(screen->rows);
+    }
+
+    for (unsigned i = 0; i < height && screen->offset + i < length; ++i) {
+        unsigned row = screen->offset + i;
+        unsigned index = *(unsigned *)vector_at(screen->rows, row);
+
+        library_screen_draw_node(screen, library, i, library_get_node(library, index),
+                                 row == screen->cursor);
+    }
+
+    wnoutrefresh(screen->win);
+}
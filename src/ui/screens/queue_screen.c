@@ -21,11 +21,15 @@
  * @file queue_screen.h
  */
 
+#define _XOPEN_SOURCE 700
+
 #include "pantomime/ui/queue_screen.h"
 
 #include <curses.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
 
 /**
  * @brief The length of the a string that displays time. i.e., something like 12:54.
@@ -35,6 +39,35 @@
  */
 #define TIME_STRING_LENGTH 9
 
+/**
+ * @brief The maximum number of bytes a single terminal cell can take up in a UTF-8 string.
+ */
+#define MAX_CELL_BYTES 4
+
+/**
+ * @brief The number of bytes needed to hold a laid-out row of the given width.
+ */
+#define ROW_SIZE(width) ((size_t)(width)*MAX_CELL_BYTES + 1)
+
+/**
+ * @brief The number of spaces between columns.
+ */
+#define COLUMN_GAP 2
+
+/**
+ * @brief The minimum number of rows kept in the row cache.
+ */
+#define MIN_CACHE_SLOTS 64
+
+/**
+ * @brief The columns shown until others are set: artist, title and album, split 3:4:3.
+ */
+static const struct queue_column default_columns[] = {
+    {COLUMN_ARTIST, 3},
+    {COLUMN_TITLE, 4},
+    {COLUMN_ALBUM, 3},
+};
+
 /**
  * @brief Creates a new queue screen instance.
  *
@@ -57,6 +90,34 @@ struct queue_screen *queue_screen_new(WINDOW *win)
         screen->win = newwin(getmaxy(stdscr), getmaxx(stdscr), 0, 0);
     }
 
+    screen->cursor = 0;
+    screen->offset = 0;
+
+    screen->filter = queue_filter_new();
+    if (!screen->filter) {
+        free(screen);
+        return NULL;
+    }
+    screen->filter_input = 0;
+
+    screen->line = NULL;
+    screen->line_size = 0;
+
+    screen->cache = NULL;
+    screen->cache_text = NULL;
+    screen->cache_slots = 0;
+    screen->cache_width = 0;
+    screen->cache_hits = 0;
+    screen->cache_misses = 0;
+
+    screen->rows = NULL;
+    screen->num_rows = 0;
+    screen->rows_width = 0;
+    screen->rows_drawn = 0;
+
+    queue_screen_set_columns(screen, default_columns,
+                             sizeof(default_columns) / sizeof(*default_columns));
+
     return screen;
 }
 
@@ -72,9 +133,230 @@ void queue_screen_free(struct queue_screen *screen)
     }
 
     delwin(screen->win);
+    queue_filter_free(screen->filter);
+    free(screen->line);
+    free(screen->cache);
+    free(screen->cache_text);
+    free(screen->rows);
     free(screen);
 }
 
+/**
+ * @brief Chooses the columns of song information shown, left of each song's length.
+ *
+ * Every row is laid out again the next time it is drawn.
+ *
+ * @param screen The queue screen.
+ * @param columns The columns, left to right.
+ * @param count The number of columns, from 1 to @ref QUEUE_MAX_COLUMNS.
+ */
+void queue_screen_set_columns(struct queue_screen *screen, const struct queue_column *columns,
+                              unsigned count)
+{
+    if (count == 0 || count > QUEUE_MAX_COLUMNS) {
+        return;
+    }
+
+    memcpy(screen->columns, columns, sizeof(*columns) * count);  // NOLINT
+    screen->num_columns = count;
+
+    /* Nothing is cached yet while the screen is being created. */
+    if (screen->cache_slots) {
+        queue_screen_invalidate_all(screen);
+        queue_screen_damage_all(screen);
+    }
+}
+
+/**
+ * @brief Scrolls the screen just enough to keep the cursor visible.
+ *
+ * @param screen The queue screen to scroll.
+ * @param length The number of songs in the queue.
+ */
+static void queue_screen_scroll_to_cursor(struct queue_screen *screen, unsigned length)
+{
+    unsigned height = getmaxy(screen->win);
+
+    if (length == 0 || height == 0) {
+        screen->cursor = 0;
+        screen->offset = 0;
+        return;
+    }
+
+    if (screen->cursor >= length) {
+        screen->cursor = length - 1;
+    }
+
+    if (screen->cursor < screen->offset) {
+        screen->offset = screen->cursor;
+    }
+    else if (screen->cursor >= screen->offset + height) {
+        screen->offset = screen->cursor - height + 1;
+    }
+
+    /* Don't leave empty rows at the bottom if the queue shrank. */
+    if (screen->offset + height > length) {
+        screen->offset = length > height ? length - height : 0;
+    }
+}
+
+/**
+ * @brief Moves the cursor by a relative amount, clamped to the queue's bounds.
+ *
+ * @param screen The queue screen to modify.
+ * @param delta The number of rows to move. Negative values move up.
+ * @param length The number of rows in the list, from queue_screen_get_length().
+ */
+void queue_screen_move_cursor(struct queue_screen *screen, int delta, unsigned length)
+{
+    if (delta < 0 && (unsigned)-delta > screen->cursor) {
+        screen->cursor = 0;
+    }
+    else {
+        screen->cursor += delta;
+    }
+
+    queue_screen_scroll_to_cursor(screen, length);
+}
+
+/**
+ * @brief Moves the cursor to the given row, clamped to the queue's bounds.
+ *
+ * @param screen The queue screen to modify.
+ * @param position The row to select. Without a filter, this is a queue position.
+ * @param length The number of rows in the list, from queue_screen_get_length().
+ */
+void queue_screen_set_cursor(struct queue_screen *screen, unsigned position, unsigned length)
+{
+    screen->cursor = position;
+    queue_screen_scroll_to_cursor(screen, length);
+}
+
+/**
+ * @brief Gets the number of rows in the list, which is the number of matches while filtering.
+ *
+ * @param screen The queue screen.
+ * @param mpd The MPD client whose queue is shown.
+ */
+unsigned queue_screen_get_length(struct queue_screen *screen, struct mpdclient *mpd)
+{
+    if (queue_filter_is_active(screen->filter)) {
+        queue_filter_sync(screen->filter, mpd);
+        return queue_filter_get_length(screen->filter);
+    }
+
+    return mpdclient_get_queue_length(mpd);
+}
+
+/**
+ * @brief Gets the queue position of the song on a row of the list.
+ *
+ * @param screen The queue screen.
+ * @param row The row, counting from the top of the list.
+ */
+unsigned queue_screen_get_position(struct queue_screen *screen, unsigned row)
+{
+    if (queue_filter_is_active(screen->filter) && row < queue_filter_get_length(screen->filter)) {
+        return queue_filter_get_position(screen->filter, row);
+    }
+
+    return row;
+}
+
+/**
+ * @brief Puts the cursor on the first row at or after a queue position, after the list changed.
+ */
+static void queue_screen_select_position(struct queue_screen *screen, struct mpdclient *mpd,
+                                         unsigned position)
+{
+    unsigned row = position;
+    if (queue_filter_is_active(screen->filter)) {
+        row = queue_filter_find(screen->filter, position);
+    }
+
+    queue_screen_set_cursor(screen, row, queue_screen_get_length(screen, mpd));
+}
+
+/**
+ * @brief Starts sending typed keys to the filter.
+ *
+ * Switching between substring and fuzzy matching drops the query typed for the other.
+ *
+ * @param screen The queue screen.
+ * @param fuzzy Whether to match fuzzily and list the best matches first.
+ */
+void queue_screen_filter_begin(struct queue_screen *screen, int fuzzy)
+{
+    if (screen->filter->fuzzy != fuzzy) {
+        queue_screen_filter_clear(screen);
+        queue_filter_set_fuzzy(screen->filter, fuzzy);
+    }
+
+    screen->filter_input = 1;
+}
+
+/**
+ * @brief Selects a song again after the query changed.
+ *
+ * Matches in queue order keep the selected song selected. Ranked matches
+ * are reordered by every change, so the best one is selected instead.
+ */
+static void queue_screen_reselect(struct queue_screen *screen, struct mpdclient *mpd,
+                                  unsigned position)
+{
+    if (screen->filter->fuzzy) {
+        screen->cursor = 0;
+        screen->offset = 0;
+        return;
+    }
+
+    queue_screen_select_position(screen, mpd, position);
+}
+
+/**
+ * @brief Adds typed text to the filter's query, keeping the selected song in view if it still matches.
+ *
+ * @param screen The queue screen.
+ * @param mpd The MPD client whose queue is shown.
+ * @param text The typed text.
+ */
+void queue_screen_filter_append(struct queue_screen *screen, struct mpdclient *mpd,
+                                const char *text)
+{
+    unsigned position = queue_screen_get_position(screen, screen->cursor);
+
+    queue_filter_append(screen->filter, mpd, text);
+    queue_screen_reselect(screen, mpd, position);
+}
+
+/**
+ * @brief Removes the last character of the filter's query.
+ *
+ * @param screen The queue screen.
+ * @param mpd The MPD client whose queue is shown.
+ */
+void queue_screen_filter_backspace(struct queue_screen *screen, struct mpdclient *mpd)
+{
+    unsigned position = queue_screen_get_position(screen, screen->cursor);
+
+    queue_filter_backspace(screen->filter, mpd);
+    queue_screen_reselect(screen, mpd, position);
+}
+
+/**
+ * @brief Drops the filter, showing the whole queue with the selected song still selected.
+ *
+ * @param screen The queue screen.
+ */
+void queue_screen_filter_clear(struct queue_screen *screen)
+{
+    screen->cursor = queue_screen_get_position(screen, screen->cursor);
+    screen->offset = queue_screen_get_position(screen, screen->offset);
+    screen->filter_input = 0;
+
+    queue_filter_clear(screen->filter);
+}
+
 /**
  * @brief Creates a string representation of a length of time.
  *
@@ -92,48 +374,457 @@ void queue_screen_create_label_time(char *buffer, unsigned length)
 }
 
 /**
- * @brief Writes song information on the screen.
+ * @brief Makes sure the line buffer can hold a row of the given width.
+ *
+ * The buffer only grows, so once it fits the window no further allocations are made.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+static int queue_screen_reserve_line(struct queue_screen *screen, int width)
+{
+    size_t size = ROW_SIZE(width);
+    if (size <= screen->line_size) {
+        return 0;
+    }
+
+    char *line = realloc(screen->line, size);
+    if (!line) {
+        return -1;
+    }
+
+    screen->line = line;
+    screen->line_size = size;
+
+    return 0;
+}
+
+/**
+ * @brief Copies a string into a fixed-width column, truncating or padding it with spaces.
+ *
+ * Multibyte characters are never split, and double-width characters are
+ * accounted for.
+ *
+ * @param dest Where to write the column. Must have room for @p width * MAX_CELL_BYTES bytes.
+ * @param src The string to copy.
+ * @param width The width of the column in terminal cells.
  *
- * This function writes a song's title, artist, album, and length on the given window.
- * Note that calling this function does **not** refresh the screen.
+ * @return The number of bytes written to @p dest.
+ */
+static size_t queue_screen_format_column(char *dest, const char *src, int width)
+{
+    mbstate_t state;
+    memset(&state, 0, sizeof(state));  // NOLINT
+
+    size_t capacity = (size_t)(width > 0 ? width : 0) * MAX_CELL_BYTES;
+    size_t remaining = strlen(src);
+    size_t written = 0;
+    int cells = 0;
+    wchar_t wc;
+
+    while (remaining > 0) {
+        size_t bytes = mbrtowc(&wc, src, remaining, &state);
+        int char_width = 1;
+        int printable = 0;
+
+        if (bytes == (size_t)-1 || bytes == (size_t)-2 || bytes == 0) {
+            /* Resynchronize after an invalid sequence. */
+            memset(&state, 0, sizeof(state));  // NOLINT
+            bytes = 1;
+        }
+        else if ((char_width = wcwidth(wc)) < 0) {
+            char_width = 1;
+        }
+        else {
+            printable = 1;
+        }
+
+        /* Invalid and non-printable characters are shown as a single '?'. */
+        size_t out = printable ? bytes : 1;
+
+        /* Always leave room to pad the rest of the column with spaces. */
+        if (cells + char_width > width || written + out + (width - cells - char_width) > capacity) {
+            break;
+        }
+
+        if (printable) {
+            memcpy(dest + written, src, bytes);  // NOLINT
+        }
+        else {
+            dest[written] = '?';
+        }
+
+        written += out;
+        cells += char_width;
+        src += bytes;
+        remaining -= bytes;
+    }
+
+    for (; cells < width; ++cells) {
+        dest[written++] = ' ';
+    }
+
+    return written;
+}
+
+/**
+ * @brief Lays out a song's information as a single row of text.
  *
- * @param win The window to draw on.
+ * @param screen The queue screen, whose columns are used.
+ * @param line Where to write the row. Must have room for @p width * MAX_CELL_BYTES + 1 bytes.
+ * @param width The width of the row in terminal cells.
  * @param title The title of the song.
  * @param artist The song's artist.
  * @param album The album the song appears on.
  * @param length The length of the song in seconds.
+ *
+ * @return The length of the row in bytes, not counting the null terminator.
  */
-void queue_screen_write_song_info(WINDOW *win, const char *title, const char *artist,
-                                  const char *album, unsigned int length)
+static size_t queue_screen_layout_row(const struct queue_screen *screen, char *line, int width,
+                                      const char *title, const char *artist, const char *album,
+                                      unsigned length)
 {
-    char *label_time = malloc(sizeof(char) * TIME_STRING_LENGTH);
+    const char *fields[NUM_COLUMN_FIELDS];
+    fields[COLUMN_ARTIST] = artist;
+    fields[COLUMN_TITLE] = title;
+    fields[COLUMN_ALBUM] = album;
+
+    char label_time[TIME_STRING_LENGTH];
     queue_screen_create_label_time(label_time, length);
 
-    /* TODO: Temorary formatting. Will create nicely-formatted rows later. */
-    wprintw(win, "%s    %s    %s    %s\n", artist, title, album, label_time);
+    size_t pos = 0;
+
+    /* The time is right-aligned and the rest of the row is split by the columns' weights. */
+    int time_width = TIME_STRING_LENGTH - 1;
+    int text_width = width - time_width - (int)screen->num_columns * COLUMN_GAP;
+
+    if (text_width <= 0) {
+        /* Too narrow for columns, so just show as much of the title as fits. */
+        pos += queue_screen_format_column(line, title, width);
+    }
+    else {
+        unsigned total = 0;
+        for (unsigned i = 0; i < screen->num_columns; ++i) {
+            total += screen->columns[i].weight;
+        }
+
+        int label_width = strlen(label_time);
+        int used = 0;
+        for (unsigned i = 0; i < screen->num_columns; ++i) {
+            const struct queue_column *column = &screen->columns[i];
+            int last = i + 1 == screen->num_columns;
+            /* The last column takes whatever rounding left over. */
+            int column_width = last ? text_width - used : text_width * column->weight / total;
+            used += column_width;
+
+            pos += queue_screen_format_column(line + pos, fields[column->field], column_width);
+            pos += queue_screen_format_column(line + pos, "",
+                                              last ? COLUMN_GAP + time_width - label_width
+                                                   : COLUMN_GAP);
+        }
+        pos += queue_screen_format_column(line + pos, label_time, label_width);
+    }
+
+    line[pos] = '\0';
 
-    free(label_time);
+    return pos;
+}
+
+/**
+ * @brief Lays out a song's information as a single row of text.
+ *
+ * The row is written into the screen's line buffer, which is reused from
+ * one row to the next, so formatting doesn't allocate memory once the
+ * buffer fits the window.
+ *
+ * @param screen The queue screen that owns the line buffer.
+ * @param width The width of the row in terminal cells.
+ * @param title The title of the song.
+ * @param artist The song's artist.
+ * @param album The album the song appears on.
+ * @param length The length of the song in seconds.
+ *
+ * @return The formatted row, borrowed from the screen, or NULL if memory ran out.
+ */
+const char *queue_screen_format_row(struct queue_screen *screen, int width, const char *title,
+                                    const char *artist, const char *album, unsigned length)
+{
+    if (width <= 0 || queue_screen_reserve_line(screen, width) != 0) {
+        return NULL;
+    }
+
+    queue_screen_layout_row(screen, screen->line, width, title, artist, album, length);
+
+    return screen->line;
+}
+
+/**
+ * @brief Resizes the row cache for the given window size and empties it.
+ *
+ * The cache holds a few screenfuls of rows so that scrolling back and forth
+ * mostly hits.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+static int queue_screen_reset_cache(struct queue_screen *screen, int width, int height)
+{
+    unsigned slots = MIN_CACHE_SLOTS;
+    while (slots < (unsigned)height * 4) {
+        slots *= 2;
+    }
+
+    if (slots != screen->cache_slots || width != screen->cache_width) {
+        free(screen->cache);
+        free(screen->cache_text);
+
+        screen->cache = malloc(sizeof(*screen->cache) * slots);
+        screen->cache_text = malloc(ROW_SIZE(width) * slots);
+
+        if (!screen->cache || !screen->cache_text) {
+            free(screen->cache);
+            free(screen->cache_text);
+            screen->cache = NULL;
+            screen->cache_text = NULL;
+            screen->cache_slots = 0;
+            screen->cache_width = 0;
+            return -1;
+        }
+
+        screen->cache_slots = slots;
+        screen->cache_width = width;
+    }
+
+    queue_screen_invalidate_all(screen);
+
+    return 0;
+}
+
+/**
+ * @brief Gets the laid-out row for a song, from the cache if possible.
+ *
+ * @param screen The queue screen.
+ * @param mpd The MPD client that owns the song's strings.
+ * @param song The song to show.
+ * @param length Where to store the row's length in bytes.
+ *
+ * @return The row's text, borrowed from the cache.
+ */
+static const char *queue_screen_get_row(struct queue_screen *screen, struct mpdclient *mpd,
+                                        const struct song *song, size_t *length)
+{
+    unsigned slot = song->id & (screen->cache_slots - 1);
+    struct queue_screen_cached_row *row = &screen->cache[slot];
+    char *text = screen->cache_text + ROW_SIZE(screen->cache_width) * slot;
+
+    if (row->width == screen->cache_width && row->song_id == song->id) {
+        ++screen->cache_hits;
+    }
+    else {
+        row->song_id = song->id;
+        row->width = screen->cache_width;
+        row->length = queue_screen_layout_row(
+            screen, text, screen->cache_width, mpdclient_get_song_title(mpd, song),
+            mpdclient_get_song_artist(mpd, song), mpdclient_get_song_album(mpd, song),
+            mpdclient_get_song_length(song));
+        ++screen->cache_misses;
+    }
+
+    *length = row->length;
+    return text;
+}
+
+/**
+ * @brief Drops the cached row for a song, so that it's laid out again next time it is drawn.
+ *
+ * @param screen The queue screen.
+ * @param song_id The id of the song that changed.
+ */
+void queue_screen_invalidate_song(struct queue_screen *screen, unsigned song_id)
+{
+    if (!screen->cache) {
+        return;
+    }
+
+    struct queue_screen_cached_row *row = &screen->cache[song_id & (screen->cache_slots - 1)];
+    if (row->song_id == song_id) {
+        row->width = 0;
+    }
+
+    for (unsigned i = 0; i < screen->num_rows; ++i) {
+        if (screen->rows[i].state == ROW_SONG && screen->rows[i].song_id == song_id) {
+            screen->rows[i].state = ROW_DAMAGED;
+        }
+    }
+}
+
+/**
+ * @brief Drops every cached row.
+ *
+ * @param screen The queue screen.
+ */
+void queue_screen_invalidate_all(struct queue_screen *screen)
+{
+    for (unsigned i = 0; i < screen->cache_slots; ++i) {
+        screen->cache[i].width = 0;
+    }
+}
+
+/**
+ * @brief Marks every row of the window as needing to be redrawn.
+ *
+ * @param screen The queue screen.
+ */
+void queue_screen_damage_all(struct queue_screen *screen)
+{
+    for (unsigned i = 0; i < screen->num_rows; ++i) {
+        screen->rows[i].state = ROW_DAMAGED;
+    }
+}
+
+/**
+ * @brief Makes sure there is a row record for every row of the window.
+ *
+ * If the window's size changed, every row is marked as damaged.
+ *
+ * @return 0 on success, or -1 if memory ran out.
+ */
+static int queue_screen_reserve_rows(struct queue_screen *screen, unsigned height, int width)
+{
+    if (height == screen->num_rows && width == screen->rows_width) {
+        return 0;
+    }
+
+    if (height > screen->num_rows) {
+        struct queue_screen_row *rows = realloc(screen->rows, sizeof(*rows) * height);
+        if (!rows) {
+            return -1;
+        }
+        screen->rows = rows;
+    }
+
+    screen->num_rows = height;
+    screen->rows_width = width;
+    queue_screen_damage_all(screen);
+
+    return 0;
+}
+
+/**
+ * @brief Invalidates the cached rows of songs that MPD reported as changed.
+ *
+ * This consumes the client's record of queue changes.
+ *
+ * @param screen The queue screen.
+ * @param mpd The MPD client.
+ */
+void queue_screen_sync(struct queue_screen *screen, struct mpdclient *mpd)
+{
+    if (mpd->queue_reloaded) {
+        queue_screen_invalidate_all(screen);
+        queue_screen_damage_all(screen);
+    }
+    else {
+        unsigned count = vector_get_length(mpd->changed_ids);
+        for (unsigned i = 0; i < count; ++i) {
+            queue_screen_invalidate_song(screen, *(unsigned *)vector_at(mpd->changed_ids, i));
+        }
+    }
+
+    mpdclient_clear_queue_changes(mpd);
 }
 
 /**
  * @brief Draws the contents of a queue screen to its window.
  *
+ * Only the songs that fit in the window, starting at the screen's scroll
+ * offset, are drawn. Rows are laid out once and then drawn from the row
+ * cache until the song changes or the window is resized.
+ *
+ * The window is never cleared. A row is only redrawn if it now shows a
+ * different song, its highlight changed, or it was damaged, so moving the
+ * cursor by one line touches just two rows.
+ *
+ * If the queue is loaded lazily, the visible songs and a margin around them
+ * are fetched first. Rows whose songs still aren't available are left blank.
+ *
  * @param screen The queue screen to draw.
- * @param queue A link list containing the songs in the queue.
+ * @param mpd The MPD client whose queue should be drawn.
  */
-void queue_screen_draw(struct queue_screen *screen, struct linkedlist *queue)
+void queue_screen_draw(struct queue_screen *screen, struct mpdclient *mpd)
 {
-    int list_length = linkedlist_get_length(queue);
-    struct mpd_song *song;
+    unsigned list_length = queue_screen_get_length(screen, mpd);
+    unsigned height = getmaxy(screen->win);
+    int width = getmaxx(screen->win);
+
+    queue_screen_scroll_to_cursor(screen, list_length);
+    screen->rows_drawn = 0;
+
+    /* Fuzzy matches are only put in order as far down as the window reaches. */
+    queue_filter_rank(screen->filter, mpd, screen->offset + height);
+
+    /* A filtered list only shows songs that were loaded, so there is nothing to prefetch. */
+    if (!queue_filter_is_active(screen->filter)) {
+        unsigned margin = mpd->prefetch_margin;
+        unsigned prefetch_start = screen->offset > margin ? screen->offset - margin : 0;
+        mpdclient_prefetch_queue(mpd, prefetch_start, screen->offset + height + margin);
+    }
+
+    if (queue_screen_reserve_rows(screen, height, width) != 0) {
+        return;
+    }
+    if (width != screen->cache_width || height * 4 > screen->cache_slots) {
+        if (queue_screen_reset_cache(screen, width, height) != 0) {
+            return;
+        }
+    }
+
+    const struct song *song;
+    struct queue_screen_row *row;
+    const char *line;
+    size_t line_length;
+
+    for (unsigned i = 0; i < height; ++i) {
+        unsigned index = screen->offset + i;
+        row = &screen->rows[i];
+
+        if (index >= list_length) {
+            if (row->state != ROW_BLANK) {
+                wmove(screen->win, i, 0);
+                wclrtoeol(screen->win);
+                row->state = ROW_BLANK;
+                ++screen->rows_drawn;
+            }
+            continue;
+        }
+
+        song = mpdclient_get_queue_song(mpd, queue_screen_get_position(screen, index));
+        if (!song) {
+            wmove(screen->win, i, 0);
+            wclrtoeol(screen->win);
+            row->state = ROW_DAMAGED;
+            ++screen->rows_drawn;
+            continue;
+        }
+
+        int selected = index == screen->cursor;
+
+        if (row->state == ROW_SONG && row->song_id == song->id && row->selected == selected) {
+            continue;
+        }
+
+        line = queue_screen_get_row(screen, mpd, song, &line_length);
+
+        if (selected) {
+            wattron(screen->win, A_REVERSE);
+        }
+
+        mvwaddnstr(screen->win, i, 0, line, line_length);
 
-    for (int i = 0; i < list_length; ++i) {
-        song = linkedlist_at(queue, i);
-        const char *title = mpdclient_get_song_title(song);
-        const char *artist = mpdclient_get_song_artist(song);
-        const char *album = mpdclient_get_song_album(song);
-        unsigned length = mpdclient_get_song_length(song);
+        wattroff(screen->win, A_REVERSE);
 
-        queue_screen_write_song_info(screen->win, title, artist, album, length);
+        row->state = ROW_SONG;
+        row->song_id = song->id;
+        row->selected = selected;
+        ++screen->rows_drawn;
     }
 
     wnoutrefresh(screen->win);
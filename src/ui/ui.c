@@ -23,12 +23,30 @@
  * @brief Functions for manipulating the overall UI comonent of the program.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "pantomime/ui/ui.h"
 
 #include <curses.h>
+#include <fcntl.h>
 #include <locale.h>
 #include <panel.h>
+#include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+/**
+ * @brief Shown before a substring query in the status bar.
+ */
+#define FILTER_PROMPT '/'
+
+/**
+ * @brief Shown before a fuzzy query in the status bar.
+ */
+#define FUZZY_PROMPT '~'
 
 enum ui_panel default_panel = QUEUE;
 
@@ -46,10 +64,23 @@ struct ui *ui_new()
 
     ui->panels = create_panels(NUM_PANELS, ui->maxx, ui->maxy - STATUSBAR_HEIGHT);
     ui->queue_screen = queue_screen_new(panel_window(ui->panels[QUEUE]));
+    ui->library_screen = library_screen_new(panel_window(ui->panels[LIBRARY]));
 
     ui->visible_panel = default_panel;
     top_panel(ui->panels[ui->visible_panel]);
 
+    ui->statusbar = newwin(STATUSBAR_HEIGHT, ui->maxx, ui->maxy - STATUSBAR_HEIGHT, 0);
+    ui->statusbar_dirty = 1;
+    ui->statusbar_panel = ui->visible_panel;
+    ui->statusbar_length = 0;
+    ui->statusbar_matches = 0;
+    ui->message[0] = '\0';
+
+    /* Linux counts the bytes each thread writes, which includes everything NCURSES sends. */
+    ui->io_fd = open("/proc/thread-self/io", O_RDONLY | O_CLOEXEC);
+    ui->frame_bytes = 0;
+    ui->total_bytes = 0;
+
     return ui;
 }
 
@@ -60,8 +91,13 @@ struct ui *ui_new()
  */
 void ui_free(struct ui *ui)
 {
+    if (ui->io_fd >= 0) {
+        close(ui->io_fd);
+    }
+    delwin(ui->statusbar);
     destroy_panels(ui->panels, NUM_PANELS);
     queue_screen_free(ui->queue_screen);
+    library_screen_free(ui->library_screen);
     free(ui);
 }
 
@@ -76,7 +112,7 @@ void start_curses()
     cbreak();
     noecho();
     curs_set(0);
-    // nodelay(stdscr, TRUE);
+    nodelay(stdscr, TRUE);
     keypad(stdscr, TRUE);
 }
 
@@ -140,31 +176,207 @@ void ui_set_visible_panel(struct ui *ui, enum ui_panel panel)
     top_panel(ui->panels[panel]);
 }
 
+/**
+ * @brief Resizes the UI to match the current size of the terminal.
+ *
+ * SIGWINCH is handled by the event loop rather than by NCURSES, so the new
+ * terminal size has to be queried and passed to NCURSES here.
+ *
+ * @param ui A pointer to the UI struct.
+ */
+void ui_resize(struct ui *ui)
+{
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0) {
+        resizeterm(size.ws_row, size.ws_col);
+    }
+
+    getmaxyx(stdscr, ui->maxy, ui->maxx);
+
+    for (int i = 0; i < NUM_PANELS; ++i) {
+        wresize(panel_window(ui->panels[i]), ui->maxy - STATUSBAR_HEIGHT, ui->maxx);
+    }
+
+    wresize(ui->statusbar, STATUSBAR_HEIGHT, ui->maxx);
+    mvwin(ui->statusbar, ui->maxy - STATUSBAR_HEIGHT, 0);
+    ui->statusbar_dirty = 1;
+
+    queue_screen_damage_all(ui->queue_screen);
+    clearok(curscr, TRUE);
+}
+
+/**
+ * @brief Reads how many bytes the calling thread has written so far.
+ *
+ * @return The number of bytes, or -1 if the count is unavailable.
+ */
+static long long ui_read_bytes_written(struct ui *ui)
+{
+    if (ui->io_fd < 0) {
+        return -1;
+    }
+
+    char buffer[512];
+    ssize_t length = pread(ui->io_fd, buffer, sizeof(buffer) - 1, 0);
+    if (length <= 0) {
+        return -1;
+    }
+    buffer[length] = '\0';
+
+    const char *wchar = strstr(buffer, "wchar:");
+    if (!wchar) {
+        return -1;
+    }
+
+    return strtoll(wchar + strlen("wchar:"), NULL, 10);
+}
+
+/**
+ * @brief Shows a message in the status bar, in place of any search or filter query.
+ *
+ * @param ui A pointer to the UI struct.
+ * @param format A printf() format for the message, or NULL to clear it.
+ */
+void ui_set_message(struct ui *ui, const char *format, ...)
+{
+    if (!format) {
+        ui->statusbar_dirty |= ui->message[0] != '\0';
+        ui->message[0] = '\0';
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(ui->message, sizeof(ui->message), format, args);  // NOLINT
+    va_end(args);
+    ui->statusbar_dirty = 1;
+}
+
+/**
+ * @brief Draws the status bar, if anything it shows has changed.
+ *
+ * @param ui A pointer to the UI struct.
+ * @param mpd A connection to the MPD server.
+ */
+static void ui_draw_statusbar(struct ui *ui, struct mpdclient *mpd)
+{
+    static const char *panel_names[NUM_PANELS] = {"1:Help", "2:Queue", "3:Library"};
+    struct queue_screen *queue = ui->queue_screen;
+    struct library_screen *library = ui->library_screen;
+    unsigned length = mpdclient_get_queue_length(mpd);
+
+    /* The library's search is shown on its own panel, the queue's filter everywhere else. */
+    int searching =
+        ui->visible_panel == LIBRARY && (library->query_length || library->search_input);
+    int filtered = !searching && queue_filter_is_active(queue->filter);
+    unsigned matches = length;
+    if (searching && library->query_length) {
+        matches = library_screen_get_length(library, mpd);
+    }
+    else if (filtered) {
+        matches = queue_screen_get_length(queue, mpd);
+    }
+
+    if (!ui->statusbar_dirty && ui->statusbar_panel == ui->visible_panel &&
+        ui->statusbar_length == length && ui->statusbar_matches == matches) {
+        return;
+    }
+
+    WINDOW *win = ui->statusbar;
+    werase(win);
+    mvwhline(win, 0, 0, ACS_HLINE, ui->maxx);
+
+    wmove(win, 1, 1);
+    for (int i = 0; i < NUM_PANELS; ++i) {
+        if (i == ui->visible_panel) {
+            wattron(win, A_REVERSE);
+        }
+        wprintw(win, "%s", panel_names[i]);
+        wattroff(win, A_REVERSE);
+        waddstr(win, "  ");
+    }
+
+    if (ui->message[0]) {
+        waddstr(win, ui->message);
+    }
+    else if (searching) {
+        wprintw(win, "%c%s", library->fuzzy ? FUZZY_PROMPT : FILTER_PROMPT, library->query);
+        if (library->search_input) {
+            waddch(win, '_');
+        }
+    }
+    else if (filtered || queue->filter_input) {
+        wprintw(win, "%c%s", queue->filter->fuzzy ? FUZZY_PROMPT : FILTER_PROMPT,
+                queue_filter_get_query(queue->filter));
+        if (queue->filter_input) {
+            waddch(win, '_');
+        }
+    }
+
+    char label[48];
+    int label_length;
+    if (searching && library->query_length) {
+        label_length = snprintf(label, sizeof(label), "%u matches", matches);  // NOLINT
+    }
+    else if (filtered) {
+        label_length = snprintf(label, sizeof(label), "%u of %u songs", matches, length);  // NOLINT
+    }
+    else {
+        label_length = snprintf(label, sizeof(label), "%u songs", length);  // NOLINT
+    }
+    if (label_length + 1 < ui->maxx) {
+        mvwaddstr(win, 1, ui->maxx - label_length - 1, label);
+    }
+
+    wnoutrefresh(win);
+
+    ui->statusbar_dirty = 0;
+    ui->statusbar_panel = ui->visible_panel;
+    ui->statusbar_length = length;
+    ui->statusbar_matches = matches;
+}
+
 /**
  * @brief Draws the UI on the screen.
  *
+ * Nothing is cleared between frames. Each part of the UI only redraws what
+ * changed, so NCURSES only sends the changed cells to the terminal. The
+ * number of bytes that took is stored in @ref ui::frame_bytes.
+ *
  * @param ui A pointer to a struct containing UI information.
  * @param mpd A connection to the MPD server.
  */
 void ui_draw(struct ui *ui, struct mpdclient *mpd)
 {
     WINDOW *win = panel_window(ui->panels[ui->visible_panel]);
-    wclear(win);
+
+    /* Keep the queue's row cache in step with the queue even while it's hidden. */
+    queue_screen_sync(ui->queue_screen, mpd);
 
     switch (ui->visible_panel) {
         case HELP:
+            werase(win);
             wprintw(win, "HELP Screen");
             break;
         case QUEUE:
-            queue_screen_draw(ui->queue_screen, mpd->queue);
+            queue_screen_draw(ui->queue_screen, mpd);
             break;
         case LIBRARY:
-            wprintw(win, "LIBRARY Screen");
+            library_screen_draw(ui->library_screen, mpd);
             break;
         default:
             break;
     }
 
     update_panels();
+    ui_draw_statusbar(ui, mpd);
+
+    long long before = ui_read_bytes_written(ui);
     doupdate();
+    long long after = ui_read_bytes_written(ui);
+
+    if (before >= 0 && after >= before) {
+        ui->frame_bytes = after - before;
+        ui->total_bytes += ui->frame_bytes;
+    }
 }
@@ -0,0 +1,361 @@
+/*******************************************************************************
+ * vector.c
+ *******************************************************************************
+ * Copyright (C) 2019-2023 Julianne Adams
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************/
+
+/**
+ * @file vector.h
+ */
+
+#include "pantomime/vector.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VECTOR_MIN_CAPACITY 16
+
+/**
+ * @brief A growable array that stores its items contiguously.
+ *
+ * Items are stored by value. Indexed access is O(1) and appending is
+ * amortized O(1). Pointers returned by vector_at() are invalidated by any
+ * operation that changes the vector's length.
+ */
+struct vector {
+    char *data;         /** The items, stored back to back. */
+    unsigned length;    /** The number of items in the vector. */
+    unsigned capacity;  /** The number of items that fit in the allocated storage. */
+    size_t data_size;   /** The size of each item in bytes. */
+};
+
+/**
+ * @brief Gets a pointer to the storage for the item at the given index.
+ */
+static char *vector_slot(struct vector *vec, unsigned index)
+{
+    return vec->data + (size_t)index * vec->data_size;
+}
+
+/**
+ * @brief Frees the data in a range of items, if a free function was given.
+ */
+static void vector_free_range(struct vector *vec, unsigned start, unsigned end,
+                              void (*free_fn)(void *))
+{
+    if (!free_fn) {
+        return;
+    }
+
+    for (unsigned i = start; i < end; ++i) {
+        free_fn(vector_slot(vec, i));
+    }
+}
+
+/**
+ * @brief Makes room for at least @p extra more items.
+ */
+static enum vec_error vector_grow(struct vector *vec, unsigned extra)
+{
+    if (extra > UINT_MAX - vec->length) {
+        return VEC_ERROR_FULL;
+    }
+
+    unsigned needed = vec->length + extra;
+    if (needed <= vec->capacity) {
+        return VEC_ERROR_SUCCESS;
+    }
+
+    unsigned capacity = vec->capacity ? vec->capacity : VECTOR_MIN_CAPACITY;
+    while (capacity < needed) {
+        capacity = capacity > UINT_MAX / 2 ? UINT_MAX : capacity * 2;
+    }
+
+    return vector_reserve(vec, capacity);
+}
+
+/**
+ * @brief Allocates memory for a new vector.
+ *
+ * @param data_size The size of the type of data being stored in bytes.
+ *
+ * @return A newly-allocated vector, or NULL on error.
+ */
+struct vector *vector_new(size_t data_size)
+{
+    if (data_size == 0) {
+        return NULL;
+    }
+
+    struct vector *vec = malloc(sizeof(*vec));
+    if (!vec) {
+        return NULL;
+    }
+
+    vec->data = NULL;
+    vec->length = 0;
+    vec->capacity = 0;
+    vec->data_size = data_size;
+
+    return vec;
+}
+
+/**
+ * @brief Removes all items from a vector and deallocates all memory used by it.
+ *
+ * @param vec The vector to free.
+ * @param free_fn Pointer to a function used to deallocate the data in an item, or NULL.
+ */
+void vector_free(struct vector *vec, void (*free_fn)(void *))
+{
+    if (!vec) {
+        return;
+    }
+
+    vector_clear(vec, free_fn);
+    free(vec->data);
+    free(vec);
+}
+
+/**
+ * @brief Get the length of a vector.
+ *
+ * @param vec The vector to query.
+ */
+unsigned vector_get_length(struct vector *vec)
+{
+    return vec->length;
+}
+
+/**
+ * @brief Gets the item at the specified index.
+ *
+ * @param vec The vector to fetch from.
+ * @param index The position in the vector to fetch.
+ *
+ * @return A pointer to the item at the given index, or NULL on error.
+ */
+void *vector_at(struct vector *vec, unsigned index)
+{
+    if (index >= vec->length) {
+        return NULL;
+    }
+
+    return vector_slot(vec, index);
+}
+
+/**
+ * @brief Allocates storage for at least the given number of items.
+ *
+ * @param vec The vector to grow.
+ * @param capacity The number of items to make room for.
+ */
+enum vec_error vector_reserve(struct vector *vec, unsigned capacity)
+{
+    if (!vec) {
+        return VEC_ERROR_PARAM;
+    }
+    if (capacity <= vec->capacity) {
+        return VEC_ERROR_SUCCESS;
+    }
+
+    char *data = realloc(vec->data, (size_t)capacity * vec->data_size);
+    if (!data) {
+        return VEC_ERROR_NO_MEMORY;
+    }
+
+    vec->data = data;
+    vec->capacity = capacity;
+
+    return VEC_ERROR_SUCCESS;
+}
+
+/**
+ * @brief Add an item to the end of a vector.
+ *
+ * @param vec The vector to push to.
+ * @param data The data to add to the vector.
+ */
+enum vec_error vector_push(struct vector *vec, const void *data)
+{
+    if (!vec || !data) {
+        return VEC_ERROR_PARAM;
+    }
+
+    enum vec_error err = vector_grow(vec, 1);
+    if (err != VEC_ERROR_SUCCESS) {
+        return err;
+    }
+
+    memcpy(vector_slot(vec, vec->length), data, vec->data_size);  // NOLINT
+    ++vec->length;
+
+    return VEC_ERROR_SUCCESS;
+}
+
+/**
+ * @brief Inserts a run of items before the given position.
+ *
+ * @param vec The vector to insert into.
+ * @param index The position to insert at. Items at or after it are shifted back.
+ * @param data An array of @p count items to copy into the vector.
+ * @param count The number of items to insert.
+ */
+enum vec_error vector_insert(struct vector *vec, unsigned index, const void *data, unsigned count)
+{
+    if (!vec || !data || index > vec->length) {
+        return VEC_ERROR_PARAM;
+    }
+
+    enum vec_error err = vector_grow(vec, count);
+    if (err != VEC_ERROR_SUCCESS) {
+        return err;
+    }
+
+    memmove(vector_slot(vec, index + count), vector_slot(vec, index),  // NOLINT
+            (size_t)(vec->length - index) * vec->data_size);
+    memcpy(vector_slot(vec, index), data, (size_t)count * vec->data_size);  // NOLINT
+    vec->length += count;
+
+    return VEC_ERROR_SUCCESS;
+}
+
+/**
+ * @brief Replaces the item at the given position.
+ *
+ * @param vec The vector to modify.
+ * @param index The position in the vector to replace.
+ * @param data The data to store at that position.
+ * @param free_fn The function to use to free the old data, or NULL.
+ */
+enum vec_error vector_set(struct vector *vec, unsigned index, const void *data,
+                          void (*free_fn)(void *))
+{
+    if (!vec || !data || index >= vec->length) {
+        return VEC_ERROR_PARAM;
+    }
+
+    vector_free_range(vec, index, index + 1, free_fn);
+    memcpy(vector_slot(vec, index), data, vec->data_size);  // NOLINT
+
+    return VEC_ERROR_SUCCESS;
+}
+
+/**
+ * @brief Moves a range of items to a new position.
+ *
+ * This follows the semantics of MPD's "move START:END TO" command: after the
+ * move, the first item of the range is at position @p to, and the relative
+ * order of all other items is preserved.
+ *
+ * @param vec The vector to modify.
+ * @param start The position of the first item to move.
+ * @param end The position after the last item to move.
+ * @param to The position the first moved item will end up at.
+ */
+enum vec_error vector_move_range(struct vector *vec, unsigned start, unsigned end, unsigned to)
+{
+    if (!vec || start > end || end > vec->length || to > vec->length - (end - start)) {
+        return VEC_ERROR_PARAM;
+    }
+
+    unsigned count = end - start;
+    if (count == 0 || to == start) {
+        return VEC_ERROR_SUCCESS;
+    }
+
+    size_t size = (size_t)count * vec->data_size;
+    char *moved = malloc(size);
+    if (!moved) {
+        return VEC_ERROR_NO_MEMORY;
+    }
+    memcpy(moved, vector_slot(vec, start), size);  // NOLINT
+
+    if (to < start) {
+        /* Shift the items in [to, start) back to make room. */
+        memmove(vector_slot(vec, to + count), vector_slot(vec, to),  // NOLINT
+                (size_t)(start - to) * vec->data_size);
+    }
+    else {
+        /* Shift the items in [end, to + count) forward to fill the gap. */
+        memmove(vector_slot(vec, start), vector_slot(vec, end),  // NOLINT
+                (size_t)(to - start) * vec->data_size);
+    }
+    memcpy(vector_slot(vec, to), moved, size);  // NOLINT
+
+    free(moved);
+
+    return VEC_ERROR_SUCCESS;
+}
+
+/**
+ * @brief Removes a range of items.
+ *
+ * @param vec The vector to remove from.
+ * @param start The position of the first item to remove.
+ * @param end The position after the last item to remove.
+ * @param free_fn The function to use to free the data, or NULL.
+ */
+enum vec_error vector_remove_range(struct vector *vec, unsigned start, unsigned end,
+                                   void (*free_fn)(void *))
+{
+    if (!vec || start > end || end > vec->length) {
+        return VEC_ERROR_PARAM;
+    }
+
+    vector_free_range(vec, start, end, free_fn);
+    memmove(vector_slot(vec, start), vector_slot(vec, end),  // NOLINT
+            (size_t)(vec->length - end) * vec->data_size);
+    vec->length -= end - start;
+
+    return VEC_ERROR_SUCCESS;
+}
+
+/**
+ * @brief Removes items from the end of a vector until it is at most the given length.
+ *
+ * @param vec The vector to shorten.
+ * @param length The number of items to keep.
+ * @param free_fn The function to use to free the removed data, or NULL.
+ */
+enum vec_error vector_truncate(struct vector *vec, unsigned length, void (*free_fn)(void *))
+{
+    if (!vec) {
+        return VEC_ERROR_PARAM;
+    }
+    if (length >= vec->length) {
+        return VEC_ERROR_SUCCESS;
+    }
+
+    vector_free_range(vec, length, vec->length, free_fn);
+    vec->length = length;
+
+    return VEC_ERROR_SUCCESS;
+}
+
+/**
+ * @brief Removes all items from a vector.
+ *
+ * The vector keeps its storage so that it can be refilled without reallocating.
+ *
+ * @param vec The vector to clear.
+ * @param free_fn The function to use to free the data, or NULL.
+ */
+enum vec_error vector_clear(struct vector *vec, void (*free_fn)(void *))
+{
+    return vector_truncate(vec, 0, free_fn);
+}